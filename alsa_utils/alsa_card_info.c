@@ -0,0 +1,64 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "alsa_card_info"
+/*#define LOG_NDEBUG 0*/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include <log/log.h>
+
+#include "include/alsa_card_info.h"
+
+ssize_t alsa_card_read_info(int card, const char* name, char* buffer, size_t size)
+{
+    if (card < 0 || size == 0) {
+        return -EINVAL;
+    }
+
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/asound/card%d/%s", card, name);
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        ALOGV("alsa_card_read_info() cannot open %s: %d", path, errno);
+        return -errno;
+    }
+
+    /* proc files may return less than requested before the end of file */
+    size_t length = 0;
+    while (length < size - 1) {
+        ssize_t ret = read(fd, buffer + length, size - 1 - length);
+        if (ret < 0 && errno == EINTR) {
+            continue;
+        }
+        if (ret < 0) {
+            ret = -errno;
+            close(fd);
+            return ret;
+        }
+        if (ret == 0) {
+            break;
+        }
+        length += ret;
+    }
+    close(fd);
+
+    buffer[length] = '\0';
+    return length;
+}
@@ -20,12 +20,16 @@
 
 #include <errno.h>
 #include <inttypes.h>
+#include <pthread.h>
 #include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <cutils/properties.h>
 
 #include <log/log.h>
 
+#include "include/alsa_card_info.h"
 #include "include/alsa_device_profile.h"
 #include "include/alsa_format.h"
 #include "include/alsa_logging.h"
@@ -58,6 +62,47 @@ extern int8_t const pcm_format_value_map[50];
 static const unsigned std_sample_rates[] =
     {96000, 88200, 192000, 176400, 48000, 44100, 32000, 24000, 22050, 16000, 12000, 11025, 8000};
 
+/* A mask of std_sample_rates[] indices */
+#define ALL_SAMPLE_RATES ((1u << ARRAY_SIZE(std_sample_rates)) - 1)
+
+/*
+ * The hw_params ranges of a device, read with a single pcm_params_get() query.
+ * They also identify the device configuration in the probe cache, so this is
+ * compared with memcmp() and has no padding.
+ */
+typedef struct {
+    unsigned min_rate;
+    unsigned max_rate;
+    unsigned min_channel_count;
+    unsigned max_channel_count;
+    unsigned min_period_size;
+    unsigned max_period_size;
+    unsigned min_period_count;
+    struct pcm_mask formats;
+} profile_hw_caps;
+
+/*
+ * The probe cache remembers the sample rates found for a USB device by its VID:PID,
+ * so attaching the same device again does not open it at all.
+ */
+#define PROFILE_CACHE_ENTRIES   16
+#define USB_ID_LENGTH           10 /* "vvvv:pppp" and the terminator */
+
+typedef struct {
+    char usb_id[USB_ID_LENGTH]; /* empty if the entry is not used */
+    int device;
+    int direction;
+    profile_hw_caps caps;
+    unsigned sample_rates[MAX_PROFILE_SAMPLE_RATES];
+} profile_cache_entry;
+
+static pthread_mutex_t profile_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static profile_cache_entry profile_cache[PROFILE_CACHE_ENTRIES];
+static unsigned profile_cache_next; /* the entry replaced next, round robin */
+
+/* The largest /proc/asound/card<N>/stream<D> file parsed */
+#define STREAM_INFO_SIZE        16384
+
 static void profile_reset(alsa_device_profile* profile)
 {
     profile->card = profile->device = -1;
@@ -231,13 +276,13 @@ bool profile_is_channel_count_valid(const alsa_device_profile* profile, unsigned
     }
 }
 
-static bool profile_test_sample_rate(const alsa_device_profile* profile, unsigned rate)
+/*
+ * Returns the configuration used to test the sample rates of the device.
+ */
+static void profile_get_probe_config(const alsa_device_profile* profile,
+        struct pcm_config* config)
 {
-    struct pcm_config config = profile->default_config;
-    config.rate = rate;
-    // This method tests whether a sample rate is supported by the USB device
-    // by attempting to open it.
-    //
+    *config = profile->default_config;
     // The profile default_config currently contains the minimum channel count.
     // As some usb devices cannot sustain the sample rate across all its supported
     // channel counts, we try the largest usable channel count.  This is
@@ -255,10 +300,20 @@ static bool profile_test_sample_rate(const alsa_device_profile* profile, unsigne
     // The Android USB audio HAL layer will automatically zero pad to accommodate the
     // 16 playback or 14 capture channel configuration from the (up to FCC_LIMIT)
     // channels delivered by AudioFlinger.
-    if (config.channels < FCC_LIMIT) {
-        config.channels = profile->max_channel_count;
-        if (config.channels > FCC_LIMIT) config.channels = FCC_LIMIT;
+    if (config->channels < FCC_LIMIT) {
+        config->channels = profile->max_channel_count;
+        if (config->channels > FCC_LIMIT) config->channels = FCC_LIMIT;
     }
+}
+
+static bool profile_test_sample_rate(const alsa_device_profile* profile, unsigned rate)
+{
+    // This method tests whether a sample rate is supported by the USB device
+    // by attempting to open it.
+    struct pcm_config config;
+    profile_get_probe_config(profile, &config);
+    config.rate = rate;
+
     bool works = false; /* let's be pessimistic */
     struct pcm * pcm = pcm_open(profile->card, profile->device,
                                 profile->direction, &config);
@@ -271,7 +326,12 @@ static bool profile_test_sample_rate(const alsa_device_profile* profile, unsigne
     return works;
 }
 
-static unsigned profile_enum_sample_rates(alsa_device_profile* profile, unsigned min, unsigned max)
+/*
+ * Fills profile->sample_rates with the std_sample_rates[] in [min, max] that are in
+ * rate_mask, and if test is true, also pass profile_test_sample_rate().
+ */
+static unsigned profile_enum_sample_rates(alsa_device_profile* profile, unsigned min, unsigned max,
+        unsigned rate_mask, bool test)
 {
     unsigned num_entries = 0;
     unsigned index;
@@ -280,7 +340,8 @@ static unsigned profile_enum_sample_rates(alsa_device_profile* profile, unsigned
                     num_entries < ARRAY_SIZE(profile->sample_rates) - 1;
          index++) {
         if (std_sample_rates[index] >= min && std_sample_rates[index] <= max
-                && profile_test_sample_rate(profile, std_sample_rates[index])) {
+                && (rate_mask & (1u << index)) != 0
+                && (!test || profile_test_sample_rate(profile, std_sample_rates[index]))) {
             profile->sample_rates[num_entries++] = std_sample_rates[index];
         }
     }
@@ -288,6 +349,243 @@ static unsigned profile_enum_sample_rates(alsa_device_profile* profile, unsigned
     return num_entries; /* return # of supported rates */
 }
 
+/*
+ * Returns the mask of std_sample_rates[] listed on a "Rates:" line of a USB stream file,
+ * either "32000, 44100, 48000" or "8000 - 96000 (continuous)".
+ */
+static unsigned stream_parse_rates(const char* rates)
+{
+    unsigned mask = 0;
+    unsigned min, max;
+    unsigned index;
+
+    if (strstr(rates, "continuous") != NULL) {
+        if (sscanf(rates, "%u - %u", &min, &max) != 2) {
+            return 0;
+        }
+        for (index = 0; index < ARRAY_SIZE(std_sample_rates); index++) {
+            if (std_sample_rates[index] >= min && std_sample_rates[index] <= max) {
+                mask |= 1u << index;
+            }
+        }
+        return mask;
+    }
+
+    for (;;) {
+        char* end;
+        unsigned long rate = strtoul(rates, &end, 10);
+        if (end == rates) {
+            break;
+        }
+        for (index = 0; index < ARRAY_SIZE(std_sample_rates); index++) {
+            if (std_sample_rates[index] == rate) {
+                mask |= 1u << index;
+            }
+        }
+        for (rates = end; *rates == ',' || *rates == ' '; rates++) {}
+    }
+    return mask;
+}
+
+/*
+ * Returns true if the space separated list of format names contains name.
+ */
+static bool stream_has_format(const char* formats, const char* name)
+{
+    const size_t length = strlen(name);
+    for (const char* format = strstr(formats, name); format != NULL;
+            format = strstr(format + length, name)) {
+        if ((format == formats || format[-1] == ' ')
+                && (format[length] == '\0' || format[length] == ' ')) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+ * Reads the sample rates of the USB interface altsettings that match the format and
+ * channel count of config from /proc/asound/card<N>/stream<D>. The kernel fills this
+ * file from the USB descriptors, so it lists the rates without opening the device.
+ *
+ * returns true and the mask of std_sample_rates[] in *rate_mask if an altsetting matches,
+ * false if the file cannot be read (e.g. not a USB device) or nothing matches.
+ */
+static bool profile_read_stream_rates(const alsa_device_profile* profile,
+        const struct pcm_config* config, unsigned* rate_mask)
+{
+    /* the format names used by the kernel */
+    static const char * const format_names[] = {
+        [PCM_FORMAT_S16_LE] = "S16_LE",
+        [PCM_FORMAT_S32_LE] = "S32_LE",
+        [PCM_FORMAT_S8] = "S8",
+        [PCM_FORMAT_S24_LE] = "S24_LE",
+        [PCM_FORMAT_S24_3LE] = "S24_3LE",
+    };
+    if (config->format < 0 || (size_t)config->format >= ARRAY_SIZE(format_names)) {
+        return false;
+    }
+    const char * const format_name = format_names[config->format];
+    const char * const section = profile->direction == PCM_OUT ? "Playback:" : "Capture:";
+
+    char name[32];
+    snprintf(name, sizeof(name), "stream%d", profile->device);
+    char* buffer = malloc(STREAM_INFO_SIZE);
+    if (buffer == NULL) {
+        return false;
+    }
+    ssize_t length = alsa_card_read_info(profile->card, name, buffer, STREAM_INFO_SIZE);
+    if (length <= 0 || length >= STREAM_INFO_SIZE - 1) {
+        /* a truncated file may be missing altsettings */
+        free(buffer);
+        return false;
+    }
+
+    bool in_section = false;
+    bool format_matches = false;
+    unsigned channels = 0;
+    bool matched = false;
+    *rate_mask = 0;
+
+    char* state;
+    for (char* line = strtok_r(buffer, "\n", &state); line != NULL;
+            line = strtok_r(NULL, "\n", &state)) {
+        if (line[0] != ' ') {
+            /* the card name or a "Playback:" or "Capture:" section */
+            in_section = strcmp(line, section) == 0;
+            continue;
+        }
+        if (!in_section) {
+            continue;
+        }
+        while (*line == ' ') line++;
+        if (strncmp(line, "Altset", 6) == 0) {
+            format_matches = false;
+            channels = 0;
+        } else if (strncmp(line, "Format:", 7) == 0) {
+            format_matches = stream_has_format(line + 7, format_name);
+        } else if (strncmp(line, "Channels:", 9) == 0) {
+            channels = strtoul(line + 9, NULL, 10);
+        } else if (strncmp(line, "Rates:", 6) == 0
+                && format_matches && channels == config->channels) {
+            matched = true;
+            *rate_mask |= stream_parse_rates(line + 6);
+        }
+    }
+
+    free(buffer);
+    return matched;
+}
+
+/*
+ * Reads the USB VID:PID of the card, as "vvvv:pppp".
+ * returns false if the card is not a USB device.
+ */
+static bool profile_read_usb_id(const alsa_device_profile* profile, char usb_id[USB_ID_LENGTH])
+{
+    char buffer[32];
+    unsigned vid, pid;
+    if (alsa_card_read_info(profile->card, "usbid", buffer, sizeof(buffer)) <= 0
+            || sscanf(buffer, "%4x:%4x", &vid, &pid) != 2) {
+        return false;
+    }
+    snprintf(usb_id, USB_ID_LENGTH, "%04x:%04x", vid, pid);
+    return true;
+}
+
+static bool profile_cache_lookup(alsa_device_profile* profile, const char* usb_id,
+        const profile_hw_caps* caps)
+{
+    bool found = false;
+    pthread_mutex_lock(&profile_cache_lock);
+    for (size_t index = 0; index < ARRAY_SIZE(profile_cache); index++) {
+        const profile_cache_entry* entry = &profile_cache[index];
+        if (strcmp(entry->usb_id, usb_id) == 0 && entry->device == profile->device
+                && entry->direction == profile->direction
+                && memcmp(&entry->caps, caps, sizeof(*caps)) == 0) {
+            memcpy(profile->sample_rates, entry->sample_rates, sizeof(profile->sample_rates));
+            found = true;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&profile_cache_lock);
+    return found;
+}
+
+static void profile_cache_store(const alsa_device_profile* profile, const char* usb_id,
+        const profile_hw_caps* caps)
+{
+    if (profile->sample_rates[0] == 0) {
+        /* don't remember a failed probe, the device may just be busy */
+        return;
+    }
+
+    pthread_mutex_lock(&profile_cache_lock);
+    profile_cache_entry* entry = NULL;
+    for (size_t index = 0; index < ARRAY_SIZE(profile_cache); index++) {
+        if (strcmp(profile_cache[index].usb_id, usb_id) == 0
+                && profile_cache[index].device == profile->device
+                && profile_cache[index].direction == profile->direction) {
+            entry = &profile_cache[index];
+            break;
+        }
+    }
+    if (entry == NULL) {
+        entry = &profile_cache[profile_cache_next];
+        profile_cache_next = (profile_cache_next + 1) % ARRAY_SIZE(profile_cache);
+    }
+    strlcpy(entry->usb_id, usb_id, sizeof(entry->usb_id));
+    entry->device = profile->device;
+    entry->direction = profile->direction;
+    entry->caps = *caps;
+    memcpy(entry->sample_rates, profile->sample_rates, sizeof(entry->sample_rates));
+    pthread_mutex_unlock(&profile_cache_lock);
+}
+
+void profile_clear_probe_cache(void)
+{
+    pthread_mutex_lock(&profile_cache_lock);
+    memset(profile_cache, 0, sizeof(profile_cache));
+    profile_cache_next = 0;
+    pthread_mutex_unlock(&profile_cache_lock);
+}
+
+/*
+ * Finds the supported sample rates within the hw_params rate range.
+ *
+ * Testing a rate means opening the device, which is slow on some USB devices and
+ * may cause pops. So USB devices are probed from the rates listed in their stream
+ * file, and the device is only opened once to confirm the preferred rate. The result
+ * is cached by VID:PID and hw_params ranges, so attaching the device again needs no
+ * open at all. Other devices, or when confirmation fails, test each candidate rate.
+ */
+static void profile_probe_sample_rates(alsa_device_profile* profile, const profile_hw_caps* caps)
+{
+    char usb_id[USB_ID_LENGTH];
+    const bool is_usb = profile_read_usb_id(profile, usb_id);
+    if (is_usb && profile_cache_lookup(profile, usb_id, caps)) {
+        ALOGV("profile_probe_sample_rates() cached rates for usb:%s", usb_id);
+        return;
+    }
+
+    struct pcm_config config;
+    profile_get_probe_config(profile, &config);
+    unsigned rate_mask;
+    if (is_usb && profile_read_stream_rates(profile, &config, &rate_mask)
+            && profile_enum_sample_rates(profile, caps->min_rate, caps->max_rate,
+                                         rate_mask, false /* test */) > 0
+            && profile_test_sample_rate(profile, profile->sample_rates[0])) {
+        ALOGV("profile_probe_sample_rates() usb:%s rates from stream file", usb_id);
+    } else {
+        profile_enum_sample_rates(profile, caps->min_rate, caps->max_rate,
+                                  ALL_SAMPLE_RATES, true /* test */);
+    }
+
+    if (is_usb) {
+        profile_cache_store(profile, usb_id, caps);
+    }
+}
+
 static unsigned profile_enum_sample_formats(alsa_device_profile* profile,
         const struct pcm_mask * mask)
 {
@@ -371,11 +669,11 @@ static unsigned profile_enum_channel_counts(alsa_device_profile* profile, unsign
 }
 
 /*
- * Reads and decodes configuration info from the specified ALSA card/device.
+ * Reads the hw_params ranges of the specified ALSA card/device with a single query.
  */
-static int read_alsa_device_config(alsa_device_profile * profile, struct pcm_config * config)
+static int read_alsa_hw_caps(const alsa_device_profile * profile, profile_hw_caps * caps)
 {
-    ALOGV("usb:audio_hw - read_alsa_device_config(c:%d d:%d t:0x%X)",
+    ALOGV("usb:audio_hw - read_alsa_hw_caps(c:%d d:%d t:0x%X)",
           profile->card, profile->device, profile->direction);
 
     if (profile->card < 0 || profile->device < 0) {
@@ -388,14 +686,6 @@ static int read_alsa_device_config(alsa_device_profile * profile, struct pcm_con
         return -EINVAL;
     }
 
-    profile->min_period_size = pcm_params_get_min(alsa_hw_params, PCM_PARAM_PERIOD_SIZE);
-    profile->max_period_size = pcm_params_get_max(alsa_hw_params, PCM_PARAM_PERIOD_SIZE);
-
-    profile->min_channel_count = pcm_params_get_min(alsa_hw_params, PCM_PARAM_CHANNELS);
-    profile->max_channel_count = pcm_params_get_max(alsa_hw_params, PCM_PARAM_CHANNELS);
-
-    int ret = 0;
-
     /*
      * This Logging will be useful when testing new USB devices.
      */
@@ -403,25 +693,54 @@ static int read_alsa_device_config(alsa_device_profile * profile, struct pcm_con
     log_pcm_params(alsa_hw_params);
 #endif
 
-    config->channels = pcm_params_get_min(alsa_hw_params, PCM_PARAM_CHANNELS);
+    memset(caps, 0, sizeof(*caps));
+    caps->min_rate = pcm_params_get_min(alsa_hw_params, PCM_PARAM_RATE);
+    caps->max_rate = pcm_params_get_max(alsa_hw_params, PCM_PARAM_RATE);
+    caps->min_channel_count = pcm_params_get_min(alsa_hw_params, PCM_PARAM_CHANNELS);
+    caps->max_channel_count = pcm_params_get_max(alsa_hw_params, PCM_PARAM_CHANNELS);
+    caps->min_period_size = pcm_params_get_min(alsa_hw_params, PCM_PARAM_PERIOD_SIZE);
+    caps->max_period_size = pcm_params_get_max(alsa_hw_params, PCM_PARAM_PERIOD_SIZE);
+    caps->min_period_count = pcm_params_get_min(alsa_hw_params, PCM_PARAM_PERIODS);
+    const struct pcm_mask * format_mask = pcm_params_get_mask(alsa_hw_params, PCM_PARAM_FORMAT);
+    if (format_mask != NULL) {
+        caps->formats = *format_mask;
+    }
+
+    pcm_params_free(alsa_hw_params);
+    return 0;
+}
+
+/*
+ * Decodes the configuration info from the hw_params ranges.
+ */
+static int read_alsa_device_config(alsa_device_profile * profile, const profile_hw_caps * caps,
+                                   struct pcm_config * config)
+{
+    profile->min_period_size = caps->min_period_size;
+    profile->max_period_size = caps->max_period_size;
+
+    profile->min_channel_count = caps->min_channel_count;
+    profile->max_channel_count = caps->max_channel_count;
+
+    int ret = 0;
+
+    config->channels = caps->min_channel_count;
     // For output devices, let's make sure we choose at least stereo
     // (assuming the device supports it).
     if (profile->direction == PCM_OUT &&
-        config->channels < 2 && pcm_params_get_max(alsa_hw_params, PCM_PARAM_CHANNELS) >= 2) {
+        config->channels < 2 && caps->max_channel_count >= 2) {
         config->channels = 2;
     }
-    config->rate = pcm_params_get_min(alsa_hw_params, PCM_PARAM_RATE);
+    config->rate = caps->min_rate;
     // Prefer 48K or 44.1K
-    if (config->rate < 48000 &&
-        pcm_params_get_max(alsa_hw_params, PCM_PARAM_RATE) >= 48000) {
+    if (config->rate < 48000 && caps->max_rate >= 48000) {
         config->rate = 48000;
-    } else if (config->rate < 44100 &&
-               pcm_params_get_max(alsa_hw_params, PCM_PARAM_RATE) >= 44100) {
+    } else if (config->rate < 44100 && caps->max_rate >= 44100) {
         config->rate = 44100;
     }
     config->period_size = profile_calc_min_period_size(profile, config->rate);
-    config->period_count = pcm_params_get_min(alsa_hw_params, PCM_PARAM_PERIODS);
-    config->format = get_pcm_format_for_mask(pcm_params_get_mask(alsa_hw_params, PCM_PARAM_FORMAT));
+    config->period_count = caps->min_period_count;
+    config->format = get_pcm_format_for_mask(&caps->formats);
 #ifdef LOG_PCM_PARAMS
     log_pcm_config(config, "read_alsa_device_config");
 #endif
@@ -429,8 +748,6 @@ static int read_alsa_device_config(alsa_device_profile * profile, struct pcm_con
         ret = -EINVAL;
     }
 
-    pcm_params_free(alsa_hw_params);
-
     return ret;
 }
 
@@ -471,37 +788,29 @@ bool profile_read_device_info(alsa_device_profile* profile)
         return false;
     }
 
+    profile_hw_caps caps;
+    if (read_alsa_hw_caps(profile, &caps) != 0) {
+        return false;
+    }
+
     /* let's get some defaults */
-    read_alsa_device_config(profile, &profile->default_config);
+    read_alsa_device_config(profile, &caps, &profile->default_config);
     ALOGV("default_config chans:%d rate:%d format:%d count:%d size:%d",
           profile->default_config.channels, profile->default_config.rate,
           profile->default_config.format, profile->default_config.period_count,
           profile->default_config.period_size);
 
-    struct pcm_params * alsa_hw_params = pcm_params_get(profile->card,
-                                                        profile->device,
-                                                        profile->direction);
-    if (alsa_hw_params == NULL) {
-        return false;
-    }
-
     /* Formats */
-    const struct pcm_mask * format_mask = pcm_params_get_mask(alsa_hw_params, PCM_PARAM_FORMAT);
-    profile_enum_sample_formats(profile, format_mask);
+    profile_enum_sample_formats(profile, &caps.formats);
 
     /* Channels */
-    profile_enum_channel_counts(
-            profile, pcm_params_get_min(alsa_hw_params, PCM_PARAM_CHANNELS),
-            pcm_params_get_max(alsa_hw_params, PCM_PARAM_CHANNELS));
+    profile_enum_channel_counts(profile, caps.min_channel_count, caps.max_channel_count);
 
     /* Sample Rates */
-    profile_enum_sample_rates(
-            profile, pcm_params_get_min(alsa_hw_params, PCM_PARAM_RATE),
-            pcm_params_get_max(alsa_hw_params, PCM_PARAM_RATE));
+    profile_probe_sample_rates(profile, &caps);
 
     profile->is_valid = true;
 
-    pcm_params_free(alsa_hw_params);
     return true;
 }
 
@@ -115,6 +115,7 @@ int proxy_prepare(alsa_device_proxy * proxy, const alsa_device_profile* profile,
     }
 
     proxy->pcm = NULL;
+    proxy->mmap = false;
     // config format should be checked earlier against profile.
     if (config->format >= 0 && (size_t)config->format < ARRAY_SIZE(format_byte_size_map)) {
         proxy->frame_size = format_byte_size_map[config->format] * proxy->alsa_config.channels;
@@ -154,6 +155,7 @@ int proxy_prepare_from_default_config(alsa_device_proxy * proxy,
     proxy->alsa_config.period_count = profile->default_config.period_count;
     proxy->alsa_config.period_size = profile->default_config.period_size;
     proxy->pcm = NULL;
+    proxy->mmap = false;
     enum pcm_format format = profile->default_config.format;
     if (format >= 0 && (size_t)format < ARRAY_SIZE(format_byte_size_map)) {
         proxy->frame_size = format_byte_size_map[format] * proxy->alsa_config.channels;
@@ -164,18 +166,19 @@ int proxy_prepare_from_default_config(alsa_device_proxy * proxy,
     return 0;
 }
 
-int proxy_open(alsa_device_proxy * proxy)
+static int proxy_open_with_flags(alsa_device_proxy * proxy, unsigned int flags)
 {
     const alsa_device_profile* profile = proxy->profile;
-    ALOGD("proxy_open(card:%d device:%d %s)", profile->card, profile->device,
-          profile->direction == PCM_OUT ? "PCM_OUT" : "PCM_IN");
+    ALOGD("proxy_open(card:%d device:%d %s%s)", profile->card, profile->device,
+          profile->direction == PCM_OUT ? "PCM_OUT" : "PCM_IN",
+          (flags & PCM_MMAP) != 0 ? " PCM_MMAP" : "");
 
     if (profile->card < 0 || profile->device < 0) {
         return -EINVAL;
     }
 
     proxy->pcm = pcm_open(profile->card, profile->device,
-            profile->direction | ALSA_CLOCK_TYPE, &proxy->alsa_config);
+            profile->direction | ALSA_CLOCK_TYPE | flags, &proxy->alsa_config);
     if (proxy->pcm == NULL) {
         return -ENOMEM;
     }
@@ -190,9 +193,23 @@ int proxy_open(alsa_device_proxy * proxy)
         return -ENOMEM;
     }
 
+    proxy->mmap = (flags & PCM_MMAP) != 0;
+    proxy->mmap_running = false;
+    proxy->mmap_offset = 0;
+    proxy->mmap_frames = 0;
     return 0;
 }
 
+int proxy_open(alsa_device_proxy * proxy)
+{
+    return proxy_open_with_flags(proxy, 0);
+}
+
+int proxy_open_mmap(alsa_device_proxy * proxy)
+{
+    return proxy_open_with_flags(proxy, PCM_MMAP);
+}
+
 void proxy_close(alsa_device_proxy * proxy)
 {
     ALOGD("proxy_close() [pcm:%p]", proxy->pcm);
@@ -201,6 +218,7 @@ void proxy_close(alsa_device_proxy * proxy)
         pcm_close(proxy->pcm);
         proxy->pcm = NULL;
     }
+    proxy->mmap = false;
 }
 
 /*
@@ -251,6 +269,31 @@ unsigned proxy_get_latency(const alsa_device_proxy * proxy)
             / proxy_get_sample_rate(proxy) + proxy_get_extra_latency_ms(proxy);
 }
 
+/*
+ * Returns the frames available to the application (room for output, data for input) and
+ * the time the hardware pointer was read.
+ */
+static int proxy_get_htimestamp(const alsa_device_proxy * proxy,
+        unsigned int *avail, struct timespec *timestamp)
+{
+    if (!proxy->mmap) {
+        return pcm_get_htimestamp(proxy->pcm, avail, timestamp);
+    }
+
+    // The hardware pointer and its timestamp are read from the mmap status page,
+    // and the available frames from that pointer and the committed frames.
+    unsigned int hw_ptr;
+    if (pcm_mmap_get_hw_ptr(proxy->pcm, &hw_ptr, timestamp) != 0) {
+        return -1;
+    }
+    const int frames = pcm_mmap_avail(proxy->pcm);
+    if (frames < 0) {
+        return -1;
+    }
+    *avail = frames;
+    return 0;
+}
+
 int proxy_get_presentation_position(const alsa_device_proxy * proxy,
         uint64_t *frames, struct timespec *timestamp)
 {
@@ -258,7 +301,7 @@ int proxy_get_presentation_position(const alsa_device_proxy * proxy,
     unsigned int avail;
     struct timespec alsaTs;
     if (proxy->pcm != NULL
-            && pcm_get_htimestamp(proxy->pcm, &avail, &alsaTs) == 0) {
+            && proxy_get_htimestamp(proxy, &avail, &alsaTs) == 0) {
         const size_t kernel_buffer_size = pcm_get_buffer_size(proxy->pcm);
         if (avail > kernel_buffer_size) {
             // pcm_get_htimestamp() computes the available frames by comparing the ALSA driver
@@ -291,7 +334,7 @@ int proxy_get_capture_position(const alsa_device_proxy * proxy,
     unsigned int avail;
     struct timespec timestamp;
     if (proxy->pcm != NULL
-            && pcm_get_htimestamp(proxy->pcm, &avail, &timestamp) == 0) {
+            && proxy_get_htimestamp(proxy, &avail, &timestamp) == 0) {
         if (timestamp.tv_sec == 0 && timestamp.tv_nsec == 0) {
             // If ALSA returned a zero timestamp, do not use it.
             clock_gettime(SYSTEM_CLOCK_TYPE, &timestamp);
@@ -311,6 +354,7 @@ int proxy_stop(alsa_device_proxy * proxy)
 {
     int ret = -ENOSYS;
     if (proxy->pcm != NULL) ret = pcm_stop(proxy->pcm);
+    proxy->mmap_running = false;
     return ret;
 }
 
@@ -325,6 +369,9 @@ int proxy_write(alsa_device_proxy * proxy, const void *data, unsigned int count)
 int proxy_write_with_retries(
         alsa_device_proxy * proxy, const void *data, unsigned int count, int tries)
 {
+    if (proxy->mmap) {
+        return -ENOSYS;
+    }
     while (true) {
         --tries;
         const int ret = pcm_write(proxy->pcm, data, count);
@@ -345,6 +392,9 @@ int proxy_read(alsa_device_proxy * proxy, void *data, unsigned int count)
 
 int proxy_read_with_retries(alsa_device_proxy * proxy, void *data, unsigned int count, int tries)
 {
+    if (proxy->mmap) {
+        return -ENOSYS;
+    }
     while (true) {
         --tries;
         const int ret = pcm_read(proxy->pcm, data, count);
@@ -358,6 +408,97 @@ int proxy_read_with_retries(alsa_device_proxy * proxy, void *data, unsigned int
     }
 }
 
+/*
+ * MMAP I/O
+ */
+static int proxy_mmap_start(alsa_device_proxy * proxy)
+{
+    const int ret = pcm_start(proxy->pcm);
+    if (ret != 0) {
+        ALOGE("proxy_mmap_start() pcm_start() failed: %s", pcm_get_error(proxy->pcm));
+        return ret;
+    }
+    proxy->mmap_running = true;
+    return 0;
+}
+
+int proxy_mmap_begin(alsa_device_proxy * proxy, void ** buffer, unsigned int * frames)
+{
+    if (proxy->pcm == NULL || !proxy->mmap) {
+        return -EINVAL;
+    }
+
+    int ret;
+    const unsigned int buffer_size = pcm_get_buffer_size(proxy->pcm);
+    const int avail = pcm_mmap_avail(proxy->pcm);
+    if (avail < 0) {
+        return avail;
+    }
+    if (proxy->mmap_running && (unsigned int)avail >= buffer_size) {
+        // Underrun or overrun, the device stopped at the stop threshold (the buffer size).
+        // pcm_stop() makes the next pcm_prepare() reset the stream, dropping its contents.
+        ALOGW("proxy_mmap_begin() xrun, %d frames available", avail);
+        pcm_stop(proxy->pcm);
+        proxy->mmap_running = false;
+    }
+    if (!proxy->mmap_running) {
+        // Prepare before the application pointer moves, as preparing resets it.
+        if ((ret = pcm_prepare(proxy->pcm)) != 0) {
+            return ret;
+        }
+        if (proxy->profile->direction == PCM_IN && (ret = proxy_mmap_start(proxy)) != 0) {
+            return ret;
+        }
+    }
+
+    void *areas;
+    unsigned int offset;
+    unsigned int count = buffer_size;
+    if ((ret = pcm_mmap_begin(proxy->pcm, &areas, &offset, &count)) != 0) {
+        return ret;
+    }
+    *buffer = (uint8_t *)areas + pcm_frames_to_bytes(proxy->pcm, offset);
+    *frames = count;
+    proxy->mmap_offset = offset;
+    proxy->mmap_frames = count;
+    return 0;
+}
+
+int proxy_mmap_commit(alsa_device_proxy * proxy, unsigned int frames)
+{
+    if (proxy->pcm == NULL || !proxy->mmap || frames > proxy->mmap_frames) {
+        return -EINVAL;
+    }
+
+    const int ret = pcm_mmap_commit(proxy->pcm, proxy->mmap_offset, frames);
+    if (ret < 0) {
+        return ret;
+    }
+    proxy->mmap_frames = 0;
+    proxy->transferred += frames;
+
+    if (!proxy->mmap_running && proxy->profile->direction == PCM_OUT) {
+        const unsigned int buffer_size = pcm_get_buffer_size(proxy->pcm);
+        unsigned int start_threshold = proxy->alsa_config.start_threshold;
+        if (start_threshold == 0 || start_threshold > buffer_size) {
+            start_threshold = buffer_size; /* as pcm_open() */
+        }
+        const int avail = pcm_mmap_avail(proxy->pcm);
+        if (avail >= 0 && buffer_size - (unsigned int)avail >= start_threshold) {
+            return proxy_mmap_start(proxy);
+        }
+    }
+    return 0;
+}
+
+int proxy_mmap_wait(alsa_device_proxy * proxy, int timeout_ms)
+{
+    if (proxy->pcm == NULL || !proxy->mmap) {
+        return -EINVAL;
+    }
+    return pcm_wait(proxy->pcm, timeout_ms);
+}
+
 /*
  * Debugging
  */
@@ -369,6 +510,7 @@ void proxy_dump(const alsa_device_proxy* proxy, int fd)
         dprintf(fd, "  period_size: %d\n", proxy->alsa_config.period_size);
         dprintf(fd, "  period_count: %d\n", proxy->alsa_config.period_count);
         dprintf(fd, "  format: %d\n", proxy->alsa_config.format);
+        dprintf(fd, "  mmap: %s\n", proxy->mmap ? "true" : "false");
     }
 }
 
@@ -0,0 +1,40 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_SYSTEM_MEDIA_ALSA_UTILS_ALSA_CARD_INFO_H
+#define ANDROID_SYSTEM_MEDIA_ALSA_UTILS_ALSA_CARD_INFO_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+/*
+ * Reads the file /proc/asound/card<card>/<name> into buffer and null terminates it.
+ * USB audio cards provide "usbid" (the VID:PID) and "stream<device>" (the formats,
+ * channel counts and rates of each interface altsetting).
+ *
+ * returns the number of bytes read, at most size - 1, or a negative errno.
+ */
+ssize_t alsa_card_read_info(int card, const char* name, char* buffer, size_t size);
+
+#if defined(__cplusplus)
+}
+#endif
+
+#endif /* ANDROID_SYSTEM_MEDIA_ALSA_UTILS_ALSA_CARD_INFO_H */
@@ -71,6 +71,11 @@ void profile_decache(alsa_device_profile* profile);
 bool profile_fill_builtin_device_info(alsa_device_profile* profile, struct pcm_config* config,
                                       unsigned buffer_frame_count);
 bool profile_read_device_info(alsa_device_profile* profile);
+/*
+ * profile_read_device_info() caches the sample rates it finds for a USB device by VID:PID,
+ * so attaching the same device again does not open it. This forgets them.
+ */
+void profile_clear_probe_cache(void);
 
 /* Audio Config Strings Methods */
 char * profile_get_sample_rate_strs(const alsa_device_profile* profile);
@@ -30,6 +30,11 @@ typedef struct {
 
     size_t frame_size;    /* valid after proxy_prepare(), the frame size in bytes */
     uint64_t transferred; /* the total frames transferred, not cleared on standby */
+
+    bool mmap;                  /* opened with proxy_open_mmap() */
+    bool mmap_running;          /* the mmap stream has been started */
+    unsigned int mmap_offset;   /* the ring buffer offset returned by proxy_mmap_begin() */
+    unsigned int mmap_frames;   /* the frames returned by proxy_mmap_begin() */
 } alsa_device_proxy;
 
 
@@ -70,6 +75,32 @@ int proxy_read(alsa_device_proxy * proxy, void *data, unsigned int count);
 int proxy_read_with_retries(
         alsa_device_proxy * proxy, void *data, unsigned int count, int tries);
 
+/*
+ * MMAP (no-copy) I/O
+ *
+ * proxy_open_mmap() opens the device with the hardware ring buffer mapped into the
+ * process. Instead of proxy_write()/proxy_read(), which copy each period through the
+ * kernel, the caller accesses the ring buffer directly:
+ *   proxy_mmap_begin() returns the next contiguous region of the buffer that can be
+ *     written (output) or read (input), and its size in frames, which may be 0.
+ *   The caller writes or reads up to that many frames in place.
+ *   proxy_mmap_commit() hands the frames to the device (output) or releases them (input).
+ * An output stream starts once the committed frames reach the start threshold (the
+ * buffer size by default), an input stream on the first proxy_mmap_begin().
+ * After an xrun, proxy_mmap_begin() recovers the stream and the output restarts as above.
+ *
+ * proxy_get_presentation_position() and proxy_get_capture_position() use the hardware
+ * pointer of the mmap stream. proxy_write() and proxy_read() return -ENOSYS.
+ */
+int proxy_open_mmap(alsa_device_proxy * proxy);
+int proxy_mmap_begin(alsa_device_proxy * proxy, void ** buffer, unsigned int * frames);
+int proxy_mmap_commit(alsa_device_proxy * proxy, unsigned int frames);
+/*
+ * Waits up to timeout_ms for the buffer to have room (output) or data (input).
+ * returns 1 when ready, 0 on timeout, negative on error.
+ */
+int proxy_mmap_wait(alsa_device_proxy * proxy, int timeout_ms);
+
 /* Debugging */
 void proxy_dump(const alsa_device_proxy * proxy, int fd);
 
@@ -0,0 +1,255 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+extern "C" {
+#include <alsa_device_profile.h>
+}
+
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "fake_pcm.h"
+
+// A /proc/asound/card<N>/stream0 file as written by the USB audio driver.
+static constexpr const char* kStreamInfo = R"(Vendor DAC at usb-xhci-hcd.1.auto-1, high speed : USB Audio
+
+Playback:
+  Status: Stop
+  Interface 1
+    Altset 1
+    Format: S16_LE
+    Channels: 2
+    Endpoint: 0x01 (1 OUT) (ASYNC)
+    Rates: 44100, 48000, 96000
+    Data packet interval: 125 us
+    Bits: 16
+    Channel map: FL FR
+  Interface 1
+    Altset 2
+    Format: S24_3LE
+    Channels: 2
+    Endpoint: 0x01 (1 OUT) (ASYNC)
+    Rates: 44100, 48000, 88200, 96000, 176400, 192000
+    Data packet interval: 125 us
+    Bits: 24
+    Channel map: FL FR
+
+Capture:
+  Status: Stop
+  Interface 2
+    Altset 1
+    Format: S16_LE
+    Channels: 1
+    Endpoint: 0x82 (2 IN) (ASYNC)
+    Rates: 8000 - 48000 (continuous)
+    Data packet interval: 125 us
+    Bits: 16
+    Channel map: MONO
+)";
+
+class AlsaDeviceProfileTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        fake_pcm::reset();
+        profile_clear_probe_cache();
+    }
+
+    // Reads the profile of card 1 device 0, returns the sample rates found.
+    std::vector<unsigned> readRates(int direction = PCM_OUT) {
+        profile_init(&mProfile, direction);
+        mProfile.card = 1;
+        mProfile.device = 0;
+        EXPECT_TRUE(profile_read_device_info(&mProfile));
+        std::vector<unsigned> rates;
+        for (size_t i = 0; mProfile.sample_rates[i] != 0; ++i) {
+            rates.push_back(mProfile.sample_rates[i]);
+        }
+        return rates;
+    }
+
+    static void setUsbDevice(const std::string& usbId = "1234:abcd") {
+        fake_pcm::setCardInfo("usbid", usbId + "\n");
+        fake_pcm::setCardInfo("stream0", kStreamInfo);
+    }
+
+    alsa_device_profile mProfile;
+};
+
+TEST_F(AlsaDeviceProfileTest, reads_ranges_with_one_query) {
+    fake_pcm::Device device;
+    device.minChannels = 1;
+    device.maxChannels = 2;
+    device.formats = {PCM_FORMAT_S16_LE, PCM_FORMAT_S24_3LE};
+    fake_pcm::setDevice(device);
+
+    readRates();
+
+    EXPECT_EQ(1u, fake_pcm::paramsGetCount());
+    EXPECT_TRUE(profile_is_valid(&mProfile));
+    EXPECT_EQ(PCM_FORMAT_S16_LE, mProfile.formats[0]);
+    EXPECT_EQ(PCM_FORMAT_S24_3LE, mProfile.formats[1]);
+    EXPECT_EQ(PCM_FORMAT_INVALID, mProfile.formats[2]);
+    EXPECT_EQ(2u, mProfile.channel_counts[0]);
+    EXPECT_EQ(1u, mProfile.channel_counts[1]);
+    EXPECT_EQ(0u, mProfile.channel_counts[2]);
+    EXPECT_EQ(2u, mProfile.default_config.channels);
+    EXPECT_EQ(48000u, mProfile.default_config.rate);
+    EXPECT_EQ(PCM_FORMAT_S16_LE, mProfile.default_config.format);
+}
+
+TEST_F(AlsaDeviceProfileTest, no_device) {
+    fake_pcm::Device device;
+    device.present = false;
+    fake_pcm::setDevice(device);
+
+    profile_init(&mProfile, PCM_OUT);
+    mProfile.card = 1;
+    mProfile.device = 0;
+    EXPECT_FALSE(profile_read_device_info(&mProfile));
+    EXPECT_FALSE(profile_is_valid(&mProfile));
+    EXPECT_TRUE(fake_pcm::openLog().empty());
+}
+
+TEST_F(AlsaDeviceProfileTest, tests_each_rate_without_usb_info) {
+    fake_pcm::Device device;
+    device.minRate = 8000;
+    device.maxRate = 96000;
+    device.rates = {44100, 48000, 96000};
+    fake_pcm::setDevice(device);
+
+    EXPECT_EQ((std::vector<unsigned>{96000, 48000, 44100}), readRates());
+    // every standard rate in [8000, 96000], which excludes 192000 and 176400
+    EXPECT_EQ(11u, fake_pcm::openLog().size());
+    for (const struct pcm_config& config : fake_pcm::openLog()) {
+        EXPECT_EQ(2u, config.channels);  // the largest channel count
+    }
+}
+
+TEST_F(AlsaDeviceProfileTest, usb_rates_from_stream_info) {
+    fake_pcm::Device device;
+    device.rates = {44100, 48000, 96000};
+    fake_pcm::setDevice(device);
+    setUsbDevice();
+
+    // the S16_LE stereo altsetting, confirmed by one open at the preferred rate
+    EXPECT_EQ((std::vector<unsigned>{96000, 48000, 44100}), readRates());
+    ASSERT_EQ(1u, fake_pcm::openLog().size());
+    EXPECT_EQ(96000u, fake_pcm::openLog()[0].rate);
+}
+
+TEST_F(AlsaDeviceProfileTest, usb_rates_match_format) {
+    fake_pcm::Device device;
+    device.formats = {PCM_FORMAT_S24_3LE};
+    device.maxRate = 192000;
+    device.rates = {44100, 48000, 88200, 96000, 176400, 192000};
+    fake_pcm::setDevice(device);
+    setUsbDevice();
+
+    EXPECT_EQ((std::vector<unsigned>{96000, 88200, 192000, 176400, 48000, 44100}), readRates());
+    EXPECT_EQ(1u, fake_pcm::openLog().size());
+}
+
+TEST_F(AlsaDeviceProfileTest, usb_continuous_rates) {
+    fake_pcm::Device device;
+    device.minRate = 8000;
+    device.maxRate = 48000;
+    device.minChannels = device.maxChannels = 1;
+    device.rates = {8000, 11025, 12000, 16000, 22050, 24000, 32000, 44100, 48000};
+    fake_pcm::setDevice(device);
+    setUsbDevice();
+
+    EXPECT_EQ((std::vector<unsigned>{48000, 44100, 32000, 24000, 22050, 16000, 12000, 11025,
+                                     8000}),
+              readRates(PCM_IN));
+    EXPECT_EQ(1u, fake_pcm::openLog().size());
+}
+
+TEST_F(AlsaDeviceProfileTest, usb_confirmation_failure_tests_each_rate) {
+    fake_pcm::Device device;
+    device.rates = {44100, 48000};  // the stream info also lists 96000
+    fake_pcm::setDevice(device);
+    setUsbDevice();
+
+    EXPECT_EQ((std::vector<unsigned>{48000, 44100}), readRates());
+    EXPECT_EQ(12u, fake_pcm::openLog().size());  // the confirmation and 11 rates
+}
+
+TEST_F(AlsaDeviceProfileTest, usb_without_matching_altsetting_tests_each_rate) {
+    fake_pcm::Device device;
+    device.minChannels = device.maxChannels = 4;  // not in the stream info
+    device.rates = {48000};
+    fake_pcm::setDevice(device);
+    setUsbDevice();
+
+    EXPECT_EQ((std::vector<unsigned>{48000}), readRates());
+    EXPECT_EQ(11u, fake_pcm::openLog().size());
+}
+
+TEST_F(AlsaDeviceProfileTest, usb_reattach_uses_cache) {
+    fake_pcm::Device device;
+    device.rates = {44100, 48000, 96000};
+    fake_pcm::setDevice(device);
+    fake_pcm::setCardInfo("usbid", "1234:abcd\n");
+
+    const std::vector<unsigned> rates = readRates();
+    EXPECT_EQ(11u, fake_pcm::openLog().size());
+
+    // same device: no open
+    fake_pcm::clearCounts();
+    EXPECT_EQ(rates, readRates());
+    EXPECT_TRUE(fake_pcm::openLog().empty());
+    EXPECT_EQ(1u, fake_pcm::paramsGetCount());
+
+    // the cache is per direction
+    fake_pcm::clearCounts();
+    readRates(PCM_IN);
+    EXPECT_FALSE(fake_pcm::openLog().empty());
+
+    // another device
+    fake_pcm::clearCounts();
+    fake_pcm::setCardInfo("usbid", "1234:abce\n");
+    EXPECT_EQ(rates, readRates());
+    EXPECT_FALSE(fake_pcm::openLog().empty());
+
+    // same device, different hw_params ranges
+    fake_pcm::clearCounts();
+    device.maxRate = 48000;
+    fake_pcm::setDevice(device);
+    fake_pcm::setCardInfo("usbid", "1234:abcd\n");
+    EXPECT_EQ((std::vector<unsigned>{48000, 44100}), readRates());
+    EXPECT_FALSE(fake_pcm::openLog().empty());
+
+    fake_pcm::clearCounts();
+    profile_clear_probe_cache();
+    readRates();
+    EXPECT_FALSE(fake_pcm::openLog().empty());
+}
+
+TEST_F(AlsaDeviceProfileTest, failed_probe_is_not_cached) {
+    fake_pcm::Device device;
+    device.rates = {};  // e.g. the device is busy
+    fake_pcm::setDevice(device);
+    fake_pcm::setCardInfo("usbid", "1234:abcd\n");
+
+    EXPECT_TRUE(readRates().empty());
+
+    device.rates = {48000};
+    fake_pcm::setDevice(device);
+    fake_pcm::clearCounts();
+    EXPECT_EQ((std::vector<unsigned>{48000}), readRates());
+}
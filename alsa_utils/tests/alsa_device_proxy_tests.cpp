@@ -0,0 +1,235 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+extern "C" {
+#include <alsa_device_proxy.h>
+}
+
+#include <errno.h>
+
+#include <cstring>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "fake_pcm.h"
+
+static constexpr unsigned kRate = 48000;
+static constexpr unsigned kChannels = 2;
+static constexpr unsigned kFrameSize = kChannels * sizeof(int16_t);
+
+class AlsaDeviceProxyMmapTest : public ::testing::TestWithParam<int> {
+protected:
+    void SetUp() override {
+        fake_pcm::reset();
+        profile_clear_probe_cache();
+        fake_pcm::Device device;
+        device.minChannels = device.maxChannels = kChannels;
+        device.rates = {kRate};
+        fake_pcm::setDevice(device);
+
+        profile_init(&mProfile, GetParam());
+        mProfile.card = 1;
+        mProfile.device = 0;
+        ASSERT_TRUE(profile_read_device_info(&mProfile));
+
+        struct pcm_config config = {};
+        config.rate = kRate;
+        config.channels = kChannels;
+        config.format = PCM_FORMAT_S16_LE;
+        memset(&mProxy, 0, sizeof(mProxy));
+        ASSERT_EQ(0, proxy_prepare(&mProxy, &mProfile, &config, true /* require_exact_match */));
+        ASSERT_EQ(0, proxy_open_mmap(&mProxy));
+        mBufferSize = mProxy.alsa_config.period_size * mProxy.alsa_config.period_count;
+        ASSERT_GT(mBufferSize, 0u);
+        ASSERT_EQ(mBufferSize * kFrameSize, fake_pcm::mmapBuffer().size());
+    }
+
+    void TearDown() override {
+        proxy_close(&mProxy);
+    }
+
+    // Begins and checks the region returned against the fake ring buffer.
+    unsigned begin(void** buffer = nullptr) {
+        void* region = nullptr;
+        unsigned frames = 0;
+        EXPECT_EQ(0, proxy_mmap_begin(&mProxy, &region, &frames));
+        const auto* base = fake_pcm::mmapBuffer().data();
+        EXPECT_EQ(base + (fake_pcm::applPtr() % mBufferSize) * kFrameSize, region);
+        if (buffer != nullptr) *buffer = region;
+        return frames;
+    }
+
+    // Fills the output buffer with frames numbered from mNextFrame.
+    void write(unsigned frames) {
+        void* buffer;
+        ASSERT_GE(begin(&buffer), frames);
+        auto* samples = static_cast<int16_t*>(buffer);
+        for (unsigned i = 0; i < frames * kChannels; ++i) {
+            samples[i] = static_cast<int16_t>(mNextFrame * kChannels + i);
+        }
+        mNextFrame += frames;
+        ASSERT_EQ(0, proxy_mmap_commit(&mProxy, frames));
+    }
+
+    alsa_device_profile mProfile;
+    alsa_device_proxy mProxy;
+    unsigned mBufferSize = 0;
+    unsigned mNextFrame = 0;
+};
+
+using AlsaDeviceProxyMmapOutputTest = AlsaDeviceProxyMmapTest;
+using AlsaDeviceProxyMmapInputTest = AlsaDeviceProxyMmapTest;
+
+TEST_P(AlsaDeviceProxyMmapOutputTest, writes_in_place) {
+    EXPECT_EQ(mBufferSize, begin());
+    write(mBufferSize / 2);
+    EXPECT_FALSE(fake_pcm::isRunning());  // below the start threshold
+    EXPECT_EQ(mBufferSize - mBufferSize / 2, begin());
+    write(mBufferSize - mBufferSize / 2);
+    EXPECT_TRUE(fake_pcm::isRunning());
+    EXPECT_EQ(0u, begin());
+
+    EXPECT_EQ(mBufferSize, fake_pcm::applPtr());
+    EXPECT_EQ(mBufferSize, mProxy.transferred);
+    const auto* samples = reinterpret_cast<const int16_t*>(fake_pcm::mmapBuffer().data());
+    for (unsigned i = 0; i < mBufferSize * kChannels; ++i) {
+        ASSERT_EQ(static_cast<int16_t>(i), samples[i]) << i;
+    }
+}
+
+TEST_P(AlsaDeviceProxyMmapOutputTest, wraps_around) {
+    write(mBufferSize);
+    fake_pcm::advance(100, {});
+    EXPECT_EQ(100u, begin());
+    write(100);
+    fake_pcm::advance(300, {});
+    // contiguous up to the end of the buffer
+    EXPECT_EQ(std::min(300u, mBufferSize - 100), begin());
+    EXPECT_EQ(1u, fake_pcm::startCount());
+}
+
+TEST_P(AlsaDeviceProxyMmapOutputTest, presentation_position) {
+    uint64_t frames;
+    struct timespec timestamp;
+    write(mBufferSize);
+    fake_pcm::advance(0, {});
+    EXPECT_EQ(0, proxy_get_presentation_position(&mProxy, &frames, &timestamp));
+    EXPECT_EQ(0u, frames);
+
+    fake_pcm::advance(100, {5, 1000});
+    EXPECT_EQ(0, proxy_get_presentation_position(&mProxy, &frames, &timestamp));
+    EXPECT_EQ(100u, frames);
+    EXPECT_EQ(5, timestamp.tv_sec);
+    EXPECT_EQ(1000, timestamp.tv_nsec);
+
+    write(50);
+    fake_pcm::advance(20, {5, 2000});
+    EXPECT_EQ(0, proxy_get_presentation_position(&mProxy, &frames, &timestamp));
+    EXPECT_EQ(120u, frames);
+}
+
+TEST_P(AlsaDeviceProxyMmapOutputTest, no_position_before_start) {
+    uint64_t frames;
+    struct timespec timestamp;
+    write(1);
+    EXPECT_NE(0, proxy_get_presentation_position(&mProxy, &frames, &timestamp));
+}
+
+TEST_P(AlsaDeviceProxyMmapOutputTest, underrun_recovery) {
+    write(mBufferSize);
+    fake_pcm::advance(mBufferSize, {1, 0});
+    EXPECT_TRUE(fake_pcm::isXrun());
+
+    // the stream is prepared again, and restarts once full
+    EXPECT_EQ(mBufferSize, begin());
+    EXPECT_FALSE(fake_pcm::isRunning());
+    write(mBufferSize);
+    EXPECT_TRUE(fake_pcm::isRunning());
+    EXPECT_EQ(2u, fake_pcm::startCount());
+
+    uint64_t frames;
+    struct timespec timestamp;
+    fake_pcm::advance(10, {2, 0});
+    EXPECT_EQ(0, proxy_get_presentation_position(&mProxy, &frames, &timestamp));
+    EXPECT_EQ(mBufferSize + 10, frames);
+}
+
+TEST_P(AlsaDeviceProxyMmapOutputTest, stop_and_restart) {
+    write(mBufferSize);
+    fake_pcm::advance(100, {});
+    EXPECT_EQ(0, proxy_stop(&mProxy));
+    EXPECT_FALSE(fake_pcm::isRunning());
+
+    // stopping dropped the queued frames, the buffer restarts where the hardware stopped
+    EXPECT_EQ(mBufferSize - 100, begin());
+    write(mBufferSize - 100);
+    EXPECT_FALSE(fake_pcm::isRunning());
+    write(100);
+    EXPECT_TRUE(fake_pcm::isRunning());
+}
+
+TEST_P(AlsaDeviceProxyMmapOutputTest, invalid) {
+    char data[kFrameSize] = {};
+    EXPECT_EQ(-ENOSYS, proxy_write(&mProxy, data, sizeof(data)));
+    begin();
+    EXPECT_EQ(-EINVAL, proxy_mmap_commit(&mProxy, mBufferSize + 1));
+    EXPECT_EQ(0, proxy_mmap_commit(&mProxy, 1));
+    EXPECT_EQ(-EINVAL, proxy_mmap_commit(&mProxy, 1));  // must begin again
+
+    proxy_close(&mProxy);
+    void* buffer;
+    unsigned frames;
+    EXPECT_EQ(-EINVAL, proxy_mmap_begin(&mProxy, &buffer, &frames));
+    ASSERT_EQ(0, proxy_open(&mProxy));
+    EXPECT_EQ(-EINVAL, proxy_mmap_begin(&mProxy, &buffer, &frames));
+}
+
+TEST_P(AlsaDeviceProxyMmapInputTest, reads_in_place) {
+    EXPECT_EQ(0u, begin());  // starts the stream
+    EXPECT_TRUE(fake_pcm::isRunning());
+
+    fake_pcm::advance(100, {3, 500});
+    void* buffer;
+    EXPECT_EQ(100u, begin(&buffer));
+    EXPECT_EQ(fake_pcm::mmapBuffer().data(), buffer);
+    EXPECT_EQ(0, proxy_mmap_commit(&mProxy, 60));
+    EXPECT_EQ(60u, mProxy.transferred);
+
+    int64_t frames;
+    int64_t time;
+    EXPECT_EQ(0, proxy_get_capture_position(&mProxy, &frames, &time));
+    EXPECT_EQ(100, frames);  // the frames read and the frames available
+    EXPECT_EQ(3000000500, time);
+
+    EXPECT_EQ(40u, begin(&buffer));
+    EXPECT_EQ(fake_pcm::mmapBuffer().data() + 60 * kFrameSize, buffer);
+    EXPECT_EQ(1, proxy_mmap_wait(&mProxy, 0));
+}
+
+TEST_P(AlsaDeviceProxyMmapInputTest, overrun_recovery) {
+    begin();
+    fake_pcm::advance(mBufferSize, {});
+    EXPECT_TRUE(fake_pcm::isXrun());
+
+    EXPECT_EQ(0u, begin());
+    EXPECT_TRUE(fake_pcm::isRunning());
+    EXPECT_EQ(2u, fake_pcm::startCount());
+    EXPECT_EQ(0, proxy_mmap_wait(&mProxy, 0));
+}
+
+INSTANTIATE_TEST_SUITE_P(Output, AlsaDeviceProxyMmapOutputTest, ::testing::Values(PCM_OUT));
+INSTANTIATE_TEST_SUITE_P(Input, AlsaDeviceProxyMmapInputTest, ::testing::Values(PCM_IN));
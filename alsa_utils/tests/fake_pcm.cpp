@@ -0,0 +1,312 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "fake_pcm.h"
+
+#include <errno.h>
+#include <string.h>
+
+#include <algorithm>
+
+#include <alsa_card_info.h>
+
+namespace {
+
+struct State {
+    fake_pcm::Device device;
+    std::map<std::string, std::string> cardInfo;
+    size_t paramsGetCount = 0;
+    std::vector<struct pcm_config> openLog;
+    struct pcm* pcm = nullptr;  // the last pcm opened
+    size_t startCount = 0;
+};
+
+State& state() {
+    static State s;
+    return s;
+}
+
+// The SNDRV_PCM_FORMAT_ bit of each format in the hw_params format mask.
+int formatBit(enum pcm_format format) {
+    switch (format) {
+        case PCM_FORMAT_S8: return 0;
+        case PCM_FORMAT_S16_LE: return 2;
+        case PCM_FORMAT_S24_LE: return 6;
+        case PCM_FORMAT_S32_LE: return 10;
+        case PCM_FORMAT_S24_3LE: return 32;
+        default: return -1;
+    }
+}
+
+}  // namespace
+
+struct pcm_params {
+    fake_pcm::Device device;
+    struct pcm_mask formats;
+};
+
+struct pcm {
+    enum class StreamState { kSetup, kPrepared, kRunning, kXrun };
+
+    struct pcm_config config;
+    unsigned int flags;
+    bool ready;
+    unsigned int bufferSize;  // in frames
+    std::vector<uint8_t> buffer;
+    unsigned long appl = 0;
+    unsigned long hw = 0;
+    StreamState state = StreamState::kSetup;
+    bool prepared = false;  // tinyalsa's view, not updated by an xrun
+    struct timespec tstamp = {};
+
+    bool isInput() const { return (flags & PCM_IN) != 0; }
+    unsigned int avail() const {
+        return isInput() ? hw - appl : hw + bufferSize - appl;
+    }
+};
+
+namespace fake_pcm {
+
+void reset() {
+    state() = State();
+}
+
+void setDevice(const Device& device) {
+    state().device = device;
+}
+
+void setCardInfo(const std::string& name, const std::string& contents) {
+    state().cardInfo[name] = contents;
+}
+
+size_t paramsGetCount() {
+    return state().paramsGetCount;
+}
+
+const std::vector<struct pcm_config>& openLog() {
+    return state().openLog;
+}
+
+void clearCounts() {
+    state().paramsGetCount = 0;
+    state().openLog.clear();
+}
+
+bool isOpen() {
+    return state().pcm != nullptr;
+}
+
+const std::vector<uint8_t>& mmapBuffer() {
+    return state().pcm->buffer;
+}
+
+unsigned long applPtr() {
+    return state().pcm->appl;
+}
+
+unsigned long hwPtr() {
+    return state().pcm->hw;
+}
+
+bool isRunning() {
+    return state().pcm->state == pcm::StreamState::kRunning;
+}
+
+bool isXrun() {
+    return state().pcm->state == pcm::StreamState::kXrun;
+}
+
+size_t startCount() {
+    return state().startCount;
+}
+
+void advance(unsigned int frames, const struct timespec& timestamp) {
+    struct pcm* pcm = state().pcm;
+    if (pcm->state != pcm::StreamState::kRunning) return;
+    // the frames queued (output) or the room left (input), the hardware stops after them
+    const unsigned int limit = pcm->bufferSize - pcm->avail();
+    pcm->hw += std::min(frames, limit);
+    pcm->tstamp = timestamp;
+    if (frames > 0 && frames >= limit) {
+        pcm->state = pcm::StreamState::kXrun;
+    }
+}
+
+}  // namespace fake_pcm
+
+extern "C" {
+
+ssize_t alsa_card_read_info(int card, const char* name, char* buffer, size_t size) {
+    const auto it = state().cardInfo.find(name);
+    if (card < 0 || size == 0) return -EINVAL;
+    if (it == state().cardInfo.end()) return -ENOENT;
+    const size_t length = std::min(it->second.size(), size - 1);
+    memcpy(buffer, it->second.data(), length);
+    buffer[length] = '\0';
+    return length;
+}
+
+struct pcm_params* pcm_params_get(unsigned int, unsigned int, unsigned int) {
+    ++state().paramsGetCount;
+    if (!state().device.present) return nullptr;
+    auto* params = new pcm_params{state().device, {}};
+    for (const enum pcm_format format : params->device.formats) {
+        const int bit = formatBit(format);
+        if (bit >= 0) params->formats.bits[bit / 32] |= 1u << (bit % 32);
+    }
+    return params;
+}
+
+void pcm_params_free(struct pcm_params* params) {
+    delete params;
+}
+
+const struct pcm_mask* pcm_params_get_mask(const struct pcm_params* params, enum pcm_param param) {
+    return param == PCM_PARAM_FORMAT ? &params->formats : nullptr;
+}
+
+unsigned int pcm_params_get_min(const struct pcm_params* params, enum pcm_param param) {
+    switch (param) {
+        case PCM_PARAM_RATE: return params->device.minRate;
+        case PCM_PARAM_CHANNELS: return params->device.minChannels;
+        case PCM_PARAM_PERIOD_SIZE: return params->device.minPeriodSize;
+        case PCM_PARAM_PERIODS: return params->device.minPeriods;
+        default: return 0;
+    }
+}
+
+unsigned int pcm_params_get_max(const struct pcm_params* params, enum pcm_param param) {
+    switch (param) {
+        case PCM_PARAM_RATE: return params->device.maxRate;
+        case PCM_PARAM_CHANNELS: return params->device.maxChannels;
+        case PCM_PARAM_PERIOD_SIZE: return params->device.maxPeriodSize;
+        case PCM_PARAM_PERIODS: return params->device.maxPeriods;
+        default: return 0;
+    }
+}
+
+struct pcm* pcm_open(unsigned int, unsigned int, unsigned int flags, struct pcm_config* config) {
+    const fake_pcm::Device& device = state().device;
+    state().openLog.push_back(*config);
+    auto* pcm = new struct pcm;
+    pcm->config = *config;
+    pcm->flags = flags;
+    pcm->ready = device.present
+            && device.rates.count(config->rate) != 0
+            && config->rate >= device.minRate && config->rate <= device.maxRate
+            && config->channels >= device.minChannels && config->channels <= device.maxChannels
+            && std::find(device.formats.begin(), device.formats.end(), config->format)
+                    != device.formats.end();
+    pcm->bufferSize = config->period_size * config->period_count;
+    if ((flags & PCM_MMAP) != 0) {
+        pcm->buffer.resize(pcm_frames_to_bytes(pcm, pcm->bufferSize));
+    }
+    state().pcm = pcm;
+    return pcm;
+}
+
+int pcm_close(struct pcm* pcm) {
+    if (state().pcm == pcm) state().pcm = nullptr;
+    delete pcm;
+    return 0;
+}
+
+int pcm_is_ready(struct pcm* pcm) {
+    return pcm != nullptr && pcm->ready;
+}
+
+const char* pcm_get_error(struct pcm* pcm) {
+    return pcm_is_ready(pcm) ? "" : "cannot set hw params";
+}
+
+unsigned int pcm_get_buffer_size(struct pcm* pcm) {
+    return pcm->bufferSize;
+}
+
+unsigned int pcm_frames_to_bytes(struct pcm* pcm, unsigned int frames) {
+    static constexpr unsigned int kBytesPerSample[] = {2, 4, 1, 4, 3};
+    return frames * pcm->config.channels * kBytesPerSample[pcm->config.format];
+}
+
+int pcm_get_htimestamp(struct pcm* pcm, unsigned int* avail, struct timespec* tstamp) {
+    if (pcm->state != pcm::StreamState::kRunning) return -1;
+    *avail = pcm->avail();
+    *tstamp = pcm->tstamp;
+    return 0;
+}
+
+int pcm_write(struct pcm* pcm, const void*, unsigned int count) {
+    pcm->appl += count / pcm_frames_to_bytes(pcm, 1);
+    return 0;
+}
+
+int pcm_read(struct pcm* pcm, void*, unsigned int count) {
+    pcm->appl += count / pcm_frames_to_bytes(pcm, 1);
+    return 0;
+}
+
+int pcm_prepare(struct pcm* pcm) {
+    if (pcm->prepared) return 0;
+    pcm->appl = pcm->hw;
+    pcm->state = pcm::StreamState::kPrepared;
+    pcm->prepared = true;
+    return 0;
+}
+
+int pcm_start(struct pcm* pcm) {
+    const int ret = pcm_prepare(pcm);
+    if (ret != 0) return ret;
+    if (pcm->state != pcm::StreamState::kPrepared) return -EBADFD;
+    pcm->state = pcm::StreamState::kRunning;
+    ++state().startCount;
+    return 0;
+}
+
+int pcm_stop(struct pcm* pcm) {
+    pcm->state = pcm::StreamState::kSetup;
+    pcm->prepared = false;
+    return 0;
+}
+
+int pcm_wait(struct pcm* pcm, int) {
+    return pcm->avail() > 0 ? 1 : 0;
+}
+
+int pcm_mmap_avail(struct pcm* pcm) {
+    return pcm->avail();
+}
+
+int pcm_mmap_begin(struct pcm* pcm, void** areas, unsigned int* offset, unsigned int* frames) {
+    *areas = pcm->buffer.data();
+    *offset = pcm->appl % pcm->bufferSize;
+    *frames = std::min({*frames, std::min(pcm->avail(), pcm->bufferSize),
+                        pcm->bufferSize - *offset});
+    return 0;
+}
+
+int pcm_mmap_commit(struct pcm* pcm, unsigned int, unsigned int frames) {
+    pcm->appl += frames;
+    return frames;
+}
+
+int pcm_mmap_get_hw_ptr(struct pcm* pcm, unsigned int* hw_ptr, struct timespec* tstamp) {
+    if (pcm->state != pcm::StreamState::kRunning) return -EPERM;
+    *hw_ptr = pcm->hw;
+    *tstamp = pcm->tstamp;
+    return 0;
+}
+
+}  // extern "C"
@@ -0,0 +1,86 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <tinyalsa/asoundlib.h>
+
+/*
+ * An in-memory stand-in for the tinyalsa pcm API and for alsa_card_read_info(),
+ * used by the alsa_utils tests in place of libtinyalsa and /proc/asound.
+ *
+ * The fake holds a single device, returned for any card and device number:
+ * a test describes its hw_params ranges and the configurations pcm_open() accepts,
+ * runs alsa_utils against it, then inspects what was queried and opened.
+ *
+ * The last pcm opened is a ring buffer of period_size * period_count frames with the
+ * kernel application and hardware pointers. The hardware only moves when the test
+ * calls advance(), and stops in an xrun when the output empties or the input fills,
+ * like the kernel does with the default stop threshold.
+ */
+namespace fake_pcm {
+
+struct Device {
+    // pcm_params_get() fails if false.
+    bool present = true;
+    // The hw_params ranges.
+    unsigned minRate = 8000;
+    unsigned maxRate = 96000;
+    unsigned minChannels = 1;
+    unsigned maxChannels = 2;
+    unsigned minPeriodSize = 16;
+    unsigned maxPeriodSize = 8192;
+    unsigned minPeriods = 2;
+    unsigned maxPeriods = 32;
+    std::vector<enum pcm_format> formats = {PCM_FORMAT_S16_LE};
+    // The rates pcm_open() accepts, within the ranges above.
+    std::set<unsigned> rates = {44100, 48000};
+};
+
+// Replaces the device with the default one, and clears the card files and counts.
+void reset();
+void setDevice(const Device& device);
+
+// Sets the contents of /proc/asound/card<N>/<name> for alsa_card_read_info().
+void setCardInfo(const std::string& name, const std::string& contents);
+
+// The number of pcm_params_get() calls since the last reset() or clearCounts().
+size_t paramsGetCount();
+// The configurations passed to pcm_open() since the last reset() or clearCounts().
+const std::vector<struct pcm_config>& openLog();
+void clearCounts();
+
+// The last pcm opened, while it is open.
+bool isOpen();
+// The ring buffer of an mmap pcm.
+const std::vector<uint8_t>& mmapBuffer();
+unsigned long applPtr();
+unsigned long hwPtr();
+bool isRunning();
+bool isXrun();
+// The number of pcm_start() calls that started the stream.
+size_t startCount();
+// Moves the hardware pointer of a running pcm by up to frames, and sets the
+// timestamp returned with it.
+void advance(unsigned int frames, const struct timespec& timestamp);
+
+}  // namespace fake_pcm
@@ -20,9 +20,15 @@
 
 #include <errno.h>
 #include <expat.h>
+#include <fcntl.h>
+#include <limits.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include <log/log.h>
 
@@ -31,6 +37,7 @@
 #define BUF_SIZE 1024
 #define MIXER_XML_PATH "/system/etc/mixer_paths.xml"
 #define INITIAL_MIXER_PATH_SIZE 8
+#define BITS_PER_LONG (sizeof(unsigned long) * 8)
 
 enum update_direction {
     DIRECTION_FORWARD,
@@ -76,6 +83,12 @@ struct mixer_state {
     struct ctl_values new_value;
     struct ctl_values reset_value;
     unsigned int active_count;
+    /*
+     scratch of audio_route_transition(), cleared before it returns: 1 + the position
+     of the last write of the control, and its old_value before the first write
+     */
+    unsigned int transition_last_write;
+    struct ctl_values transition_saved_value;
 };
 
 struct mixer_setting {
@@ -101,6 +114,7 @@ struct mixer_value {
 
 struct mixer_path {
     char *name;
+    uint32_t hash;
     unsigned int size;
     unsigned int length;
     struct mixer_setting *setting;
@@ -110,10 +124,19 @@ struct audio_route {
     struct mixer *mixer;
     unsigned int num_mixer_ctls;
     struct mixer_state *mixer_state;
+    /* bitmap of controls whose new_value may differ from old_value */
+    unsigned long *dirty_ctls;
 
     unsigned int mixer_path_size;
     unsigned int num_mixer_paths;
     struct mixer_path *mixer_path;
+    /*
+     open addressed hash table of path names, with linear probing. Each slot
+     holds the index of a path in mixer_path plus one, 0 marks an empty slot.
+     name_index_size is a power of two kept at least twice num_mixer_paths.
+     */
+    unsigned int name_index_size;
+    unsigned int *name_index;
 };
 
 struct config_parse_state {
@@ -121,6 +144,8 @@ struct config_parse_state {
     struct mixer_path *path;
     int level;
     bool enum_mixer_numeric_fallback;
+    /* records what the parse did for the route cache, NULL when not caching */
+    struct route_cache_builder *cache;
 };
 
 static size_t sizeof_ctl_type(enum mixer_ctl_type type);
@@ -197,6 +222,24 @@ static inline struct mixer_ctl *index_to_ctl(struct audio_route *ar,
     return ar->mixer_state[ctl_index].ctl;
 }
 
+/* records that the new_value of a control was written, for audio_route_update_mixer() */
+static inline void mark_ctl_dirty(struct audio_route *ar, unsigned int ctl_index)
+{
+    ar->dirty_ctls[ctl_index / BITS_PER_LONG] |= 1UL << (ctl_index % BITS_PER_LONG);
+}
+
+/* FNV-1a */
+static uint32_t path_name_hash(const char *name)
+{
+    uint32_t hash = 2166136261u;
+
+    while (*name) {
+        hash ^= (unsigned char)*name++;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
 #if 0
 static void path_print(struct audio_route *ar, struct mixer_path *path)
 {
@@ -243,16 +286,61 @@ static void path_free(struct audio_route *ar)
     ar->mixer_path = NULL;
     ar->mixer_path_size = 0;
     ar->num_mixer_paths = 0;
+    free(ar->name_index);
+    ar->name_index = NULL;
+    ar->name_index_size = 0;
+}
+
+static void name_index_insert(unsigned int *index, unsigned int size,
+                              uint32_t hash, unsigned int path_pos)
+{
+    unsigned int i;
+
+    for (i = hash & (size - 1); index[i] != 0; i = (i + 1) & (size - 1))
+        ;
+    index[i] = path_pos + 1;
+}
+
+/* rebuilds the name index with room for at least twice the current number of paths */
+static int name_index_rebuild(struct audio_route *ar)
+{
+    unsigned int size = ar->name_index_size ? ar->name_index_size : INITIAL_MIXER_PATH_SIZE;
+    unsigned int *index;
+    unsigned int i;
+
+    while (size < 2 * ar->num_mixer_paths)
+        size *= 2;
+
+    index = calloc(size, sizeof(*index));
+    if (index == NULL)
+        return -1;
+
+    for (i = 0; i < ar->num_mixer_paths; i++)
+        name_index_insert(index, size, ar->mixer_path[i].hash, i);
+
+    free(ar->name_index);
+    ar->name_index = index;
+    ar->name_index_size = size;
+    return 0;
 }
 
 static struct mixer_path *path_get_by_name(struct audio_route *ar,
                                            const char *name)
 {
+    uint32_t hash;
     unsigned int i;
+    unsigned int mask = ar->name_index_size - 1;
 
-    for (i = 0; i < ar->num_mixer_paths; i++)
-        if (strcmp(ar->mixer_path[i].name, name) == 0)
-            return &ar->mixer_path[i];
+    if (ar->name_index_size == 0)
+        return NULL;
+
+    hash = path_name_hash(name);
+    for (i = hash & mask; ar->name_index[i] != 0; i = (i + 1) & mask) {
+        struct mixer_path *path = &ar->mixer_path[ar->name_index[i] - 1];
+
+        if (path->hash == hash && strcmp(path->name, name) == 0)
+            return path;
+    }
 
     return NULL;
 }
@@ -285,12 +373,27 @@ static struct mixer_path *path_create(struct audio_route *ar, const char *name)
 
     /* initialise the new mixer path */
     ar->mixer_path[ar->num_mixer_paths].name = strdup(name);
+    ar->mixer_path[ar->num_mixer_paths].hash = path_name_hash(name);
     ar->mixer_path[ar->num_mixer_paths].size = 0;
     ar->mixer_path[ar->num_mixer_paths].length = 0;
     ar->mixer_path[ar->num_mixer_paths].setting = NULL;
+    ar->num_mixer_paths++;
 
-    /* return the mixer path just added, then increment number of them */
-    return &ar->mixer_path[ar->num_mixer_paths++];
+    /* index the new path, growing the index if it is more than half full */
+    if (2 * ar->num_mixer_paths > ar->name_index_size) {
+        if (name_index_rebuild(ar) < 0) {
+            ALOGE("Unable to allocate path index");
+            free(ar->mixer_path[--ar->num_mixer_paths].name);
+            return NULL;
+        }
+    } else {
+        name_index_insert(ar->name_index, ar->name_index_size,
+                          ar->mixer_path[ar->num_mixer_paths - 1].hash,
+                          ar->num_mixer_paths - 1);
+    }
+
+    /* return the mixer path just added */
+    return &ar->mixer_path[ar->num_mixer_paths - 1];
 }
 
 static int find_ctl_index_in_path(struct mixer_path *path,
@@ -482,6 +585,7 @@ static int path_apply(struct audio_route *ar, struct mixer_path *path)
         if (!is_supported_ctl_type(type))
             continue;
         ctl_values_copy(&ar->mixer_state[ctl_index].new_value, &path->setting[i].value);
+        mark_ctl_dirty(ar, ctl_index);
     }
 
     return 0;
@@ -504,6 +608,7 @@ static int path_reset(struct audio_route *ar, struct mixer_path *path)
         /* reset the value(s) */
         ctl_values_copy(&ar->mixer_state[ctl_index].new_value,
                         &ar->mixer_state[ctl_index].reset_value);
+        mark_ctl_dirty(ar, ctl_index);
     }
 
     return 0;
@@ -600,6 +705,493 @@ exit:
     return bytes_read;
 }
 
+/*
+ compiled route cache
+
+ The result of parsing the XML file against a given card is cached in a binary
+ file, so later inits can skip the parse. The file is only valid for the key
+ stored in its header, a hash of the XML contents and of the card's control
+ list, and its contents must match the checksum in the header; any byte files
+ referenced by the XML are re-read and compared on load.
+ All fields are native endian, the cache is not meant to be portable.
+
+   header      struct route_cache_header
+   bin files   u32 path_len, path (no NUL), u32 max_bytes, i32 bytes_read, u64 hash
+   initial     u32 ctl_index, u32 offset, u32 length, u32 byte_size, value bytes[length]
+   paths       u32 name_len, name (no NUL), u32 length, then per setting:
+               u32 ctl_index, u32 num_values, u32 type, u32 byte_size, value bytes[byte_size]
+
+ "initial" records replay, in order, the writes the top level <ctl> elements
+ made to new_value. Only the written range is stored so that the values not
+ named by an "id" attribute keep the ones read from the card.
+ */
+#define ROUTE_CACHE_MAGIC 0x31435241 /* "ARC1" */
+#define ROUTE_CACHE_VERSION 1
+
+struct route_cache_header {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t key;
+    uint64_t checksum;  /* of everything after the header */
+    uint32_t size;
+    uint32_t num_ctls;
+    uint32_t num_bin_files;
+    uint32_t num_initial;
+    uint32_t num_paths;
+    uint32_t reserved;
+};
+
+struct route_cache_buf {
+    unsigned char *data;
+    size_t size;
+    size_t capacity;
+    bool error;
+};
+
+struct route_cache_builder {
+    struct route_cache_buf bin_files;
+    struct route_cache_buf initial;
+    unsigned int num_bin_files;
+    unsigned int num_initial;
+};
+
+struct route_cache_reader {
+    const unsigned char *data;
+    size_t size;
+    size_t pos;
+};
+
+#define FNV64_OFFSET 14695981039346656037ULL
+#define FNV64_PRIME 1099511628211ULL
+
+static uint64_t hash_bytes(uint64_t hash, const void *data, size_t size)
+{
+    const unsigned char *bytes = data;
+    size_t i;
+
+    for (i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= FNV64_PRIME;
+    }
+    return hash;
+}
+
+static uint64_t hash_u32(uint64_t hash, uint32_t value)
+{
+    return hash_bytes(hash, &value, sizeof(value));
+}
+
+static uint64_t hash_string(uint64_t hash, const char *str)
+{
+    /* include the NUL so adjacent strings can't alias */
+    return hash_bytes(hash, str != NULL ? str : "", str != NULL ? strlen(str) + 1 : 1);
+}
+
+static uint64_t hash_values(const long *values, int count)
+{
+    uint64_t hash = FNV64_OFFSET;
+    int i;
+
+    for (i = 0; i < count; i++) {
+        unsigned char byte = values[i];
+        hash = hash_bytes(hash, &byte, 1);
+    }
+    return hash;
+}
+
+/* hashes everything the parse depends on: the XML file and the card's controls */
+static int route_cache_key(struct audio_route *ar, FILE *file, uint64_t *key)
+{
+    uint64_t hash = hash_u32(FNV64_OFFSET, ROUTE_CACHE_VERSION);
+    unsigned char buf[BUF_SIZE];
+    size_t bytes_read;
+    unsigned int i;
+    unsigned int j;
+
+    hash = hash_u32(hash, sizeof(long));
+    hash = hash_u32(hash, ar->num_mixer_ctls);
+    for (i = 0; i < ar->num_mixer_ctls; i++) {
+        struct mixer_ctl *ctl = ar->mixer_state[i].ctl;
+        enum mixer_ctl_type type = mixer_ctl_get_type(ctl);
+
+        hash = hash_string(hash, mixer_ctl_get_name(ctl));
+        hash = hash_u32(hash, type);
+        hash = hash_u32(hash, ar->mixer_state[i].num_values);
+        hash = hash_u32(hash, mixer_ctl_is_access_tlv_rw(ctl) != 0);
+        if (type == MIXER_CTL_TYPE_ENUM) {
+            unsigned int num_enums = mixer_ctl_get_num_enums(ctl);
+
+            hash = hash_u32(hash, num_enums);
+            for (j = 0; j < num_enums; j++)
+                hash = hash_string(hash, mixer_ctl_get_enum_string(ctl, j));
+        }
+    }
+
+    while ((bytes_read = fread(buf, 1, sizeof(buf), file)) > 0)
+        hash = hash_bytes(hash, buf, bytes_read);
+    if (ferror(file)) {
+        ALOGE("Failed to read mixer xml");
+        return -1;
+    }
+    rewind(file);
+
+    *key = hash;
+    return 0;
+}
+
+static void route_cache_put(struct route_cache_buf *buf, const void *data, size_t size)
+{
+    if (buf->error || size == 0)
+        return;
+
+    if (buf->capacity - buf->size < size) {
+        size_t capacity = buf->capacity ? buf->capacity : BUF_SIZE;
+        unsigned char *new_data;
+
+        while (capacity - buf->size < size)
+            capacity *= 2;
+        new_data = realloc(buf->data, capacity);
+        if (new_data == NULL) {
+            buf->error = true;
+            return;
+        }
+        buf->data = new_data;
+        buf->capacity = capacity;
+    }
+    memcpy(buf->data + buf->size, data, size);
+    buf->size += size;
+}
+
+static void route_cache_put_u32(struct route_cache_buf *buf, uint32_t value)
+{
+    route_cache_put(buf, &value, sizeof(value));
+}
+
+static void route_cache_put_string(struct route_cache_buf *buf, const char *str)
+{
+    route_cache_put_u32(buf, strlen(str));
+    route_cache_put(buf, str, strlen(str));
+}
+
+static const void *route_cache_get(struct route_cache_reader *reader, size_t size)
+{
+    const void *data;
+
+    if (size > reader->size - reader->pos)
+        return NULL;
+    data = reader->data + reader->pos;
+    reader->pos += size;
+    return data;
+}
+
+static bool route_cache_get_u32(struct route_cache_reader *reader, uint32_t *value)
+{
+    const void *data = route_cache_get(reader, sizeof(*value));
+
+    if (data == NULL)
+        return false;
+    memcpy(value, data, sizeof(*value));
+    return true;
+}
+
+/* records a byte file read by the parse, with the result it gave */
+static void route_cache_add_bin_file(struct route_cache_builder *cache, const char *path,
+                                     unsigned int max_bytes, int bytes_read,
+                                     const long *values)
+{
+    uint64_t hash = bytes_read > 0 ? hash_values(values, bytes_read) : 0;
+
+    route_cache_put_string(&cache->bin_files, path);
+    route_cache_put_u32(&cache->bin_files, max_bytes);
+    route_cache_put_u32(&cache->bin_files, bytes_read);
+    route_cache_put(&cache->bin_files, &hash, sizeof(hash));
+    cache->num_bin_files++;
+}
+
+/* records a write of new_value by a top level <ctl>, from byte offset for length bytes */
+static void route_cache_add_initial(struct route_cache_builder *cache, unsigned int ctl_index,
+                                    const struct ctl_values *value, size_t offset,
+                                    size_t length)
+{
+    route_cache_put_u32(&cache->initial, ctl_index);
+    route_cache_put_u32(&cache->initial, offset);
+    route_cache_put_u32(&cache->initial, length);
+    route_cache_put_u32(&cache->initial, value->byte_size);
+    route_cache_put(&cache->initial, value->bytes + offset, length);
+    cache->num_initial++;
+}
+
+static void route_cache_builder_free(struct route_cache_builder *cache)
+{
+    free(cache->bin_files.data);
+    free(cache->initial.data);
+}
+
+/* writes the parsed routes to cache_path, replacing it atomically */
+static int route_cache_store(struct audio_route *ar, struct route_cache_builder *cache,
+                             const char *cache_path, uint64_t key)
+{
+    struct route_cache_header header;
+    struct route_cache_buf buf;
+    char tmp_path[PATH_MAX];
+    unsigned int i;
+    unsigned int j;
+    FILE *file;
+    int ret = -1;
+
+    memset(&buf, 0, sizeof(buf));
+    memset(&header, 0, sizeof(header));
+    route_cache_put(&buf, &header, sizeof(header));
+    route_cache_put(&buf, cache->bin_files.data, cache->bin_files.size);
+    route_cache_put(&buf, cache->initial.data, cache->initial.size);
+    for (i = 0; i < ar->num_mixer_paths; i++) {
+        struct mixer_path *path = &ar->mixer_path[i];
+
+        route_cache_put_string(&buf, path->name);
+        route_cache_put_u32(&buf, path->length);
+        for (j = 0; j < path->length; j++) {
+            struct mixer_setting *setting = &path->setting[j];
+
+            route_cache_put_u32(&buf, setting->ctl_index);
+            route_cache_put_u32(&buf, setting->num_values);
+            route_cache_put_u32(&buf, setting->type);
+            route_cache_put_u32(&buf, setting->value.byte_size);
+            route_cache_put(&buf, setting->value.ptr, setting->value.byte_size);
+        }
+    }
+    if (buf.error || cache->bin_files.error || cache->initial.error || buf.size > UINT32_MAX) {
+        ALOGE("Unable to allocate route cache");
+        goto exit;
+    }
+
+    header.magic = ROUTE_CACHE_MAGIC;
+    header.version = ROUTE_CACHE_VERSION;
+    header.key = key;
+    header.checksum = hash_bytes(FNV64_OFFSET, buf.data + sizeof(header),
+                                 buf.size - sizeof(header));
+    header.size = buf.size;
+    header.num_ctls = ar->num_mixer_ctls;
+    header.num_bin_files = cache->num_bin_files;
+    header.num_initial = cache->num_initial;
+    header.num_paths = ar->num_mixer_paths;
+    memcpy(buf.data, &header, sizeof(header));
+
+    if (snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", cache_path) >= (int)sizeof(tmp_path))
+        goto exit;
+    file = fopen(tmp_path, "wb");
+    if (!file) {
+        ALOGW("Failed to create %s: %s", tmp_path, strerror(errno));
+        goto exit;
+    }
+    if (fwrite(buf.data, 1, buf.size, file) != buf.size) {
+        ALOGW("Failed to write %s", tmp_path);
+        fclose(file);
+        unlink(tmp_path);
+        goto exit;
+    }
+    if (fclose(file) != 0 || rename(tmp_path, cache_path) != 0) {
+        ALOGW("Failed to store %s: %s", cache_path, strerror(errno));
+        unlink(tmp_path);
+        goto exit;
+    }
+    ret = 0;
+
+exit:
+    free(buf.data);
+    return ret;
+}
+
+/* returns the size of the value buffer of a control, or 0 if it has none */
+static size_t ctl_values_capacity(struct audio_route *ar, unsigned int ctl_index)
+{
+    enum mixer_ctl_type type = mixer_ctl_get_type(ar->mixer_state[ctl_index].ctl);
+
+    if (!is_supported_ctl_type(type))
+        return 0;
+    return ar->mixer_state[ctl_index].num_values * sizeof_ctl_type(type);
+}
+
+static int route_cache_check_bin_files(struct route_cache_reader *reader, unsigned int count)
+{
+    unsigned int i;
+
+    for (i = 0; i < count; i++) {
+        uint32_t path_len, max_bytes, bytes_read;
+        const char *path_data;
+        const void *hash_data;
+        char path[PATH_MAX];
+        uint64_t hash;
+        long *values = NULL;
+        int ret;
+
+        if (!route_cache_get_u32(reader, &path_len) || path_len >= sizeof(path) ||
+                (path_data = route_cache_get(reader, path_len)) == NULL ||
+                !route_cache_get_u32(reader, &max_bytes) ||
+                !route_cache_get_u32(reader, &bytes_read) ||
+                (hash_data = route_cache_get(reader, sizeof(hash))) == NULL)
+            return -1;
+        memcpy(path, path_data, path_len);
+        path[path_len] = '\0';
+        memcpy(&hash, hash_data, sizeof(hash));
+
+        ret = mixer_get_bytes_from_file(&values, path, max_bytes);
+        if (ret != (int)bytes_read || (ret > 0 && hash_values(values, ret) != hash)) {
+            ALOGV("byte file %s changed", path);
+            free(values);
+            return -1;
+        }
+        free(values);
+    }
+    return 0;
+}
+
+static int route_cache_read_initial(struct audio_route *ar, struct route_cache_reader *reader,
+                                    unsigned int count, bool apply)
+{
+    unsigned int i;
+
+    for (i = 0; i < count; i++) {
+        uint32_t ctl_index, offset, length, byte_size;
+        const void *data;
+        size_t capacity;
+
+        if (!route_cache_get_u32(reader, &ctl_index) ||
+                !route_cache_get_u32(reader, &offset) ||
+                !route_cache_get_u32(reader, &length) ||
+                !route_cache_get_u32(reader, &byte_size) ||
+                ctl_index >= ar->num_mixer_ctls ||
+                (data = route_cache_get(reader, length)) == NULL)
+            return -1;
+        capacity = ctl_values_capacity(ar, ctl_index);
+        if (offset > capacity || length > capacity - offset || byte_size > capacity)
+            return -1;
+
+        if (apply) {
+            struct ctl_values *value = &ar->mixer_state[ctl_index].new_value;
+
+            memcpy(value->bytes + offset, data, length);
+            value->byte_size = byte_size;
+            mark_ctl_dirty(ar, ctl_index);
+        }
+    }
+    return 0;
+}
+
+static int route_cache_read_paths(struct audio_route *ar, struct route_cache_reader *reader,
+                                  unsigned int count)
+{
+    unsigned int i;
+    unsigned int j;
+
+    for (i = 0; i < count; i++) {
+        uint32_t name_len, length;
+        const char *name_data;
+        char *name;
+        struct mixer_path *path;
+
+        if (!route_cache_get_u32(reader, &name_len) ||
+                (name_data = route_cache_get(reader, name_len)) == NULL ||
+                !route_cache_get_u32(reader, &length))
+            return -1;
+        name = strndup(name_data, name_len);
+        if (name == NULL)
+            return -1;
+        path = path_create(ar, name);
+        free(name);
+        if (path == NULL)
+            return -1;
+
+        for (j = 0; j < length; j++) {
+            struct mixer_setting setting;
+            uint32_t ctl_index, num_values, type, byte_size;
+            const void *data;
+
+            if (!route_cache_get_u32(reader, &ctl_index) ||
+                    !route_cache_get_u32(reader, &num_values) ||
+                    !route_cache_get_u32(reader, &type) ||
+                    !route_cache_get_u32(reader, &byte_size) ||
+                    ctl_index >= ar->num_mixer_ctls ||
+                    num_values != ar->mixer_state[ctl_index].num_values ||
+                    type != mixer_ctl_get_type(ar->mixer_state[ctl_index].ctl) ||
+                    byte_size > ctl_values_capacity(ar, ctl_index) ||
+                    (data = route_cache_get(reader, byte_size)) == NULL)
+                return -1;
+
+            setting.ctl_index = ctl_index;
+            setting.num_values = num_values;
+            setting.type = type;
+            setting.value.ptr = (void *)data;
+            setting.value.byte_size = byte_size;
+            if (path_add_setting(ar, path, &setting) < 0)
+                return -1;
+        }
+    }
+    return 0;
+}
+
+/*
+ * loads the routes from cache_path if it was compiled with the given key.
+ * On failure ar is left without paths and with its initial values untouched.
+ */
+static int route_cache_load(struct audio_route *ar, const char *cache_path, uint64_t key)
+{
+    struct route_cache_header header;
+    struct route_cache_reader reader;
+    struct stat st;
+    size_t initial_pos;
+    void *map;
+    int ret = -1;
+    int fd;
+
+    fd = open(cache_path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return -1;
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(header)) {
+        close(fd);
+        return -1;
+    }
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return -1;
+
+    reader.data = map;
+    reader.size = st.st_size;
+    reader.pos = 0;
+    memcpy(&header, route_cache_get(&reader, sizeof(header)), sizeof(header));
+    if (header.magic != ROUTE_CACHE_MAGIC || header.version != ROUTE_CACHE_VERSION ||
+            header.key != key || header.size != reader.size ||
+            header.num_ctls != ar->num_mixer_ctls) {
+        ALOGV("stale route cache %s", cache_path);
+        goto exit;
+    }
+    if (header.checksum != hash_bytes(FNV64_OFFSET, reader.data + reader.pos,
+                                      reader.size - reader.pos)) {
+        ALOGW("corrupt route cache %s", cache_path);
+        goto exit;
+    }
+
+    if (route_cache_check_bin_files(&reader, header.num_bin_files) < 0)
+        goto exit;
+
+    /* validate the initial values now, but only apply them once the paths loaded */
+    initial_pos = reader.pos;
+    if (route_cache_read_initial(ar, &reader, header.num_initial, false) < 0 ||
+            route_cache_read_paths(ar, &reader, header.num_paths) < 0 ||
+            reader.pos != reader.size) {
+        ALOGW("corrupt route cache %s", cache_path);
+        path_free(ar);
+        goto exit;
+    }
+    reader.pos = initial_pos;
+    route_cache_read_initial(ar, &reader, header.num_initial, true);
+    ret = 0;
+
+exit:
+    munmap(map, st.st_size);
+    return ret;
+}
+
 static void start_tag(void *data, const XML_Char *tag_name,
                       const XML_Char **attr)
 {
@@ -682,6 +1274,9 @@ static void start_tag(void *data, const XML_Char *tag_name,
                 if (attr_bin && mixer_ctl_get_type(ctl) == MIXER_CTL_TYPE_BYTE) {
                     /* get byte values from binfile */
                     int bytes_read = mixer_get_bytes_from_file(&value_array, attr_bin, num_values);
+                    if (state->cache != NULL)
+                        route_cache_add_bin_file(state->cache, attr_bin, num_values,
+                                                 bytes_read, value_array);
                     if (bytes_read <= 0) {
                         ALOGE("failed to get bytes from file '%s'", attr_bin);
                         goto done;
@@ -756,11 +1351,16 @@ static void start_tag(void *data, const XML_Char *tag_name,
 
             type = mixer_ctl_get_type(ctl);
             if (is_supported_ctl_type(type)) {
+                /* the range of new_value written, in values */
+                unsigned int first = 0;
+                unsigned int count = 0;
+
+                mark_ctl_dirty(ar, ctl_index);
                 /* apply the new value */
                 if (attr_id) {
                     /* set only one value */
                     id = atoi((char *)attr_id);
-                    if (id < ar->mixer_state[ctl_index].num_values)
+                    if (id < ar->mixer_state[ctl_index].num_values) {
                         if (type == MIXER_CTL_TYPE_BYTE)
                             ar->mixer_state[ctl_index].new_value.bytes[id] = value_array[0];
                         else if (type == MIXER_CTL_TYPE_INT)
@@ -769,7 +1369,9 @@ static void start_tag(void *data, const XML_Char *tag_name,
                             ar->mixer_state[ctl_index].new_value.enumerated[id] = value;
                         else
                             ar->mixer_state[ctl_index].new_value.integer[id] = value;
-                    else
+                        first = id;
+                        count = 1;
+                    } else
                         ALOGW("value id out of range for mixer ctl '%s'",
                               mixer_ctl_get_name(ctl));
                 } else if (ctl_is_tlv_byte_type(ctl)) {
@@ -778,6 +1380,7 @@ static void start_tag(void *data, const XML_Char *tag_name,
                     for (i = 0; i < num_values_in_array; i++)
                         ar->mixer_state[ctl_index].new_value.bytes[i] = value_array[i];
                     ar->mixer_state[ctl_index].new_value.byte_size = num_values_in_array;
+                    count = num_values_in_array;
                 } else {
                     /* set all values the same except for CTL_TYPE_BYTE and CTL_TYPE_INT */
                     for (i = 0; i < ar->mixer_state[ctl_index].num_values; i++)
@@ -789,7 +1392,14 @@ static void start_tag(void *data, const XML_Char *tag_name,
                             ar->mixer_state[ctl_index].new_value.enumerated[i] = value;
                         else
                             ar->mixer_state[ctl_index].new_value.integer[i] = value;
+                    count = ar->mixer_state[ctl_index].num_values;
                 }
+
+                if (state->cache != NULL && count > 0)
+                    route_cache_add_initial(state->cache, ctl_index,
+                                            &ar->mixer_state[ctl_index].new_value,
+                                            first * sizeof_ctl_type(type),
+                                            count * sizeof_ctl_type(type));
             }
         } else {
             /* nested ctl (within a path) */
@@ -836,6 +1446,14 @@ static int alloc_mixer_state(struct audio_route *ar)
     if (!ar->mixer_state)
         return -1;
 
+    ar->dirty_ctls = calloc((ar->num_mixer_ctls + BITS_PER_LONG - 1) / BITS_PER_LONG,
+                            sizeof(unsigned long));
+    if (!ar->dirty_ctls) {
+        free(ar->mixer_state);
+        ar->mixer_state = NULL;
+        return -1;
+    }
+
     for (i = 0; i < ar->num_mixer_ctls; i++) {
         ctl = mixer_get_ctl(ar->mixer, i);
         num_values = mixer_ctl_get_num_values(ctl);
@@ -887,65 +1505,84 @@ static void free_mixer_state(struct audio_route *ar)
 
     free(ar->mixer_state);
     ar->mixer_state = NULL;
+    free(ar->dirty_ctls);
+    ar->dirty_ctls = NULL;
 }
 
-static void mixer_set_value_if_changed(struct mixer_state *ms)
+/* returns the number of values of a control setting that are written to the mixer */
+static unsigned int ctl_values_num_written(struct mixer_state *ms, const struct ctl_values *value)
+{
+    /*
+     for tlv-typed ctl, "mixer_ctl_set_array()" should specify the length of data to
+     be set, thus the data can be wrapped into tlv format correctly by Tinyalsa.
+     */
+    if (ctl_is_tlv_byte_type(ms->ctl))
+        return value->byte_size;
+    return ms->num_values;
+}
+
+/* returns true if writing new_value to a control holding old_value would change it */
+static bool mixer_values_differ(struct mixer_state *ms, const struct ctl_values *old_value,
+                                const struct ctl_values *new_value)
 {
     unsigned int i;
-    struct mixer_ctl *ctl = ms->ctl;
-    enum mixer_ctl_type type = mixer_ctl_get_type(ctl);
+    enum mixer_ctl_type type = mixer_ctl_get_type(ms->ctl);
 
     if (type == MIXER_CTL_TYPE_BYTE) {
-        unsigned int num_bytes;
-        /*
-         for tlv-typed ctl, "mixer_ctl_set_array()" should specify the length of data to
-         be set, thus the data can be wrapped into tlv format correctly by Tinyalsa.
-         */
-        num_bytes = ctl_is_tlv_byte_type(ctl) ? ms->new_value.byte_size : ms->num_values;
-        for (i = 0; i < num_bytes; i++) {
-            if (ms->old_value.bytes[i] != ms->new_value.bytes[i]) {
-                mixer_ctl_set_array(ctl, ms->new_value.ptr, num_bytes);
-                ctl_values_copy(&ms->old_value, &ms->new_value);
-                return;
-            }
-        }
+        unsigned int num_bytes = ctl_values_num_written(ms, new_value);
+
+        for (i = 0; i < num_bytes; i++)
+            if (old_value->bytes[i] != new_value->bytes[i])
+                return true;
     } else if (type == MIXER_CTL_TYPE_ENUM) {
-        for (i = 0; i < ms->num_values; i++) {
-            if (ms->old_value.enumerated[i] != ms->new_value.enumerated[i]) {
-                mixer_ctl_set_value(ctl, 0, ms->new_value.enumerated[0]);
-                ctl_values_copy(&ms->old_value, &ms->new_value);
-                return;
-            }
-        }
+        for (i = 0; i < ms->num_values; i++)
+            if (old_value->enumerated[i] != new_value->enumerated[i])
+                return true;
     } else {
-        for (i = 0; i < ms->num_values; i++) {
-            if (ms->old_value.integer[i] != ms->new_value.integer[i]) {
-                mixer_ctl_set_array(ctl, ms->new_value.ptr, ms->num_values);
-                ctl_values_copy(&ms->old_value, &ms->new_value);
-                return;
-            }
-        }
+        for (i = 0; i < ms->num_values; i++)
+            if (old_value->integer[i] != new_value->integer[i])
+                return true;
     }
+    return false;
 }
 
-/* Update the mixer with any changed values */
-int audio_route_update_mixer(struct audio_route *ar)
+static void mixer_write_values(struct mixer_state *ms, const struct ctl_values *value)
 {
-    unsigned int i;
-    struct mixer_ctl *ctl;
+    if (mixer_ctl_get_type(ms->ctl) == MIXER_CTL_TYPE_ENUM)
+        mixer_ctl_set_value(ms->ctl, 0, value->enumerated[0]);
+    else
+        mixer_ctl_set_array(ms->ctl, value->ptr, ctl_values_num_written(ms, value));
+}
 
-    for (i = 0; i < ar->num_mixer_ctls; i++) {
-        enum mixer_ctl_type type;
+static void mixer_set_value_if_changed(struct mixer_state *ms)
+{
+    if (mixer_values_differ(ms, &ms->old_value, &ms->new_value)) {
+        mixer_write_values(ms, &ms->new_value);
+        ctl_values_copy(&ms->old_value, &ms->new_value);
+    }
+}
 
-        ctl = ar->mixer_state[i].ctl;
+/*
+ * Update the mixer with any changed values. Only controls marked dirty since
+ * the last update are visited, in ascending control order. Controls of
+ * unsupported types are never marked.
+ */
+int audio_route_update_mixer(struct audio_route *ar)
+{
+    unsigned int w;
+    unsigned int num_words = (ar->num_mixer_ctls + BITS_PER_LONG - 1) / BITS_PER_LONG;
 
-        /* Skip unsupported types */
-        type = mixer_ctl_get_type(ctl);
-        if (!is_supported_ctl_type(type))
-            continue;
+    for (w = 0; w < num_words; w++) {
+        unsigned long bits = ar->dirty_ctls[w];
+
+        ar->dirty_ctls[w] = 0;
+        while (bits) {
+            unsigned int i = w * BITS_PER_LONG + __builtin_ctzl(bits);
 
-        /* if the value has changed, update the mixer */
-        mixer_set_value_if_changed(&ar->mixer_state[i]);
+            bits &= bits - 1;
+            /* if the value has changed, update the mixer */
+            mixer_set_value_if_changed(&ar->mixer_state[i]);
+        }
     }
 
     return 0;
@@ -979,6 +1616,7 @@ void audio_route_reset(struct audio_route *ar)
             continue;
 
         ctl_values_copy(&ar->mixer_state[i].new_value, &ar->mixer_state[i].reset_value);
+        mark_ctl_dirty(ar, i);
     }
 }
 
@@ -1025,26 +1663,55 @@ int audio_route_reset_path(struct audio_route *ar, const char *name)
 }
 
 /*
- * Operates on the specified path .. controls will be updated in the
- * order listed in the XML file
+ state of audio_route_transition(): the mixer writes that the equivalent sequence of
+ path updates would make are simulated, advancing old_value as the mixer would, and
+ only the last write of each control is issued, if it changes the control.
  */
-static int audio_route_update_path(struct audio_route *ar, const char *name, int direction)
+struct route_transition {
+    /* ctl index of each simulated write, in order */
+    unsigned int *writes;
+    unsigned int num_writes;
+    /* backs the transition_saved_value of the controls written */
+    unsigned char *arena;
+    size_t arena_used;
+};
+
+/* arena space for a control value, rounded up to keep every value aligned for long */
+static size_t transition_value_size(unsigned int num_values, enum mixer_ctl_type type)
 {
-    struct mixer_path *path;
-    unsigned int j;
-    bool reverse = direction != DIRECTION_FORWARD;
-    bool force_reset = direction == DIRECTION_REVERSE_RESET;
+    size_t size = num_values * sizeof_ctl_type(type);
 
-    if (!ar) {
-        ALOGE("invalid audio_route");
-        return -1;
-    }
+    return (size + sizeof(long) - 1) & ~(sizeof(long) - 1);
+}
 
-    path = path_get_by_name(ar, name);
-    if (!path) {
-        ALOGE("unable to find path '%s'", name);
-        return -1;
+static void transition_add_write(struct audio_route *ar, struct route_transition *transition,
+                                 unsigned int ctl_index)
+{
+    struct mixer_state *ms = &ar->mixer_state[ctl_index];
+
+    if (!mixer_values_differ(ms, &ms->old_value, &ms->new_value))
+        return;
+
+    if (ms->transition_last_write == 0) {
+        ms->transition_saved_value.ptr = transition->arena + transition->arena_used;
+        transition->arena_used += transition_value_size(ms->num_values,
+                                                        mixer_ctl_get_type(ms->ctl));
+        ctl_values_copy(&ms->transition_saved_value, &ms->old_value);
     }
+    transition->writes[transition->num_writes++] = ctl_index;
+    ms->transition_last_write = transition->num_writes;
+    ctl_values_copy(&ms->old_value, &ms->new_value);
+}
+
+/*
+ * Operates on the specified path .. controls will be updated in the
+ * order listed in the XML file. With a transition, the writes are only recorded.
+ */
+static void path_update(struct audio_route *ar, struct mixer_path *path, int direction,
+                        struct route_transition *transition)
+{
+    bool reverse = direction != DIRECTION_FORWARD;
+    bool force_reset = direction == DIRECTION_REVERSE_RESET;
 
     for (size_t i = 0; i < path->length; ++i) {
         unsigned int ctl_index;
@@ -1065,7 +1732,7 @@ static int audio_route_update_path(struct audio_route *ar, const char *name, int
             } else if (--ms->active_count > 0) {
                 ALOGD("%s: skip to reset mixer control '%s' in path '%s' "
                     "because it is still needed by other paths", __func__,
-                    mixer_ctl_get_name(ms->ctl), name);
+                    mixer_ctl_get_name(ms->ctl), path->name);
                 ctl_values_copy(&ms->new_value, &ms->old_value);
                 continue;
             }
@@ -1074,8 +1741,29 @@ static int audio_route_update_path(struct audio_route *ar, const char *name, int
         }
 
         /* if any value has changed, update the mixer */
-        mixer_set_value_if_changed(ms);
+        if (transition != NULL)
+            transition_add_write(ar, transition, ctl_index);
+        else
+            mixer_set_value_if_changed(ms);
+    }
+}
+
+static int audio_route_update_path(struct audio_route *ar, const char *name, int direction)
+{
+    struct mixer_path *path;
+
+    if (!ar) {
+        ALOGE("invalid audio_route");
+        return -1;
+    }
+
+    path = path_get_by_name(ar, name);
+    if (!path) {
+        ALOGE("unable to find path '%s'", name);
+        return -1;
     }
+
+    path_update(ar, path, direction, NULL);
     return 0;
 }
 
@@ -1104,6 +1792,108 @@ int audio_route_force_reset_and_update_path(struct audio_route *ar, const char *
     return audio_route_update_path(ar, name, DIRECTION_REVERSE_RESET);
 }
 
+/* resolves a NULL terminated list of path names, returning the number of settings in them */
+static int transition_get_paths(struct audio_route *ar, const char *const *names,
+                                struct mixer_path **paths, size_t *num_settings)
+{
+    unsigned int i;
+
+    for (i = 0; names != NULL && names[i] != NULL; i++) {
+        paths[i] = path_get_by_name(ar, names[i]);
+        if (!paths[i]) {
+            ALOGE("unable to find path '%s'", names[i]);
+            return -1;
+        }
+        *num_settings += paths[i]->length;
+    }
+    return 0;
+}
+
+static unsigned int path_list_length(const char *const *names)
+{
+    unsigned int i;
+
+    for (i = 0; names != NULL && names[i] != NULL; i++)
+        ;
+    return i;
+}
+
+int audio_route_transition(struct audio_route *ar, const char *const *from_paths,
+                           const char *const *to_paths, unsigned int *writes_saved)
+{
+    struct route_transition transition;
+    unsigned int num_from = path_list_length(from_paths);
+    unsigned int num_to = path_list_length(to_paths);
+    struct mixer_path **paths;
+    size_t num_settings = 0;
+    size_t arena_size = 0;
+    unsigned int num_issued = 0;
+    unsigned int i;
+    unsigned int j;
+    int ret = -1;
+
+    if (!ar) {
+        ALOGE("invalid audio_route");
+        return -1;
+    }
+
+    memset(&transition, 0, sizeof(transition));
+    paths = calloc(num_from + num_to + 1, sizeof(*paths));
+    if (!paths)
+        return -1;
+    if (transition_get_paths(ar, from_paths, paths, &num_settings) < 0 ||
+            transition_get_paths(ar, to_paths, paths + num_from, &num_settings) < 0)
+        goto exit;
+
+    /* each setting of each path is simulated at most once, size everything up front */
+    for (i = 0; i < num_from + num_to; i++)
+        for (j = 0; j < paths[i]->length; j++)
+            if (is_supported_ctl_type(paths[i]->setting[j].type))
+                arena_size += transition_value_size(paths[i]->setting[j].num_values,
+                                                    paths[i]->setting[j].type);
+    transition.writes = malloc(num_settings * sizeof(*transition.writes) + 1);
+    transition.arena = malloc(arena_size + 1);
+    if (!transition.writes || !transition.arena) {
+        ALOGE("Unable to allocate path transition");
+        goto exit;
+    }
+
+    for (i = 0; i < num_from; i++) {
+        path_reset(ar, paths[i]);
+        path_update(ar, paths[i], DIRECTION_REVERSE, &transition);
+    }
+    for (i = num_from; i < num_from + num_to; i++) {
+        path_apply(ar, paths[i]);
+        path_update(ar, paths[i], DIRECTION_FORWARD, &transition);
+    }
+
+    /* issue the last write of each control, if it ends up changing the control */
+    for (i = 0; i < transition.num_writes; i++) {
+        unsigned int ctl_index = transition.writes[i];
+        struct mixer_state *ms = &ar->mixer_state[ctl_index];
+
+        if (ms->transition_last_write != i + 1)
+            continue;
+        ms->transition_last_write = 0;
+        if (mixer_values_differ(ms, &ms->transition_saved_value, &ms->old_value)) {
+            mixer_write_values(ms, &ms->old_value);
+            num_issued++;
+        }
+        ms->transition_saved_value.ptr = NULL;
+    }
+
+    ALOGV("%s: %u of %u mixer writes issued", __func__, num_issued, transition.num_writes);
+    if (writes_saved)
+        *writes_saved = transition.num_writes - num_issued;
+    ret = 0;
+
+exit:
+    free(transition.writes);
+    free(transition.arena);
+    free(paths);
+    return ret;
+}
+
 int audio_route_supports_path(struct audio_route *ar, const char *name)
 {
     if (!path_get_by_name(ar, name)) {
@@ -1113,9 +1903,12 @@ int audio_route_supports_path(struct audio_route *ar, const char *name)
     return 0;
 }
 
-struct audio_route *audio_route_init(unsigned int card, const char *xml_path)
+struct audio_route *audio_route_init_with_cache(unsigned int card, const char *xml_path,
+                                                const char *cache_path)
 {
     struct config_parse_state state;
+    struct route_cache_builder cache;
+    uint64_t cache_key = 0;
     XML_Parser parser;
     FILE *file;
     int bytes_read;
@@ -1135,6 +1928,8 @@ struct audio_route *audio_route_init(unsigned int card, const char *xml_path)
     ar->mixer_path = NULL;
     ar->mixer_path_size = 0;
     ar->num_mixer_paths = 0;
+    ar->name_index = NULL;
+    ar->name_index_size = 0;
 
     /* allocate space for and read current mixer settings */
     if (alloc_mixer_state(ar) < 0)
@@ -1151,14 +1946,26 @@ struct audio_route *audio_route_init(unsigned int card, const char *xml_path)
         goto err_fopen;
     }
 
+    memset(&state, 0, sizeof(state));
+    state.ar = ar;
+    memset(&cache, 0, sizeof(cache));
+    if (cache_path != NULL) {
+        if (route_cache_key(ar, file, &cache_key) < 0)
+            goto err_parser_create;
+        if (route_cache_load(ar, cache_path, cache_key) == 0) {
+            ALOGV("loaded routes from %s", cache_path);
+            fclose(file);
+            goto apply;
+        }
+        state.cache = &cache;
+    }
+
     parser = XML_ParserCreate(NULL);
     if (!parser) {
         ALOGE("Failed to create XML parser");
         goto err_parser_create;
     }
 
-    memset(&state, 0, sizeof(state));
-    state.ar = ar;
     XML_SetUserData(parser, &state);
     XML_SetElementHandler(parser, start_tag, end_tag);
 
@@ -1181,19 +1988,26 @@ struct audio_route *audio_route_init(unsigned int card, const char *xml_path)
             break;
     }
 
+    /* a cache that can't be written only costs the next init a parse */
+    if (state.cache != NULL)
+        route_cache_store(ar, state.cache, cache_path, cache_key);
+    route_cache_builder_free(&cache);
+
+    XML_ParserFree(parser);
+    fclose(file);
+
+apply:
     /* apply the initial mixer values, and save them so we can reset the
        mixer to the original values */
     audio_route_update_mixer(ar);
     save_mixer_state(ar);
-
-    XML_ParserFree(parser);
-    fclose(file);
     return ar;
 
 err_parse:
     path_free(ar);
     XML_ParserFree(parser);
 err_parser_create:
+    route_cache_builder_free(&cache);
     fclose(file);
 err_fopen:
     free_mixer_state(ar);
@@ -1206,6 +2020,11 @@ err_calloc:
     return NULL;
 }
 
+struct audio_route *audio_route_init(unsigned int card, const char *xml_path)
+{
+    return audio_route_init_with_cache(card, xml_path, NULL);
+}
+
 void audio_route_free(struct audio_route *ar)
 {
     free_mixer_state(ar);
@@ -0,0 +1,218 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <audio_route/audio_route.h>
+
+#include <string>
+
+#include <android-base/file.h>
+#include <benchmark/benchmark.h>
+
+#include "fake_mixer.h"
+
+/*
+All benchmarks run against the in-memory fake mixer, so they measure audio_route
+itself and not the kernel. The card has the given number of controls and
+kNumPaths paths of kCtlsPerPath controls each, plus a common sub path of
+kCtlsPerPath controls shared by every path.
+
+BM_DeviceSwitch measures a device switch: reset one path, apply another,
+then audio_route_update_mixer().
+BM_UpdateMixerIdle measures audio_route_update_mixer() with nothing changed.
+BM_UpdateMixerReset measures audio_route_reset() and audio_route_update_mixer(),
+the worst case where every control is dirty.
+BM_Transition measures a device switch with audio_route_transition().
+BM_TransitionSequence measures the same switch made with
+audio_route_reset_and_update_path() then audio_route_apply_and_update_path().
+The "writes" counter is the number of mixer writes per switch.
+BM_Init measures audio_route_init(), which parses the XML file.
+BM_InitCached measures audio_route_init_with_cache() loading a compiled cache.
+The fake mixer looks controls up by name in constant time where tinyalsa
+compares every name, so on a real card the parse is slower than shown.
+
+The argument is the number of mixer controls.
+
+BM_SupportsPath measures audio_route_supports_path() for the last path of the
+file, where the argument is the number of paths.
+ */
+
+static constexpr int kNumPaths = 100;
+static constexpr int kCtlsPerPath = 16;
+
+static std::string ctlName(int i) {
+    return "Ctl " + std::to_string(i);
+}
+
+static std::string pathName(int i) {
+    return "path-" + std::to_string(i);
+}
+
+// Creates numCtls controls on the fake mixer and returns matching mixer paths XML.
+static std::string setupCard(int numCtls, int numPaths) {
+    fake_mixer::reset();
+    for (int i = 0; i < numCtls; ++i) {
+        fake_mixer::addCtl(ctlName(i), MIXER_CTL_TYPE_INT, 2);
+    }
+
+    std::string xml = "<mixer>\n";
+    for (int i = 0; i < numCtls; i += 4) {
+        xml += "<ctl name=\"" + ctlName(i) + "\" value=\"0 0\" />\n";
+    }
+    xml += "<path name=\"common\">\n";
+    for (int c = 0; c < kCtlsPerPath; ++c) {
+        xml += "<ctl name=\"" + ctlName(numCtls - 1 - c) + "\" value=\"1 1\" />\n";
+    }
+    xml += "</path>\n";
+    for (int p = 0; p < numPaths; ++p) {
+        xml += "<path name=\"" + pathName(p) + "\">\n";
+        xml += "<path name=\"common\" />\n";
+        for (int c = 0; c < kCtlsPerPath; ++c) {
+            const int ctl = (p * 7919 + c * 104729) % numCtls;
+            xml += "<ctl name=\"" + ctlName(ctl) + "\" value=\"1 " + std::to_string(p + 1)
+                    + "\" />\n";
+        }
+        xml += "</path>\n";
+    }
+    xml += "</mixer>\n";
+    return xml;
+}
+
+static struct audio_route* initRoute(int numCtls, int numPaths) {
+    android::base::TemporaryFile xmlFile;
+    android::base::WriteStringToFile(setupCard(numCtls, numPaths), xmlFile.path);
+    return audio_route_init(0, xmlFile.path);
+}
+
+static void BM_DeviceSwitch(benchmark::State& state) {
+    struct audio_route* ar = initRoute(state.range(0), kNumPaths);
+    int current = 0;
+
+    for (auto _ : state) {
+        const int next = (current + 1) % kNumPaths;
+        audio_route_reset_path(ar, pathName(current).c_str());
+        audio_route_apply_path(ar, pathName(next).c_str());
+        audio_route_update_mixer(ar);
+        current = next;
+    }
+
+    audio_route_free(ar);
+}
+
+static void BM_UpdateMixerIdle(benchmark::State& state) {
+    struct audio_route* ar = initRoute(state.range(0), kNumPaths);
+
+    for (auto _ : state) {
+        audio_route_update_mixer(ar);
+    }
+
+    audio_route_free(ar);
+}
+
+static void BM_UpdateMixerReset(benchmark::State& state) {
+    struct audio_route* ar = initRoute(state.range(0), kNumPaths);
+    int current = 0;
+
+    for (auto _ : state) {
+        audio_route_apply_path(ar, pathName(current).c_str());
+        audio_route_update_mixer(ar);
+        audio_route_reset(ar);
+        audio_route_update_mixer(ar);
+        current = (current + 1) % kNumPaths;
+    }
+
+    audio_route_free(ar);
+}
+
+static void BenchmarkTransition(benchmark::State& state, bool transition) {
+    struct audio_route* ar = initRoute(state.range(0), kNumPaths);
+    int current = 0;
+    audio_route_apply_and_update_path(ar, pathName(current).c_str());
+    fake_mixer::clearWrites();
+
+    for (auto _ : state) {
+        const int next = (current + 1) % kNumPaths;
+        const std::string from = pathName(current);
+        const std::string to = pathName(next);
+        if (transition) {
+            const char* fromPaths[] = {from.c_str(), nullptr};
+            const char* toPaths[] = {to.c_str(), nullptr};
+            audio_route_transition(ar, fromPaths, toPaths, nullptr);
+        } else {
+            audio_route_reset_and_update_path(ar, from.c_str());
+            audio_route_apply_and_update_path(ar, to.c_str());
+        }
+        current = next;
+    }
+
+    state.counters["writes"] = benchmark::Counter(
+            fake_mixer::writeCount(), benchmark::Counter::kAvgIterations);
+    audio_route_free(ar);
+}
+
+static void BM_Transition(benchmark::State& state) {
+    BenchmarkTransition(state, true /* transition */);
+}
+
+static void BM_TransitionSequence(benchmark::State& state) {
+    BenchmarkTransition(state, false /* transition */);
+}
+
+static void BenchmarkInit(benchmark::State& state, bool cached) {
+    android::base::TemporaryFile xmlFile;
+    android::base::TemporaryFile cacheFile;
+    android::base::WriteStringToFile(setupCard(state.range(0), kNumPaths), xmlFile.path);
+    const char* cachePath = cached ? cacheFile.path : nullptr;
+
+    // compiles the cache
+    audio_route_free(audio_route_init_with_cache(0, xmlFile.path, cachePath));
+
+    for (auto _ : state) {
+        struct audio_route* ar = audio_route_init_with_cache(0, xmlFile.path, cachePath);
+        benchmark::DoNotOptimize(ar);
+        audio_route_free(ar);
+    }
+}
+
+static void BM_Init(benchmark::State& state) {
+    BenchmarkInit(state, false /* cached */);
+}
+
+static void BM_InitCached(benchmark::State& state) {
+    BenchmarkInit(state, true /* cached */);
+}
+
+static void BM_SupportsPath(benchmark::State& state) {
+    const int numPaths = state.range(0);
+    struct audio_route* ar = initRoute(256, numPaths);
+    const std::string name = pathName(numPaths - 1);
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(audio_route_supports_path(ar, name.c_str()));
+    }
+
+    audio_route_free(ar);
+}
+
+BENCHMARK(BM_DeviceSwitch)->Arg(256)->Arg(2048)->Arg(8192);
+BENCHMARK(BM_UpdateMixerIdle)->Arg(256)->Arg(2048)->Arg(8192);
+BENCHMARK(BM_UpdateMixerReset)->Arg(256)->Arg(2048)->Arg(8192);
+BENCHMARK(BM_Transition)->Arg(256)->Arg(2048)->Arg(8192);
+BENCHMARK(BM_TransitionSequence)->Arg(256)->Arg(2048)->Arg(8192);
+BENCHMARK(BM_Init)->Arg(256)->Arg(2048)->Arg(8192);
+BENCHMARK(BM_InitCached)->Arg(256)->Arg(2048)->Arg(8192);
+BENCHMARK(BM_SupportsPath)->Arg(10)->Arg(100)->Arg(1000);
+
+BENCHMARK_MAIN();
@@ -25,6 +25,15 @@ extern "C" {
 struct audio_route *audio_route_init(unsigned int card, const char *xml_path);
 void audio_route_free(struct audio_route *ar);
 
+/*
+ * Initialize the audio routes from a compiled cache of the XML file at cache_path,
+ * if it matches both the XML file and the controls of the card. Otherwise the XML
+ * file is parsed as by audio_route_init() and the cache is rewritten.
+ * A NULL cache_path behaves as audio_route_init().
+ */
+struct audio_route *audio_route_init_with_cache(unsigned int card, const char *xml_path,
+                                                const char *cache_path);
+
 /* Apply an audio route path by name */
 int audio_route_apply_path(struct audio_route *ar, const char *name);
 
@@ -40,6 +49,19 @@ int audio_route_reset_and_update_path(struct audio_route *ar, const char *name);
 /* Reset and update mixer with audio route path by name forcely */
 int audio_route_force_reset_and_update_path(struct audio_route *ar, const char *name);
 
+/*
+ * Switch from one set of audio route paths to another. The result is the same as
+ * calling audio_route_reset_and_update_path() on each path of from_paths, then
+ * audio_route_apply_and_update_path() on each path of to_paths, active counts
+ * included, but each mixer control is written at most once, in the order of its
+ * last write in that sequence, and only if its final value differs from the
+ * current one. Both lists are NULL terminated, and either may be NULL.
+ * If writes_saved is not NULL it receives the number of mixer writes avoided.
+ * Returns -1 without changing anything if a path doesn't exist.
+ */
+int audio_route_transition(struct audio_route *ar, const char *const *from_paths,
+                           const char *const *to_paths, unsigned int *writes_saved);
+
 /* Reset the audio routes back to the initial state */
 void audio_route_reset(struct audio_route *ar);
 
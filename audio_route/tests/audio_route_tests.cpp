@@ -0,0 +1,455 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <audio_route/audio_route.h>
+
+#include <fstream>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+#include <unistd.h>
+
+#include "fake_mixer.h"
+
+static constexpr const char* kMixerPaths = R"(<mixer>
+    <ctl name="Speaker Volume" value="10" />
+    <ctl name="Mic Mux" value="Main" />
+    <path name="speaker">
+        <ctl name="Speaker Switch" value="1" />
+        <ctl name="Speaker Volume" value="80" />
+        <ctl name="DAC Mux" value="Speaker" />
+    </path>
+    <path name="headphones">
+        <ctl name="Headphone Switch" value="1" />
+        <ctl name="Headphone Volume" value="40 50" />
+        <ctl name="DAC Mux" value="Headphone" />
+    </path>
+    <path name="speaker-and-headphones">
+        <path name="speaker" />
+        <path name="headphones" />
+    </path>
+    <path name="voice-mic">
+        <ctl name="Mic Mux" value="Aux" />
+        <ctl name="Mic EQ" value="01 02 03 04" />
+    </path>
+</mixer>
+)";
+
+class AudioRouteTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        addControls();
+
+        mXmlPath = ::testing::TempDir() + "audio_route_tests_mixer_paths.xml";
+        mCachePath = ::testing::TempDir() + "audio_route_tests_mixer_paths.cache";
+        mBinPath = ::testing::TempDir() + "audio_route_tests_eq.bin";
+        unlink(mCachePath.c_str());
+        writeXml(kMixerPaths);
+    }
+
+    static void addControls() {
+        fake_mixer::reset();
+        fake_mixer::addCtl("Speaker Switch", MIXER_CTL_TYPE_BOOL, 1);
+        fake_mixer::addCtl("Speaker Volume", MIXER_CTL_TYPE_INT, 1);
+        fake_mixer::addCtl("Headphone Switch", MIXER_CTL_TYPE_BOOL, 1);
+        fake_mixer::addCtl("Headphone Volume", MIXER_CTL_TYPE_INT, 2);
+        fake_mixer::addCtl("DAC Mux", MIXER_CTL_TYPE_ENUM, 1, {"Off", "Speaker", "Headphone"});
+        fake_mixer::addCtl("Mic Mux", MIXER_CTL_TYPE_ENUM, 1, {"Off", "Main", "Aux"});
+        fake_mixer::addCtl("Mic EQ", MIXER_CTL_TYPE_BYTE, 4);
+        fake_mixer::addCtl("Unused", MIXER_CTL_TYPE_INT, 1);
+    }
+
+    void TearDown() override {
+        if (mAr != nullptr) audio_route_free(mAr);
+        unlink(mXmlPath.c_str());
+        unlink(mCachePath.c_str());
+        unlink(mBinPath.c_str());
+    }
+
+    void writeXml(const std::string& xml) {
+        std::ofstream(mXmlPath) << xml;
+    }
+
+    void init() {
+        mAr = audio_route_init(0, mXmlPath.c_str());
+        ASSERT_NE(nullptr, mAr);
+        fake_mixer::clearWrites();
+    }
+
+    // returns true if the routes were loaded from the cache, i.e. the XML was not parsed
+    bool initWithCache() {
+        if (mAr != nullptr) audio_route_free(mAr);
+        const size_t lookups = fake_mixer::lookupCount();
+        mAr = audio_route_init_with_cache(0, mXmlPath.c_str(), mCachePath.c_str());
+        EXPECT_NE(nullptr, mAr);
+        fake_mixer::clearWrites();
+        return fake_mixer::lookupCount() == lookups;
+    }
+
+    std::string mXmlPath;
+    std::string mCachePath;
+    std::string mBinPath;
+    struct audio_route* mAr = nullptr;
+};
+
+TEST_F(AudioRouteTest, initial_settings) {
+    init();
+    EXPECT_EQ(10, fake_mixer::getValue("Speaker Volume"));
+    EXPECT_EQ(1, fake_mixer::getValue("Mic Mux"));
+    EXPECT_EQ(0, fake_mixer::getValue("Speaker Switch"));
+}
+
+TEST_F(AudioRouteTest, supports_path) {
+    std::string xml = "<mixer>\n";
+    for (int i = 0; i < 500; ++i) {
+        xml += "<path name=\"path-" + std::to_string(i) + "\">"
+                "<ctl name=\"Speaker Volume\" value=\"" + std::to_string(i) + "\" /></path>\n";
+    }
+    // duplicates are ignored, the first definition wins
+    xml += "<path name=\"path-7\"><ctl name=\"Speaker Switch\" value=\"1\" /></path>\n";
+    xml += "</mixer>\n";
+    writeXml(xml);
+    init();
+
+    for (int i = 0; i < 500; ++i) {
+        const std::string name = "path-" + std::to_string(i);
+        ASSERT_EQ(0, audio_route_supports_path(mAr, name.c_str())) << name;
+    }
+    EXPECT_EQ(-1, audio_route_supports_path(mAr, "path-500"));
+    EXPECT_EQ(-1, audio_route_supports_path(mAr, ""));
+    EXPECT_EQ(-1, audio_route_apply_path(mAr, "path"));
+
+    ASSERT_EQ(0, audio_route_apply_path(mAr, "path-7"));
+    audio_route_update_mixer(mAr);
+    EXPECT_EQ(7, fake_mixer::getValue("Speaker Volume"));
+    EXPECT_EQ(0, fake_mixer::getValue("Speaker Switch"));
+}
+
+TEST_F(AudioRouteTest, update_mixer_writes_changed_controls) {
+    init();
+
+    // nothing changed since init
+    audio_route_update_mixer(mAr);
+    EXPECT_EQ(0u, fake_mixer::writeCount());
+
+    ASSERT_EQ(0, audio_route_apply_path(mAr, "speaker"));
+    audio_route_update_mixer(mAr);
+    EXPECT_EQ((std::vector<std::string>{"Speaker Switch", "Speaker Volume", "DAC Mux"}),
+              fake_mixer::writeLog());
+    EXPECT_EQ(1, fake_mixer::getValue("Speaker Switch"));
+    EXPECT_EQ(80, fake_mixer::getValue("Speaker Volume"));
+    EXPECT_EQ(1, fake_mixer::getValue("DAC Mux"));
+
+    // applying again dirties the controls but does not change their values
+    fake_mixer::clearWrites();
+    ASSERT_EQ(0, audio_route_apply_path(mAr, "speaker"));
+    audio_route_update_mixer(mAr);
+    EXPECT_EQ(0u, fake_mixer::writeCount());
+
+    // only the controls that differ between the paths are written, in control order
+    ASSERT_EQ(0, audio_route_reset_path(mAr, "speaker"));
+    ASSERT_EQ(0, audio_route_apply_path(mAr, "speaker-and-headphones"));
+    audio_route_update_mixer(mAr);
+    EXPECT_EQ((std::vector<std::string>{"Headphone Switch", "Headphone Volume"}),
+              fake_mixer::writeLog());
+    EXPECT_EQ(40, fake_mixer::getValue("Headphone Volume", 0));
+    EXPECT_EQ(50, fake_mixer::getValue("Headphone Volume", 1));
+    EXPECT_EQ(1, fake_mixer::getValue("DAC Mux"));
+
+    fake_mixer::clearWrites();
+    ASSERT_EQ(0, audio_route_reset_path(mAr, "speaker-and-headphones"));
+    audio_route_update_mixer(mAr);
+    EXPECT_EQ(5u, fake_mixer::writeCount());
+    EXPECT_EQ(0, fake_mixer::getValue("Speaker Switch"));
+    EXPECT_EQ(10, fake_mixer::getValue("Speaker Volume"));
+    EXPECT_EQ(0, fake_mixer::getValue("Headphone Volume", 1));
+    EXPECT_EQ(0, fake_mixer::getValue("DAC Mux"));
+}
+
+TEST_F(AudioRouteTest, reset_restores_initial_state) {
+    init();
+    ASSERT_EQ(0, audio_route_apply_path(mAr, "headphones"));
+    ASSERT_EQ(0, audio_route_apply_path(mAr, "voice-mic"));
+    audio_route_update_mixer(mAr);
+    EXPECT_EQ(2, fake_mixer::getValue("Mic Mux"));
+    EXPECT_EQ(3, fake_mixer::getValue("Mic EQ", 2));
+
+    fake_mixer::clearWrites();
+    audio_route_reset(mAr);
+    audio_route_update_mixer(mAr);
+    EXPECT_EQ(5u, fake_mixer::writeCount());
+    EXPECT_EQ(0, fake_mixer::getValue("Headphone Switch"));
+    EXPECT_EQ(1, fake_mixer::getValue("Mic Mux"));
+    EXPECT_EQ(0, fake_mixer::getValue("Mic EQ", 2));
+}
+
+TEST_F(AudioRouteTest, update_path_shared_controls) {
+    init();
+    ASSERT_EQ(0, audio_route_apply_and_update_path(mAr, "speaker"));
+    ASSERT_EQ(0, audio_route_apply_and_update_path(mAr, "speaker-and-headphones"));
+    EXPECT_EQ(1, fake_mixer::getValue("Headphone Switch"));
+
+    // "speaker" controls stay set while "speaker-and-headphones" is active
+    fake_mixer::clearWrites();
+    ASSERT_EQ(0, audio_route_reset_and_update_path(mAr, "speaker"));
+    EXPECT_EQ(0u, fake_mixer::writeCount());
+    EXPECT_EQ(1, fake_mixer::getValue("Speaker Switch"));
+
+    // a later full update must not undo the skipped reset
+    audio_route_update_mixer(mAr);
+    EXPECT_EQ(0u, fake_mixer::writeCount());
+
+    ASSERT_EQ(0, audio_route_reset_and_update_path(mAr, "speaker-and-headphones"));
+    EXPECT_EQ(0, fake_mixer::getValue("Speaker Switch"));
+    EXPECT_EQ(0, fake_mixer::getValue("Headphone Switch"));
+}
+
+TEST_F(AudioRouteTest, cache) {
+    ASSERT_FALSE(initWithCache());
+    ASSERT_EQ(0, access(mCachePath.c_str(), R_OK));
+    ASSERT_TRUE(initWithCache());
+
+    // initial settings are applied from the cache
+    audio_route_free(mAr);
+    mAr = nullptr;
+    fake_mixer::setValue("Speaker Volume", 0, 0);
+    ASSERT_TRUE(initWithCache());
+    EXPECT_EQ(10, fake_mixer::getValue("Speaker Volume"));
+    EXPECT_EQ(1, fake_mixer::getValue("Mic Mux"));
+
+    // paths are loaded from the cache, including nested ones
+    EXPECT_EQ(0, audio_route_supports_path(mAr, "voice-mic"));
+    EXPECT_EQ(-1, audio_route_supports_path(mAr, "voice"));
+    ASSERT_EQ(0, audio_route_apply_path(mAr, "speaker-and-headphones"));
+    ASSERT_EQ(0, audio_route_apply_path(mAr, "voice-mic"));
+    audio_route_update_mixer(mAr);
+    EXPECT_EQ(80, fake_mixer::getValue("Speaker Volume"));
+    EXPECT_EQ(50, fake_mixer::getValue("Headphone Volume", 1));
+    EXPECT_EQ(1, fake_mixer::getValue("DAC Mux"));
+    EXPECT_EQ(2, fake_mixer::getValue("Mic Mux"));
+    EXPECT_EQ(4, fake_mixer::getValue("Mic EQ", 3));
+
+    audio_route_reset(mAr);
+    audio_route_update_mixer(mAr);
+    EXPECT_EQ(10, fake_mixer::getValue("Speaker Volume"));
+    EXPECT_EQ(0, fake_mixer::getValue("Mic EQ", 3));
+}
+
+TEST_F(AudioRouteTest, cache_partial_initial_setting) {
+    writeXml(R"(<mixer>
+        <ctl name="Headphone Volume" id="1" value="7" />
+    </mixer>)");
+    ASSERT_FALSE(initWithCache());
+    audio_route_free(mAr);
+    mAr = nullptr;
+
+    // values not named by the id keep what the card reports
+    fake_mixer::setValue("Headphone Volume", 0, 3);
+    fake_mixer::setValue("Headphone Volume", 1, 0);
+    ASSERT_TRUE(initWithCache());
+    EXPECT_EQ(3, fake_mixer::getValue("Headphone Volume", 0));
+    EXPECT_EQ(7, fake_mixer::getValue("Headphone Volume", 1));
+}
+
+TEST_F(AudioRouteTest, cache_invalidation) {
+    ASSERT_FALSE(initWithCache());
+
+    // the XML changed
+    std::string xml = kMixerPaths;
+    xml.replace(xml.find("value=\"80\""), 10, "value=\"90\"");
+    writeXml(xml);
+    ASSERT_FALSE(initWithCache());
+    ASSERT_TRUE(initWithCache());
+    ASSERT_EQ(0, audio_route_apply_path(mAr, "speaker"));
+    audio_route_update_mixer(mAr);
+    EXPECT_EQ(90, fake_mixer::getValue("Speaker Volume"));
+
+    // the card's controls changed
+    fake_mixer::addCtl("New Switch", MIXER_CTL_TYPE_BOOL, 1);
+    ASSERT_FALSE(initWithCache());
+    ASSERT_TRUE(initWithCache());
+}
+
+TEST_F(AudioRouteTest, cache_bin_file) {
+    std::ofstream(mBinPath) << std::string("\x01\x02\x03\x04", 4);
+    writeXml(R"(<mixer>
+        <path name="eq">
+            <ctl name="Mic EQ" bin=")" + mBinPath + R"(" />
+        </path>
+    </mixer>)");
+    ASSERT_FALSE(initWithCache());
+    ASSERT_TRUE(initWithCache());
+
+    std::ofstream(mBinPath) << std::string("\x05\x06\x07\x08", 4);
+    ASSERT_FALSE(initWithCache());
+    ASSERT_EQ(0, audio_route_apply_path(mAr, "eq"));
+    audio_route_update_mixer(mAr);
+    EXPECT_EQ(8, fake_mixer::getValue("Mic EQ", 3));
+}
+
+TEST_F(AudioRouteTest, cache_corrupt) {
+    ASSERT_FALSE(initWithCache());
+
+    std::string data;
+    {
+        std::ifstream in(mCachePath, std::ios::binary);
+        data.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    }
+    ASSERT_GT(data.size(), 64u);
+
+    // truncated, then with a corrupted value
+    std::ofstream(mCachePath, std::ios::binary) << data.substr(0, data.size() / 2);
+    ASSERT_FALSE(initWithCache());
+    std::string corrupt = data;
+    corrupt[corrupt.size() - 24] = '\xff';
+    std::ofstream(mCachePath, std::ios::binary) << corrupt;
+    EXPECT_FALSE(initWithCache());
+
+    ASSERT_EQ(0, audio_route_apply_path(mAr, "voice-mic"));
+    audio_route_update_mixer(mAr);
+    EXPECT_EQ(2, fake_mixer::getValue("Mic Mux"));
+    EXPECT_EQ(3, fake_mixer::getValue("Mic EQ", 2));
+}
+
+class AudioRouteTransitionTest : public AudioRouteTest {
+protected:
+    struct Result {
+        std::map<std::string, std::vector<long>> values;
+        std::vector<std::string> writeLog;
+        size_t writes;
+        unsigned int saved;
+        // after resetting the "to" paths and then the "active" ones
+        std::map<std::string, std::vector<long>> valuesAfterReset;
+    };
+
+    static std::vector<const char*> toList(const std::vector<std::string>& names) {
+        std::vector<const char*> list;
+        for (const auto& name : names) list.push_back(name.c_str());
+        list.push_back(nullptr);
+        return list;
+    }
+
+    // Activates the active paths on a fresh card, then switches from one set of paths
+    // to the other either with audio_route_transition() or one path at a time.
+    Result run(const std::vector<std::string>& active, const std::vector<std::string>& from,
+               const std::vector<std::string>& to, bool transition) {
+        Result result{};
+        if (mAr != nullptr) audio_route_free(mAr);
+        mAr = nullptr;
+        addControls();
+        init();
+        for (const auto& name : active) {
+            EXPECT_EQ(0, audio_route_apply_and_update_path(mAr, name.c_str()));
+        }
+
+        fake_mixer::clearWrites();
+        if (transition) {
+            EXPECT_EQ(0, audio_route_transition(mAr, toList(from).data(), toList(to).data(),
+                                                &result.saved));
+        } else {
+            for (const auto& name : from) {
+                EXPECT_EQ(0, audio_route_reset_and_update_path(mAr, name.c_str()));
+            }
+            for (const auto& name : to) {
+                EXPECT_EQ(0, audio_route_apply_and_update_path(mAr, name.c_str()));
+            }
+        }
+        result.writes = fake_mixer::writeCount();
+        result.writeLog = fake_mixer::writeLog();
+        result.values = fake_mixer::getValues();
+
+        for (const auto& name : to) {
+            EXPECT_EQ(0, audio_route_reset_and_update_path(mAr, name.c_str()));
+        }
+        for (const auto& name : active) {
+            audio_route_reset_and_update_path(mAr, name.c_str());
+        }
+        result.valuesAfterReset = fake_mixer::getValues();
+        return result;
+    }
+
+    // Checks that the transition ends in the same state as the path by path sequence.
+    Result expectTransition(const std::vector<std::string>& active,
+                          const std::vector<std::string>& from,
+                          const std::vector<std::string>& to, unsigned int expectedSaved) {
+        const Result sequence = run(active, from, to, false /* transition */);
+        const Result transition = run(active, from, to, true /* transition */);
+        EXPECT_EQ(sequence.values, transition.values);
+        EXPECT_EQ(sequence.valuesAfterReset, transition.valuesAfterReset);
+        EXPECT_EQ(expectedSaved, transition.saved);
+        EXPECT_EQ(sequence.writes, transition.writes + transition.saved);
+        return transition;
+    }
+};
+
+TEST_F(AudioRouteTransitionTest, switch_paths) {
+    const Result result =
+            expectTransition({"speaker"}, {"speaker"}, {"headphones"}, 1 /* DAC Mux */);
+
+    // the last write of each control is kept, in order
+    EXPECT_EQ((std::vector<std::string>{"Speaker Volume", "Speaker Switch", "Headphone Switch",
+                                        "Headphone Volume", "DAC Mux"}),
+              result.writeLog);
+}
+
+TEST_F(AudioRouteTransitionTest, shared_controls) {
+    // the speaker controls are reset then applied again with the same values
+    Result result = expectTransition({"speaker-and-headphones"}, {"speaker-and-headphones"},
+                                     {"speaker"}, 6);
+    EXPECT_EQ((std::vector<std::string>{"Headphone Volume", "Headphone Switch"}),
+              result.writeLog);
+
+    result = expectTransition({"speaker"}, {"speaker"}, {"speaker"}, 6);
+    EXPECT_EQ(0u, result.writes);
+}
+
+TEST_F(AudioRouteTransitionTest, active_count) {
+    // "speaker" keeps its controls while "speaker-and-headphones" goes away
+    const Result result = expectTransition({"speaker", "speaker-and-headphones"},
+                                           {"speaker-and-headphones"}, {"voice-mic"}, 0);
+    EXPECT_EQ(std::vector<long>{1}, result.values.at("Speaker Switch"));
+    EXPECT_EQ(std::vector<long>{0}, result.values.at("Headphone Switch"));
+
+    // headphone controls are reset then applied again, the speaker ones are reset
+    expectTransition({"speaker", "speaker-and-headphones"},
+                     {"speaker-and-headphones", "speaker"}, {"headphones"}, 5);
+    expectTransition({}, {}, {"speaker", "speaker-and-headphones", "voice-mic"}, 0);
+}
+
+TEST_F(AudioRouteTransitionTest, invalid) {
+    init();
+    ASSERT_EQ(0, audio_route_apply_and_update_path(mAr, "speaker"));
+    fake_mixer::clearWrites();
+    const auto values = fake_mixer::getValues();
+
+    const char* from[] = {"speaker", nullptr};
+    const char* to[] = {"headphones", "none", nullptr};
+    unsigned int saved = 1234;
+    EXPECT_EQ(-1, audio_route_transition(mAr, from, to, &saved));
+    EXPECT_EQ(1234u, saved);
+    EXPECT_EQ(0u, fake_mixer::writeCount());
+    EXPECT_EQ(values, fake_mixer::getValues());
+
+    EXPECT_EQ(0, audio_route_transition(mAr, nullptr, nullptr, &saved));
+    EXPECT_EQ(0u, saved);
+    EXPECT_EQ(0u, fake_mixer::writeCount());
+
+    // speaker is still active once
+    ASSERT_EQ(0, audio_route_reset_and_update_path(mAr, "speaker"));
+    EXPECT_EQ(0, fake_mixer::getValue("Speaker Switch"));
+}
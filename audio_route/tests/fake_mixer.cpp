@@ -0,0 +1,203 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "fake_mixer.h"
+
+#include <errno.h>
+
+#include <memory>
+#include <unordered_map>
+
+struct mixer_ctl {
+    std::string name;
+    enum mixer_ctl_type type;
+    std::vector<long> values;
+    std::vector<std::string> enums;
+    bool tlv;
+};
+
+struct mixer {
+    std::vector<std::unique_ptr<mixer_ctl>> ctls;
+    std::unordered_map<std::string, mixer_ctl*> byName;
+    std::vector<std::string> writes;
+    size_t lookups = 0;
+};
+
+static mixer gMixer;
+
+static void recordWrite(struct mixer_ctl* ctl) {
+    gMixer.writes.push_back(ctl->name);
+}
+
+namespace fake_mixer {
+
+void reset() {
+    gMixer.ctls.clear();
+    gMixer.byName.clear();
+    gMixer.writes.clear();
+    gMixer.lookups = 0;
+}
+
+void addCtl(const std::string& name, enum mixer_ctl_type type, unsigned int numValues,
+            const std::vector<std::string>& enums, bool tlv) {
+    auto ctl = std::make_unique<mixer_ctl>();
+    ctl->name = name;
+    ctl->type = type;
+    ctl->values.assign(numValues, 0);
+    ctl->enums = enums;
+    ctl->tlv = tlv;
+    gMixer.byName[name] = ctl.get();
+    gMixer.ctls.push_back(std::move(ctl));
+}
+
+long getValue(const std::string& name, unsigned int id) {
+    return gMixer.byName.at(name)->values.at(id);
+}
+
+void setValue(const std::string& name, unsigned int id, long value) {
+    gMixer.byName.at(name)->values.at(id) = value;
+}
+
+std::map<std::string, std::vector<long>> getValues() {
+    std::map<std::string, std::vector<long>> values;
+    for (const auto& ctl : gMixer.ctls) {
+        values[ctl->name] = ctl->values;
+    }
+    return values;
+}
+
+size_t writeCount() {
+    return gMixer.writes.size();
+}
+
+const std::vector<std::string>& writeLog() {
+    return gMixer.writes;
+}
+
+void clearWrites() {
+    gMixer.writes.clear();
+}
+
+size_t lookupCount() {
+    return gMixer.lookups;
+}
+
+}  // namespace fake_mixer
+
+extern "C" {
+
+struct mixer *mixer_open(unsigned int /* card */) {
+    return &gMixer;
+}
+
+void mixer_close(struct mixer * /* mixer */) {
+}
+
+const char *mixer_get_name(struct mixer * /* mixer */) {
+    return "fake_mixer";
+}
+
+unsigned int mixer_get_num_ctls(struct mixer *mixer) {
+    return mixer->ctls.size();
+}
+
+struct mixer_ctl *mixer_get_ctl(struct mixer *mixer, unsigned int id) {
+    return id < mixer->ctls.size() ? mixer->ctls[id].get() : nullptr;
+}
+
+struct mixer_ctl *mixer_get_ctl_by_name(struct mixer *mixer, const char *name) {
+    if (name == nullptr) return nullptr;
+    mixer->lookups++;
+    auto it = mixer->byName.find(name);
+    return it != mixer->byName.end() ? it->second : nullptr;
+}
+
+const char *mixer_ctl_get_name(struct mixer_ctl *ctl) {
+    return ctl->name.c_str();
+}
+
+enum mixer_ctl_type mixer_ctl_get_type(struct mixer_ctl *ctl) {
+    return ctl->type;
+}
+
+const char *mixer_ctl_get_type_string(struct mixer_ctl *ctl) {
+    switch (ctl->type) {
+    case MIXER_CTL_TYPE_BOOL: return "BOOL";
+    case MIXER_CTL_TYPE_INT: return "INT";
+    case MIXER_CTL_TYPE_ENUM: return "ENUM";
+    case MIXER_CTL_TYPE_BYTE: return "BYTE";
+    default: return "Unknown";
+    }
+}
+
+unsigned int mixer_ctl_get_num_values(struct mixer_ctl *ctl) {
+    return ctl->values.size();
+}
+
+unsigned int mixer_ctl_get_num_enums(struct mixer_ctl *ctl) {
+    return ctl->enums.size();
+}
+
+const char *mixer_ctl_get_enum_string(struct mixer_ctl *ctl, unsigned int enum_id) {
+    return enum_id < ctl->enums.size() ? ctl->enums[enum_id].c_str() : nullptr;
+}
+
+int mixer_ctl_is_access_tlv_rw(struct mixer_ctl *ctl) {
+    return ctl->tlv;
+}
+
+int mixer_ctl_get_value(struct mixer_ctl *ctl, unsigned int id) {
+    return id < ctl->values.size() ? ctl->values[id] : -EINVAL;
+}
+
+// Mirrors tinyalsa: BOOL and INT arrays are long, BYTE arrays are unsigned char.
+int mixer_ctl_get_array(struct mixer_ctl *ctl, void *array, size_t count) {
+    if (array == nullptr || count > ctl->values.size()) return -EINVAL;
+    for (size_t i = 0; i < count; ++i) {
+        if (ctl->type == MIXER_CTL_TYPE_BYTE) {
+            static_cast<unsigned char*>(array)[i] = ctl->values[i];
+        } else if (ctl->type == MIXER_CTL_TYPE_ENUM) {
+            static_cast<int*>(array)[i] = ctl->values[i];
+        } else {
+            static_cast<long*>(array)[i] = ctl->values[i];
+        }
+    }
+    return 0;
+}
+
+int mixer_ctl_set_value(struct mixer_ctl *ctl, unsigned int id, int value) {
+    if (id >= ctl->values.size()) return -EINVAL;
+    recordWrite(ctl);
+    ctl->values[id] = value;
+    return 0;
+}
+
+int mixer_ctl_set_array(struct mixer_ctl *ctl, const void *array, size_t count) {
+    if (array == nullptr || count > ctl->values.size()) return -EINVAL;
+    recordWrite(ctl);
+    for (size_t i = 0; i < count; ++i) {
+        if (ctl->type == MIXER_CTL_TYPE_BYTE) {
+            ctl->values[i] = static_cast<const unsigned char*>(array)[i];
+        } else if (ctl->type == MIXER_CTL_TYPE_ENUM) {
+            ctl->values[i] = static_cast<const int*>(array)[i];
+        } else {
+            ctl->values[i] = static_cast<const long*>(array)[i];
+        }
+    }
+    return 0;
+}
+
+}  // extern "C"
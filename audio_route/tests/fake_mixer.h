@@ -0,0 +1,59 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include <tinyalsa/asoundlib.h>
+
+/*
+ * An in-memory stand-in for the tinyalsa mixer API, used by the audio_route
+ * tests and benchmarks in place of libtinyalsa.
+ *
+ * The fake holds a single card: mixer_open() returns it for any card number
+ * and mixer_close() leaves its controls in place, so a test describes the
+ * controls first, runs audio_route against them, then inspects the values
+ * and the writes that were issued.
+ */
+namespace fake_mixer {
+
+// Removes all controls and clears the write log.
+void reset();
+
+// Adds a control with all values zero. Enum controls take their value strings from enums.
+void addCtl(const std::string& name, enum mixer_ctl_type type, unsigned int numValues,
+            const std::vector<std::string>& enums = {}, bool tlv = false);
+
+// Reads or writes a control value directly, without going through the write log.
+long getValue(const std::string& name, unsigned int id = 0);
+void setValue(const std::string& name, unsigned int id, long value);
+// Returns the values of all controls, by name.
+std::map<std::string, std::vector<long>> getValues();
+
+// Each mixer_ctl_set_value() or mixer_ctl_set_array() call is one write,
+// standing in for one SNDRV_CTL_IOCTL_ELEM_WRITE ioctl.
+size_t writeCount();
+// The names of the controls written, in order.
+const std::vector<std::string>& writeLog();
+void clearWrites();
+
+// The number of mixer_get_ctl_by_name() calls since the last reset().
+size_t lookupCount();
+
+}  // namespace fake_mixer
@@ -0,0 +1,269 @@
+/*
+ * Copyright 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// #define LOG_NDEBUG 0
+#define LOG_TAG "audio_utils_FloatFFT"
+
+#include <math.h>
+
+#include <log/log.h>
+
+#include <audio_utils/FloatFFT.h>
+#include <audio_utils/intrinsic_utils.h>
+
+#if defined(__aarch64__) || defined(__ARM_NEON__)
+#define USE_NEON
+#endif
+
+namespace android::audio_utils {
+
+namespace {
+
+using namespace intrinsics;
+
+#ifdef USE_NEON
+using Vector = float32x4_t;
+#else
+using Vector = internal_array_t<float, 8>;
+#endif
+constexpr size_t kVectorWidth = sizeof(Vector) / sizeof(float);
+
+// (re, im) *= (wr, wi)
+template <typename V>
+inline void complexMultiply(V& re, V& im, const V& wr, const V& wi) {
+    const V r = vsub(vmul(re, wr), vmul(im, wi));
+    im = vmla(vmul(re, wi), im, wr);
+    re = r;
+}
+
+// One radix-4 decimation in time stage, combining four transforms of size L
+// (stored consecutively in bit reversed order) into one transform of size 4L.
+// V is either float, for L < kVectorWidth, or Vector.
+template <typename V>
+void radix4Stage(float *re, float *im, size_t n, size_t L, const float *twiddles) {
+    constexpr size_t kWidth = sizeof(V) / sizeof(float);
+    const float *w1r = twiddles;
+    const float *w1i = w1r + L;
+    const float *w2r = w1i + L;
+    const float *w2i = w2r + L;
+    const float *w3r = w2i + L;
+    const float *w3i = w3r + L;
+    for (size_t base = 0; base < n; base += 4 * L) {
+        float *r0 = re + base;
+        float *i0 = im + base;
+        float *r1 = r0 + L;
+        float *i1 = i0 + L;
+        float *r2 = r1 + L;
+        float *i2 = i1 + L;
+        float *r3 = r2 + L;
+        float *i3 = i2 + L;
+        for (size_t k = 0; k < L; k += kWidth) {
+            const V a0r = vld1<V>(r0 + k);
+            const V a0i = vld1<V>(i0 + k);
+            V a1r = vld1<V>(r1 + k);
+            V a1i = vld1<V>(i1 + k);
+            V a2r = vld1<V>(r2 + k);
+            V a2i = vld1<V>(i2 + k);
+            V a3r = vld1<V>(r3 + k);
+            V a3i = vld1<V>(i3 + k);
+            complexMultiply(a1r, a1i, vld1<V>(w2r + k), vld1<V>(w2i + k));
+            complexMultiply(a2r, a2i, vld1<V>(w1r + k), vld1<V>(w1i + k));
+            complexMultiply(a3r, a3i, vld1<V>(w3r + k), vld1<V>(w3i + k));
+
+            const V s01r = vadd(a0r, a1r);
+            const V s01i = vadd(a0i, a1i);
+            const V d01r = vsub(a0r, a1r);
+            const V d01i = vsub(a0i, a1i);
+            const V s23r = vadd(a2r, a3r);
+            const V s23i = vadd(a2i, a3i);
+            const V d23r = vsub(a2r, a3r);
+            const V d23i = vsub(a2i, a3i);
+
+            vst1(r0 + k, vadd(s01r, s23r));
+            vst1(i0 + k, vadd(s01i, s23i));
+            vst1(r2 + k, vsub(s01r, s23r));
+            vst1(i2 + k, vsub(s01i, s23i));
+            // multiply d23 by -i for r1, and by i for r3.
+            vst1(r1 + k, vadd(d01r, d23i));
+            vst1(i1 + k, vsub(d01i, d23r));
+            vst1(r3 + k, vsub(d01r, d23i));
+            vst1(i3 + k, vadd(d01i, d23r));
+        }
+    }
+}
+
+// Returns n, or aborts if it is not valid. Called from the first member initializer,
+// so that no member is computed or allocated from an invalid size.
+size_t checkedSize(size_t n, bool valid, const char *caller) {
+    LOG_ALWAYS_FATAL_IF(!valid, "%s: invalid size %zu", caller, n);
+    return n;
+}
+
+} // namespace
+
+FloatFFT::FloatFFT(size_t n)
+    : mSize(checkedSize(n, isValidSize(n), __func__))
+    , mLog2Size(__builtin_ctzll(n))
+    , mBitReverse(n)
+    , mRe(n)
+    , mIm(n)
+{
+    for (size_t i = 0; i < n; ++i) {
+        uint32_t r = 0;
+        for (uint32_t b = 0; b < mLog2Size; ++b) {
+            r |= ((i >> b) & 1) << (mLog2Size - 1 - b);
+        }
+        mBitReverse[i] = r;
+    }
+
+    for (size_t L = (mLog2Size & 1) ? 2 : 1; L < n; L *= 4) {
+        for (size_t m = 1; m <= 3; ++m) {
+            const size_t offset = mTwiddles.size();
+            mTwiddles.resize(offset + 2 * L);
+            for (size_t k = 0; k < L; ++k) {
+                const double phase = -2. * M_PI * m * k / (4 * L);
+                mTwiddles[offset + k] = cos(phase);
+                mTwiddles[offset + L + k] = sin(phase);
+            }
+        }
+    }
+}
+
+void FloatFFT::transform(const float *in, bool inverse) {
+    float * const re = mRe.data();
+    float * const im = mIm.data();
+    for (size_t i = 0; i < mSize; ++i) {
+        const uint32_t j = mBitReverse[i];
+        re[i] = in[2 * j];
+        im[i] = in[2 * j + 1];
+    }
+
+    // The inverse transform is the forward transform of the data with the
+    // real and imaginary parts swapped, followed by the same swap.
+    float * const r = inverse ? im : re;
+    float * const i = inverse ? re : im;
+
+    size_t L = 1;
+    if (mLog2Size & 1) {
+        for (size_t k = 0; k < mSize; k += 2) {
+            const float tr = r[k + 1];
+            const float ti = i[k + 1];
+            r[k + 1] = r[k] - tr;
+            i[k + 1] = i[k] - ti;
+            r[k] += tr;
+            i[k] += ti;
+        }
+        L = 2;
+    }
+    const float *twiddles = mTwiddles.data();
+    for (; L < mSize; L *= 4) {
+        if (L < kVectorWidth) {
+            radix4Stage<float>(r, i, mSize, L, twiddles);
+        } else {
+            radix4Stage<Vector>(r, i, mSize, L, twiddles);
+        }
+        twiddles += 6 * L;
+    }
+}
+
+void FloatFFT::forward(const float *in, float *out) {
+    transform(in, false /* inverse */);
+    for (size_t k = 0; k < mSize; ++k) {
+        out[2 * k] = mRe[k];
+        out[2 * k + 1] = mIm[k];
+    }
+}
+
+void FloatFFT::inverse(const float *in, float *out) {
+    transform(in, true /* inverse */);
+    const float scale = 1.f / mSize;
+    for (size_t k = 0; k < mSize; ++k) {
+        out[2 * k] = mRe[k] * scale;
+        out[2 * k + 1] = mIm[k] * scale;
+    }
+}
+
+FloatRealFFT::FloatRealFFT(size_t n)
+    : mSize(checkedSize(n, isValidSize(n), __func__))
+    , mFFT(n / 2)
+    , mTwiddles(n + 2)
+{
+    for (size_t k = 0; k <= n / 2; ++k) {
+        const double phase = -2. * M_PI * k / n;
+        mTwiddles[2 * k] = cos(phase);
+        mTwiddles[2 * k + 1] = sin(phase);
+    }
+}
+
+// The n real values x are transformed as n / 2 complex values z[k] = x[2k] + i x[2k + 1].
+// With M = n / 2 and W = exp(-2 pi i / n), the spectra of the even and odd samples are
+//   E[k] = (Z[k] + conj(Z[M - k])) / 2
+//   O[k] = (Z[k] - conj(Z[M - k])) / 2i
+// and X[k] = E[k] + W^k O[k].
+void FloatRealFFT::forward(const float *in, float *out) {
+    const size_t m = mSize / 2;
+    mFFT.transform(in, false /* inverse */);
+    const float *re = mFFT.mRe.data();
+    const float *im = mFFT.mIm.data();
+    for (size_t k = 0; k <= m; ++k) {
+        const size_t j = k == m ? 0 : k;
+        const size_t c = k == 0 ? 0 : m - k;
+        const float er = 0.5f * (re[j] + re[c]);
+        const float ei = 0.5f * (im[j] - im[c]);
+        const float or_ = 0.5f * (im[j] + im[c]);
+        const float oi = 0.5f * (re[c] - re[j]);
+        const float wr = mTwiddles[2 * k];
+        const float wi = mTwiddles[2 * k + 1];
+        out[2 * k] = er + or_ * wr - oi * wi;
+        out[2 * k + 1] = ei + or_ * wi + oi * wr;
+    }
+    out[1] = 0.f;
+    out[2 * m + 1] = 0.f;
+}
+
+// Inverts the split step of forward(): Z[k] = E[k] + i O[k], with
+//   E[k] = (X[k] + conj(X[M - k])) / 2
+//   O[k] = (X[k] - conj(X[M - k])) W^-k / 2
+// followed by an inverse complex transform of size M.
+void FloatRealFFT::inverse(const float *in, float *out) {
+    const size_t m = mSize / 2;
+    for (size_t k = 0; k < m; ++k) {
+        const float xr = in[2 * k];
+        const float xi = k == 0 ? 0.f : in[2 * k + 1];
+        const float cr = in[2 * (m - k)];
+        const float ci = k == 0 ? 0.f : -in[2 * (m - k) + 1];
+        const float er = xr + cr;
+        const float ei = xi + ci;
+        const float dr = xr - cr;
+        const float di = xi - ci;
+        const float wr = mTwiddles[2 * k];
+        const float wi = -mTwiddles[2 * k + 1];
+        const float or_ = dr * wr - di * wi;
+        const float oi = dr * wi + di * wr;
+        out[2 * k] = er - oi;
+        out[2 * k + 1] = ei + or_;
+    }
+    mFFT.transform(out, true /* inverse */);
+    const float scale = 1.f / mSize;
+    const float *re = mFFT.mRe.data();
+    const float *im = mFFT.mIm.data();
+    for (size_t k = 0; k < m; ++k) {
+        out[2 * k] = re[k] * scale;
+        out[2 * k + 1] = im[k] * scale;
+    }
+}
+
+} // namespace android::audio_utils
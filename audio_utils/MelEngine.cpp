@@ -0,0 +1,122 @@
+/*
+ * Copyright 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// #define LOG_NDEBUG 0
+#define LOG_TAG "audio_utils_MelEngine"
+
+#include <audio_utils/MelEngine.h>
+
+#include <audio_utils/MelProcessor.h>
+#include <errno.h>
+#include <log/log.h>
+#include <string>
+#include <utils/threads.h>
+
+namespace android::audio_utils {
+
+constexpr size_t kMaxThreadCount = 8;
+
+MelEngine::MelEngine(size_t threadCount) {
+    LOG_ALWAYS_FATAL_IF(threadCount == 0 || threadCount > kMaxThreadCount,
+            "%s: invalid threadCount %zu", __func__, threadCount);
+    sem_init(&mWakeupSem, 0 /* pshared */, 0 /* value */);
+    for (size_t i = 0; i < threadCount; ++i) {
+        mThreads.emplace_back([this, i, destroyed = mDestroyed] {
+            const std::string name = "MelEngine#" + std::to_string(i);
+            androidSetThreadName(name.c_str());
+            ALOGV("%s: Started thread", name.c_str());
+            // the engine may be destroyed by the worker itself during a pass.
+            while (threadLoop() && !*destroyed) {}
+        });
+    }
+}
+
+MelEngine::~MelEngine() {
+    *mDestroyed = true;
+    {
+        std::lock_guard l(mLock);
+        mStopRequested = true;
+    }
+    for (size_t i = 0; i < mThreads.size(); ++i) {
+        sem_post(&mWakeupSem);
+    }
+    for (auto& thread : mThreads) {
+        // The last reference to the engine may be released by a worker, when it drops
+        // the last reference to a MelProcessor. That worker exits on its own.
+        if (thread.get_id() == std::this_thread::get_id()) {
+            thread.detach();
+        } else {
+            thread.join();
+        }
+    }
+    sem_destroy(&mWakeupSem);
+}
+
+size_t MelEngine::getProcessorCount() const {
+    std::lock_guard l(mLock);
+    return mProcessors.size();
+}
+
+void MelEngine::addProcessor(const wp<MelProcessor>& processor) {
+    std::lock_guard l(mLock);
+    mProcessors.push_back(processor);
+}
+
+void MelEngine::removeProcessor(const MelProcessor* processor) {
+    std::lock_guard l(mLock);
+    std::erase_if(mProcessors, [processor](const wp<MelProcessor>& p) {
+        return p.unsafe_get() == processor;
+    });
+}
+
+void MelEngine::wakeup() {
+    // post only once per pass. sem_post() does not block, and a post before the
+    // worker waits is counted, so no wakeup is lost.
+    if (!mWakeupPending.exchange(true)) {
+        sem_post(&mWakeupSem);
+    }
+}
+
+bool MelEngine::threadLoop() {
+    // idle workers wait without a timeout.
+    while (sem_wait(&mWakeupSem) != 0 && errno == EINTR) {}
+
+    std::vector<sp<MelProcessor>> batch;
+    {
+        std::lock_guard l(mLock);
+        if (mStopRequested) {
+            return false;
+        }
+        mWakeupPending = false;
+        for (const auto& weakProcessor : mProcessors) {
+            sp<MelProcessor> processor = weakProcessor.promote();
+            if (processor != nullptr) {
+                batch.push_back(std::move(processor));
+            }
+        }
+    }
+
+    // A MelProcessor is drained by a single worker at a time, the others skip it.
+    for (const auto& processor : batch) {
+        processor->processQueued();
+    }
+    // Released without the lock, this may destroy a MelProcessor and even the engine,
+    // so no member may be accessed after this point.
+    batch.clear();
+    return true;
+}
+
+}  // namespace android::audio_utils
@@ -124,10 +124,10 @@ MelProcessor::MelProcessor(uint32_t sampleRate,
       mFramesPerMelValue(sampleRate * kSecondsPerMelValue),
       mChannelCount(channelCount),
       mFormat(format),
-      mAWeightSamples(mFramesPerMelValue * mChannelCount),
-      mFloatSamples(mFramesPerMelValue * mChannelCount),
       mCurrentChannelEnergy(channelCount, 0.0f),
       mMelValues(maxMelsCallback),
+      mFloatSamples(kAWeightBlockFrames * mChannelCount),
+      mAWeightSamples(kAWeightBlockFrames * mChannelCount),
       mDeviceId(deviceId),
       mRs2UpperBound(rs2Value)
 {
@@ -136,6 +136,35 @@ MelProcessor::MelProcessor(uint32_t sampleRate,
     mMelWorker.run();
 }
 
+MelProcessor::MelProcessor(uint32_t sampleRate,
+        uint32_t channelCount,
+        audio_format_t format,
+        const sp<MelCallback>& callback,
+        audio_port_handle_t deviceId,
+        float rs2Value,
+        const sp<MelEngine>& engine,
+        size_t maxMelsCallback)
+    : mCallback(callback),
+      mMelWorker("MelWorker#" + pointerString(), mCallback),
+      mEngine(engine),
+      mSampleRate(sampleRate),
+      mFramesPerMelValue(sampleRate * kSecondsPerMelValue),
+      mChannelCount(channelCount),
+      mFormat(format),
+      mCurrentChannelEnergy(channelCount, 0.0f),
+      mMelValues(maxMelsCallback),
+      mFloatSamples(kAWeightBlockFrames * mChannelCount),
+      mAWeightSamples(kAWeightBlockFrames * mChannelCount),
+      mDeviceId(deviceId),
+      mRs2UpperBound(rs2Value)
+{
+    LOG_ALWAYS_FATAL_IF(mEngine == nullptr, "%s: null engine", __func__);
+    std::lock_guard l(mLock);
+    createBiquads_l();
+    createQueue_l();
+    // the callbacks are dispatched by the engine, the MelWorker thread is not started.
+}
+
 static const std::unordered_map<uint32_t, const std::array<std::array<float, kBiquadNumCoefs>,
         MelProcessor::kCascadeBiquadNumber>*>& getSampleRateBiquadCoeffs() {
     static const std::unordered_map<uint32_t, const std::array<std::array<float, kBiquadNumCoefs>,
@@ -175,6 +204,15 @@ void MelProcessor::createBiquads_l() {
                std::make_unique<DefaultBiquadFilter>(mChannelCount, biquadCoeffs->at(2))};
 }
 
+void MelProcessor::createQueue_l() {
+    mQueue.reset();
+    const uint32_t frameSize = audio_bytes_per_sample(mFormat) * mChannelCount;
+    if (mEngine == nullptr || !isSampleRateSupported_l() || frameSize == 0) {
+        return;
+    }
+    mQueue = std::make_unique<EngineQueue>(mSampleRate * kEngineQueueMs / 1000, frameSize);
+}
+
 status_t MelProcessor::setOutputRs2UpperBound(float rs2Value)
 {
     if (rs2Value < kRs2LowerBound || rs2Value > kRs2UpperBound) {
@@ -215,15 +253,22 @@ void MelProcessor::resume()
 void MelProcessor::drain()
 {
     ALOGV("%s", __func__);
+    if (mEngine != nullptr) {
+        mEngine->wakeup();
+        return;
+    }
     mMelWorker.drain();
 }
 
 void MelProcessor::drainAndWait() {
     constexpr size_t kPollMs = 8;
-    while (!mMelWorker.ringBufferIsEmpty()) {
+    // with an engine, first wait for the queued data to be processed.
+    while (mDequeuedFrames != mQueuedFrames || !mMelWorker.ringBufferIsEmpty()) {
         drain();
         std::this_thread::sleep_for(std::chrono::milliseconds(kPollMs));
     }
+    // the last entry may have left the ring buffer while its callback is still running.
+    mMelWorker.waitForDispatch();
 }
 
 void MelProcessor::updateAudioFormat(uint32_t sampleRate,
@@ -233,41 +278,57 @@ void MelProcessor::updateAudioFormat(uint32_t sampleRate,
 
     std::lock_guard l(mLock);
 
-    bool differentSampleRate = (mSampleRate != sampleRate);
     bool differentChannelCount = (mChannelCount != channelCount);
 
+    if (mQueue != nullptr) {
+        // the queued data is in the previous format.
+        processQueued_l();
+    }
+
     mSampleRate = sampleRate;
     mFramesPerMelValue = sampleRate * kSecondsPerMelValue;
     mChannelCount = channelCount;
     mFormat = format;
 
-    if (differentSampleRate || differentChannelCount) {
-        mAWeightSamples.resize(mFramesPerMelValue * mChannelCount);
-        mFloatSamples.resize(mFramesPerMelValue * mChannelCount);
-    }
     if (differentChannelCount) {
         mCurrentChannelEnergy.resize(channelCount);
+        mFloatSamples.resize(kAWeightBlockFrames * mChannelCount);
+        mAWeightSamples.resize(kAWeightBlockFrames * mChannelCount);
     }
 
     createBiquads_l();
+    createQueue_l();
 }
 
-void MelProcessor::applyAWeight_l(const void* buffer, size_t samples)
+void MelProcessor::accumulateAWeightedEnergy_l(const void* buffer, size_t samples)
 {
-    memcpy_by_audio_format(mFloatSamples.data(), AUDIO_FORMAT_PCM_FLOAT, buffer, mFormat, samples);
-
-    float* tempFloat[2] = { mFloatSamples.data(), mAWeightSamples.data() };
-    int inIdx = 1, outIdx = 0;
-    const size_t frames = samples / mChannelCount;
-    for (const auto& biquad : mCascadedBiquads) {
-        outIdx ^= 1;
-        inIdx ^= 1;
-        biquad->process(tempFloat[outIdx], tempFloat[inIdx], frames);
-    }
+    // the input is converted and filtered in blocks, instead of whole MEL windows, so that
+    // the intermediate float data stays in cache until its energy is accumulated.
+    const memcpy_by_audio_format_fn_t toFloat =
+            get_memcpy_by_audio_format_fn(AUDIO_FORMAT_PCM_FLOAT, mFormat);
+    LOG_ALWAYS_FATAL_IF(toFloat == nullptr, "%s: invalid format: %#x", __func__, mFormat);
+    const uint8_t* in = static_cast<const uint8_t*>(buffer);
+    const size_t frameSize = audio_bytes_per_sample(mFormat) * mChannelCount;
+    for (size_t frames = samples / mChannelCount; frames > 0;) {
+        const size_t blockFrames = std::min(frames, kAWeightBlockFrames);
+        const size_t blockSamples = blockFrames * mChannelCount;
+        toFloat(mFloatSamples.data(), in, blockSamples);
+
+        float* tempFloat[2] = { mFloatSamples.data(), mAWeightSamples.data() };
+        int inIdx = 1, outIdx = 0;
+        for (const auto& biquad : mCascadedBiquads) {
+            outIdx ^= 1;
+            inIdx ^= 1;
+            biquad->process(tempFloat[outIdx], tempFloat[inIdx], blockFrames);
+        }
 
-    // should not be the case since the size is odd
-    if (!(mCascadedBiquads.size() & 1)) {
-        std::swap(mFloatSamples, mAWeightSamples);
+        audio_utils_accumulate_energy(tempFloat[outIdx],
+                                      AUDIO_FORMAT_PCM_FLOAT,
+                                      blockSamples,
+                                      mChannelCount,
+                                      mCurrentChannelEnergy.data());
+        in += blockFrames * frameSize;
+        frames -= blockFrames;
     }
 }
 
@@ -321,9 +382,64 @@ int32_t MelProcessor::process(const void* buffer, size_t bytes) {
         return 0;
     }
 
+    if (mEngine != nullptr) {
+        // only a copy on the audio thread, mQueue is not replaced concurrently.
+        if (mQueue == nullptr) {
+            return 0;
+        }
+        const size_t frameSize = mQueue->mFifo.frameSize();
+        const ssize_t written = mQueue->mWriter.write(buffer, bytes / frameSize);
+        if (written <= 0) {
+            return 0;
+        }
+        mQueuedFrames += written;
+        mEngine->wakeup();
+        return static_cast<int32_t>(written * frameSize);
+    }
+
     // should be uncontested and not block if process method is called from a single thread
     std::lock_guard<std::mutex> guard(mLock);
+    return process_l(buffer, bytes);
+}
+
+void MelProcessor::processQueued() {
+    // Skipped while another worker or updateAudioFormat() holds the lock. A wakeup for data
+    // queued meanwhile may find the lock taken, so the holder checks for more once unlocked.
+    while (mLock.try_lock()) {
+        {
+            std::lock_guard l(mLock, std::adopt_lock);
+            processQueued_l();
+        }
+        if (mDequeuedFrames >= mQueuedFrames) {
+            break;
+        }
+    }
+    if (!mMelWorker.ringBufferIsEmpty()) {
+        mMelWorker.dispatch();
+    }
+}
 
+void MelProcessor::processQueued_l() {
+    if (mQueue == nullptr) {
+        return;
+    }
+    audio_utils_iovec iovec[2];
+    const ssize_t frames = mQueue->mReader.obtain(iovec);
+    if (frames <= 0) {
+        return;
+    }
+    const size_t frameSize = mQueue->mFifo.frameSize();
+    for (const auto& fragment : iovec) {
+        if (fragment.mLength > 0) {
+            process_l(mQueue->mBuffer.data() + fragment.mOffset * frameSize,
+                      fragment.mLength * frameSize);
+        }
+    }
+    mQueue->mReader.release(frames);
+    mDequeuedFrames += frames;
+}
+
+int32_t MelProcessor::process_l(const void* buffer, size_t bytes) {
     if (!isSampleRateSupported_l()) {
         return 0;
     }
@@ -336,13 +452,7 @@ int32_t MelProcessor::process(const void* buffer, size_t bytes) {
         size_t processSamples = std::min(requiredSamples, samples);
         processSamples -= processSamples % mChannelCount;
 
-        applyAWeight_l(buffer, processSamples);
-
-        audio_utils_accumulate_energy(mAWeightSamples.data(),
-                                      AUDIO_FORMAT_PCM_FLOAT,
-                                      processSamples,
-                                      mChannelCount,
-                                      mCurrentChannelEnergy.data());
+        accumulateAWeightedEnergy_l(buffer, processSamples);
         mCurrentSamples += processSamples;
 
         ALOGVV(
@@ -375,7 +485,16 @@ void MelProcessor::setAttenuation(float attenuationDB) {
     mAttenuationDB = attenuationDB;
 }
 
+void MelProcessor::onFirstRef() {
+    if (mEngine != nullptr) {
+        mEngine->addProcessor(wp<MelProcessor>::fromExisting(this));
+    }
+}
+
 void MelProcessor::onLastStrongRef(const void* id __attribute__((unused))) {
+   if (mEngine != nullptr) {
+       mEngine->removeProcessor(this);
+   }
    mMelWorker.stop();
    ALOGV("%s: Stopped thread: %s for device %d", __func__, mMelWorker.getThreadName().c_str(),
          mDeviceId.load());
@@ -412,25 +531,53 @@ void MelProcessor::MelWorker::run() {
                     return;
                 }
 
-                const MelCallbackData& data = mCallbackRingBuffer[mRbReadPtr];
-                if (data.mMel != 0.f) {
-                    l.unlock();
-                    callback->onMomentaryExposure(data.mMel, data.mPort);
-                    l.lock();
-                } else if (data.mMelsSize != 0) {
-                    l.unlock();
-                    callback->onNewMelValues(data.mMels, 0, data.mMelsSize,
-                                             data.mPort, /*attenuated=*/true);
-                    l.lock();
-                } else {
-                    ALOGE("%s::run(): Invalid MEL data. Skipping callback", mThreadName.c_str());
-                }
+                l.unlock();
+                this->callback(callback, mCallbackRingBuffer[mRbReadPtr]);
+                l.lock();
                 mRbReadPtr = nextRingBufferIndex(mRbReadPtr);  // single reader updates this.
             }
         }
     });
 }
 
+void MelProcessor::MelWorker::dispatch() {
+    // serializes the engine workers, which are all readers of the ring buffer.
+    std::lock_guard dispatchGuard(mDispatchMutex);
+    while (true) {
+        {
+            // the entry is copied so that the callback runs without holding mCondVarMutex.
+            std::lock_guard l(mCondVarMutex);
+            if (ringBufferIsEmpty()) {  // load-acquire mRbWritePtr
+                return;
+            }
+            mDispatchData = mCallbackRingBuffer[mRbReadPtr];  // capacity is kMaxMelValues
+            mRbReadPtr = nextRingBufferIndex(mRbReadPtr);  // single reader updates this.
+        }
+        const auto callback = mCallback.promote();
+        if (callback == nullptr) {
+            ALOGW("%s::dispatch(): MelCallback is null", mThreadName.c_str());
+            return;
+        }
+        this->callback(callback, mDispatchData);
+    }
+}
+
+void MelProcessor::MelWorker::waitForDispatch() {
+    std::lock_guard l(mDispatchMutex);
+}
+
+void MelProcessor::MelWorker::callback(const sp<MelCallback>& callback,
+                                       const MelCallbackData& data) const {
+    if (data.mMel != 0.f) {
+        callback->onMomentaryExposure(data.mMel, data.mPort);
+    } else if (data.mMelsSize != 0) {
+        callback->onNewMelValues(data.mMels, 0, data.mMelsSize,
+                                 data.mPort, /*attenuated=*/true);
+    } else {
+        ALOGE("%s: Invalid MEL data. Skipping callback", mThreadName.c_str());
+    }
+}
+
 void MelProcessor::MelWorker::stop() {
     bool oldValue;
     {
@@ -438,7 +585,7 @@ void MelProcessor::MelWorker::stop() {
         oldValue = mStopRequested;
         mStopRequested = true;
     }
-    if (!oldValue) {
+    if (!oldValue && mThread.joinable()) {
         mCondVar.notify_one();
         mThread.join();
     }
@@ -0,0 +1,199 @@
+/*
+ * Copyright 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// #define LOG_NDEBUG 0
+#define LOG_TAG "audio_utils_StftProcessor"
+
+#include <math.h>
+#include <string.h>
+
+#include <algorithm>
+
+#include <audio_utils/StftProcessor.h>
+#include <audio_utils/format.h>
+#include <log/log.h>
+
+namespace android::audio_utils {
+
+namespace {
+
+// Number of frames converted to float at a time.
+constexpr size_t kBlockFrames = 256;
+
+// Periodic windows, which overlap-add to a constant at the usual hops.
+std::vector<float> makeWindow(StftProcessor::Window window, size_t n) {
+    std::vector<double> w(n);
+    for (size_t i = 0; i < n; ++i) {
+        const double phase = 2. * M_PI * i / n;
+        switch (window) {
+        case StftProcessor::Window::RECTANGULAR:
+            w[i] = 1.;
+            break;
+        case StftProcessor::Window::HANN:
+            w[i] = 0.5 - 0.5 * cos(phase);
+            break;
+        case StftProcessor::Window::HAMMING:
+            w[i] = 0.54 - 0.46 * cos(phase);
+            break;
+        case StftProcessor::Window::BLACKMAN:
+            w[i] = 0.42 - 0.5 * cos(phase) + 0.08 * cos(2. * phase);
+            break;
+        }
+    }
+    double sum = 0.;
+    for (double value : w) sum += value;
+    std::vector<float> normalized(n);
+    for (size_t i = 0; i < n; ++i) {
+        normalized[i] = w[i] / sum;
+    }
+    return normalized;
+}
+
+// Returns format, or aborts if an argument is not valid. Called from the first member
+// initializer, so that no member is computed or allocated from an invalid argument.
+audio_format_t checkedFormat(audio_format_t format, uint32_t channelCount, size_t fftSize,
+        size_t hop, const StftProcessor::Callback& callback, const char *caller) {
+    LOG_ALWAYS_FATAL_IF(!StftProcessor::isFormatSupported(format),
+            "%s: invalid format %#x", caller, format);
+    LOG_ALWAYS_FATAL_IF(channelCount == 0 || channelCount > FCC_LIMIT,
+            "%s: invalid channelCount %u", caller, channelCount);
+    LOG_ALWAYS_FATAL_IF(!FloatRealFFT::isValidSize(fftSize),
+            "%s: invalid fftSize %zu", caller, fftSize);
+    LOG_ALWAYS_FATAL_IF(hop == 0 || hop > fftSize, "%s: invalid hop %zu", caller, hop);
+    LOG_ALWAYS_FATAL_IF(!callback, "%s: null callback", caller);
+    return format;
+}
+
+} // namespace
+
+// static
+bool StftProcessor::isFormatSupported(audio_format_t format) {
+    switch (format) {
+    case AUDIO_FORMAT_PCM_8_BIT:
+    case AUDIO_FORMAT_PCM_16_BIT:
+    case AUDIO_FORMAT_PCM_24_BIT_PACKED:
+    case AUDIO_FORMAT_PCM_32_BIT:
+    case AUDIO_FORMAT_PCM_8_24_BIT:
+    case AUDIO_FORMAT_PCM_FLOAT:
+        return true;
+    default:
+        return false;
+    }
+}
+
+StftProcessor::StftProcessor(audio_format_t format, uint32_t channelCount, size_t fftSize,
+        size_t hop, Window window, Spectrum spectrum, Callback callback)
+    : mFormat(checkedFormat(format, channelCount, fftSize, hop, callback, __func__))
+    , mChannelCount(channelCount)
+    , mFrameSize(audio_bytes_per_sample(format) * channelCount)
+    , mFftSize(fftSize)
+    , mHop(hop)
+    , mSpectrum(spectrum)
+    , mCallback(std::move(callback))
+    , mFFT(fftSize)
+    , mWindow(makeWindow(window, fftSize))
+    , mRing(fftSize)
+    , mScratch(kBlockFrames * channelCount)
+    , mMono(kBlockFrames)
+    , mFrame(fftSize)
+    , mFreq(fftSize + 2)
+    , mBins(fftSize / 2 + 1)
+    , mUntilNextWindow(fftSize)
+{
+}
+
+void StftProcessor::push(const void *buffer, size_t frames) {
+    const uint8_t *in = static_cast<const uint8_t *>(buffer);
+    if (mChannelCount == 1 && mFormat == AUDIO_FORMAT_PCM_FLOAT) {
+        append(static_cast<const float *>(buffer), frames);
+        return;
+    }
+    while (frames > 0) {
+        const size_t count = std::min(frames, kBlockFrames);
+        if (mChannelCount == 1) {
+            memcpy_by_audio_format(mMono.data(), AUDIO_FORMAT_PCM_FLOAT, in, mFormat, count);
+        } else {
+            memcpy_by_audio_format(mScratch.data(), AUDIO_FORMAT_PCM_FLOAT, in, mFormat,
+                    count * mChannelCount);
+            const float scale = 1.f / mChannelCount;
+            const float *sample = mScratch.data();
+            for (size_t i = 0; i < count; ++i) {
+                float sum = 0.f;
+                for (size_t c = 0; c < mChannelCount; ++c) {
+                    sum += *sample++;
+                }
+                mMono[i] = sum * scale;
+            }
+        }
+        append(mMono.data(), count);
+        in += count * mFrameSize;
+        frames -= count;
+    }
+}
+
+void StftProcessor::reset() {
+    std::fill(mRing.begin(), mRing.end(), 0.f);
+    mRingPosition = 0;
+    mUntilNextWindow = mFftSize;
+    mFramesReceived = 0;
+}
+
+void StftProcessor::append(const float *samples, size_t count) {
+    while (count > 0) {
+        // mUntilNextWindow <= mFftSize, so this wraps the ring at most once.
+        const size_t n = std::min(count, mUntilNextWindow);
+        const size_t first = std::min(n, mFftSize - mRingPosition);
+        memcpy(&mRing[mRingPosition], samples, first * sizeof(float));
+        memcpy(&mRing[0], samples + first, (n - first) * sizeof(float));
+        mRingPosition = (mRingPosition + n) & (mFftSize - 1);
+        mFramesReceived += n;
+        mUntilNextWindow -= n;
+        samples += n;
+        count -= n;
+        if (mUntilNextWindow == 0) {
+            emitSpectrum();
+            mUntilNextWindow = mHop;
+        }
+    }
+}
+
+void StftProcessor::emitSpectrum() {
+    // the ring is full, and its oldest sample is at mRingPosition.
+    const size_t first = mFftSize - mRingPosition;
+    for (size_t i = 0; i < first; ++i) {
+        mFrame[i] = mRing[mRingPosition + i] * mWindow[i];
+    }
+    for (size_t i = first; i < mFftSize; ++i) {
+        mFrame[i] = mRing[i - first] * mWindow[i];
+    }
+
+    mFFT.forward(mFrame.data(), mFreq.data());
+
+    const size_t binCount = mBins.size();
+    for (size_t k = 0; k < binCount; ++k) {
+        const float re = mFreq[2 * k];
+        const float im = mFreq[2 * k + 1];
+        mBins[k] = re * re + im * im;
+    }
+    if (mSpectrum == Spectrum::MAGNITUDE) {
+        for (float& bin : mBins) {
+            bin = sqrtf(bin);
+        }
+    }
+    mCallback(mBins.data(), binCount, mFramesReceived - mFftSize);
+}
+
+} // namespace android::audio_utils
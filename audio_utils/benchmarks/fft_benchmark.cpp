@@ -0,0 +1,113 @@
+/*
+ * Copyright 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <random>
+#include <vector>
+
+#include <audio_utils/FloatFFT.h>
+#include <audio_utils/fixedfft.h>
+#include <audio_utils/primitives.h>
+#include <benchmark/benchmark.h>
+
+/*
+Real FFT of float data, the argument is the number of real samples.
+fixed_fft_real() includes the conversion of the float data to packed Q15 pairs,
+and is limited to 1024 real samples.
+
+Host x86_64
+------------------------------------------------------------------------
+Benchmark                              Time             CPU   Iterations
+------------------------------------------------------------------------
+BM_FixedFftReal/256                 4232 ns         4196 ns       190457
+BM_FixedFftReal/512                 8053 ns         7864 ns        89547
+BM_FixedFftReal/1024               16564 ns        16513 ns        42741
+BM_FloatRealFFT/256                  929 ns          917 ns       773757
+BM_FloatRealFFT/1024                5040 ns         4991 ns       157126
+BM_FloatRealFFT/4096               16248 ns        16212 ns        31681
+BM_FloatRealFFT/16384              81516 ns        79762 ns         9727
+BM_FloatRealFFT/65536             376011 ns       372642 ns         1974
+BM_FloatRealFFT_Inverse/256          738 ns          731 ns       944087
+BM_FloatRealFFT_Inverse/1024        3304 ns         3272 ns       214661
+BM_FloatRealFFT_Inverse/4096       17712 ns        17563 ns        41825
+BM_FloatRealFFT_Inverse/16384      72998 ns        72501 ns         9888
+BM_FloatRealFFT_Inverse/65536     383095 ns       379930 ns         1985
+*/
+
+namespace {
+
+using android::audio_utils::FloatRealFFT;
+
+std::vector<float> makeRandom(size_t count) {
+    std::minstd_rand gen(count);
+    std::uniform_real_distribution<> dis(-0.5f, 0.5f);
+    std::vector<float> data(count);
+    for (auto& value : data) {
+        value = dis(gen);
+    }
+    return data;
+}
+
+void BM_FixedFftReal(benchmark::State& state) {
+    const size_t n = state.range(0);
+    const std::vector<float> in = makeRandom(n);
+    std::vector<int32_t> work(n / 2);
+
+    for (auto _ : state) {
+        // two real samples are packed into each Q15 complex value.
+        for (size_t i = 0; i < n / 2; ++i) {
+            work[i] = (int32_t)((uint32_t)clamp16_from_float(in[2 * i]) << 16)
+                    | (uint16_t)clamp16_from_float(in[2 * i + 1]);
+        }
+        fixed_fft_real(n / 2, work.data());
+        benchmark::ClobberMemory();
+    }
+    state.SetComplexityN(n);
+}
+
+void BM_FloatRealFFT(benchmark::State& state) {
+    const size_t n = state.range(0);
+    const std::vector<float> in = makeRandom(n);
+    std::vector<float> out(n + 2);
+    FloatRealFFT fft(n);
+
+    for (auto _ : state) {
+        fft.forward(in.data(), out.data());
+        benchmark::ClobberMemory();
+    }
+    state.SetComplexityN(n);
+}
+
+void BM_FloatRealFFT_Inverse(benchmark::State& state) {
+    const size_t n = state.range(0);
+    std::vector<float> spectrum(n + 2);
+    std::vector<float> out(n);
+    FloatRealFFT fft(n);
+    fft.forward(makeRandom(n).data(), spectrum.data());
+
+    for (auto _ : state) {
+        fft.inverse(spectrum.data(), out.data());
+        benchmark::ClobberMemory();
+    }
+    state.SetComplexityN(n);
+}
+
+} // namespace
+
+BENCHMARK(BM_FixedFftReal)->RangeMultiplier(2)->Range(256, 1024);
+BENCHMARK(BM_FloatRealFFT)->RangeMultiplier(4)->Range(256, 1 << 16);
+BENCHMARK(BM_FloatRealFFT_Inverse)->RangeMultiplier(4)->Range(256, 1 << 16);
+
+BENCHMARK_MAIN();
@@ -20,6 +20,7 @@
 
 #include <benchmark/benchmark.h>
 
+#include <audio_utils/format.h>
 #include <audio_utils/primitives.h>
 
 static void BM_MemcpyToFloatFromFloatWithClamping(benchmark::State& state) {
@@ -137,4 +138,93 @@ static void BM_MemcpyToI16FromFloat(benchmark::State& state) {
 
 BENCHMARK(BM_MemcpyToI16FromFloat)->RangeMultiplier(2)->Ranges({{10, 8<<12}});
 
+// Remaps 8 channels PCM 16 to state.range(1) channels PCM float with a gain per channel,
+// either with separate index array copy, format conversion and gain passes,
+// or with the single pass memcpy_by_index_array_and_format_with_gain().
+static void BM_RemapConvertGain(benchmark::State& state, bool fused) {
+    const size_t count = state.range(0);
+    const uint32_t dstChannels = state.range(1);
+    constexpr uint32_t srcChannels = 8;
+
+    std::vector<int16_t> src(count * srcChannels);
+    std::vector<int16_t> tmp(count * dstChannels);
+    std::vector<float> dst(count * dstChannels);
+    std::vector<int8_t> idxary(dstChannels);
+    std::vector<float> gains(dstChannels);
+
+    // Initialize src buffer with deterministic pseudo-random values
+    std::minstd_rand gen(count);
+    std::uniform_int_distribution<> dis(INT16_MIN, INT16_MAX);
+    for (auto& sample : src) {
+        sample = dis(gen);
+    }
+    for (uint32_t c = 0; c < dstChannels; c++) {
+        idxary[c] = srcChannels - 1 - c;
+        gains[c] = 0.5f + 0.05f * c;
+    }
+
+    // Run the test
+    while (state.KeepRunning()) {
+        benchmark::DoNotOptimize(src.data());
+        benchmark::DoNotOptimize(dst.data());
+        if (fused) {
+            memcpy_by_index_array_and_format_with_gain(
+                    dst.data(), AUDIO_FORMAT_PCM_FLOAT, dstChannels,
+                    src.data(), AUDIO_FORMAT_PCM_16_BIT, srcChannels,
+                    idxary.data(), gains.data(), count);
+        } else {
+            memcpy_by_index_array(tmp.data(), dstChannels, src.data(), srcChannels,
+                    idxary.data(), sizeof(int16_t), count);
+            memcpy_by_audio_format(dst.data(), AUDIO_FORMAT_PCM_FLOAT,
+                    tmp.data(), AUDIO_FORMAT_PCM_16_BIT, count * dstChannels);
+            for (size_t i = 0; i < count; i++) {
+                for (uint32_t c = 0; c < dstChannels; c++) {
+                    dst[i * dstChannels + c] *= gains[c];
+                }
+            }
+        }
+        benchmark::ClobberMemory();
+    }
+
+    state.SetComplexityN(state.range(0));
+}
+
+static void BM_RemapConvertGain_ThreePass(benchmark::State& state) {
+    BM_RemapConvertGain(state, false /* fused */);
+}
+
+static void BM_RemapConvertGain_Fused(benchmark::State& state) {
+    BM_RemapConvertGain(state, true /* fused */);
+}
+
+static void RemapArgs(benchmark::internal::Benchmark* b) {
+    for (int channels : {2, 6, 8}) {
+        for (int count : {256, 4096}) {
+            b->Args({count, channels});
+        }
+    }
+}
+
+/*
+Host x86_64, frames and destination channel count as arguments.
+-------------------------------------------------------------------------------
+Benchmark                                     Time             CPU   Iterations
+-------------------------------------------------------------------------------
+BM_RemapConvertGain_ThreePass/256/2         851 ns          845 ns       739342
+BM_RemapConvertGain_ThreePass/4096/2      13535 ns        13424 ns        50601
+BM_RemapConvertGain_ThreePass/256/6        1977 ns         1943 ns       340318
+BM_RemapConvertGain_ThreePass/4096/6      32096 ns        31885 ns        24282
+BM_RemapConvertGain_ThreePass/256/8        2724 ns         2706 ns       205583
+BM_RemapConvertGain_ThreePass/4096/8      36907 ns        36747 ns        18874
+BM_RemapConvertGain_Fused/256/2             191 ns          190 ns      3688190
+BM_RemapConvertGain_Fused/4096/2           3125 ns         3112 ns       227927
+BM_RemapConvertGain_Fused/256/6             913 ns          905 ns       793317
+BM_RemapConvertGain_Fused/4096/6          17672 ns        17546 ns        36818
+BM_RemapConvertGain_Fused/256/8             859 ns          852 ns       910511
+BM_RemapConvertGain_Fused/4096/8          12038 ns        11997 ns        55785
+*/
+
+BENCHMARK(BM_RemapConvertGain_ThreePass)->Apply(RemapArgs);
+BENCHMARK(BM_RemapConvertGain_Fused)->Apply(RemapArgs);
+
 BENCHMARK_MAIN();
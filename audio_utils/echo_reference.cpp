@@ -0,0 +1,674 @@
+/*
+** Copyright 2011, The Android Open-Source Project
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "echo_reference"
+
+#include <errno.h>
+#include <inttypes.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <new>
+#include <vector>
+
+#include <log/log.h>
+#include <system/audio.h>
+#include <audio_utils/echo_reference.h>
+#include <audio_utils/fifo.h>
+#include <audio_utils/resampler.h>
+
+// The write() side pushes playback frames, unmodified, into an audio_utils_fifo that does not
+// throttle the writer. Each reader owns a non-throttling audio_utils_fifo_reader, a resampler, a
+// reference buffer at its own rate and its own delay estimate, so neither write() nor read() takes
+// a lock, and all memory is allocated when the echo reference or reader is created.
+// A reader that falls more than the FIFO capacity behind the writer loses frames and resyncs.
+
+namespace {
+
+// duration of the playback FIFO and of each reader reference buffer
+constexpr uint32_t kBufferDurationMs = 500;
+// number of playback frames pulled from the FIFO at a time by a reader
+constexpr size_t kChunkFrames = 256;
+// delay jump threshold to update ref buffer: 6 samples at 8kHz in nsecs
+constexpr int64_t kMinDelayDeltaNs = 375000 * 2;
+// number of consecutive delta with same sign between expected and actual delay before adjusting
+// the buffer
+constexpr uint16_t kMinDeltaNum = 4;
+
+constexpr int64_t kNanosPerSecond = 1000000000;
+
+class EchoReference;
+
+// Playback position and timing published by write() to all readers.
+struct WriterState {
+    struct timespec renderTime; // latest render time indicated by write()
+    int32_t playbackDelayNs;    // playback buffer delay indicated by last write()
+    uint64_t framesWritten;     // total frames written to the FIFO including this write()
+    uint32_t generation;        // incremented each time writing starts or stops
+    bool writing;               // whether writing is active
+};
+
+// Single writer, multiple reader sequence lock: the writer never waits, and readers retry
+// while a publish is in progress. Each field is an atomic so there is no data race.
+class WriterStateLock {
+public:
+    void publish(const WriterState& state) {
+        const uint32_t seq = mSeq.load(std::memory_order_relaxed);
+        mSeq.store(seq + 1, std::memory_order_relaxed);
+        // release stores order the odd sequence before the fields for any reader seeing them.
+        mRenderTimeSec.store(state.renderTime.tv_sec, std::memory_order_release);
+        mRenderTimeNsec.store(state.renderTime.tv_nsec, std::memory_order_release);
+        mPlaybackDelayNs.store(state.playbackDelayNs, std::memory_order_release);
+        mFramesWritten.store(state.framesWritten, std::memory_order_release);
+        mGeneration.store(state.generation, std::memory_order_release);
+        mWriting.store(state.writing, std::memory_order_release);
+        mSeq.store(seq + 2, std::memory_order_release);
+    }
+
+    WriterState snapshot() const {
+        WriterState state;
+        uint32_t seq;
+        do {
+            seq = mSeq.load(std::memory_order_acquire);
+            state.renderTime.tv_sec = mRenderTimeSec.load(std::memory_order_acquire);
+            state.renderTime.tv_nsec = mRenderTimeNsec.load(std::memory_order_acquire);
+            state.playbackDelayNs = mPlaybackDelayNs.load(std::memory_order_acquire);
+            state.framesWritten = mFramesWritten.load(std::memory_order_acquire);
+            state.generation = mGeneration.load(std::memory_order_acquire);
+            state.writing = mWriting.load(std::memory_order_acquire);
+        } while ((seq & 1) != 0 || seq != mSeq.load(std::memory_order_relaxed));
+        return state;
+    }
+
+private:
+    std::atomic<uint32_t> mSeq{0};
+    std::atomic<time_t> mRenderTimeSec{0};
+    std::atomic<long> mRenderTimeNsec{0};
+    std::atomic<int32_t> mPlaybackDelayNs{0};
+    std::atomic<uint64_t> mFramesWritten{0};
+    std::atomic<uint32_t> mGeneration{0};
+    std::atomic<bool> mWriting{false};
+};
+
+// One AEC client of the echo reference. read() must be called from a single thread.
+class EchoReferenceReader {
+public:
+    EchoReferenceReader(EchoReference& er, uint32_t channelCount, uint32_t samplingRate);
+    ~EchoReferenceReader();
+
+    // Returns false if the resampler could not be created.
+    bool initCheck() const { return mInitOk; }
+
+    struct echo_reference_itfe *itfe() { return &mItfe.itfe; }
+    static EchoReferenceReader *fromItfe(struct echo_reference_itfe *itfe) {
+        return reinterpret_cast<Itfe *>(itfe)->reader;
+    }
+
+    int read(struct echo_reference_buffer *buffer);
+
+private:
+    struct Itfe {
+        struct echo_reference_itfe itfe;  // must be first
+        EchoReferenceReader *reader;
+    };
+
+    void reset();
+    void pull(const struct timespec *timeout);
+    size_t copyFromFifo(int16_t *dst, const struct audio_utils_iovec iovec[2]);
+    void estimateDelay(const WriterState& state, const struct echo_reference_buffer *buffer);
+
+    Itfe mItfe;
+    EchoReference& mEr;
+    audio_utils_fifo_reader mFifoReader;
+    const uint32_t mChannelCount;
+    const uint32_t mSamplingRate;
+    const size_t mFrameSize;
+    bool mInitOk = true;
+    bool mReading = false;
+    uint32_t mGeneration = 0;
+    uint64_t mFifoBase = 0;         // writer total at the reader position, less totalReleased()
+    struct resampler_itfe *mResampler = NULL;
+    std::vector<int16_t> mScratch;  // playback frames downmixed, at the playback rate
+    std::vector<int16_t> mBuffer;   // reference frames at the read rate
+    size_t mBufferFrames;           // capacity of mBuffer in frames
+    size_t mFramesIn = 0;           // number of frames in mBuffer
+    int16_t mPrevDeltaSign = 0;     // sign of previous delay difference:
+                                    //  1: positive, -1: negative, 0: unknown
+    uint16_t mDeltaCount = 0;       // number of consecutive delay differences with same sign
+};
+
+class EchoReference {
+public:
+    EchoReference(uint32_t rdChannelCount, uint32_t rdSamplingRate,
+            uint32_t wrChannelCount, uint32_t wrSamplingRate);
+    ~EchoReference();
+
+    bool initCheck() const { return mReader.initCheck(); }
+
+    struct echo_reference_itfe *itfe() { return &mItfe.itfe; }
+    static EchoReference *fromItfe(struct echo_reference_itfe *itfe) {
+        return reinterpret_cast<Itfe *>(itfe)->er;
+    }
+
+    int write(struct echo_reference_buffer *buffer);
+
+    WriterState writerState() const { return mStateLock.snapshot(); }
+    audio_utils_fifo& fifo() { return mFifo; }
+    uint32_t channelCount() const { return mChannelCount; }
+    uint32_t samplingRate() const { return mSamplingRate; }
+    EchoReferenceReader& defaultReader() { return mReader; }
+    // Flushes the reader and returns the total frames written to the FIFO at its new position.
+    uint64_t flushReader(audio_utils_fifo_reader& reader);
+
+    std::atomic<int32_t> mActiveReaders{0};  // readers between start and stop of read()
+    std::atomic<int32_t> mAddedReaders{0};   // readers created by echo_reference_add_reader()
+
+private:
+    struct Itfe {
+        struct echo_reference_itfe itfe;  // must be first
+        EchoReference *er;
+    };
+
+    Itfe mItfe;
+    const uint32_t mChannelCount;
+    const uint32_t mSamplingRate;
+    const size_t mFrameSize;
+    std::vector<int16_t> mFifoBuffer;
+    audio_utils_fifo mFifo;
+    audio_utils_fifo_writer mWriter;
+    WriterStateLock mStateLock;
+    WriterState mState{};   // writer copy of the published state
+    // total frames written to the FIFO times two, plus one while a FIFO write is in progress
+    std::atomic<uint64_t> mWritePosition{0};
+    EchoReferenceReader mReader;  // reader used by the read() method of the echo reference
+};
+
+uint32_t framesForDuration(uint32_t samplingRate) {
+    return (uint32_t)(((uint64_t)samplingRate * kBufferDurationMs) / 1000);
+}
+
+EchoReference::EchoReference(uint32_t rdChannelCount, uint32_t rdSamplingRate,
+        uint32_t wrChannelCount, uint32_t wrSamplingRate)
+    : mItfe{}
+    , mChannelCount(wrChannelCount)
+    , mSamplingRate(wrSamplingRate)
+    , mFrameSize(audio_bytes_per_sample(AUDIO_FORMAT_PCM_16_BIT) * wrChannelCount)
+    , mFifoBuffer(framesForDuration(wrSamplingRate) * wrChannelCount)
+    , mFifo(framesForDuration(wrSamplingRate), mFrameSize, mFifoBuffer.data(),
+            false /*throttlesWriter*/)
+    , mWriter(mFifo)
+    , mReader(*this, rdChannelCount, rdSamplingRate)
+{
+    mItfe.itfe.read = [](struct echo_reference_itfe *echo_reference,
+            struct echo_reference_buffer *buffer) {
+        return fromItfe(echo_reference)->defaultReader().read(buffer);
+    };
+    mItfe.itfe.write = [](struct echo_reference_itfe *echo_reference,
+            struct echo_reference_buffer *buffer) {
+        return fromItfe(echo_reference)->write(buffer);
+    };
+    mItfe.er = this;
+}
+
+EchoReference::~EchoReference() {
+    LOG_ALWAYS_FATAL_IF(mAddedReaders.load() != 0,
+            "%s: %d readers not removed", __func__, mAddedReaders.load());
+}
+
+int EchoReference::write(struct echo_reference_buffer *buffer) {
+    if (buffer == NULL) {
+        ALOGV("echo_reference_write() stop write");
+        if (mState.writing) {
+            mState.writing = false;
+            mState.renderTime = {};
+            mState.generation++;
+            mStateLock.publish(mState);
+        }
+        return 0;
+    }
+
+    ALOGV("echo_reference_write() START trying to write %zu frames", buffer->frame_count);
+    ALOGV("echo_reference_write() playbackTimestamp:[%d].[%d], playback_delay:[%d]",
+            (int)buffer->time_stamp.tv_sec,
+            (int)buffer->time_stamp.tv_nsec, buffer->delay_ns);
+
+    // discard writes until a valid time stamp is provided.
+    if ((buffer->time_stamp.tv_sec == 0) && (buffer->time_stamp.tv_nsec == 0) &&
+        (mState.renderTime.tv_sec == 0) && (mState.renderTime.tv_nsec == 0)) {
+        return 0;
+    }
+
+    if (!mState.writing) {
+        ALOGV("echo_reference_write() start write");
+        mState.writing = true;
+        mState.generation++;
+    }
+
+    if (mActiveReaders.load(std::memory_order_relaxed) != 0) {
+        mWritePosition.store(mWriter.totalReleased() * 2 + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        // the FIFO never blocks the writer; when the write exceeds the FIFO capacity
+        // only the most recent frames are kept.
+        const char *src = (const char *)buffer->raw;
+        size_t frames = buffer->frame_count;
+        while (frames > 0) {
+            const ssize_t written = mWriter.write(src, frames);
+            if (written <= 0) {
+                ALOGE("echo_reference_write() FIFO write failed %zd", written);
+                break;
+            }
+            src += written * mFrameSize;
+            frames -= written;
+        }
+        mWritePosition.store(mWriter.totalReleased() * 2, std::memory_order_release);
+    }
+
+    mState.renderTime = buffer->time_stamp;
+    mState.playbackDelayNs = buffer->delay_ns;
+    mState.framesWritten = mWriter.totalReleased();
+    mStateLock.publish(mState);
+
+    ALOGV("echo_reference_write() END frames written total:[%" PRIu64 "]", mState.framesWritten);
+    return 0;
+}
+
+uint64_t EchoReference::flushReader(audio_utils_fifo_reader& reader) {
+    // A reader joining mid-stream starts at the current FIFO rear, which only matches the
+    // writer total when no write is in progress. Retry a few times, then accept being off by
+    // at most one write.
+    constexpr int kMaxAttempts = 4;
+    uint64_t position = 0;
+    for (int i = 0; i < kMaxAttempts; i++) {
+        position = mWritePosition.load(std::memory_order_acquire);
+        reader.flush();
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if ((position & 1) == 0 &&
+                position == mWritePosition.load(std::memory_order_relaxed)) {
+            break;
+        }
+        sched_yield();
+    }
+    return position / 2;
+}
+
+EchoReferenceReader::EchoReferenceReader(EchoReference& er, uint32_t channelCount,
+        uint32_t samplingRate)
+    : mItfe{}
+    , mEr(er)
+    , mFifoReader(er.fifo(), false /*throttlesWriter*/, true /*flush*/)
+    , mChannelCount(channelCount)
+    , mSamplingRate(samplingRate)
+    , mFrameSize(audio_bytes_per_sample(AUDIO_FORMAT_PCM_16_BIT) * channelCount)
+    , mScratch(kChunkFrames * channelCount)
+    , mBufferFrames(framesForDuration(samplingRate) + kChunkFrames)
+{
+    mBuffer.resize(mBufferFrames * channelCount);
+    mItfe.itfe.read = [](struct echo_reference_itfe *echo_reference,
+            struct echo_reference_buffer *buffer) {
+        return fromItfe(echo_reference)->read(buffer);
+    };
+    // readers never write, the echo reference has a single writer.
+    mItfe.itfe.write = [](struct echo_reference_itfe *,
+            struct echo_reference_buffer *) {
+        return -ENOSYS;
+    };
+    mItfe.reader = this;
+
+    if (samplingRate != er.samplingRate()) {
+        ALOGV("%s: new resampler(%u, %u)", __func__, er.samplingRate(), samplingRate);
+        if (create_polyphase_resampler(er.samplingRate(), samplingRate, channelCount,
+                RESAMPLER_QUALITY_DEFAULT, AUDIO_FORMAT_PCM_16_BIT, NULL /*provider*/,
+                &mResampler) != 0) {
+            ALOGW("%s: failure to create resampler", __func__);
+            mResampler = NULL;
+            mInitOk = false;
+        }
+    }
+}
+
+EchoReferenceReader::~EchoReferenceReader() {
+    if (mReading) {
+        mEr.mActiveReaders--;
+    }
+    if (mResampler != NULL) {
+        release_resampler(mResampler);
+    }
+}
+
+void EchoReferenceReader::reset() {
+    ALOGV("%s", __func__);
+    // after this, the writer total at the reader position is mFifoBase + totalReleased().
+    mFifoBase = mEr.flushReader(mFifoReader) - mFifoReader.totalReleased();
+    if (mResampler != NULL) {
+        mResampler->reset(mResampler);
+    }
+    mFramesIn = 0;
+    mDeltaCount = 0;
+    mPrevDeltaSign = 0;
+}
+
+size_t EchoReferenceReader::copyFromFifo(int16_t *dst, const struct audio_utils_iovec iovec[2]) {
+    const int16_t *fifoBuffer = (const int16_t *)mFifoReader.fifo().buffer();
+    const uint32_t wrChannelCount = mEr.channelCount();
+    size_t frames = 0;
+    for (int i = 0; i < 2; i++) {
+        const int16_t *src = fifoBuffer + iovec[i].mOffset * wrChannelCount;
+        if (mChannelCount == wrChannelCount) {
+            memcpy(dst, src, iovec[i].mLength * mFrameSize);
+            dst += iovec[i].mLength * mChannelCount;
+        } else {
+            // must be stereo to mono
+            for (size_t n = iovec[i].mLength; n > 0; n--) {
+                *dst++ = (int16_t)(((int32_t)src[0] + (int32_t)src[1]) >> 1);
+                src += 2;
+            }
+        }
+        frames += iovec[i].mLength;
+    }
+    return frames;
+}
+
+// Moves all playback frames available in the FIFO to the reference buffer, waiting at most
+// timeout for the first frame.
+void EchoReferenceReader::pull(const struct timespec *timeout) {
+    for (;;) {
+        struct audio_utils_iovec iovec[2];
+        size_t lost;
+        const size_t count = mResampler != NULL ? kChunkFrames : mBufferFrames - mFramesIn;
+        const ssize_t avail = mFifoReader.obtain(iovec, count, timeout, &lost);
+        timeout = NULL;
+        if (avail == -EOVERFLOW) {
+            ALOGW("echo_reference_read() lost %zu frames, resync", lost);
+            reset();
+            continue;
+        }
+        if (avail <= 0) {
+            break;
+        }
+
+        size_t framesRd = (size_t)avail;
+        if (mResampler == NULL) {
+            copyFromFifo(mBuffer.data() + mFramesIn * mChannelCount, iovec);
+            mFramesIn += framesRd;
+        } else {
+            copyFromFifo(mScratch.data(), iovec);
+            size_t outFrames = mBufferFrames - mFramesIn;
+            mResampler->resample_from_input(mResampler, mScratch.data(), &framesRd,
+                    mBuffer.data() + mFramesIn * mChannelCount, &outFrames);
+            mFramesIn += outFrames;
+        }
+        mFifoReader.release(avail);
+
+        if (mFramesIn == mBufferFrames || framesRd != (size_t)avail) {
+            // only happens if read() is not called for the buffer duration.
+            ALOGW("echo_reference_read() reference buffer full, resync");
+            reset();
+            break;
+        }
+    }
+}
+
+void EchoReferenceReader::estimateDelay(const WriterState& state,
+        const struct echo_reference_buffer *buffer) {
+    if ((state.renderTime.tv_sec == 0 && state.renderTime.tv_nsec == 0) ||
+        (buffer->time_stamp.tv_sec == 0 && buffer->time_stamp.tv_nsec == 0)) {
+        ALOGV("echo_reference_read(): NEW:timestamp is zero---------setting timeDiff = 0, "
+             "not updating delay this time");
+        return;
+    }
+
+    const int64_t timeDiff =
+            ((int64_t)buffer->time_stamp.tv_sec - state.renderTime.tv_sec) * kNanosPerSecond
+            + (buffer->time_stamp.tv_nsec - state.renderTime.tv_nsec);
+
+    int64_t expectedDelayNs = (int64_t)state.playbackDelayNs + buffer->delay_ns - timeDiff;
+
+    if (mResampler != NULL) {
+        // Resampler already compensates part of the delay
+        expectedDelayNs -= mResampler->delay_ns(mResampler);
+    }
+
+    ALOGV("echo_reference_read(): expectedDelayNs[%" PRId64 "] = "
+            "playback_delay[%d] + delayCapture[%d] - timeDiff[%" PRId64 "]",
+            expectedDelayNs, state.playbackDelayNs, buffer->delay_ns, timeDiff);
+
+    if (expectedDelayNs <= 0) {
+        ALOGV("echo_reference_read(): NEGATIVE expectedDelayNs[%" PRId64 "]", expectedDelayNs);
+        return;
+    }
+
+    // Frames written after the render time snapshot are still in the FIFO (positive),
+    // or the reader already consumed frames whose render time is not yet published (negative).
+    const int64_t pendingFrames =
+            (int64_t)(state.framesWritten - (mFifoBase + mFifoReader.totalReleased()))
+            * mSamplingRate / mEr.samplingRate();
+    const int64_t delayNs = ((int64_t)mFramesIn + pendingFrames) * kNanosPerSecond / mSamplingRate;
+    const int64_t deltaNs = delayNs - expectedDelayNs;
+
+    ALOGV("echo_reference_read(): EchoPathDelayDeviation between reference and DMA [%"
+            PRId64 "]", deltaNs);
+    if (llabs(deltaNs) < kMinDelayDeltaNs) {
+        mDeltaCount = 0;
+        mPrevDeltaSign = 0;
+        return;
+    }
+
+    // smooth the variation and update the reference buffer only
+    // if a deviation in the same direction is observed for more than kMinDeltaNum
+    // consecutive reads.
+    const int16_t delaySign = (deltaNs >= 0) ? 1 : -1;
+    if (delaySign == mPrevDeltaSign) {
+        mDeltaCount++;
+    } else {
+        mDeltaCount = 1;
+    }
+    mPrevDeltaSign = delaySign;
+    if (mDeltaCount <= kMinDeltaNum) {
+        return;
+    }
+
+    const int64_t targetFrames = expectedDelayNs * mSamplingRate / kNanosPerSecond - pendingFrames;
+    const size_t framesIn = (size_t)std::clamp<int64_t>(targetFrames, 0, mBufferFrames);
+    ALOGV("echo_reference_read(): adjusting reference buffer from %zu to %zu frames",
+            mFramesIn, framesIn);
+    if (framesIn > mFramesIn) {
+        // Less data available in the reference buffer than expected
+        memset(mBuffer.data() + mFramesIn * mChannelCount, 0,
+                (framesIn - mFramesIn) * mFrameSize);
+    } else if (framesIn < mFramesIn) {
+        // More data available in the reference buffer than expected
+        memmove(mBuffer.data(), mBuffer.data() + (mFramesIn - framesIn) * mChannelCount,
+                framesIn * mFrameSize);
+    }
+    mFramesIn = framesIn;
+}
+
+int EchoReferenceReader::read(struct echo_reference_buffer *buffer) {
+    if (buffer == NULL) {
+        ALOGV("echo_reference_read() stop read");
+        if (mReading) {
+            mReading = false;
+            mEr.mActiveReaders--;
+        }
+        return 0;
+    }
+
+    ALOGV("echo_reference_read() START, delayCapture:[%d], mFramesIn:[%zu], frame_count:[%zu]",
+            buffer->delay_ns, mFramesIn, buffer->frame_count);
+
+    WriterState state = mEr.writerState();
+    if (!mReading || state.generation != mGeneration) {
+        ALOGV("echo_reference_read() start read");
+        if (!mReading) {
+            mReading = true;
+            mEr.mActiveReaders++;
+        }
+        mGeneration = state.generation;
+        reset();
+    }
+
+    if (!state.writing) {
+        memset(buffer->raw, 0, mFrameSize * buffer->frame_count);
+        buffer->delay_ns = 0;
+        return 0;
+    }
+
+    pull(NULL);
+    // allow some time for new frames to arrive if not enough frames are ready for read
+    if (mFramesIn < buffer->frame_count) {
+        const uint32_t timeoutMs = (uint32_t)((1000 * buffer->frame_count) / mSamplingRate / 2);
+        const struct timespec timeout = {(time_t)(timeoutMs / 1000),
+                (long)(timeoutMs % 1000) * 1000000};
+        pull(&timeout);
+        ALOGV_IF(mFramesIn < buffer->frame_count,
+                 "echo_reference_read() waited %u ms but still not enough frames"
+                 " mFramesIn: %zu, buffer->frame_count = %zu",
+                 timeoutMs, mFramesIn, buffer->frame_count);
+    }
+
+    // the render time must be read after the frames it describes were pulled.
+    state = mEr.writerState();
+    estimateDelay(state, buffer);
+
+    const size_t frames = std::min(mFramesIn, buffer->frame_count);
+    memcpy(buffer->raw, mBuffer.data(), frames * mFrameSize);
+    if (frames < buffer->frame_count) {
+        // filling up the reference buffer with 0s to match the expected delay.
+        memset((char *)buffer->raw + frames * mFrameSize, 0,
+                (buffer->frame_count - frames) * mFrameSize);
+    }
+    mFramesIn -= frames;
+    memmove(mBuffer.data(), mBuffer.data() + frames * mChannelCount, mFramesIn * mFrameSize);
+
+    // As the reference buffer is now time aligned to the microphone signal there is a zero delay
+    buffer->delay_ns = 0;
+
+    ALOGV("echo_reference_read() END %zu frames, total frames in %zu",
+          buffer->frame_count, mFramesIn);
+    return 0;
+}
+
+bool isConfigSupported(audio_format_t rdFormat, uint32_t rdChannelCount,
+        audio_format_t wrFormat, uint32_t wrChannelCount) {
+    if (rdFormat != AUDIO_FORMAT_PCM_16_BIT ||
+            rdFormat != wrFormat) {
+        ALOGW("create_echo_reference bad format rd %d, wr %d", rdFormat, wrFormat);
+        return false;
+    }
+    if ((rdChannelCount != 1 && rdChannelCount != 2) ||
+            wrChannelCount != 2) {
+        ALOGW("create_echo_reference bad channel count rd %d, wr %d", rdChannelCount,
+                wrChannelCount);
+        return false;
+    }
+    return true;
+}
+
+} // namespace
+
+int create_echo_reference(audio_format_t rdFormat,
+                            uint32_t rdChannelCount,
+                            uint32_t rdSamplingRate,
+                            audio_format_t wrFormat,
+                            uint32_t wrChannelCount,
+                            uint32_t wrSamplingRate,
+                            struct echo_reference_itfe **echo_reference)
+{
+    ALOGV("create_echo_reference()");
+
+    if (echo_reference == NULL) {
+        return -EINVAL;
+    }
+
+    *echo_reference = NULL;
+
+    if (!isConfigSupported(rdFormat, rdChannelCount, wrFormat, wrChannelCount)) {
+        return -EINVAL;
+    }
+    if (rdSamplingRate == 0 || wrSamplingRate == 0) {
+        return -EINVAL;
+    }
+
+    EchoReference *er = new (std::nothrow) EchoReference(
+            rdChannelCount, rdSamplingRate, wrChannelCount, wrSamplingRate);
+    if (er == NULL) {
+        return -ENOMEM;
+    }
+    if (!er->initCheck()) {
+        delete er;
+        return -ENODEV;
+    }
+    *echo_reference = er->itfe();
+    return 0;
+}
+
+void release_echo_reference(struct echo_reference_itfe *echo_reference) {
+    if (echo_reference == NULL) {
+        return;
+    }
+
+    ALOGV("EchoReference dstor");
+    delete EchoReference::fromItfe(echo_reference);
+}
+
+int echo_reference_add_reader(struct echo_reference_itfe *echo_reference,
+                              audio_format_t rdFormat,
+                              uint32_t rdChannelCount,
+                              uint32_t rdSamplingRate,
+                              struct echo_reference_itfe **reader)
+{
+    if (echo_reference == NULL || reader == NULL) {
+        return -EINVAL;
+    }
+
+    *reader = NULL;
+
+    if (!isConfigSupported(rdFormat, rdChannelCount, AUDIO_FORMAT_PCM_16_BIT, 2)) {
+        return -EINVAL;
+    }
+    if (rdSamplingRate == 0) {
+        return -EINVAL;
+    }
+
+    EchoReference *er = EchoReference::fromItfe(echo_reference);
+    EchoReferenceReader *rd = new (std::nothrow) EchoReferenceReader(
+            *er, rdChannelCount, rdSamplingRate);
+    if (rd == NULL) {
+        return -ENOMEM;
+    }
+    if (!rd->initCheck()) {
+        delete rd;
+        return -ENODEV;
+    }
+    er->mAddedReaders++;
+    *reader = rd->itfe();
+    return 0;
+}
+
+void echo_reference_remove_reader(struct echo_reference_itfe *echo_reference,
+                                  struct echo_reference_itfe *reader)
+{
+    if (echo_reference == NULL || reader == NULL) {
+        return;
+    }
+
+    EchoReference::fromItfe(echo_reference)->mAddedReaders--;
+    delete EchoReferenceReader::fromItfe(reader);
+}
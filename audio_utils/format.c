@@ -15,149 +15,174 @@
  */
 
 #include <assert.h>
+#include <string.h>
+
 #include <audio_utils/format.h>
 #include <audio_utils/primitives.h>
 
-void memcpy_by_audio_format(void *dst, audio_format_t dst_format,
-        const void *src, audio_format_t src_format, size_t count)
+/* Straight copy of identical formats, skipped for in-place conversion. */
+#define DEFINE_MEMCPY_SAME_FN(name, bytes) \
+static void memcpy_fn_##name(void *dst, const void *src, size_t count) \
+{ \
+    if (dst != src) { \
+        /* TODO: should assert if memory regions overlap. */ \
+        memcpy(dst, src, count * (bytes)); \
+    } \
+}
+
+/* Adapts a typed primitives.h conversion to memcpy_by_audio_format_fn_t. */
+#define DEFINE_MEMCPY_FN(name, dst_type, src_type, fn) \
+static void memcpy_fn_##name(void *dst, const void *src, size_t count) \
+{ \
+    fn((dst_type *)dst, (const src_type *)src, count); \
+}
+
+DEFINE_MEMCPY_SAME_FN(copy_8, 1)
+DEFINE_MEMCPY_SAME_FN(copy_16, 2)
+DEFINE_MEMCPY_SAME_FN(copy_24, 3)
+DEFINE_MEMCPY_SAME_FN(copy_32, 4)
+
+DEFINE_MEMCPY_FN(u8_from_i16, uint8_t, int16_t, memcpy_to_u8_from_i16)
+DEFINE_MEMCPY_FN(u8_from_p24, uint8_t, uint8_t, memcpy_to_u8_from_p24)
+DEFINE_MEMCPY_FN(u8_from_i32, uint8_t, int32_t, memcpy_to_u8_from_i32)
+DEFINE_MEMCPY_FN(u8_from_q8_23, uint8_t, int32_t, memcpy_to_u8_from_q8_23)
+DEFINE_MEMCPY_FN(u8_from_float, uint8_t, float, memcpy_to_u8_from_float)
+
+DEFINE_MEMCPY_FN(i16_from_u8, int16_t, uint8_t, memcpy_to_i16_from_u8)
+DEFINE_MEMCPY_FN(i16_from_p24, int16_t, uint8_t, memcpy_to_i16_from_p24)
+DEFINE_MEMCPY_FN(i16_from_i32, int16_t, int32_t, memcpy_to_i16_from_i32)
+DEFINE_MEMCPY_FN(i16_from_q8_23, int16_t, int32_t, memcpy_to_i16_from_q8_23)
+DEFINE_MEMCPY_FN(i16_from_float, int16_t, float, memcpy_to_i16_from_float)
+
+DEFINE_MEMCPY_FN(p24_from_u8, uint8_t, uint8_t, memcpy_to_p24_from_u8)
+DEFINE_MEMCPY_FN(p24_from_i16, uint8_t, int16_t, memcpy_to_p24_from_i16)
+DEFINE_MEMCPY_FN(p24_from_i32, uint8_t, int32_t, memcpy_to_p24_from_i32)
+DEFINE_MEMCPY_FN(p24_from_q8_23, uint8_t, int32_t, memcpy_to_p24_from_q8_23)
+DEFINE_MEMCPY_FN(p24_from_float, uint8_t, float, memcpy_to_p24_from_float)
+
+DEFINE_MEMCPY_FN(i32_from_u8, int32_t, uint8_t, memcpy_to_i32_from_u8)
+DEFINE_MEMCPY_FN(i32_from_i16, int32_t, int16_t, memcpy_to_i32_from_i16)
+DEFINE_MEMCPY_FN(i32_from_p24, int32_t, uint8_t, memcpy_to_i32_from_p24)
+DEFINE_MEMCPY_FN(i32_from_q8_23, int32_t, int32_t, memcpy_to_i32_from_q8_23)
+DEFINE_MEMCPY_FN(i32_from_float, int32_t, float, memcpy_to_i32_from_float)
+
+DEFINE_MEMCPY_FN(q8_23_from_u8, int32_t, uint8_t, memcpy_to_q8_23_from_u8)
+DEFINE_MEMCPY_FN(q8_23_from_i16, int32_t, int16_t, memcpy_to_q8_23_from_i16)
+DEFINE_MEMCPY_FN(q8_23_from_p24, int32_t, uint8_t, memcpy_to_q8_23_from_p24)
+DEFINE_MEMCPY_FN(q8_23_from_i32, int32_t, int32_t, memcpy_to_q8_23_from_i32)
+DEFINE_MEMCPY_FN(q8_23_from_float, int32_t, float, memcpy_to_q8_23_from_float_with_clamp)
+
+DEFINE_MEMCPY_FN(float_from_u8, float, uint8_t, memcpy_to_float_from_u8)
+DEFINE_MEMCPY_FN(float_from_i16, float, int16_t, memcpy_to_float_from_i16)
+DEFINE_MEMCPY_FN(float_from_p24, float, uint8_t, memcpy_to_float_from_p24)
+DEFINE_MEMCPY_FN(float_from_i32, float, int32_t, memcpy_to_float_from_i32)
+DEFINE_MEMCPY_FN(float_from_q8_23, float, int32_t, memcpy_to_float_from_q8_23)
+
+/* Row and column indices of the conversion matrix. */
+enum memcpy_format_index {
+    MEMCPY_FORMAT_U8,
+    MEMCPY_FORMAT_I16,
+    MEMCPY_FORMAT_P24,
+    MEMCPY_FORMAT_I32,
+    MEMCPY_FORMAT_Q8_23,
+    MEMCPY_FORMAT_FLOAT,
+    MEMCPY_FORMAT_COUNT,
+    MEMCPY_FORMAT_INVALID = MEMCPY_FORMAT_COUNT,
+};
+
+/* Direct conversion for every pair of PCM formats, indexed by [dst][src]. */
+static const memcpy_by_audio_format_fn_t memcpy_fns[MEMCPY_FORMAT_COUNT][MEMCPY_FORMAT_COUNT] = {
+    [MEMCPY_FORMAT_U8] = {
+        [MEMCPY_FORMAT_U8] = memcpy_fn_copy_8,
+        [MEMCPY_FORMAT_I16] = memcpy_fn_u8_from_i16,
+        [MEMCPY_FORMAT_P24] = memcpy_fn_u8_from_p24,
+        [MEMCPY_FORMAT_I32] = memcpy_fn_u8_from_i32,
+        [MEMCPY_FORMAT_Q8_23] = memcpy_fn_u8_from_q8_23,
+        [MEMCPY_FORMAT_FLOAT] = memcpy_fn_u8_from_float,
+    },
+    [MEMCPY_FORMAT_I16] = {
+        [MEMCPY_FORMAT_U8] = memcpy_fn_i16_from_u8,
+        [MEMCPY_FORMAT_I16] = memcpy_fn_copy_16,
+        [MEMCPY_FORMAT_P24] = memcpy_fn_i16_from_p24,
+        [MEMCPY_FORMAT_I32] = memcpy_fn_i16_from_i32,
+        [MEMCPY_FORMAT_Q8_23] = memcpy_fn_i16_from_q8_23,
+        [MEMCPY_FORMAT_FLOAT] = memcpy_fn_i16_from_float,
+    },
+    [MEMCPY_FORMAT_P24] = {
+        [MEMCPY_FORMAT_U8] = memcpy_fn_p24_from_u8,
+        [MEMCPY_FORMAT_I16] = memcpy_fn_p24_from_i16,
+        [MEMCPY_FORMAT_P24] = memcpy_fn_copy_24,
+        [MEMCPY_FORMAT_I32] = memcpy_fn_p24_from_i32,
+        [MEMCPY_FORMAT_Q8_23] = memcpy_fn_p24_from_q8_23,
+        [MEMCPY_FORMAT_FLOAT] = memcpy_fn_p24_from_float,
+    },
+    [MEMCPY_FORMAT_I32] = {
+        [MEMCPY_FORMAT_U8] = memcpy_fn_i32_from_u8,
+        [MEMCPY_FORMAT_I16] = memcpy_fn_i32_from_i16,
+        [MEMCPY_FORMAT_P24] = memcpy_fn_i32_from_p24,
+        [MEMCPY_FORMAT_I32] = memcpy_fn_copy_32,
+        [MEMCPY_FORMAT_Q8_23] = memcpy_fn_i32_from_q8_23,
+        [MEMCPY_FORMAT_FLOAT] = memcpy_fn_i32_from_float,
+    },
+    [MEMCPY_FORMAT_Q8_23] = {
+        [MEMCPY_FORMAT_U8] = memcpy_fn_q8_23_from_u8,
+        [MEMCPY_FORMAT_I16] = memcpy_fn_q8_23_from_i16,
+        [MEMCPY_FORMAT_P24] = memcpy_fn_q8_23_from_p24,
+        [MEMCPY_FORMAT_I32] = memcpy_fn_q8_23_from_i32,
+        [MEMCPY_FORMAT_Q8_23] = memcpy_fn_copy_32,
+        [MEMCPY_FORMAT_FLOAT] = memcpy_fn_q8_23_from_float,
+    },
+    [MEMCPY_FORMAT_FLOAT] = {
+        [MEMCPY_FORMAT_U8] = memcpy_fn_float_from_u8,
+        [MEMCPY_FORMAT_I16] = memcpy_fn_float_from_i16,
+        [MEMCPY_FORMAT_P24] = memcpy_fn_float_from_p24,
+        [MEMCPY_FORMAT_I32] = memcpy_fn_float_from_i32,
+        [MEMCPY_FORMAT_Q8_23] = memcpy_fn_float_from_q8_23,
+        [MEMCPY_FORMAT_FLOAT] = memcpy_fn_copy_32,
+    },
+};
+
+static enum memcpy_format_index memcpy_format_index(audio_format_t format)
 {
-    /* default cases for error falls through to assert(false) below. */
-    if (dst_format == src_format) {
-        switch (dst_format) {
-        case AUDIO_FORMAT_PCM_16_BIT:
-        case AUDIO_FORMAT_PCM_FLOAT:
-        case AUDIO_FORMAT_PCM_8_BIT:
-        case AUDIO_FORMAT_PCM_24_BIT_PACKED:
-        case AUDIO_FORMAT_PCM_32_BIT:
-        case AUDIO_FORMAT_PCM_8_24_BIT:
-            if (dst != src) {
-                // TODO: should assert if memory regions overlap.
-                memcpy(dst, src, count * audio_bytes_per_sample(dst_format));
-            }
-            return;
-        default:
-            break;
-        }
-    }
-    switch (dst_format) {
-    case AUDIO_FORMAT_PCM_16_BIT:
-        switch (src_format) {
-        case AUDIO_FORMAT_PCM_FLOAT:
-            memcpy_to_i16_from_float((int16_t*)dst, (float*)src, count);
-            return;
-        case AUDIO_FORMAT_PCM_8_BIT:
-            memcpy_to_i16_from_u8((int16_t*)dst, (uint8_t*)src, count);
-            return;
-        case AUDIO_FORMAT_PCM_24_BIT_PACKED:
-            memcpy_to_i16_from_p24((int16_t*)dst, (uint8_t*)src, count);
-            return;
-        case AUDIO_FORMAT_PCM_32_BIT:
-            memcpy_to_i16_from_i32((int16_t*)dst, (int32_t*)src, count);
-            return;
-        case AUDIO_FORMAT_PCM_8_24_BIT:
-            memcpy_to_i16_from_q8_23((int16_t*)dst, (int32_t*)src, count);
-            return;
-        default:
-            break;
-        }
-        break;
-    case AUDIO_FORMAT_PCM_FLOAT:
-        switch (src_format) {
-        case AUDIO_FORMAT_PCM_16_BIT:
-            memcpy_to_float_from_i16((float*)dst, (int16_t*)src, count);
-            return;
-        case AUDIO_FORMAT_PCM_8_BIT:
-            memcpy_to_float_from_u8((float*)dst, (uint8_t*)src, count);
-            return;
-        case AUDIO_FORMAT_PCM_24_BIT_PACKED:
-            memcpy_to_float_from_p24((float*)dst, (uint8_t*)src, count);
-            return;
-        case AUDIO_FORMAT_PCM_32_BIT:
-            memcpy_to_float_from_i32((float*)dst, (int32_t*)src, count);
-            return;
-        case AUDIO_FORMAT_PCM_8_24_BIT:
-            memcpy_to_float_from_q8_23((float*)dst, (int32_t*)src, count);
-            return;
-        default:
-            break;
-        }
-        break;
+    switch (format) {
     case AUDIO_FORMAT_PCM_8_BIT:
-        switch (src_format) {
-        case AUDIO_FORMAT_PCM_16_BIT:
-            memcpy_to_u8_from_i16((uint8_t*)dst, (int16_t*)src, count);
-            return;
-        case AUDIO_FORMAT_PCM_FLOAT:
-            memcpy_to_u8_from_float((uint8_t*)dst, (float*)src, count);
-            return;
-        // The following converts HAL to AudioRecord formats.
-        case AUDIO_FORMAT_PCM_24_BIT_PACKED:
-            memcpy_to_u8_from_p24((uint8_t*)dst, (uint8_t*)src, count);
-            return;
-        case AUDIO_FORMAT_PCM_32_BIT:
-            memcpy_to_u8_from_i32((uint8_t*)dst, (int32_t*)src, count);
-            return;
-        case AUDIO_FORMAT_PCM_8_24_BIT:
-            memcpy_to_u8_from_q8_23((uint8_t*)dst, (int32_t*)src, count);
-            return;
-        default:
-            break;
-        }
-        break;
+        return MEMCPY_FORMAT_U8;
+    case AUDIO_FORMAT_PCM_16_BIT:
+        return MEMCPY_FORMAT_I16;
     case AUDIO_FORMAT_PCM_24_BIT_PACKED:
-        switch (src_format) {
-        case AUDIO_FORMAT_PCM_16_BIT:
-            memcpy_to_p24_from_i16((uint8_t*)dst, (int16_t*)src, count);
-            return;
-        case AUDIO_FORMAT_PCM_FLOAT:
-            memcpy_to_p24_from_float((uint8_t*)dst, (float*)src, count);
-            return;
-        case AUDIO_FORMAT_PCM_32_BIT:
-            memcpy_to_p24_from_i32((uint8_t*)dst, (int32_t*)src, count);
-            return;
-        case AUDIO_FORMAT_PCM_8_24_BIT:
-            memcpy_to_p24_from_q8_23((uint8_t*)dst, (int32_t*)src, count);
-            return;
-        default:
-            break;
-        }
-        break;
+        return MEMCPY_FORMAT_P24;
     case AUDIO_FORMAT_PCM_32_BIT:
-        switch (src_format) {
-        case AUDIO_FORMAT_PCM_16_BIT:
-            memcpy_to_i32_from_i16((int32_t*)dst, (int16_t*)src, count);
-            return;
-        case AUDIO_FORMAT_PCM_FLOAT:
-            memcpy_to_i32_from_float((int32_t*)dst, (float*)src, count);
-            return;
-        case AUDIO_FORMAT_PCM_24_BIT_PACKED:
-            memcpy_to_i32_from_p24((int32_t*)dst, (uint8_t *)src, count);
-            return;
-        default:
-            break;
-        }
-        break;
+        return MEMCPY_FORMAT_I32;
     case AUDIO_FORMAT_PCM_8_24_BIT:
-        switch (src_format) {
-        case AUDIO_FORMAT_PCM_16_BIT:
-            memcpy_to_q8_23_from_i16((int32_t*)dst, (int16_t*)src, count);
-            return;
-        case AUDIO_FORMAT_PCM_FLOAT:
-            memcpy_to_q8_23_from_float_with_clamp((int32_t*)dst, (float*)src, count);
-            return;
-        case AUDIO_FORMAT_PCM_24_BIT_PACKED: {
-            memcpy_to_q8_23_from_p24((int32_t *)dst, (uint8_t *)src, count);
-            return;
-        }
-        default:
-            break;
-        }
-        break;
+        return MEMCPY_FORMAT_Q8_23;
+    case AUDIO_FORMAT_PCM_FLOAT:
+        return MEMCPY_FORMAT_FLOAT;
     default:
-        break;
+        return MEMCPY_FORMAT_INVALID;
     }
-    // invalid src format for dst format
-    assert(false);
+}
+
+memcpy_by_audio_format_fn_t get_memcpy_by_audio_format_fn(audio_format_t dst_format,
+        audio_format_t src_format)
+{
+    const enum memcpy_format_index dst_index = memcpy_format_index(dst_format);
+    const enum memcpy_format_index src_index = memcpy_format_index(src_format);
+    if (dst_index == MEMCPY_FORMAT_INVALID || src_index == MEMCPY_FORMAT_INVALID) {
+        return NULL;
+    }
+    return memcpy_fns[dst_index][src_index];
+}
+
+void memcpy_by_audio_format(void *dst, audio_format_t dst_format,
+        const void *src, audio_format_t src_format, size_t count)
+{
+    const memcpy_by_audio_format_fn_t fn = get_memcpy_by_audio_format_fn(dst_format, src_format);
+    if (fn == NULL) {
+        // invalid src format for dst format
+        assert(false);
+        return;
+    }
+    fn(dst, src, count);
 }
 
 size_t memcpy_by_index_array_initialization_from_channel_mask(int8_t *idxary, size_t arysize,
@@ -0,0 +1,252 @@
+/*
+ * Copyright 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdlib.h>
+
+#include <audio_utils/format.h>
+#include <audio_utils/intrinsic_utils.h>
+#include <audio_utils/primitives.h>
+
+#if defined(__aarch64__) || defined(__ARM_NEON__)
+#define USE_NEON
+#endif
+
+namespace {
+
+using namespace android::audio_utils::intrinsics;
+
+// Sample traits: the storage type of one sample, and conversion to and from float.
+
+struct U8Sample {
+    using storage_t = uint8_t;
+    static constexpr size_t kStride = 1;
+    static float load(const storage_t *p) { return float_from_u8(*p); }
+    static void store(storage_t *p, float f) { *p = clamp8_from_float(f); }
+};
+
+struct I16Sample {
+    using storage_t = int16_t;
+    static constexpr size_t kStride = 1;
+    static float load(const storage_t *p) { return float_from_i16(*p); }
+    static void store(storage_t *p, float f) { *p = clamp16_from_float(f); }
+};
+
+struct P24Sample {
+    using storage_t = uint8_t;
+    static constexpr size_t kStride = 3;
+    static float load(const storage_t *p) { return float_from_p24(p); }
+    static void store(storage_t *p, float f) {
+        const int32_t ival = clamp24_from_float(f);
+#if HAVE_BIG_ENDIAN
+        p[0] = ival >> 16;
+        p[1] = ival >> 8;
+        p[2] = ival;
+#else
+        p[0] = ival;
+        p[1] = ival >> 8;
+        p[2] = ival >> 16;
+#endif
+    }
+};
+
+struct I32Sample {
+    using storage_t = int32_t;
+    static constexpr size_t kStride = 1;
+    static float load(const storage_t *p) { return float_from_i32(*p); }
+    static void store(storage_t *p, float f) { *p = clamp32_from_float(f); }
+};
+
+struct Q8_23Sample {
+    using storage_t = int32_t;
+    static constexpr size_t kStride = 1;
+    static float load(const storage_t *p) { return float_from_q8_23(*p); }
+    static void store(storage_t *p, float f) { *p = clamp24_from_float(f); }
+};
+
+struct FloatSample {
+    using storage_t = float;
+    static constexpr size_t kStride = 1;
+    static float load(const storage_t *p) { return *p; }
+    static void store(storage_t *p, float f) { *p = f; }
+};
+
+// Single pass over the frames for a compile time destination channel count.
+// The source samples of a frame are gathered into a SIMD vector (NEON on ARM,
+// a loop vectorized array elsewhere), scaled by the channel gains,
+// and converted to the destination format.
+template <size_t N, typename D, typename S>
+void remapFrames(void *dst, const void *src, uint32_t srcChannels,
+        const int8_t *idxary, const float *gains, size_t count) {
+    using Vector = vector_hw_t<float, N>;
+    auto *d = static_cast<typename D::storage_t *>(dst);
+    auto *s = static_cast<const typename S::storage_t *>(src);
+    const size_t srcFrameStride = srcChannels * S::kStride;
+
+    size_t offsets[N];
+    float gainLanes[N];
+    for (size_t c = 0; c < N; ++c) {
+        offsets[c] = idxary[c] * S::kStride;
+        gainLanes[c] = gains == nullptr ? 1.f : gains[c];
+    }
+    const Vector gainVector = vld1<Vector>(gainLanes);
+
+    for (; count > 0; --count) {
+        float lanes[N];
+        #pragma unroll
+        for (size_t c = 0; c < N; ++c) {
+            lanes[c] = S::load(s + offsets[c]);
+        }
+        const Vector out = vmul(vld1<Vector>(lanes), gainVector);
+        if constexpr (std::is_same_v<D, FloatSample>) {
+            vst1(d, out);
+        } else {
+            vst1(lanes, out);
+            #pragma unroll
+            for (size_t c = 0; c < N; ++c) {
+                D::store(d + c * D::kStride, lanes[c]);
+            }
+        }
+        d += N * D::kStride;
+        s += srcFrameStride;
+    }
+}
+
+// Any other destination channel count, or silent destination channels.
+template <typename D, typename S>
+void remapFrames(void *dst, uint32_t dstChannels, const void *src, uint32_t srcChannels,
+        const int8_t *idxary, const float *gains, size_t count) {
+    auto *d = static_cast<typename D::storage_t *>(dst);
+    auto *s = static_cast<const typename S::storage_t *>(src);
+    for (; count > 0; --count) {
+        for (size_t c = 0; c < dstChannels; ++c) {
+            const float f = idxary[c] < 0 ? 0.f
+                    : S::load(s + idxary[c] * S::kStride) * (gains == nullptr ? 1.f : gains[c]);
+            D::store(d, f);
+            d += D::kStride;
+        }
+        s += srcChannels * S::kStride;
+    }
+}
+
+template <typename D, typename S>
+void remapByChannels(void *dst, uint32_t dstChannels, const void *src, uint32_t srcChannels,
+        const int8_t *idxary, const float *gains, size_t count) {
+    for (size_t c = 0; c < dstChannels; ++c) {
+        if (idxary[c] < 0) {
+            remapFrames<D, S>(dst, dstChannels, src, srcChannels, idxary, gains, count);
+            return;
+        }
+    }
+    switch (dstChannels) {
+    case 1:
+        remapFrames<1, D, S>(dst, src, srcChannels, idxary, gains, count);
+        return;
+    case 2:
+        remapFrames<2, D, S>(dst, src, srcChannels, idxary, gains, count);
+        return;
+    case 4:
+        remapFrames<4, D, S>(dst, src, srcChannels, idxary, gains, count);
+        return;
+    case 6:
+        remapFrames<6, D, S>(dst, src, srcChannels, idxary, gains, count);
+        return;
+    case 8:
+        remapFrames<8, D, S>(dst, src, srcChannels, idxary, gains, count);
+        return;
+    default:
+        remapFrames<D, S>(dst, dstChannels, src, srcChannels, idxary, gains, count);
+        return;
+    }
+}
+
+template <typename D>
+void remapBySource(void *dst, uint32_t dstChannels,
+        const void *src, audio_format_t srcFormat, uint32_t srcChannels,
+        const int8_t *idxary, const float *gains, size_t count) {
+    switch (srcFormat) {
+    case AUDIO_FORMAT_PCM_8_BIT:
+        remapByChannels<D, U8Sample>(dst, dstChannels, src, srcChannels, idxary, gains, count);
+        return;
+    case AUDIO_FORMAT_PCM_16_BIT:
+        remapByChannels<D, I16Sample>(dst, dstChannels, src, srcChannels, idxary, gains, count);
+        return;
+    case AUDIO_FORMAT_PCM_24_BIT_PACKED:
+        remapByChannels<D, P24Sample>(dst, dstChannels, src, srcChannels, idxary, gains, count);
+        return;
+    case AUDIO_FORMAT_PCM_32_BIT:
+        remapByChannels<D, I32Sample>(dst, dstChannels, src, srcChannels, idxary, gains, count);
+        return;
+    case AUDIO_FORMAT_PCM_8_24_BIT:
+        remapByChannels<D, Q8_23Sample>(dst, dstChannels, src, srcChannels, idxary, gains, count);
+        return;
+    case AUDIO_FORMAT_PCM_FLOAT:
+        remapByChannels<D, FloatSample>(dst, dstChannels, src, srcChannels, idxary, gains, count);
+        return;
+    default:
+        abort(); /* illegal value */
+    }
+}
+
+bool isUnityGain(const float *gains, uint32_t channels) {
+    if (gains == nullptr) return true;
+    for (size_t c = 0; c < channels; ++c) {
+        if (gains[c] != 1.f) return false;
+    }
+    return true;
+}
+
+} // namespace
+
+void memcpy_by_index_array_and_format_with_gain(
+        void *dst, audio_format_t dst_format, uint32_t dst_channels,
+        const void *src, audio_format_t src_format, uint32_t src_channels,
+        const int8_t *idxary, const float *gains, size_t count)
+{
+    // a copy keeps all the bits of the 32 bit integer formats, which float does not.
+    if (dst_format == src_format && isUnityGain(gains, dst_channels)) {
+        memcpy_by_index_array(dst, dst_channels, src, src_channels, idxary,
+                audio_bytes_per_sample(dst_format), count);
+        return;
+    }
+    switch (dst_format) {
+    case AUDIO_FORMAT_PCM_8_BIT:
+        remapBySource<U8Sample>(dst, dst_channels, src, src_format, src_channels,
+                idxary, gains, count);
+        return;
+    case AUDIO_FORMAT_PCM_16_BIT:
+        remapBySource<I16Sample>(dst, dst_channels, src, src_format, src_channels,
+                idxary, gains, count);
+        return;
+    case AUDIO_FORMAT_PCM_24_BIT_PACKED:
+        remapBySource<P24Sample>(dst, dst_channels, src, src_format, src_channels,
+                idxary, gains, count);
+        return;
+    case AUDIO_FORMAT_PCM_32_BIT:
+        remapBySource<I32Sample>(dst, dst_channels, src, src_format, src_channels,
+                idxary, gains, count);
+        return;
+    case AUDIO_FORMAT_PCM_8_24_BIT:
+        remapBySource<Q8_23Sample>(dst, dst_channels, src, src_format, src_channels,
+                idxary, gains, count);
+        return;
+    case AUDIO_FORMAT_PCM_FLOAT:
+        remapBySource<FloatSample>(dst, dst_channels, src, src_format, src_channels,
+                idxary, gains, count);
+        return;
+    default:
+        abort(); /* illegal value */
+    }
+}
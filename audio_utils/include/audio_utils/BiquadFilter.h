@@ -169,6 +169,17 @@ struct BiquadDirect2Transpose {
         s_[0] = s[0];
         s_[1] = s[1];
     }
+
+    // Filters a single sample (or a vector of channels) with all coefficients,
+    // updating the delay state.  This is used to chain kernels in BiquadCascadeFilter.
+    __attribute__((always_inline))
+    T step(const T& x) {
+        using namespace intrinsics;
+        const T y = vmla(s_[0], coef_[0], x);
+        s_[0] = vmla(vmla(s_[1], coef_[3], y), coef_[1], x);
+        s_[1] = vmla(vmul(coef_[2], x), coef_[4], y);
+        return y;
+    }
 };
 
 /**
@@ -397,6 +408,18 @@ struct BiquadStateSpace {
         s_[0] = s[0];
         s_[1] = s[1];
     }
+
+    // Filters a single sample (or a vector of channels) with all coefficients,
+    // updating the delay state.  This is used to chain kernels in BiquadCascadeFilter.
+    __attribute__((always_inline))
+    T step(const T& x) {
+        using namespace intrinsics;
+        const T y = vmla(s_[0], coef_[0], x);
+        const T s0 = vmla(vmla(s_[1], coef_[1], x), coef_[3], s_[0]);
+        s_[1] = vmla(vmul(coef_[2], x), coef_[4], s_[0]);
+        s_[0] = s0;
+        return y;
+    }
 };
 
 namespace details {
@@ -655,6 +678,232 @@ void biquad_filter_func(D *out, const D *in, size_t frames, size_t stride,
     exit:;
 }
 
+// Constructs the STAGES filter kernels of a cascade for one vector of channels.
+// The coefficients are stored by stage, and the delays by stage and then by channel
+// with channelStride between the s1 and s2 of a stage.
+template <typename KernelType, typename T, typename D, size_t... Is>
+static inline auto make_cascade_kernels(const D *coefs, const D *delays, size_t channelStride,
+        std::index_sequence<Is...>) {
+    using namespace android::audio_utils::intrinsics;
+    return std::array<KernelType, sizeof...(Is)>{{
+            KernelType(coefs[Is * kBiquadNumCoefs], coefs[Is * kBiquadNumCoefs + 1],
+                    coefs[Is * kBiquadNumCoefs + 2], coefs[Is * kBiquadNumCoefs + 3],
+                    coefs[Is * kBiquadNumCoefs + 4],
+                    vld1<T>(&delays[Is * kBiquadNumDelays * channelStride]),
+                    vld1<T>(&delays[(Is * kBiquadNumDelays + 1) * channelStride]))...}};
+}
+
+// Filters channelCount channels through all STAGES of the cascade in a single pass,
+// with sizeof(T) / sizeof(D) channels per SIMD vector.  The intermediate results
+// between stages stay in registers.
+template <typename ConstOptions, size_t STAGES, typename T, typename D>
+void biquad_cascade_func_impl(D *out, const D *in, size_t frames, size_t stride,
+        size_t channelCount, D *delays, const D *coefs, size_t channelStride) {
+    using namespace android::audio_utils::intrinsics;
+    using KernelType = typename ConstOptions::template FilterType<T, D>;
+    constexpr size_t elements = sizeof(T) / sizeof(D); // how many float elements in T.
+
+    for (size_t i = 0; i < channelCount; i += elements) {
+        auto kernels = make_cascade_kernels<KernelType, T>(
+                coefs, delays + i, channelStride, std::make_index_sequence<STAGES>());
+#ifdef USE_DITHER
+        constexpr D DITHER_VALUE = std::numeric_limits<float>::min() * (1 << 24); // use FLOAT
+        T dither = vdupn<T>(DITHER_VALUE); // NEON does not have vector + scalar acceleration.
+#endif
+        const D *input = in + i;
+        D *output = out + i;
+        for (size_t frame = 0; frame < frames; ++frame) {
+            T x = vld1<T>(input);
+            input += stride;
+            #pragma unroll
+            for (size_t j = 0; j < STAGES; ++j) {
+#ifdef USE_DITHER
+                x = vadd(x, dither);
+#endif
+                x = kernels[j].step(x);
+            }
+#ifdef USE_DITHER
+            dither = vneg(dither);
+#endif
+            vst1(output, x);
+            output += stride;
+        }
+        for (size_t j = 0; j < STAGES; ++j) {
+            vst1(&delays[j * kBiquadNumDelays * channelStride + i], kernels[j].s_[0]);
+            vst1(&delays[(j * kBiquadNumDelays + 1) * channelStride + i], kernels[j].s_[1]);
+        }
+    }
+}
+
+template <typename ConstOptions, size_t STAGES, typename D>
+void biquad_cascade_func(D *out, const D *in, size_t frames, size_t stride,
+        size_t channelCount, D *delays, const D *coefs) {
+#ifdef USE_NEON
+    using alt_16_t = float32x4x4_t;
+    using alt_8_t = float32x4x2_t;
+    using alt_4_t = float32x4_t;
+#else
+    using alt_16_t = intrinsics::internal_array_t<float, 16>;
+    using alt_8_t = intrinsics::internal_array_t<float, 8>;
+    using alt_4_t = intrinsics::internal_array_t<float, 4>;
+#endif
+    using alt_2_t = intrinsics::internal_array_t<float, 2>;
+
+    for (size_t offset = 0; offset < channelCount; ) {
+        size_t remaining = channelCount - offset;
+        if constexpr (std::is_same_v<D, float>) {
+            if (remaining >= 16) {
+                remaining &= ~15;
+                biquad_cascade_func_impl<ConstOptions, STAGES, alt_16_t>(
+                        out + offset, in + offset, frames, stride, remaining,
+                        delays + offset, coefs, channelCount);
+            } else if (remaining >= 8) {
+                remaining = 8;
+                biquad_cascade_func_impl<ConstOptions, STAGES, alt_8_t>(
+                        out + offset, in + offset, frames, stride, remaining,
+                        delays + offset, coefs, channelCount);
+            } else if (remaining >= 4) {
+                remaining = 4;
+                biquad_cascade_func_impl<ConstOptions, STAGES, alt_4_t>(
+                        out + offset, in + offset, frames, stride, remaining,
+                        delays + offset, coefs, channelCount);
+            } else if (remaining >= 2) {
+                remaining = 2;
+                biquad_cascade_func_impl<ConstOptions, STAGES, alt_2_t>(
+                        out + offset, in + offset, frames, stride, remaining,
+                        delays + offset, coefs, channelCount);
+            } else {
+                biquad_cascade_func_impl<ConstOptions, STAGES, D>(
+                        out + offset, in + offset, frames, stride, remaining,
+                        delays + offset, coefs, channelCount);
+            }
+        } else /* constexpr */ {
+            biquad_cascade_func_impl<ConstOptions, STAGES, D>(
+                    out + offset, in + offset, frames, stride, remaining,
+                    delays + offset, coefs, channelCount);
+        }
+        offset += remaining;
+    }
+}
+
+// Loads sizeof(T) / sizeof(D) consecutive samples of type S as a vector of D.
+template <typename T, typename D, typename S>
+static inline T vld1_convert(const S *in) {
+    using namespace android::audio_utils::intrinsics;
+    if constexpr (std::is_same_v<S, D>) {
+        return vld1<T>(in);
+    } else /* constexpr */ {
+        constexpr size_t elements = sizeof(T) / sizeof(D);
+        D converted[elements];
+#pragma unroll
+        for (size_t k = 0; k < elements; ++k) {
+            converted[k] = static_cast<D>(in[k]);
+        }
+        return vld1<T>(converted);
+    }
+}
+
+// Filters channelCount channels of S samples through all STAGES of the cascade
+// and adds the sum of squares of the output of each channel to energies.
+// Each input sample is converted to (sample + sampleOffset) * scale before filtering.
+// Nothing is written back but the delays.
+template <typename ConstOptions, size_t STAGES, typename T, typename D, typename S>
+void biquad_cascade_energy_func_impl(D *energies, const S *in, size_t frames, size_t stride,
+        size_t channelCount, D *delays, const D *coefs, size_t channelStride,
+        D scale, D sampleOffset) {
+    using namespace android::audio_utils::intrinsics;
+    using KernelType = typename ConstOptions::template FilterType<T, D>;
+    constexpr size_t elements = sizeof(T) / sizeof(D); // how many float elements in T.
+    const T vscale = vdupn<T>(scale);
+    const T vbias = vdupn<T>(sampleOffset * scale);
+
+    for (size_t i = 0; i < channelCount; i += elements) {
+        auto kernels = make_cascade_kernels<KernelType, T>(
+                coefs, delays + i, channelStride, std::make_index_sequence<STAGES>());
+#ifdef USE_DITHER
+        constexpr D DITHER_VALUE = std::numeric_limits<float>::min() * (1 << 24); // use FLOAT
+        T dither = vdupn<T>(DITHER_VALUE); // NEON does not have vector + scalar acceleration.
+#endif
+        T accum = vdupn<T>(D{});
+        const S *input = in + i;
+        for (size_t frame = 0; frame < frames; ++frame) {
+            T x = vmla(vbias, vld1_convert<T, D>(input), vscale);
+            input += stride;
+            #pragma unroll
+            for (size_t j = 0; j < STAGES; ++j) {
+#ifdef USE_DITHER
+                x = vadd(x, dither);
+#endif
+                x = kernels[j].step(x);
+            }
+#ifdef USE_DITHER
+            dither = vneg(dither);
+#endif
+            accum = vmla(accum, x, x);
+        }
+        D sums[elements];
+        vst1(sums, accum);
+        for (size_t k = 0; k < elements; ++k) {
+            energies[i + k] += sums[k];
+        }
+        for (size_t j = 0; j < STAGES; ++j) {
+            vst1(&delays[j * kBiquadNumDelays * channelStride + i], kernels[j].s_[0]);
+            vst1(&delays[(j * kBiquadNumDelays + 1) * channelStride + i], kernels[j].s_[1]);
+        }
+    }
+}
+
+template <typename ConstOptions, size_t STAGES, typename D, typename S>
+void biquad_cascade_energy_func(D *energies, const S *in, size_t frames, size_t stride,
+        size_t channelCount, D *delays, const D *coefs, D scale, D sampleOffset) {
+#ifdef USE_NEON
+    using alt_16_t = float32x4x4_t;
+    using alt_8_t = float32x4x2_t;
+    using alt_4_t = float32x4_t;
+#else
+    using alt_16_t = intrinsics::internal_array_t<float, 16>;
+    using alt_8_t = intrinsics::internal_array_t<float, 8>;
+    using alt_4_t = intrinsics::internal_array_t<float, 4>;
+#endif
+    using alt_2_t = intrinsics::internal_array_t<float, 2>;
+
+    for (size_t offset = 0; offset < channelCount; ) {
+        size_t remaining = channelCount - offset;
+        if constexpr (std::is_same_v<D, float>) {
+            if (remaining >= 16) {
+                remaining &= ~15;
+                biquad_cascade_energy_func_impl<ConstOptions, STAGES, alt_16_t>(
+                        energies + offset, in + offset, frames, stride, remaining,
+                        delays + offset, coefs, channelCount, scale, sampleOffset);
+            } else if (remaining >= 8) {
+                remaining = 8;
+                biquad_cascade_energy_func_impl<ConstOptions, STAGES, alt_8_t>(
+                        energies + offset, in + offset, frames, stride, remaining,
+                        delays + offset, coefs, channelCount, scale, sampleOffset);
+            } else if (remaining >= 4) {
+                remaining = 4;
+                biquad_cascade_energy_func_impl<ConstOptions, STAGES, alt_4_t>(
+                        energies + offset, in + offset, frames, stride, remaining,
+                        delays + offset, coefs, channelCount, scale, sampleOffset);
+            } else if (remaining >= 2) {
+                remaining = 2;
+                biquad_cascade_energy_func_impl<ConstOptions, STAGES, alt_2_t>(
+                        energies + offset, in + offset, frames, stride, remaining,
+                        delays + offset, coefs, channelCount, scale, sampleOffset);
+            } else {
+                biquad_cascade_energy_func_impl<ConstOptions, STAGES, D>(
+                        energies + offset, in + offset, frames, stride, remaining,
+                        delays + offset, coefs, channelCount, scale, sampleOffset);
+            }
+        } else /* constexpr */ {
+            biquad_cascade_energy_func_impl<ConstOptions, STAGES, D>(
+                    energies + offset, in + offset, frames, stride, remaining,
+                    delays + offset, coefs, channelCount, scale, sampleOffset);
+        }
+        offset += remaining;
+    }
+}
+
 } // namespace details
 
 /**
@@ -1107,6 +1356,152 @@ private:
     std::decay_t<decltype(mFilterFuncs[0])> mFunc;
 };
 
+/**
+ * BiquadCascadeFilter
+ *
+ * A multichannel cascade of STAGES Biquad filters, applied in order, with the same
+ * coefficients for every channel.
+ *
+ * This is equivalent to STAGES BiquadFilter objects processed one after another,
+ * but makes a single pass over the audio data: each frame goes through all the stages
+ * before the next frame is read, so the intermediate results stay in registers.
+ * Channels are interleaved into SIMD lanes as for BiquadFilter.
+ *
+ * All coefficients are treated as nonzero; there is no per-occupancy optimization.
+ * biquad_filter_benchmark.cpp shows no consistent gain over sequential BiquadFilter
+ * objects, so MelProcessor does not use it.
+ *
+ * \param D type variable representing the data type, one of float or double.
+ * \param STAGES the number of Biquad filters in the cascade.
+ */
+template <typename D = float,
+        size_t STAGES = 3,
+        typename ConstOptions = details::DefaultBiquadConstOptions>
+class BiquadCascadeFilter {
+public:
+    /**
+     * \param channelCount the number of interleaved channels.
+     * \param coefs a container of STAGES containers of 5 or 6 coefficients,
+     *        as for BiquadFilter::setCoefficients().  The first stage is applied first.
+     */
+    template <typename T = std::array<std::array<D, kBiquadNumCoefs>, STAGES>>
+    explicit BiquadCascadeFilter(size_t channelCount, const T& coefs = {})
+            : mChannelCount(channelCount)
+            , mCoefs(kBiquadNumCoefs * STAGES)
+            , mDelays(kBiquadNumDelays * STAGES * channelCount) {
+        setCoefficients(coefs);
+    }
+
+    /**
+     * Sets the coefficients of all the stages.
+     *
+     * \return true if all the stages are stable, otherwise false.
+     */
+    template <typename T = std::array<std::array<D, kBiquadNumCoefs>, STAGES>>
+    bool setCoefficients(const T& coefs) {
+        assert(coefs.size() == STAGES);
+        for (size_t j = 0; j < STAGES; ++j) {
+            details::setCoefficients<D>(mCoefs, j * kBiquadNumCoefs, 1 /* stride */,
+                    1 /* channelCount */, coefs[j]);
+        }
+        return isStable();
+    }
+
+    /**
+     * Returns the coefficients, kBiquadNumCoefs per stage, with positive a1 and a2.
+     */
+    const std::vector<D>& getCoefficients() const {
+        return mCoefs;
+    }
+
+    /** Returns true if all the stages are stable. */
+    bool isStable() const {
+        for (size_t j = 0; j < STAGES; ++j) {
+            if (!details::isStable(mCoefs[j * kBiquadNumCoefs + 3],
+                    mCoefs[j * kBiquadNumCoefs + 4])) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    size_t getChannelCount() const {
+        return mChannelCount;
+    }
+
+    /**
+     * \brief Filters the input data through all the stages
+     *
+     * \param out     pointer to the output data, may be the same as in.
+     * \param in      pointer to the input data
+     * \param frames  number of audio frames to be processed
+     */
+    void process(D* out, const D* in, size_t frames) {
+        process(out, in, frames, mChannelCount);
+    }
+
+    /**
+     * \brief Filters the input data through all the stages with stride
+     *
+     * \param out     pointer to the output data, may be the same as in.
+     * \param in      pointer to the input data
+     * \param frames  number of audio frames to be processed
+     * \param stride  the total number of samples associated with a frame, if not channelCount.
+     */
+    void process(D* out, const D* in, size_t frames, size_t stride) {
+        assert(stride >= mChannelCount);
+        details::biquad_cascade_func<ConstOptions, STAGES>(out, in, frames, stride,
+                mChannelCount, mDelays.data(), mCoefs.data());
+    }
+
+    /**
+     * \brief Filters the input data through all the stages and accumulates the energy
+     *
+     * The filtered data is not stored, only the sum of squares of each channel
+     * is added to energies. The input samples may be of any type convertible to D,
+     * each sample being filtered as (sample + offset) * scale, so integer PCM is
+     * normalized without an intermediate buffer.
+     *
+     * \param energies an array of channelCount values, the energy of each channel
+     *                 is added to it.
+     * \param in       pointer to the interleaved input data
+     * \param frames   number of audio frames to be processed
+     * \param scale    factor applied to each input sample after the offset
+     * \param offset   value added to each input sample, for unsigned PCM.
+     */
+    template <typename S>
+    void accumulateEnergy(D* energies, const S* in, size_t frames,
+            D scale = 1, D offset = 0) {
+        details::biquad_cascade_energy_func<ConstOptions, STAGES>(energies, in, frames,
+                mChannelCount, mChannelCount, mDelays.data(), mCoefs.data(), scale, offset);
+    }
+
+    /**
+     * \brief Clears the delay elements of all the stages
+     */
+    void clear() {
+        std::fill(mDelays.begin(), mDelays.end(), 0.f);
+    }
+
+    /**
+     * \brief Gets delay elements as a vector
+     *
+     * The delays are stored by stage, then by delay, then by channel:
+     * delays[(2 * j + 0) * channelCount + i] is s1 of the i-th channel of the j-th stage,
+     * delays[(2 * j + 1) * channelCount + i] is s2 of the i-th channel of the j-th stage.
+     *
+     * \return a const vector reference of delays.
+     */
+    const std::vector<D>& getDelays() const {
+        return mDelays;
+    }
+
+private:
+    const size_t mChannelCount;
+    std::vector<D> mCoefs;   // kBiquadNumCoefs per stage.
+    std::vector<D> mDelays;  // see getDelays().
+};
+
 } // namespace android::audio_utils
 
 #pragma pop_macro("USE_DITHER")
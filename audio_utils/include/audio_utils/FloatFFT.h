@@ -0,0 +1,147 @@
+/*
+ * Copyright 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+namespace android::audio_utils {
+
+/**
+ * Single precision floating point Fast Fourier Transform.
+ *
+ * Unlike fixed_fft() in fixedfft.h, which works in place on Q15 data and is limited
+ * to 1024 points, FloatFFT works on float data for any power of 2 size up to kMaxSize.
+ *
+ * The plan (bit reversal permutation and per stage twiddle tables) is computed
+ * once in the constructor; forward() and inverse() do not allocate and may be
+ * called from a real time thread. The transform uses radix-4 butterflies,
+ * with one radix-2 stage when the size is an odd power of 2, vectorized
+ * with the intrinsic_utils.h vector types.
+ *
+ * Complex data is interleaved: real and imaginary parts of element k are
+ * at float indices 2k and 2k + 1 (the layout of std::complex<float>).
+ *
+ * The forward transform is unscaled, and the inverse transform is scaled by 1 / size(),
+ * so inverse(forward(x)) == x up to rounding.
+ *
+ * A FloatFFT object holds scratch memory, so it must not be used concurrently
+ * from more than one thread.
+ */
+class FloatFFT {
+public:
+    static constexpr size_t kMaxSize = 1 << 16;
+
+    /** Returns true if n is a valid size: a power of 2 between 1 and kMaxSize. */
+    static constexpr bool isValidSize(size_t n) {
+        return n > 0 && n <= kMaxSize && (n & (n - 1)) == 0;
+    }
+
+    /**
+     * \param n   number of complex points, which must satisfy isValidSize().
+     */
+    explicit FloatFFT(size_t n);
+
+    size_t size() const { return mSize; }
+
+    /**
+     * Computes the forward transform.
+     *
+     * \param in    size() interleaved complex input values.
+     * \param out   size() interleaved complex output values, may be the same as in.
+     */
+    void forward(const float *in, float *out);
+
+    /**
+     * Computes the inverse transform, scaled by 1 / size().
+     *
+     * \param in    size() interleaved complex input values.
+     * \param out   size() interleaved complex output values, may be the same as in.
+     */
+    void inverse(const float *in, float *out);
+
+private:
+    friend class FloatRealFFT;
+
+    // Transforms the interleaved complex input into the split mRe and mIm arrays.
+    // The inverse transform is the forward transform with the real and
+    // imaginary parts swapped on input and output, so it shares the same plan.
+    void transform(const float *in, bool inverse);
+
+    const size_t mSize;
+    const uint32_t mLog2Size;
+    std::vector<uint32_t> mBitReverse;
+    // For each radix-4 stage, with L the sub-transform size: the real and
+    // imaginary parts of W^k, W^2k and W^3k for k in [0, L), W = exp(-2 pi i / 4L).
+    std::vector<float> mTwiddles;
+    std::vector<float> mRe;
+    std::vector<float> mIm;
+};
+
+/**
+ * Single precision floating point FFT of real data.
+ *
+ * The n real input values are transformed as n / 2 complex values by a FloatFFT
+ * followed by a split step, which is about twice as fast as a complex FFT of size n.
+ *
+ * The spectrum of real data is conjugate symmetric, so only the n / 2 + 1
+ * non negative frequency bins are returned, as interleaved complex values.
+ * The imaginary parts of bin 0 (DC) and bin n / 2 (Nyquist) are always 0.
+ *
+ * Scaling and thread safety are as for FloatFFT.
+ */
+class FloatRealFFT {
+public:
+    /** Returns true if n is a valid size: a power of 2 between 2 and FloatFFT::kMaxSize. */
+    static constexpr bool isValidSize(size_t n) {
+        return n >= 2 && FloatFFT::isValidSize(n);
+    }
+
+    /**
+     * \param n   number of real points, which must satisfy isValidSize().
+     */
+    explicit FloatRealFFT(size_t n);
+
+    size_t size() const { return mSize; }
+
+    /**
+     * Computes the forward transform.
+     *
+     * \param in    size() real input values.
+     * \param out   size() / 2 + 1 interleaved complex output values, must not overlap in.
+     */
+    void forward(const float *in, float *out);
+
+    /**
+     * Computes the inverse transform, scaled by 1 / size().
+     *
+     * \param in    size() / 2 + 1 interleaved complex input values. The imaginary parts
+     *              of bins 0 and size() / 2 are ignored.
+     * \param out   size() real output values, must not overlap in.
+     */
+    void inverse(const float *in, float *out);
+
+private:
+    const size_t mSize;
+    FloatFFT mFFT;  // of size mSize / 2
+    // The real and imaginary parts of exp(-2 pi i k / mSize) for k in [0, mSize / 2].
+    std::vector<float> mTwiddles;
+};
+
+} // namespace android::audio_utils
@@ -0,0 +1,90 @@
+/*
+ * Copyright 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <semaphore.h>
+#include <thread>
+#include <vector>
+
+#include <android-base/thread_annotations.h>
+#include <utils/RefBase.h>
+
+namespace android::audio_utils {
+
+class MelProcessor;
+
+/**
+ * A small pool of worker threads computing the MEL values of many MelProcessors.
+ *
+ * A MelProcessor created with a MelEngine only copies the audio data passed to
+ * MelProcessor::process() into a lock-free single producer single consumer queue,
+ * so the cost on the audio thread is a memcpy. The engine workers drain the queues
+ * of all the MelProcessors with pending data in a single pass, compute the MEL values,
+ * and call the MelCallback of each MelProcessor from the worker thread. A MelAggregator
+ * updated from the MelCallback thus receives its MEL records asynchronously,
+ * off the audio threads.
+ *
+ * All the public methods are thread-safe.
+ */
+class MelEngine : public RefBase {
+public:
+    static constexpr size_t kDefaultThreadCount = 2;
+
+    /**
+     * \param threadCount   number of worker threads, between 1 and 8, else the
+     *                      constructor will abort.
+     */
+    explicit MelEngine(size_t threadCount = kDefaultThreadCount);
+
+    ~MelEngine() override;
+
+    size_t getThreadCount() const { return mThreads.size(); }
+
+    /** Returns the number of MelProcessors currently using the engine. */
+    size_t getProcessorCount() const EXCLUDES(mLock);
+
+private:
+    friend class MelProcessor;
+
+    // called by MelProcessor on creation and on its last strong reference.
+    void addProcessor(const wp<MelProcessor>& processor) EXCLUDES(mLock);
+    void removeProcessor(const MelProcessor* processor) EXCLUDES(mLock);
+
+    // Wakes a worker for queued data. Does not block, may be called from the audio thread.
+    void wakeup();
+
+    // Runs one pass over the processors, returns false when the engine is stopped.
+    bool threadLoop() EXCLUDES(mLock);
+
+    mutable std::mutex mLock;
+    sem_t mWakeupSem;  // posted by wakeup() and on stop, waited on by the workers
+    std::vector<wp<MelProcessor>> mProcessors GUARDED_BY(mLock);
+    bool mStopRequested GUARDED_BY(mLock) = false;
+
+    // set by wakeup(), cleared by the worker which picks it up before its pass.
+    std::atomic_bool mWakeupPending = false;
+
+    // shared with the workers, which may outlive the engine.
+    const std::shared_ptr<std::atomic_bool> mDestroyed = std::make_shared<std::atomic_bool>(false);
+
+    std::vector<std::thread> mThreads;  // set in the constructor
+};
+
+}  // namespace android::audio_utils
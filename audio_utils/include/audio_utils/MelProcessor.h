@@ -18,11 +18,14 @@
 
 #include <array>
 #include <condition_variable>
+#include <memory>
 #include <mutex>
 #include <thread>
 
 #include <android-base/thread_annotations.h>
 #include <audio_utils/BiquadFilter.h>
+#include <audio_utils/MelEngine.h>
+#include <audio_utils/fifo.h>
 #include <system/audio.h>
 #include <utils/Errors.h>
 #include <utils/RefBase.h>
@@ -92,6 +95,30 @@ public:
                  float rs2Value,
                  size_t maxMelsCallback = kMaxMelValues);
 
+    /**
+     * \brief Creates a MelProcessor object computing the MEL values on a MelEngine.
+     *
+     * process() only copies the audio data into a queue, which holds kEngineQueueMs
+     * of audio, and the MEL values are computed and the callbacks are called on the
+     * engine worker threads. process() and updateAudioFormat() must not be called
+     * concurrently, which is the case when both are called from the audio thread.
+     *
+     * \param engine            the engine computing the MEL values, must not be null.
+     *
+     * The other parameters are the same as above.
+     */
+    MelProcessor(uint32_t sampleRate,
+                 uint32_t channelCount,
+                 audio_format_t format,
+                 const sp<MelCallback>& callback,
+                 audio_port_handle_t deviceId,
+                 float rs2Value,
+                 const sp<MelEngine>& engine,
+                 size_t maxMelsCallback = kMaxMelValues);
+
+    /** Duration of audio data queued for a MelEngine before it is dropped. */
+    static constexpr int32_t kEngineQueueMs = 250;
+
     /**
      * Sets the output RS2 upper bound for momentary exposure warnings. Default value
      * is 100dBA as specified in IEC62368-1 3rd edition. Must not be higher than
@@ -112,7 +139,15 @@ public:
     /** Returns the device id. */
     audio_port_handle_t getDeviceId();
 
-    /** Update the format to use for the input frames to process. */
+    /**
+     * Update the format to use for the input frames to process.
+     *
+     * With a MelEngine, the audio data still queued in the previous format is processed
+     * on the calling thread before the format changes, after waiting for an engine worker
+     * which is processing the queue. This is at most kEngineQueueMs of audio data, which
+     * costs a quarter of what process() takes for one second of audio without an engine
+     * (see mel_processor_benchmark). The callbacks are still called on the engine threads.
+     */
     void updateAudioFormat(uint32_t sampleRate, uint32_t channelCount, audio_format_t newFormat)
             EXCLUDES(mLock);
 
@@ -126,6 +161,8 @@ public:
      *
      * \return the number of bytes that were processed. Note: the method will
      *   output 0 if the processor is paused or the sample rate is not supported.
+     *   With a MelEngine, this is the number of bytes queued, which is lower than
+     *   bytes if the queue is full.
      */
     int32_t process(const void* buffer, size_t bytes);
 
@@ -153,9 +190,12 @@ public:
      */
     void setAttenuation(float attenuationDB);
 
+    void onFirstRef() override;
     void onLastStrongRef(const void* id) override;
 
 private:
+    friend class MelEngine;
+
     /** Struct to store the possible callback data. */
     struct MelCallbackData {
         // used for momentaryExposure callback
@@ -180,6 +220,13 @@ private:
 
         void run() EXCLUDES(mCondVarMutex);
 
+        // Calls the callbacks for all the queued data on the caller thread,
+        // when the MelWorker thread is not running. Callbacks run without mCondVarMutex.
+        void dispatch() EXCLUDES(mCondVarMutex, mDispatchMutex);
+
+        // blocks until a dispatch() in progress has returned from its last callback
+        void waitForDispatch() EXCLUDES(mDispatchMutex);
+
         // blocks until the MelWorker thread is stopped
         void stop() EXCLUDES(mCondVarMutex);
 
@@ -204,6 +251,7 @@ private:
             return idx >= kRingBufferSize - 1 ? 0 : idx + 1;
         }
         bool ringBufferIsFull() const;
+        void callback(const sp<MelCallback>& callback, const MelCallbackData& data) const;
 
         const wp<MelCallback> mCallback;
         const std::string mThreadName;
@@ -223,12 +271,37 @@ private:
 
         bool mStopRequested GUARDED_BY(mCondVarMutex) = false;
         std::thread mThread;
+
+        // serializes dispatch() callers, acquired before mCondVarMutex.
+        std::mutex mDispatchMutex ACQUIRED_BEFORE(mCondVarMutex);
+        // entry being dispatched, copied out of the ring buffer.
+        MelCallbackData mDispatchData GUARDED_BY(mDispatchMutex);
+    };
+
+    // Lock-free single producer single consumer queue between process() and the MelEngine.
+    struct EngineQueue {
+        EngineQueue(uint32_t frameCount, uint32_t frameSize)
+            : mBuffer(frameCount * frameSize),
+              mFifo(frameCount, frameSize, mBuffer.data()),
+              mWriter(mFifo),
+              mReader(mFifo) {}
+
+        std::vector<uint8_t> mBuffer;
+        audio_utils_fifo mFifo;
+        audio_utils_fifo_writer mWriter;
+        audio_utils_fifo_reader mReader;
     };
 
+    // Called by the MelEngine workers to process the queued data and call the callbacks.
+    void processQueued() EXCLUDES(mLock);
+    void processQueued_l() REQUIRES(mLock);
+    void createQueue_l() REQUIRES(mLock);
+    int32_t process_l(const void* buffer, size_t bytes) REQUIRES(mLock);
+
     std::string pointerString() const;
     void createBiquads_l() REQUIRES(mLock);
     bool isSampleRateSupported_l() const REQUIRES(mLock);
-    void applyAWeight_l(const void* buffer, size_t frames) REQUIRES(mLock);
+    void accumulateAWeightedEnergy_l(const void* buffer, size_t samples) REQUIRES(mLock);
     float getCombinedChannelEnergy_l() REQUIRES(mLock);
     void addMelValue_l(float mel) REQUIRES(mLock);
 
@@ -239,6 +312,8 @@ private:
     MelWorker mMelWorker;                      // spawns thread for asynchronous callbacks,
                                                // worker is thread-safe
 
+    const sp<MelEngine> mEngine;               // if not null, computes MELs and callbacks
+
     mutable std::mutex mLock;                  // monitor mutex
     // audio data sample rate
     uint32_t mSampleRate GUARDED_BY(mLock);
@@ -250,16 +325,17 @@ private:
     audio_format_t mFormat GUARDED_BY(mLock);
     // number of samples in the energy
     size_t mCurrentSamples GUARDED_BY(mLock) = 0;
-    // contains the A-weighted input samples to be processed
-    std::vector<float> mAWeightSamples GUARDED_BY(mLock);
-    // contains the input samples converted to float
-    std::vector<float> mFloatSamples GUARDED_BY(mLock);
     // local energy accumulation
     std::vector<float> mCurrentChannelEnergy GUARDED_BY(mLock);
     // accumulated MEL values
     std::vector<float> mMelValues GUARDED_BY(mLock);
     // current index to store the MEL values
     uint32_t mCurrentIndex GUARDED_BY(mLock) = 0;
+    // number of frames converted and filtered at a time, so that the buffers stay in cache
+    static constexpr size_t kAWeightBlockFrames = 256;
+    // A-weighting buffers of kAWeightBlockFrames frames
+    std::vector<float> mFloatSamples GUARDED_BY(mLock);
+    std::vector<float> mAWeightSamples GUARDED_BY(mLock);
     using DefaultBiquadFilter = BiquadFilter<float, true, details::DefaultBiquadConstOptions>;
     // Biquads used for the A-weighting
     std::array<std::unique_ptr<DefaultBiquadFilter>, kCascadeBiquadNumber>
@@ -272,6 +348,14 @@ private:
     std::atomic<float> mRs2UpperBound;
     // Skip processing data.
     std::atomic_bool mPaused = false;
+
+    // Queue to mEngine, null without engine or if the audio format is not supported.
+    // Written by process(), read by the engine with mLock held, and only replaced by
+    // updateAudioFormat() with mLock held, which is not concurrent with process().
+    std::unique_ptr<EngineQueue> mQueue;
+    // frames written to and read from mQueue, for drainAndWait().
+    std::atomic<int64_t> mQueuedFrames = 0;
+    std::atomic<int64_t> mDequeuedFrames = 0;
 };
 
 }  // namespace android::audio_utils
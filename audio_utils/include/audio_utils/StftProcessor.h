@@ -0,0 +1,132 @@
+/*
+ * Copyright 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <functional>
+#include <vector>
+
+#include <audio_utils/FloatFFT.h>
+#include <system/audio.h>
+
+namespace android::audio_utils {
+
+/**
+ * Streaming Short Time Fourier Transform, for spectral analysis of an audio stream.
+ *
+ * Audio data is pushed in buffers of any size, and the channels are averaged
+ * into a mono signal kept in a ring of the last fftSize samples. Every hop samples,
+ * once fftSize samples have been received, the ring is windowed and transformed,
+ * and the magnitude or power of the fftSize / 2 + 1 frequency bins is passed to
+ * the callback.
+ *
+ * The spectra are normalized by the sum of the window, so a full scale
+ * DC signal has magnitude 1 in bin 0, and a full scale sine centered on a
+ * bin has magnitude 0.5 in that bin.
+ *
+ * All memory is allocated in the constructor; push() does not allocate or block,
+ * other than in the callback, and may be called from a real time thread.
+ * A StftProcessor is not thread safe.
+ */
+class StftProcessor {
+public:
+    enum class Window {
+        RECTANGULAR,
+        HANN,
+        HAMMING,
+        BLACKMAN,
+    };
+
+    enum class Spectrum {
+        MAGNITUDE,
+        POWER,
+    };
+
+    /**
+     * Called from push() with the spectrum of each window.
+     *
+     * \param bins        fftSize / 2 + 1 magnitude or power values, from DC to Nyquist.
+     *                    Only valid during the callback.
+     * \param binCount    the number of values in bins.
+     * \param position    the frame position of the start of the window,
+     *                    counted from the first frame pushed after construction or reset().
+     */
+    using Callback = std::function<void(const float *bins, size_t binCount, int64_t position)>;
+
+    /** Returns true if format is supported by push(). */
+    static bool isFormatSupported(audio_format_t format);
+
+    /**
+     * \param format        format of the pushed data, which must satisfy isFormatSupported().
+     * \param channelCount  channel count of the pushed data, between 1 and FCC_LIMIT.
+     * \param fftSize       window length, which must satisfy FloatRealFFT::isValidSize().
+     * \param hop           number of frames between the start of consecutive windows,
+     *                      between 1 and fftSize.
+     * \param window        window shape.
+     * \param spectrum      whether magnitude or power spectra are returned.
+     * \param callback      called with each spectrum.
+     *
+     * Invalid arguments abort.
+     */
+    StftProcessor(audio_format_t format, uint32_t channelCount, size_t fftSize, size_t hop,
+            Window window, Spectrum spectrum, Callback callback);
+
+    /**
+     * Processes frames of audio data, calling the callback for each completed window.
+     *
+     * \param buffer   interleaved audio data in the format and channel count of the constructor.
+     * \param frames   number of frames in buffer.
+     */
+    void push(const void *buffer, size_t frames);
+
+    /** Discards all data pushed, the next window starts with the next frame pushed. */
+    void reset();
+
+    size_t getFftSize() const { return mFftSize; }
+    size_t getHop() const { return mHop; }
+    size_t getBinCount() const { return mFftSize / 2 + 1; }
+
+private:
+    // Appends count mono samples to the ring, emitting spectra as windows complete.
+    void append(const float *samples, size_t count);
+    void emitSpectrum();
+
+    const audio_format_t mFormat;
+    const uint32_t mChannelCount;
+    const size_t mFrameSize;
+    const size_t mFftSize;
+    const size_t mHop;
+    const Spectrum mSpectrum;
+    const Callback mCallback;
+
+    FloatRealFFT mFFT;
+    std::vector<float> mWindow;   // already scaled by the normalization
+    std::vector<float> mRing;     // the last mFftSize samples, mFftSize is a power of 2
+    std::vector<float> mScratch;  // input converted to float
+    std::vector<float> mMono;     // input averaged to mono
+    std::vector<float> mFrame;    // windowed samples
+    std::vector<float> mFreq;     // interleaved complex spectrum
+    std::vector<float> mBins;
+
+    size_t mRingPosition = 0;     // next sample to write, and oldest sample once full
+    size_t mUntilNextWindow;      // samples to append before the next window is complete
+    int64_t mFramesReceived = 0;
+};
+
+} // namespace android::audio_utils
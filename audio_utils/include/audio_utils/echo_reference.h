@@ -20,6 +20,8 @@
 #include <stdint.h>
 #include <sys/time.h>
 
+#include <system/audio.h>
+
 __BEGIN_DECLS
 
 /** Buffer descriptor used by read() and write() methods, including the time stamp and delay. */
@@ -47,6 +49,16 @@ struct echo_reference_buffer {
  *      - frame_count is updated with the actual number of frames returned
  */
 
+/**
+ * write() is called by the single playback thread and read() by each capture (AEC) thread.
+ * Neither method takes a lock or allocates memory: write() pushes the playback frames into a
+ * FIFO that never blocks the writer, and each reader converts, resamples and aligns the frames
+ * with its own state. A reader that falls more than 500 ms behind the writer loses frames and
+ * starts over with an empty reference buffer.
+ *
+ * read() waits at most half the duration of the requested frames for playback frames to arrive,
+ * and zero-fills whatever is still missing.
+ */
 struct echo_reference_itfe {
     int (*read)(struct echo_reference_itfe *echo_reference, struct echo_reference_buffer *buffer);
     int (*write)(struct echo_reference_itfe *echo_reference, struct echo_reference_buffer *buffer);
@@ -60,8 +72,35 @@ int create_echo_reference(audio_format_t rdFormat,
                           uint32_t wrSamplingRate,
                           struct echo_reference_itfe **);
 
+/**
+ * Releases an echo reference created by create_echo_reference().
+ * All readers added with echo_reference_add_reader() must have been removed.
+ */
 void release_echo_reference(struct echo_reference_itfe *echo_reference);
 
+/**
+ * Adds a reader of the playback frames written to \p echo_reference, for an additional AEC.
+ * The reader has its own format, channel count and sampling rate, delay estimate and resampler.
+ * Only the read() method of the returned interface is supported, write() returns -ENOSYS.
+ * Supported configurations are the same as for create_echo_reference() read parameters.
+ *
+ * \param echo_reference  Echo reference created by create_echo_reference().
+ * \param reader          Set to the new reader on success, NULL otherwise.
+ * \return 0 on success, -EINVAL for bad arguments, -ENOMEM or -ENODEV on resource failure.
+ */
+int echo_reference_add_reader(struct echo_reference_itfe *echo_reference,
+                              audio_format_t rdFormat,
+                              uint32_t rdChannelCount,
+                              uint32_t rdSamplingRate,
+                              struct echo_reference_itfe **reader);
+
+/**
+ * Removes and releases a reader added with echo_reference_add_reader().
+ * Must not be called concurrently with the read() method of the reader.
+ */
+void echo_reference_remove_reader(struct echo_reference_itfe *echo_reference,
+                                  struct echo_reference_itfe *reader);
+
 __END_DECLS
 
 #endif // ANDROID_ECHO_REFERENCE_H
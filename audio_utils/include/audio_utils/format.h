@@ -34,11 +34,8 @@ __BEGIN_DECLS
  *  \param src_format Source buffer format
  *  \param count      Number of samples to copy
  *
- * Allowed format conversions are given by either case 1 or 2 below:
- *
- * 1) Either src_format is (AUDIO_FORMAT_PCM_16_BIT or AUDIO_FORMAT_PCM_FLOAT)
- * or dst_format is (AUDIO_FORMAT_PCM_8_BIT or AUDIO_FORMAT_PCM_16_BIT or AUDIO_FORMAT_PCM_FLOAT)
- * and the other format type is one of:
+ * Conversion is allowed between any two of the following formats,
+ * each pair having a direct conversion without an intermediate format:
  *
  * AUDIO_FORMAT_PCM_16_BIT
  * <BR>
@@ -52,8 +49,7 @@ __BEGIN_DECLS
  * <BR>
  * AUDIO_FORMAT_PCM_8_24_BIT
  *
- * 2) Both dst_format and src_format are identical and of the list given
- * in (1). This is a straight copy.
+ * If dst_format and src_format are identical, this is a straight copy.
  *
  * The destination and source buffers must be completely separate
  * or point to the same starting buffer address. These routines call functions
@@ -64,6 +60,29 @@ __BEGIN_DECLS
 void memcpy_by_audio_format(void *dst, audio_format_t dst_format,
         const void *src, audio_format_t src_format, size_t count);
 
+/**
+ * Conversion function returned by get_memcpy_by_audio_format_fn().
+ *
+ *  \param dst        Destination buffer
+ *  \param src        Source buffer
+ *  \param count      Number of samples to copy
+ */
+typedef void (*memcpy_by_audio_format_fn_t)(void *dst, const void *src, size_t count);
+
+/**
+ * Returns the function used by memcpy_by_audio_format() to convert from src_format
+ * to dst_format, so that a processing loop can resolve the conversion once
+ * instead of for every buffer.
+ *
+ *  \param dst_format Destination buffer format
+ *  \param src_format Source buffer format
+ *
+ * \return the conversion function, or NULL if the conversion is not allowed
+ * by the rules of memcpy_by_audio_format().
+ */
+memcpy_by_audio_format_fn_t get_memcpy_by_audio_format_fn(audio_format_t dst_format,
+        audio_format_t src_format);
+
 
 /**
  * This function creates an index array for converting audio data with different
@@ -85,6 +104,39 @@ void memcpy_by_audio_format(void *dst, audio_format_t dst_format,
 size_t memcpy_by_index_array_initialization_from_channel_mask(int8_t *idxary, size_t arysize,
         audio_channel_mask_t dst_channel_mask, audio_channel_mask_t src_channel_mask);
 
+/**
+ * Copy frames with channel remapping, per channel gain and sample format conversion
+ * in a single pass, instead of memcpy_by_index_array() followed by memcpy_by_audio_format()
+ * and a gain loop.
+ *
+ * For each frame, dst[i] = gains[i] * src[idxary[i]] converted to dst_format,
+ * or zero if idxary[i] is -1. The gain is applied in single precision float,
+ * and integer destination formats are clamped. Destination channel counts 1, 2, 4, 6 and 8
+ * use SIMD kernels. Through float, AUDIO_FORMAT_PCM_32_BIT keeps 24 bits of precision and
+ * AUDIO_FORMAT_PCM_8_24_BIT is clamped to [-1.0, 1.0]. When dst_format is src_format and
+ * all gains are 1.0 (or gains is NULL), the samples are copied exactly as with
+ * memcpy_by_index_array().
+ *
+ *  \param dst          Destination buffer
+ *  \param dst_format   Destination buffer format
+ *  \param dst_channels Number of destination channels per frame
+ *  \param src          Source buffer
+ *  \param src_format   Source buffer format
+ *  \param src_channels Number of source channels per frame
+ *  \param idxary       Array of dst_channels indices of channels in the source frame,
+ *                      as initialized by memcpy_by_index_array_initialization() and related.
+ *  \param gains        Array of dst_channels linear gains, or NULL for unity gain.
+ *  \param count        Number of frames to copy
+ *
+ * Supported sample formats are those of memcpy_by_audio_format().
+ * The destination and source buffers must be completely separate (non-overlapping).
+ * If a format is not supported, the function will abort.
+ */
+void memcpy_by_index_array_and_format_with_gain(
+        void *dst, audio_format_t dst_format, uint32_t dst_channels,
+        const void *src, audio_format_t src_format, uint32_t src_channels,
+        const int8_t *idxary, const float *gains, size_t count);
+
 /**
  * Accumulates samples from src and dst buffers into dst buffer.
  *
@@ -317,6 +317,47 @@ void memcpy_to_p24_from_q8_23(uint8_t *dst, const int32_t *src, size_t count);
  */
 void memcpy_to_p24_from_i32(uint8_t *dst, const int32_t *src, size_t count);
 
+/**
+ * Expand and copy samples from unsigned 8-bit offset by 0x80
+ * to signed fixed-point packed 24 bit Q0.23.
+ * The packed 24 bit output is assumed to be a native-endian uint8_t byte array.
+ *
+ *  \param dst     Destination buffer
+ *  \param src     Source buffer
+ *  \param count   Number of samples to copy
+ *
+ * The destination and source buffers must either be completely separate (non-overlapping), or
+ * they must both start at the same address.  Partially overlapping buffers are not supported.
+ */
+void memcpy_to_p24_from_u8(uint8_t *dst, const uint8_t *src, size_t count);
+
+/**
+ * Expand and copy samples from unsigned 8-bit offset by 0x80 to signed fixed-point 32-bit Q8.23.
+ * The output data range is [0xff800000, 0x007f0000] at intervals of 0x10000.
+ *
+ *  \param dst     Destination buffer
+ *  \param src     Source buffer
+ *  \param count   Number of samples to copy
+ *
+ * The destination and source buffers must either be completely separate (non-overlapping), or
+ * they must both start at the same address.  Partially overlapping buffers are not supported.
+ */
+void memcpy_to_q8_23_from_u8(int32_t *dst, const uint8_t *src, size_t count);
+
+/**
+ * Copy samples from signed fixed-point 32-bit Q0.31 to signed fixed-point 32-bit Q8.23.
+ * The output data range is [0xff800000, 0x007fffff].
+ * The conversion is done by truncation, without dithering, so it loses resolution.
+ *
+ *  \param dst     Destination buffer
+ *  \param src     Source buffer
+ *  \param count   Number of samples to copy
+ *
+ * The destination and source buffers must either be completely separate (non-overlapping), or
+ * they must both start at the same address.  Partially overlapping buffers are not supported.
+ */
+void memcpy_to_q8_23_from_i32(int32_t *dst, const int32_t *src, size_t count);
+
 /**
  * Copy samples from signed fixed point 16-bit Q0.15 to signed fixed-point 32-bit Q8.23.
  * The output data range is [0xff800000, 0x007fff00] at intervals of 0x100.
@@ -386,6 +427,20 @@ void memcpy_to_q4_27_from_float(int32_t *dst, const float *src, size_t count);
  */
 void memcpy_to_i16_from_q8_23(int16_t *dst, const int32_t *src, size_t count);
 
+/**
+ * Copy samples from signed fixed-point 32-bit Q8.23 to signed fixed-point 32-bit Q0.31.
+ * The data is clamped to [0xff800000, 0x007fffff] before conversion, so the output data range
+ * is [0x80000000, 0x7fffff00] at intervals of 0x100.
+ *
+ *  \param dst     Destination buffer
+ *  \param src     Source buffer
+ *  \param count   Number of samples to copy
+ *
+ * The destination and source buffers must either be completely separate (non-overlapping), or
+ * they must both start at the same address.  Partially overlapping buffers are not supported.
+ */
+void memcpy_to_i32_from_q8_23(int32_t *dst, const int32_t *src, size_t count);
+
 /**
  * Copy samples from signed fixed-point 32-bit Q8.23 to single-precision floating-point.
  * The nominal output float range is [-1.0, 1.0) for the fixed-point
@@ -20,6 +20,8 @@
 #include <stdint.h>
 #include <sys/time.h>
 
+#include <system/audio.h>
+
 __BEGIN_DECLS
 
 
@@ -34,6 +36,8 @@ struct resampler_buffer {
         void*       raw;
         short*      i16;
         int8_t*     i8;
+        int32_t*    i32;
+        float*      f32;
     };
     size_t frame_count;
 };
@@ -85,6 +89,34 @@ struct resampler_itfe {
      * \return the latency introduced by the resampler in ns.
      */
     int32_t (*delay_ns)(struct resampler_itfe *resampler);
+    /**
+     * release resampler resources. May be NULL, in which case release_resampler() frees a
+     * resampler created by create_resampler().
+     */
+    void (*release)(struct resampler_itfe *resampler);
+    /**
+     * float and int32_t variants of resample_from_provider() and resample_from_input().
+     * float samples are nominally in [-1.0, 1.0], int32_t samples are Q0.31.
+     * For resample_from_provider_*(), the format of the data returned by the buffer provider
+     * is set when the resampler is created and does not depend on the output format.
+     * These are NULL if the resampler engine only supports int16_t (see create_resampler()).
+     */
+    int (*resample_from_provider_float)(struct resampler_itfe *resampler,
+                    float *out,
+                    size_t *outFrameCount);
+    int (*resample_from_input_float)(struct resampler_itfe *resampler,
+                    const float *in,
+                    size_t *inFrameCount,
+                    float *out,
+                    size_t *outFrameCount);
+    int (*resample_from_provider_i32)(struct resampler_itfe *resampler,
+                    int32_t *out,
+                    size_t *outFrameCount);
+    int (*resample_from_input_i32)(struct resampler_itfe *resampler,
+                    const int32_t *in,
+                    size_t *inFrameCount,
+                    int32_t *out,
+                    size_t *outFrameCount);
 };
 
 /**
@@ -99,6 +131,60 @@ int create_resampler(uint32_t inSampleRate,
           struct resampler_buffer_provider *provider,
           struct resampler_itfe **);
 
+/** Maximum number of filter phases used for an exact rational ratio by the polyphase resampler */
+#define RESAMPLER_POLYPHASE_MAX_PHASES 512
+
+/**
+ * create a polyphase FIR resampler according to input parameters passed.
+ * The resampler processes data in float internally and implements the int16_t, int32_t and
+ * float entry points of resampler_itfe.
+ * If the ratio inSampleRate / outSampleRate reduces to a fraction M / L with
+ * L <= RESAMPLER_POLYPHASE_MAX_PHASES (e.g. 44100 -> 48000 is 147 / 160) an exact polyphase
+ * filter bank is used, otherwise the filter coefficients are interpolated between phases.
+ * All memory is allocated here: the resampling calls never allocate, and an arbitrarily
+ * large request is processed in blocks through a fixed size input buffer.
+ *
+ * Float input is resampled in place: resample_from_input_float(), and resample_from_provider*()
+ * with an AUDIO_FORMAT_PCM_FLOAT provider, read the caller's buffers directly and only copy
+ * the filter window spanning two buffers. In that case the provider may be released with a
+ * frame_count smaller than the one returned by get_next_buffer(), the remaining frames must be
+ * returned again by the next get_next_buffer().
+ *
+ * \param providerFormat format of the buffers returned by provider, one of
+ *                       AUDIO_FORMAT_PCM_16_BIT, AUDIO_FORMAT_PCM_24_BIT_PACKED,
+ *                       AUDIO_FORMAT_PCM_8_24_BIT, AUDIO_FORMAT_PCM_32_BIT or
+ *                       AUDIO_FORMAT_PCM_FLOAT. Ignored if provider is NULL.
+ *
+ * Other parameters and the provider / input rules are as for create_resampler().
+ */
+int create_polyphase_resampler(uint32_t inSampleRate,
+          uint32_t outSampleRate,
+          uint32_t channelCount,
+          uint32_t quality,
+          audio_format_t providerFormat,
+          struct resampler_buffer_provider *provider,
+          struct resampler_itfe **);
+
+/**
+ * \return the number of input bytes copied to the internal input buffer of a resampler created
+ * by create_polyphase_resampler() since creation. This is intended for performance analysis.
+ */
+size_t polyphase_resampler_get_input_bytes_copied(struct resampler_itfe *resampler);
+
+/**
+ * Same as create_resampler(), but resample_from_provider() passes the provider buffers directly
+ * to the resampler instead of first copying them to an intermediate buffer. Only the filter
+ * state is kept between calls. The provider may be released with a frame_count smaller than the
+ * one returned by get_next_buffer(), the remaining frames must be returned again by the next
+ * get_next_buffer().
+ */
+int create_resampler_in_place(uint32_t inSampleRate,
+          uint32_t outSampleRate,
+          uint32_t channelCount,
+          uint32_t quality,
+          struct resampler_buffer_provider *provider,
+          struct resampler_itfe **);
+
 /**
  * release resampler resources.
  */
@@ -228,6 +228,34 @@ void memcpy_to_p24_from_i32(uint8_t *dst, const int32_t *src, size_t count)
     }
 }
 
+void memcpy_to_p24_from_u8(uint8_t *dst, const uint8_t *src, size_t count)
+{
+    dst += count * 3;
+    src += count;
+    for (; count > 0; --count) {
+        dst -= 3;
+        const uint8_t sample = *--src ^ 0x80;
+#if HAVE_BIG_ENDIAN
+        dst[0] = sample;
+        dst[1] = 0;
+        dst[2] = 0;
+#else
+        dst[0] = 0;
+        dst[1] = 0;
+        dst[2] = sample;
+#endif
+    }
+}
+
+void memcpy_to_q8_23_from_u8(int32_t *dst, const uint8_t *src, size_t count)
+{
+    dst += count;
+    src += count;
+    for (; count > 0; --count) {
+        *--dst = ((int32_t)(*--src) - 0x80) << 16;
+    }
+}
+
 void memcpy_to_q8_23_from_i16(int32_t *dst, const int16_t *src, size_t count)
 {
     dst += count;
@@ -265,6 +293,20 @@ void memcpy_to_q4_27_from_float(int32_t *dst, const float *src, size_t count)
     }
 }
 
+void memcpy_to_q8_23_from_i32(int32_t *dst, const int32_t *src, size_t count)
+{
+    for (; count > 0; --count) {
+        *dst++ = *src++ >> 8;
+    }
+}
+
+void memcpy_to_i32_from_q8_23(int32_t *dst, const int32_t *src, size_t count)
+{
+    for (; count > 0; --count) {
+        *dst++ = clamp24_from_q8_23(*src++) << 8;
+    }
+}
+
 void memcpy_to_i16_from_q8_23(int16_t *dst, const int32_t *src, size_t count)
 {
     for (; count > 0; --count) {
@@ -18,6 +18,7 @@
 #define LOG_TAG "resampler"
 
 #include <errno.h>
+#include <stdbool.h>
 #include <stdlib.h>
 
 #include <log/log.h>
@@ -150,6 +151,65 @@ int resampler_resample_from_provider(struct resampler_itfe *resampler,
     return 0;
 }
 
+// Same as resampler_resample_from_provider() but feeds the provider buffers directly to speex,
+// which keeps the filter history. Frames not consumed by speex are left with the provider.
+static int resampler_resample_from_provider_in_place(struct resampler_itfe *resampler,
+                       int16_t *out,
+                       size_t *outFrameCount)
+{
+    struct resampler *rsmp = (struct resampler *)resampler;
+
+    if (rsmp == NULL || out == NULL || outFrameCount == NULL) {
+        return -EINVAL;
+    }
+    if (rsmp->provider == NULL) {
+        *outFrameCount = 0;
+        return -ENOSYS;
+    }
+
+    size_t framesRq = *outFrameCount;
+    if (framesRq != rsmp->frames_rq) {
+        rsmp->frames_needed = (framesRq * rsmp->in_sample_rate) / rsmp->out_sample_rate + 1;
+        rsmp->frames_rq = framesRq;
+    }
+
+    size_t framesWr = 0;
+    while (framesWr < framesRq) {
+        struct resampler_buffer buf;
+        buf.frame_count = rsmp->frames_needed;
+        rsmp->provider->get_next_buffer(rsmp->provider, &buf);
+        if (buf.raw == NULL) {
+            break;
+        }
+        spx_uint32_t inFrames = buf.frame_count;
+        spx_uint32_t outFrames = framesRq - framesWr;
+        if (rsmp->channel_count == 1) {
+            speex_resampler_process_int(rsmp->speex_resampler,
+                                        0,
+                                        buf.i16,
+                                        &inFrames,
+                                        out + framesWr,
+                                        &outFrames);
+        } else {
+            speex_resampler_process_interleaved_int(rsmp->speex_resampler,
+                                        buf.i16,
+                                        &inFrames,
+                                        out + framesWr * rsmp->channel_count,
+                                        &outFrames);
+        }
+        framesWr += outFrames;
+        buf.frame_count = inFrames;
+        rsmp->provider->release_buffer(rsmp->provider, &buf);
+        if (inFrames == 0 && outFrames == 0) {
+            // an empty provider buffer, or no progress possible
+            break;
+        }
+    }
+    *outFrameCount = framesWr;
+
+    return 0;
+}
+
 int resampler_resample_from_input(struct resampler_itfe *resampler,
                                   int16_t *in,
                                   size_t *inFrameCount,
@@ -187,11 +247,12 @@ int resampler_resample_from_input(struct resampler_itfe *resampler,
     return 0;
 }
 
-int create_resampler(uint32_t inSampleRate,
+static int create_resampler_l(uint32_t inSampleRate,
                     uint32_t outSampleRate,
                     uint32_t channelCount,
                     uint32_t quality,
                     struct resampler_buffer_provider* provider,
+                    bool inPlace,
                     struct resampler_itfe **resampler)
 {
     int error;
@@ -224,7 +285,8 @@ int create_resampler(uint32_t inSampleRate,
     }
 
     rsmp->itfe.reset = resampler_reset;
-    rsmp->itfe.resample_from_provider = resampler_resample_from_provider;
+    rsmp->itfe.resample_from_provider = inPlace ?
+            resampler_resample_from_provider_in_place : resampler_resample_from_provider;
     rsmp->itfe.resample_from_input = resampler_resample_from_input;
     rsmp->itfe.delay_ns = resampler_delay_ns;
 
@@ -248,6 +310,28 @@ int create_resampler(uint32_t inSampleRate,
     return 0;
 }
 
+int create_resampler(uint32_t inSampleRate,
+                    uint32_t outSampleRate,
+                    uint32_t channelCount,
+                    uint32_t quality,
+                    struct resampler_buffer_provider* provider,
+                    struct resampler_itfe **resampler)
+{
+    return create_resampler_l(inSampleRate, outSampleRate, channelCount, quality, provider,
+                              false /* inPlace */, resampler);
+}
+
+int create_resampler_in_place(uint32_t inSampleRate,
+                    uint32_t outSampleRate,
+                    uint32_t channelCount,
+                    uint32_t quality,
+                    struct resampler_buffer_provider* provider,
+                    struct resampler_itfe **resampler)
+{
+    return create_resampler_l(inSampleRate, outSampleRate, channelCount, quality, provider,
+                              true /* inPlace */, resampler);
+}
+
 void release_resampler(struct resampler_itfe *resampler)
 {
     struct resampler *rsmp = (struct resampler *)resampler;
@@ -255,6 +339,10 @@ void release_resampler(struct resampler_itfe *resampler)
     if (rsmp == NULL) {
         return;
     }
+    if (resampler->release != NULL) {
+        resampler->release(resampler);
+        return;
+    }
 
     free(rsmp->in_buf);
 
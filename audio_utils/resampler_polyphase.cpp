@@ -0,0 +1,619 @@
+/*
+ * Copyright 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// #define LOG_NDEBUG 0
+#define LOG_TAG "resampler_polyphase"
+
+#include <errno.h>
+#include <math.h>
+#include <string.h>
+
+#include <algorithm>
+#include <new>
+#include <numeric>
+#include <type_traits>
+#include <vector>
+
+#include <log/log.h>
+
+#include <audio_utils/format.h>
+#include <audio_utils/intrinsic_utils.h>
+#include <audio_utils/primitives.h>
+#include <audio_utils/resampler.h>
+
+#if defined(__aarch64__) || defined(__ARM_NEON__)
+#define USE_NEON
+#endif
+
+namespace {
+
+using namespace android::audio_utils::intrinsics;
+
+// Number of input frames added to the input buffer at a time, in addition to the filter length.
+// This bounds the input buffer size, which is allocated once at creation.
+constexpr size_t kBlockFrames = 256;
+
+// Number of filter phases when the ratio does not reduce to an exact polyphase filter bank.
+// Coefficients are linearly interpolated between adjacent phases.
+constexpr uint32_t kInterpolatedPhasesLog2 = 8;
+constexpr uint32_t kInterpolatedPhases = 1 << kInterpolatedPhasesLog2;
+
+#ifdef USE_NEON
+using Vector = float32x4_t;
+#else
+using Vector = internal_array_t<float, 8>;
+#endif
+constexpr size_t kVectorWidth = sizeof(Vector) / sizeof(float);
+
+// The number of taps is a multiple of 8, so the SIMD kernels have no remainder loop.
+constexpr size_t tapsForQuality(uint32_t quality) {
+    return 16 + 8 * quality;
+}
+
+// zeroth order modified Bessel function of the first kind, for the Kaiser window.
+double besselI0(double x) {
+    double sum = 1.;
+    double term = 1.;
+    const double halfXSquared = x * x * 0.25;
+    for (int k = 1; k < 32; ++k) {
+        term *= halfXSquared / (k * k);
+        sum += term;
+        if (term < sum * 1e-12) break;
+    }
+    return sum;
+}
+
+template <typename T>
+inline T sampleFromFloat(float f);
+
+template <>
+inline float sampleFromFloat<float>(float f) { return f; }
+
+template <>
+inline int16_t sampleFromFloat<int16_t>(float f) { return clamp16_from_float(f); }
+
+template <>
+inline int32_t sampleFromFloat<int32_t>(float f) { return clamp32_from_float(f); }
+
+inline void copyToFloat(float *dst, const float *src, size_t count) {
+    memcpy(dst, src, count * sizeof(float));
+}
+
+inline void copyToFloat(float *dst, const int16_t *src, size_t count) {
+    memcpy_to_float_from_i16(dst, src, count);
+}
+
+inline void copyToFloat(float *dst, const int32_t *src, size_t count) {
+    memcpy_to_float_from_i32(dst, src, count);
+}
+
+// Dot product of two float arrays of length count, a multiple of kVectorWidth.
+// The lanes of the accumulator are returned unreduced in lanes[].
+inline void dotProductLanes(const float *coefs, const float *in, size_t count,
+        float (&lanes)[kVectorWidth]) {
+    Vector accum{};
+    for (size_t i = 0; i < count; i += kVectorWidth) {
+        accum = vmla(accum, vld1<Vector>(coefs + i), vld1<Vector>(in + i));
+    }
+    vst1(lanes, accum);
+}
+
+// Filters one output frame from taps consecutive input frames.
+// For stereo, the coefficient row is expanded so that each coefficient appears twice,
+// and the interleaved input is processed as a single contiguous array.
+template <int CHANNELS>
+inline void filterFrame(const float *coefs, const float *in, size_t taps,
+        size_t channelCount, float *out) {
+    if constexpr (CHANNELS == 1) {
+        float lanes[kVectorWidth];
+        dotProductLanes(coefs, in, taps, lanes);
+        float sum = 0.f;
+        for (float lane : lanes) sum += lane;
+        out[0] = sum;
+    } else if constexpr (CHANNELS == 2) {
+        static_assert(kVectorWidth % 2 == 0);
+        float lanes[kVectorWidth];
+        dotProductLanes(coefs, in, taps * 2, lanes);
+        float left = 0.f;
+        float right = 0.f;
+        for (size_t i = 0; i < kVectorWidth; i += 2) {
+            left += lanes[i];
+            right += lanes[i + 1];
+        }
+        out[0] = left;
+        out[1] = right;
+    } else /* constexpr */ {
+        float accum[FCC_LIMIT]{};
+        for (size_t j = 0; j < taps; ++j) {
+            const float coef = coefs[j];
+            const float *frame = in + j * channelCount;
+            for (size_t c = 0; c < channelCount; ++c) {
+                accum[c] += coef * frame[c];
+            }
+        }
+        memcpy(out, accum, channelCount * sizeof(float));
+    }
+}
+
+class PolyphaseResampler {
+public:
+    PolyphaseResampler(uint32_t inSampleRate, uint32_t outSampleRate, uint32_t channelCount,
+            uint32_t quality, audio_format_t providerFormat,
+            struct resampler_buffer_provider *provider);
+
+    struct resampler_itfe *itfe() { return &mItfe; }
+
+    static PolyphaseResampler *fromItfe(struct resampler_itfe *itfe) {
+        return reinterpret_cast<PolyphaseResampler *>(itfe);
+    }
+
+    void reset();
+    int32_t delayNs() const;
+
+    template <typename T>
+    int resampleFromProvider(T *out, size_t *outFrameCount);
+
+    template <typename T>
+    int resampleFromInput(const T *in, size_t *inFrameCount, T *out, size_t *outFrameCount);
+
+    size_t inputBytesCopied() const { return mInputBytesCopied; }
+
+private:
+    void computeCoefficients();
+
+    // Produces at most outFrames output frames from the input buffer, returns frames produced.
+    template <typename T>
+    size_t process(T *out, size_t outFrames) {
+        return processFrom(mBuffer.data(), mFramesIn, &mBase, out, outFrames);
+    }
+
+    // Produces at most outFrames output frames from the inFrames frames at in, starting with
+    // the filter window at *base, which is advanced. Returns frames produced.
+    template <typename T>
+    size_t processFrom(const float *in, size_t inFrames, size_t *base, T *out, size_t outFrames);
+
+    template <typename T, int CHANNELS>
+    size_t processChannels(const float *in, size_t inFrames, size_t *base,
+            T *out, size_t outFrames);
+
+    // Produces output frames directly from the float frames at src, copying only the
+    // filter window across the boundary with the input buffer and the tail left for the
+    // next call. Adds the frames produced to *framesWr and returns the src frames consumed.
+    template <typename T>
+    size_t processInPlace(const float *src, size_t srcFrames,
+            T *out, size_t outFrames, size_t *framesWr);
+
+    // Appends frames from src to the input buffer.
+    template <typename S>
+    void append(const S *src, size_t frames) {
+        copyToFloat(writePtr(), src, frames * mChannelCount);
+        mFramesIn += frames;
+        mInputBytesCopied += frames * mChannelCount * sizeof(S);
+    }
+
+    // Moves the frames still needed by the filter to the beginning of the input buffer.
+    void compact();
+
+    size_t availableFrames() const { return mBufferFrames - mFramesIn; }
+    float *writePtr() { return mBuffer.data() + mFramesIn * mChannelCount; }
+
+    // Must be the first member, resampler_itfe is cast to PolyphaseResampler.
+    struct resampler_itfe mItfe{};
+
+    const uint32_t mInSampleRate;
+    const uint32_t mOutSampleRate;
+    const uint32_t mChannelCount;
+    const uint32_t mQuality;
+    const audio_format_t mProviderFormat;
+    struct resampler_buffer_provider * const mProvider;
+
+    const size_t mTaps;              // filter taps per phase
+    const size_t mRowLength;         // floats per coefficient row (taps, or taps * 2 for stereo)
+    const size_t mBufferFrames;      // input buffer capacity in frames
+    bool mRational = false;          // exact polyphase filter bank
+    uint32_t mPhases = 0;            // L, number of filter phases
+    uint32_t mStepInt = 0;           // integer part of the input step per output frame
+    uint32_t mStepPhase = 0;         // rational: phase increment (M % L) per output frame
+    uint32_t mStepFrac = 0;          // interpolated: Q0.32 fractional step per output frame
+
+    std::vector<float> mCoefs;       // (mPhases + 1) rows of mRowLength coefficients
+    std::vector<float> mInterpolated; // interpolated coefficient row scratch
+    std::vector<float> mBuffer;      // interleaved float input buffer, mBufferFrames frames
+
+    size_t mFramesIn = 0;            // number of valid frames in mBuffer
+    size_t mBase = 0;                // first input frame of the filter window for next output
+    uint32_t mPhase = 0;             // rational: current phase in [0, mPhases)
+    uint32_t mFrac = 0;              // interpolated: Q0.32 position between input frames
+    size_t mInputBytesCopied = 0;    // input bytes copied to mBuffer, for performance analysis
+};
+
+static_assert(std::is_standard_layout_v<PolyphaseResampler>);
+
+PolyphaseResampler::PolyphaseResampler(uint32_t inSampleRate, uint32_t outSampleRate,
+        uint32_t channelCount, uint32_t quality, audio_format_t providerFormat,
+        struct resampler_buffer_provider *provider)
+    : mInSampleRate(inSampleRate)
+    , mOutSampleRate(outSampleRate)
+    , mChannelCount(channelCount)
+    , mQuality(quality)
+    , mProviderFormat(providerFormat)
+    , mProvider(provider)
+    , mTaps(tapsForQuality(quality))
+    , mRowLength(channelCount == 2 ? mTaps * 2 : mTaps)
+    , mBufferFrames(mTaps + kBlockFrames)
+{
+    const uint32_t divisor = std::gcd(inSampleRate, outSampleRate);
+    const uint32_t interpolation = outSampleRate / divisor;  // L
+    const uint32_t decimation = inSampleRate / divisor;      // M
+    if (interpolation <= RESAMPLER_POLYPHASE_MAX_PHASES) {
+        mRational = true;
+        mPhases = interpolation;
+        mStepInt = decimation / interpolation;
+        mStepPhase = decimation % interpolation;
+    } else {
+        mPhases = kInterpolatedPhases;
+        const uint64_t step = ((uint64_t)inSampleRate << 32) / outSampleRate;
+        mStepInt = (uint32_t)(step >> 32);
+        mStepFrac = (uint32_t)step;
+        mInterpolated.resize(mRowLength);
+    }
+    computeCoefficients();
+    mBuffer.resize(mBufferFrames * mChannelCount);
+
+    mItfe.reset = [](struct resampler_itfe *resampler) {
+        fromItfe(resampler)->reset();
+    };
+    mItfe.resample_from_provider = [](struct resampler_itfe *resampler,
+            int16_t *out, size_t *outFrameCount) {
+        return fromItfe(resampler)->resampleFromProvider(out, outFrameCount);
+    };
+    mItfe.resample_from_input = [](struct resampler_itfe *resampler,
+            int16_t *in, size_t *inFrameCount, int16_t *out, size_t *outFrameCount) {
+        return fromItfe(resampler)->resampleFromInput<int16_t>(
+                in, inFrameCount, out, outFrameCount);
+    };
+    mItfe.delay_ns = [](struct resampler_itfe *resampler) {
+        return fromItfe(resampler)->delayNs();
+    };
+    mItfe.release = [](struct resampler_itfe *resampler) {
+        delete fromItfe(resampler);
+    };
+    mItfe.resample_from_provider_float = [](struct resampler_itfe *resampler,
+            float *out, size_t *outFrameCount) {
+        return fromItfe(resampler)->resampleFromProvider(out, outFrameCount);
+    };
+    mItfe.resample_from_input_float = [](struct resampler_itfe *resampler,
+            const float *in, size_t *inFrameCount, float *out, size_t *outFrameCount) {
+        return fromItfe(resampler)->resampleFromInput(in, inFrameCount, out, outFrameCount);
+    };
+    mItfe.resample_from_provider_i32 = [](struct resampler_itfe *resampler,
+            int32_t *out, size_t *outFrameCount) {
+        return fromItfe(resampler)->resampleFromProvider(out, outFrameCount);
+    };
+    mItfe.resample_from_input_i32 = [](struct resampler_itfe *resampler,
+            const int32_t *in, size_t *inFrameCount, int32_t *out, size_t *outFrameCount) {
+        return fromItfe(resampler)->resampleFromInput(in, inFrameCount, out, outFrameCount);
+    };
+
+    reset();
+}
+
+// Kaiser windowed sinc, one row per phase plus a final row equal to phase 0 advanced by
+// one input frame, used as the upper bound when interpolating coefficients.
+void PolyphaseResampler::computeCoefficients() {
+    const double halfTaps = mTaps / 2;
+    const double beta = 4. + 0.6 * mQuality;
+    const double rolloff = 0.85 + 0.01 * mQuality;
+    // cutoff in cycles per input frame.
+    const double cutoff = 0.5 * rolloff * std::min(1., (double)mOutSampleRate / mInSampleRate);
+    const double windowNorm = 1. / besselI0(beta);
+    const size_t expand = mRowLength / mTaps;
+
+    mCoefs.resize((mPhases + 1) * mRowLength);
+    std::vector<double> row(mTaps);
+    for (uint32_t p = 0; p <= mPhases; ++p) {
+        double sum = 0.;
+        for (size_t j = 0; j < mTaps; ++j) {
+            const double x = (halfTaps - 1 - j) + (double)p / mPhases;
+            const double r = x / halfTaps;
+            const double window = r * r < 1. ? besselI0(beta * sqrt(1. - r * r)) * windowNorm : 0.;
+            const double arg = M_PI * 2. * cutoff * x;
+            const double sinc = x == 0. ? 1. : sin(arg) / arg;
+            row[j] = 2. * cutoff * sinc * window;
+            sum += row[j];
+        }
+        // normalize each phase to unity gain at DC.
+        float *coefs = &mCoefs[p * mRowLength];
+        for (size_t j = 0; j < mTaps; ++j) {
+            for (size_t e = 0; e < expand; ++e) {
+                coefs[j * expand + e] = (float)(row[j] / sum);
+            }
+        }
+    }
+}
+
+void PolyphaseResampler::reset() {
+    std::fill(mBuffer.begin(), mBuffer.end(), 0.f);
+    // prime the filter so that the first output frame is centered on the first input frame.
+    mFramesIn = mTaps / 2 - 1;
+    mBase = 0;
+    mPhase = 0;
+    mFrac = 0;
+}
+
+int32_t PolyphaseResampler::delayNs() const {
+    // input frames buffered after the center of the filter window for the next output frame.
+    const int64_t frames = (int64_t)mFramesIn - (int64_t)(mBase + mTaps / 2 - 1);
+    return frames <= 0 ? 0 : (int32_t)((1000000000 * frames) / mInSampleRate);
+}
+
+template <typename T, int CHANNELS>
+size_t PolyphaseResampler::processChannels(const float *in, size_t inFrames, size_t *base,
+        T *out, size_t outFrames) {
+    const size_t channelCount = CHANNELS > 0 ? CHANNELS : mChannelCount;
+    float frame[FCC_LIMIT];
+    size_t produced = 0;
+    size_t position = *base;
+    while (produced < outFrames && position + mTaps <= inFrames) {
+        const float *window = in + position * channelCount;
+        const float *coefs;
+        if (mRational) {
+            coefs = &mCoefs[mPhase * mRowLength];
+            mPhase += mStepPhase;
+            position += mStepInt;
+            if (mPhase >= mPhases) {
+                mPhase -= mPhases;
+                ++position;
+            }
+        } else {
+            const uint32_t phase = mFrac >> (32 - kInterpolatedPhasesLog2);
+            const float alpha = (float)(mFrac << kInterpolatedPhasesLog2) * 0x1p-32f;
+            const float *lower = &mCoefs[phase * mRowLength];
+            const float *upper = lower + mRowLength;
+            float *interpolated = mInterpolated.data();
+            for (size_t i = 0; i < mRowLength; ++i) {
+                interpolated[i] = lower[i] + alpha * (upper[i] - lower[i]);
+            }
+            coefs = interpolated;
+            const uint32_t frac = mFrac + mStepFrac;
+            position += mStepInt + (frac < mFrac);
+            mFrac = frac;
+        }
+        filterFrame<CHANNELS>(coefs, window, mTaps, channelCount, frame);
+        for (size_t c = 0; c < channelCount; ++c) {
+            *out++ = sampleFromFloat<T>(frame[c]);
+        }
+        ++produced;
+    }
+    *base = position;
+    return produced;
+}
+
+template <typename T>
+size_t PolyphaseResampler::processFrom(const float *in, size_t inFrames, size_t *base,
+        T *out, size_t outFrames) {
+    switch (mChannelCount) {
+    case 1:
+        return processChannels<T, 1>(in, inFrames, base, out, outFrames);
+    case 2:
+        return processChannels<T, 2>(in, inFrames, base, out, outFrames);
+    default:
+        return processChannels<T, 0>(in, inFrames, base, out, outFrames);
+    }
+}
+
+template <typename T>
+size_t PolyphaseResampler::processInPlace(const float *src, size_t srcFrames,
+        T *out, size_t outFrames, size_t *framesWr) {
+    compact();
+    const size_t bridgeFrames = mTaps - 1;
+    if (srcFrames < mTaps * 2 || availableFrames() < bridgeFrames) {
+        // the bridge and the tail would copy about as much as the whole buffer.
+        const size_t frames = std::min(availableFrames(), srcFrames);
+        append(src, frames);
+        *framesWr += process(out + *framesWr * mChannelCount, outFrames - *framesWr);
+        return frames;
+    }
+
+    // Filter windows starting in the input buffer need at most bridgeFrames frames from src.
+    const size_t bufferedFrames = mFramesIn;
+    append(src, bridgeFrames);
+    *framesWr += process(out + *framesWr * mChannelCount, outFrames - *framesWr);
+    if (mBase < bufferedFrames) {
+        // output is full before any window starts in src, drop the bridge.
+        mFramesIn = bufferedFrames;
+        return 0;
+    }
+
+    // The remaining windows start in src.
+    size_t srcBase = mBase - bufferedFrames;
+    *framesWr += processFrom(src, srcFrames, &srcBase, out + *framesWr * mChannelCount,
+            outFrames - *framesWr);
+    mFramesIn = 0;
+    mBase = 0;
+    if (srcBase + mTaps <= srcFrames) {
+        // output is full, the frames from srcBase on are not consumed.
+        return srcBase;
+    }
+    // carry the filter tail to the next call.
+    if (srcBase < srcFrames) {
+        append(src + srcBase * mChannelCount, srcFrames - srcBase);
+    } else {
+        mBase = srcBase - srcFrames;
+    }
+    return srcFrames;
+}
+
+void PolyphaseResampler::compact() {
+    if (mBase == 0) return;
+    if (mBase >= mFramesIn) {
+        // large decimation ratios may step past the buffered input, the remainder
+        // of the step is skipped in the next input received.
+        mBase -= mFramesIn;
+        mFramesIn = 0;
+        return;
+    }
+    mFramesIn -= mBase;
+    memmove(mBuffer.data(), mBuffer.data() + mBase * mChannelCount,
+            mFramesIn * mChannelCount * sizeof(float));
+    mBase = 0;
+}
+
+template <typename T>
+int PolyphaseResampler::resampleFromProvider(T *out, size_t *outFrameCount) {
+    if (out == NULL || outFrameCount == NULL) {
+        return -EINVAL;
+    }
+    if (mProvider == NULL) {
+        *outFrameCount = 0;
+        return -ENOSYS;
+    }
+
+    const size_t framesRq = *outFrameCount;
+    size_t framesWr = 0;
+    while (true) {
+        framesWr += process(out + framesWr * mChannelCount, framesRq - framesWr);
+        if (framesWr == framesRq) break;
+        compact();
+
+        struct resampler_buffer buf;
+        if (mProviderFormat == AUDIO_FORMAT_PCM_FLOAT) {
+            // request enough frames to complete the output.
+            buf.frame_count = (size_t)(((uint64_t)(framesRq - framesWr) * mInSampleRate)
+                    / mOutSampleRate) + mTaps;
+            mProvider->get_next_buffer(mProvider, &buf);
+            if (buf.raw == NULL || buf.frame_count == 0) {
+                break;
+            }
+            buf.frame_count = processInPlace(buf.f32, buf.frame_count, out, framesRq, &framesWr);
+            mProvider->release_buffer(mProvider, &buf);
+            continue;
+        }
+        buf.frame_count = availableFrames();
+        mProvider->get_next_buffer(mProvider, &buf);
+        if (buf.raw == NULL || buf.frame_count == 0) {
+            break;
+        }
+        memcpy_by_audio_format(writePtr(), AUDIO_FORMAT_PCM_FLOAT,
+                buf.raw, mProviderFormat, buf.frame_count * mChannelCount);
+        mFramesIn += buf.frame_count;
+        mInputBytesCopied += buf.frame_count * mChannelCount
+                * audio_bytes_per_sample(mProviderFormat);
+        mProvider->release_buffer(mProvider, &buf);
+    }
+    *outFrameCount = framesWr;
+    return 0;
+}
+
+template <typename T>
+int PolyphaseResampler::resampleFromInput(
+        const T *in, size_t *inFrameCount, T *out, size_t *outFrameCount) {
+    if (in == NULL || inFrameCount == NULL || out == NULL || outFrameCount == NULL) {
+        return -EINVAL;
+    }
+    if (mProvider != NULL) {
+        *outFrameCount = 0;
+        return -ENOSYS;
+    }
+
+    const size_t framesRq = *outFrameCount;
+    const size_t framesAvail = *inFrameCount;
+    size_t framesWr = 0;
+    size_t framesRd = 0;
+    while (true) {
+        framesWr += process(out + framesWr * mChannelCount, framesRq - framesWr);
+        if (framesWr == framesRq) break;
+        compact();
+
+        if (framesRd == framesAvail) break;
+        if constexpr (std::is_same_v<T, float>) {
+            const size_t frames = processInPlace(in + framesRd * mChannelCount,
+                    framesAvail - framesRd, out, framesRq, &framesWr);
+            if (frames == 0) break;  // output is full.
+            framesRd += frames;
+            continue;
+        }
+        const size_t frames = std::min(availableFrames(), framesAvail - framesRd);
+        if (frames == 0) break;
+        append(in + framesRd * mChannelCount, frames);
+        framesRd += frames;
+    }
+    *inFrameCount = framesRd;
+    *outFrameCount = framesWr;
+    ALOGV("%s: DONE in %zu out %zu", __func__, framesRd, framesWr);
+    return 0;
+}
+
+bool isProviderFormatSupported(audio_format_t format) {
+    switch (format) {
+    case AUDIO_FORMAT_PCM_16_BIT:
+    case AUDIO_FORMAT_PCM_24_BIT_PACKED:
+    case AUDIO_FORMAT_PCM_8_24_BIT:
+    case AUDIO_FORMAT_PCM_32_BIT:
+    case AUDIO_FORMAT_PCM_FLOAT:
+        return true;
+    default:
+        return false;
+    }
+}
+
+} // namespace
+
+int create_polyphase_resampler(uint32_t inSampleRate,
+                               uint32_t outSampleRate,
+                               uint32_t channelCount,
+                               uint32_t quality,
+                               audio_format_t providerFormat,
+                               struct resampler_buffer_provider *provider,
+                               struct resampler_itfe **resampler)
+{
+    ALOGV("%s: In SR %u Out SR %u channels %u quality %u",
+            __func__, inSampleRate, outSampleRate, channelCount, quality);
+
+    if (resampler == NULL) {
+        return -EINVAL;
+    }
+
+    *resampler = NULL;
+
+    if (quality <= RESAMPLER_QUALITY_MIN || quality >= RESAMPLER_QUALITY_MAX) {
+        return -EINVAL;
+    }
+    if (channelCount == 0 || channelCount > FCC_LIMIT) {
+        return -EINVAL;
+    }
+    // the input step per output frame must fit in the input block.
+    if (inSampleRate == 0 || outSampleRate == 0 || inSampleRate / outSampleRate >= kBlockFrames) {
+        return -EINVAL;
+    }
+    if (provider != NULL && !isProviderFormatSupported(providerFormat)) {
+        ALOGW("%s: unsupported provider format %#x", __func__, providerFormat);
+        return -EINVAL;
+    }
+
+    PolyphaseResampler *rsmp = new (std::nothrow) PolyphaseResampler(
+            inSampleRate, outSampleRate, channelCount, quality, providerFormat, provider);
+    if (rsmp == NULL) {
+        return -ENOMEM;
+    }
+    *resampler = rsmp->itfe();
+    return 0;
+}
+
+size_t polyphase_resampler_get_input_bytes_copied(struct resampler_itfe *resampler)
+{
+    return resampler == NULL ? 0 : PolyphaseResampler::fromItfe(resampler)->inputBytesCopied();
+}
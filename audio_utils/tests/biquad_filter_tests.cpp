@@ -351,3 +351,116 @@ TYPED_TEST(BiquadBasicTest, Equivalence) {
 TYPED_TEST(BiquadBasicTest, CoefReductionEquivalence) {
     this->testCoefReductionEquivalence();
 }
+
+// The BiquadCascadeFilterTest is parameterized on channel count.
+class BiquadCascadeFilterTest : public ::testing::TestWithParam<size_t> {
+protected:
+    // Compares a cascade of STAGES Biquads with STAGES BiquadFilters applied in sequence.
+    template <typename ConstOptions, typename D>
+    static void testCascade(size_t zeroChannels = 0) {
+        constexpr size_t STAGES = 3;
+        constexpr size_t FRAMES = 100;
+        const size_t channelCount = static_cast<size_t>(GetParam());
+        const size_t stride = channelCount + zeroChannels;
+
+        std::array<std::array<D, kBiquadNumCoefs>, STAGES> coefs;
+        std::vector<BiquadFilter<D, true /* SAME_COEF_PER_CHANNEL */, ConstOptions>> stages;
+        for (auto& coef : coefs) {
+            coef = randomFilter<D>();
+            stages.emplace_back(channelCount, coef);
+        }
+        BiquadCascadeFilter<D, STAGES, ConstOptions> cascade(channelCount, coefs);
+        ASSERT_TRUE(cascade.isStable());
+
+        std::vector<D> input(FRAMES * stride);
+        std::vector<D> expected(FRAMES * stride);
+        std::vector<D> output(FRAMES * stride);
+        for (size_t period = 0; period < PERIOD; ++period) { // the state carries over.
+            randomBuffer(input.data(), FRAMES, stride);
+            expected = input;
+            for (auto& stage : stages) {
+                stage.process(expected.data(), expected.data(), FRAMES, stride);
+            }
+            output = input;
+            cascade.process(output.data(), output.data(), FRAMES, stride);  // in place
+            for (size_t i = 0; i < FRAMES; ++i) {
+                for (size_t j = 0; j < stride; ++j) {
+                    // channels past channelCount are not modified.
+                    ASSERT_NEAR(j < channelCount ? expected[i * stride + j]
+                            : input[i * stride + j], output[i * stride + j], EPS);
+                }
+            }
+        }
+
+        cascade.clear();
+        for (D delay : cascade.getDelays()) {
+            ASSERT_EQ(D{}, delay);
+        }
+    }
+
+    // Compares the fused energy of a cascade on int16_t input with the energy
+    // of the output of the cascade on the same input converted to float.
+    template <typename ConstOptions>
+    static void testCascadeEnergy() {
+        constexpr size_t STAGES = 3;
+        constexpr size_t FRAMES = 100;
+        const size_t channelCount = static_cast<size_t>(GetParam());
+
+        std::array<std::array<float, kBiquadNumCoefs>, STAGES> coefs;
+        for (auto& coef : coefs) {
+            coef = randomFilter<float>();
+        }
+        BiquadCascadeFilter<float, STAGES, ConstOptions> cascade(channelCount, coefs);
+        BiquadCascadeFilter<float, STAGES, ConstOptions> fused(channelCount, coefs);
+
+        std::vector<int16_t> input(FRAMES * channelCount);
+        std::vector<float> output(FRAMES * channelCount);
+        std::vector<float> expected(channelCount);
+        std::vector<float> energies(channelCount);
+        for (size_t period = 0; period < PERIOD; ++period) { // the state carries over.
+            std::vector<float> floatInput(FRAMES * channelCount);
+            randomBuffer(floatInput.data(), FRAMES, channelCount);
+            for (size_t i = 0; i < input.size(); ++i) {
+                input[i] = static_cast<int16_t>(floatInput[i] * INT16_MAX);
+                output[i] = input[i] * (1.f / (1 << 15));
+            }
+            cascade.process(output.data(), output.data(), FRAMES);
+            for (size_t i = 0; i < output.size(); ++i) {
+                expected[i % channelCount] += output[i] * output[i];
+            }
+            fused.accumulateEnergy(energies.data(), input.data(), FRAMES, 1.f / (1 << 15));
+            for (size_t j = 0; j < channelCount; ++j) {
+                ASSERT_NEAR(expected[j], energies[j], EPS * expected[j]);
+            }
+        }
+        ASSERT_EQ(cascade.getDelays(), fused.getDelays());
+    }
+};
+
+TEST_P(BiquadCascadeFilterTest, SSFilterFloat) {
+    testCascade<StateSpaceOptions, float>();
+}
+
+TEST_P(BiquadCascadeFilterTest, SSFilterDoubleZero3) {
+    testCascade<StateSpaceOptions, double>(3 /* zeroChannels */);
+}
+
+TEST_P(BiquadCascadeFilterTest, DT2FilterFloatZero5) {
+    testCascade<Direct2TransposeOptions, float>(5 /* zeroChannels */);
+}
+
+TEST_P(BiquadCascadeFilterTest, SSEnergyInt16) {
+    testCascadeEnergy<StateSpaceOptions>();
+}
+
+TEST_P(BiquadCascadeFilterTest, DT2EnergyInt16) {
+    testCascadeEnergy<Direct2TransposeOptions>();
+}
+
+INSTANTIATE_TEST_CASE_P(
+        CstrAndRunBiquadCascadeFilter,
+        BiquadCascadeFilterTest,
+        ::testing::Values(1, 2, 3, 4, 5, 6, 7, 8,
+                9, 10, 11, 12, 13, 14, 15, 16,
+                17, 18, 19, 20, 21, 22, 23, 24)
+        );
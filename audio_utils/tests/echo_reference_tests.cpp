@@ -0,0 +1,248 @@
+/*
+ * Copyright 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "audio_utils_echo_reference_tests"
+
+#include <math.h>
+#include <time.h>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include <audio_utils/echo_reference.h>
+#include <gtest/gtest.h>
+#include <log/log.h>
+
+namespace {
+
+constexpr uint32_t kWriteSampleRate = 48000;
+constexpr size_t kWriteFrames = 480;  // 10 ms
+
+std::vector<int16_t> makeStereoSine(size_t frames, size_t offset) {
+    std::vector<int16_t> buffer(frames * 2);
+    for (size_t i = 0; i < frames; ++i) {
+        buffer[i * 2] = buffer[i * 2 + 1] = (int16_t)(8192 *
+                sinf(2.f * M_PI * 1000.f * (offset + i) / kWriteSampleRate));
+    }
+    return buffer;
+}
+
+int writeFrames(struct echo_reference_itfe *er, std::vector<int16_t>& data) {
+    struct echo_reference_buffer b{};
+    b.raw = data.data();
+    b.frame_count = data.size() / 2;
+    clock_gettime(CLOCK_MONOTONIC, &b.time_stamp);
+    return er->write(er, &b);
+}
+
+int readFrames(struct echo_reference_itfe *reader, std::vector<int16_t>& data,
+        size_t channelCount) {
+    struct echo_reference_buffer b{};
+    b.raw = data.data();
+    b.frame_count = data.size() / channelCount;
+    return reader->read(reader, &b);
+}
+
+} // namespace
+
+TEST(echo_reference, invalid_arguments) {
+    struct echo_reference_itfe *er;
+    EXPECT_EQ(-EINVAL, create_echo_reference(AUDIO_FORMAT_PCM_16_BIT, 1, 16000,
+            AUDIO_FORMAT_PCM_16_BIT, 2, kWriteSampleRate, nullptr));
+    EXPECT_EQ(-EINVAL, create_echo_reference(AUDIO_FORMAT_PCM_FLOAT, 1, 16000,
+            AUDIO_FORMAT_PCM_FLOAT, 2, kWriteSampleRate, &er));
+    EXPECT_EQ(-EINVAL, create_echo_reference(AUDIO_FORMAT_PCM_16_BIT, 3, 16000,
+            AUDIO_FORMAT_PCM_16_BIT, 2, kWriteSampleRate, &er));
+    ASSERT_EQ(0, create_echo_reference(AUDIO_FORMAT_PCM_16_BIT, 1, 16000,
+            AUDIO_FORMAT_PCM_16_BIT, 2, kWriteSampleRate, &er));
+
+    struct echo_reference_itfe *reader;
+    EXPECT_EQ(-EINVAL, echo_reference_add_reader(er, AUDIO_FORMAT_PCM_16_BIT, 4, 16000,
+            &reader));
+    EXPECT_EQ(nullptr, reader);
+    ASSERT_EQ(0, echo_reference_add_reader(er, AUDIO_FORMAT_PCM_16_BIT, 2, 32000, &reader));
+    struct echo_reference_buffer b{};
+    EXPECT_EQ(-ENOSYS, reader->write(reader, &b));
+    echo_reference_remove_reader(er, reader);
+    release_echo_reference(er);
+}
+
+TEST(echo_reference, read_without_writer) {
+    struct echo_reference_itfe *er;
+    ASSERT_EQ(0, create_echo_reference(AUDIO_FORMAT_PCM_16_BIT, 2, kWriteSampleRate,
+            AUDIO_FORMAT_PCM_16_BIT, 2, kWriteSampleRate, &er));
+    std::vector<int16_t> out(kWriteFrames * 2, 1);
+    ASSERT_EQ(0, readFrames(er, out, 2));
+    for (int16_t sample : out) {
+        ASSERT_EQ(0, sample);
+    }
+    release_echo_reference(er);
+}
+
+TEST(echo_reference, multiple_readers) {
+    struct echo_reference_itfe *er;
+    ASSERT_EQ(0, create_echo_reference(AUDIO_FORMAT_PCM_16_BIT, 2, kWriteSampleRate,
+            AUDIO_FORMAT_PCM_16_BIT, 2, kWriteSampleRate, &er));
+    struct echo_reference_itfe *monoReader;
+    ASSERT_EQ(0, echo_reference_add_reader(er, AUDIO_FORMAT_PCM_16_BIT, 1, 16000,
+            &monoReader));
+
+    // start reading and writing.
+    std::vector<int16_t> out(kWriteFrames * 2);
+    std::vector<int16_t> monoOut(kWriteFrames / 3);
+    std::vector<int16_t> in = makeStereoSine(kWriteFrames, 0);
+    ASSERT_EQ(0, writeFrames(er, in));
+    ASSERT_EQ(0, readFrames(er, out, 2));
+    ASSERT_EQ(0, readFrames(monoReader, monoOut, 1));
+
+    // without capture time stamps, the delay is not adjusted and frames are returned in order.
+    constexpr size_t kBlocks = 20;
+    double monoEnergy = 0.;
+    for (size_t block = 1; block <= kBlocks; ++block) {
+        in = makeStereoSine(kWriteFrames, block * kWriteFrames);
+        ASSERT_EQ(0, writeFrames(er, in));
+        ASSERT_EQ(0, readFrames(er, out, 2));
+        ASSERT_EQ(in, out);
+        ASSERT_EQ(0, readFrames(monoReader, monoOut, 1));
+        if (block > 1) {  // skip the resampler warm up.
+            for (int16_t sample : monoOut) {
+                monoEnergy += (double)sample * sample;
+            }
+        }
+    }
+    // a sine of amplitude 8192 has an RMS of 8192 / sqrt(2).
+    const double monoRms = sqrt(monoEnergy / ((kBlocks - 1) * monoOut.size()));
+    EXPECT_NEAR(8192. / M_SQRT2, monoRms, 200.);
+
+    // stop writing, readers return silence.
+    ASSERT_EQ(0, er->write(er, nullptr));
+    ASSERT_EQ(0, readFrames(monoReader, monoOut, 1));
+    for (int16_t sample : monoOut) {
+        ASSERT_EQ(0, sample);
+    }
+
+    echo_reference_remove_reader(er, monoReader);
+    release_echo_reference(er);
+}
+
+TEST(echo_reference, reader_added_mid_stream) {
+    struct echo_reference_itfe *er;
+    ASSERT_EQ(0, create_echo_reference(AUDIO_FORMAT_PCM_16_BIT, 2, kWriteSampleRate,
+            AUDIO_FORMAT_PCM_16_BIT, 2, kWriteSampleRate, &er));
+
+    // render and capture time stamps are synthetic: block n is rendered at n * 10 ms with a
+    // 20 ms playback delay and captured at the same time, so once aligned each read returns
+    // the block written before the current one.
+    constexpr int64_t kBlockNs = 10000000;
+    auto readBlock = [&](struct echo_reference_itfe *reader, std::vector<int16_t>& out,
+            size_t block) {
+        const struct timespec ts = {(time_t)(1 + block * kBlockNs / 1000000000),
+                (long)(block * kBlockNs % 1000000000)};
+        struct echo_reference_buffer b{};
+        b.raw = out.data();
+        b.frame_count = kWriteFrames;
+        b.time_stamp = ts;
+        return reader->read(reader, &b);
+    };
+    auto writeBlock = [&](std::vector<int16_t>& in, size_t block) {
+        struct echo_reference_buffer b{};
+        b.raw = in.data();
+        b.frame_count = kWriteFrames;
+        b.delay_ns = 2 * kBlockNs;
+        b.time_stamp = {(time_t)(1 + block * kBlockNs / 1000000000),
+                (long)(block * kBlockNs % 1000000000)};
+        return er->write(er, &b);
+    };
+
+    std::vector<int16_t> out(kWriteFrames * 2);
+    std::vector<int16_t> addedOut(kWriteFrames * 2);
+    std::vector<int16_t> prev;
+    size_t block = 0;
+    for (; block < 50; ++block) {
+        std::vector<int16_t> in = makeStereoSine(kWriteFrames, block * kWriteFrames);
+        ASSERT_EQ(0, writeBlock(in, block));
+        ASSERT_EQ(0, readBlock(er, out, block));
+        prev = in;
+    }
+
+    // a reader attached after many frames were written is aligned like the default reader.
+    struct echo_reference_itfe *reader;
+    ASSERT_EQ(0, echo_reference_add_reader(er, AUDIO_FORMAT_PCM_16_BIT, 2, kWriteSampleRate,
+            &reader));
+    ASSERT_EQ(0, readBlock(reader, addedOut, block));
+    for (size_t end = block + 20; block < end; ++block) {
+        std::vector<int16_t> in = makeStereoSine(kWriteFrames, block * kWriteFrames);
+        ASSERT_EQ(0, writeBlock(in, block));
+        ASSERT_EQ(0, readBlock(er, out, block));
+        ASSERT_EQ(0, readBlock(reader, addedOut, block));
+        ASSERT_EQ(prev, out);
+        prev = in;
+    }
+    EXPECT_EQ(out, addedOut);
+    double energy = 0.;
+    for (int16_t sample : addedOut) {
+        energy += (double)sample * sample;
+    }
+    EXPECT_NEAR(8192. / M_SQRT2, sqrt(energy / addedOut.size()), 200.);
+
+    echo_reference_remove_reader(er, reader);
+    release_echo_reference(er);
+}
+
+TEST(echo_reference, concurrent_readers) {
+    struct echo_reference_itfe *er;
+    ASSERT_EQ(0, create_echo_reference(AUDIO_FORMAT_PCM_16_BIT, 1, 16000,
+            AUDIO_FORMAT_PCM_16_BIT, 2, kWriteSampleRate, &er));
+    struct echo_reference_itfe *reader;
+    ASSERT_EQ(0, echo_reference_add_reader(er, AUDIO_FORMAT_PCM_16_BIT, 2, 32000, &reader));
+
+    std::atomic<bool> done{false};
+    auto readLoop = [&done](struct echo_reference_itfe *r, size_t channelCount, size_t frames) {
+        std::vector<int16_t> out(frames * channelCount);
+        while (!done) {
+            struct echo_reference_buffer b{};
+            b.raw = out.data();
+            b.frame_count = frames;
+            b.delay_ns = 5000000;
+            clock_gettime(CLOCK_MONOTONIC, &b.time_stamp);
+            EXPECT_EQ(0, r->read(r, &b));
+            EXPECT_EQ(0, b.delay_ns);
+        }
+        r->read(r, nullptr);
+    };
+    std::thread t1(readLoop, er, 1, 160);
+    std::thread t2(readLoop, reader, 2, 320);
+
+    for (size_t block = 0; block < 100; ++block) {
+        std::vector<int16_t> in = makeStereoSine(kWriteFrames, block * kWriteFrames);
+        struct echo_reference_buffer b{};
+        b.raw = in.data();
+        b.frame_count = kWriteFrames;
+        b.delay_ns = 10000000;
+        clock_gettime(CLOCK_MONOTONIC, &b.time_stamp);
+        ASSERT_EQ(0, er->write(er, &b));
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    er->write(er, nullptr);
+    done = true;
+    t1.join();
+    t2.join();
+
+    echo_reference_remove_reader(er, reader);
+    release_echo_reference(er);
+}
@@ -0,0 +1,170 @@
+/*
+ * Copyright 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "audio_utils_float_fft_tests"
+
+#include <math.h>
+
+#include <algorithm>
+#include <complex>
+#include <random>
+#include <vector>
+
+#include <audio_utils/FloatFFT.h>
+#include <gtest/gtest.h>
+#include <log/log.h>
+
+using namespace android::audio_utils;
+
+namespace {
+
+std::vector<float> makeRandom(size_t count, unsigned seed) {
+    std::minstd_rand gen(seed);
+    std::uniform_real_distribution<> dis(-1.f, 1.f);
+    std::vector<float> data(count);
+    for (auto& value : data) {
+        value = dis(gen);
+    }
+    return data;
+}
+
+// Direct O(n^2) DFT in double precision of n interleaved complex values.
+std::vector<std::complex<double>> dft(const float *in, size_t n, size_t stride) {
+    std::vector<std::complex<double>> out(n);
+    for (size_t k = 0; k < n; ++k) {
+        std::complex<double> sum{};
+        for (size_t j = 0; j < n; ++j) {
+            const double phase = -2. * M_PI * ((j * k) % n) / n;
+            const std::complex<double> value(in[j * stride], stride == 2 ? in[j * 2 + 1] : 0.);
+            sum += value * std::polar(1., phase);
+        }
+        out[k] = sum;
+    }
+    return out;
+}
+
+// Maximum absolute difference of the interleaved complex values, relative to sqrt(n),
+// the expected magnitude of the transform of random data.
+float maxError(const float *out, const std::vector<std::complex<double>>& expected) {
+    double error = 0.;
+    for (size_t k = 0; k < expected.size(); ++k) {
+        error = std::max({error, fabs(out[2 * k] - expected[k].real()),
+                fabs(out[2 * k + 1] - expected[k].imag())});
+    }
+    return error / sqrt(expected.size());
+}
+
+} // namespace
+
+class FloatFFTTest : public ::testing::TestWithParam<size_t> {};
+
+TEST_P(FloatFFTTest, forward) {
+    const size_t n = GetParam();
+    const std::vector<float> in = makeRandom(2 * n, n);
+    std::vector<float> out(2 * n);
+    FloatFFT fft(n);
+    ASSERT_EQ(n, fft.size());
+    fft.forward(in.data(), out.data());
+    EXPECT_LT(maxError(out.data(), dft(in.data(), n, 2)), 1e-5f);
+}
+
+TEST_P(FloatFFTTest, inverse_in_place) {
+    const size_t n = GetParam();
+    const std::vector<float> in = makeRandom(2 * n, n);
+    std::vector<float> data = in;
+    FloatFFT fft(n);
+    fft.forward(data.data(), data.data());
+    fft.inverse(data.data(), data.data());
+    for (size_t i = 0; i < data.size(); ++i) {
+        ASSERT_NEAR(in[i], data[i], 1e-5f);
+    }
+}
+
+TEST_P(FloatFFTTest, real_forward) {
+    const size_t n = GetParam() * 2;
+    const std::vector<float> in = makeRandom(n, n);
+    std::vector<float> out(n + 2);
+    FloatRealFFT fft(n);
+    ASSERT_EQ(n, fft.size());
+    fft.forward(in.data(), out.data());
+    std::vector<std::complex<double>> expected = dft(in.data(), n, 1);
+    expected.resize(n / 2 + 1);
+    EXPECT_LT(maxError(out.data(), expected), 1e-5f);
+    EXPECT_EQ(0.f, out[1]);
+    EXPECT_EQ(0.f, out[n + 1]);
+}
+
+TEST_P(FloatFFTTest, real_inverse) {
+    const size_t n = GetParam() * 2;
+    const std::vector<float> in = makeRandom(n, n);
+    std::vector<float> spectrum(n + 2);
+    std::vector<float> out(n);
+    FloatRealFFT fft(n);
+    fft.forward(in.data(), spectrum.data());
+    fft.inverse(spectrum.data(), out.data());
+    for (size_t i = 0; i < n; ++i) {
+        ASSERT_NEAR(in[i], out[i], 1e-5f);
+    }
+}
+
+INSTANTIATE_TEST_SUITE_P(FloatFFTTestAll, FloatFFTTest,
+        ::testing::Values(1, 2, 4, 8, 16, 32, 64, 128, 256, 512, 1024, 2048));
+
+TEST(FloatFFT, valid_size) {
+    EXPECT_FALSE(FloatFFT::isValidSize(0));
+    EXPECT_TRUE(FloatFFT::isValidSize(1));
+    EXPECT_FALSE(FloatFFT::isValidSize(3));
+    EXPECT_TRUE(FloatFFT::isValidSize(FloatFFT::kMaxSize));
+    EXPECT_FALSE(FloatFFT::isValidSize(FloatFFT::kMaxSize * 2));
+    EXPECT_FALSE(FloatRealFFT::isValidSize(1));
+    EXPECT_TRUE(FloatRealFFT::isValidSize(2));
+}
+
+TEST(FloatFFT, invalid_size) {
+    // the size is checked before anything is computed or allocated from it.
+    for (size_t n : {size_t{0}, size_t{3}, SIZE_MAX / 2 + 1}) {
+        SCOPED_TRACE(testing::Message() << "n " << n);
+        EXPECT_DEATH(FloatFFT{n}, ".*invalid size.*");
+    }
+    for (size_t n : {size_t{1}, size_t{6}, SIZE_MAX / 2 + 1}) {
+        SCOPED_TRACE(testing::Message() << "n " << n);
+        EXPECT_DEATH(FloatRealFFT{n}, ".*invalid size.*");
+    }
+}
+
+TEST(FloatFFT, max_size_sine) {
+    // a real cosine at bin b transforms to n / 2 in bin b and (almost) 0 elsewhere.
+    constexpr size_t n = FloatFFT::kMaxSize;
+    constexpr size_t bin = 1000;
+    std::vector<float> in(n);
+    for (size_t i = 0; i < n; ++i) {
+        in[i] = cos(2. * M_PI * ((bin * i) % n) / n);
+    }
+    std::vector<float> out(n + 2);
+    FloatRealFFT fft(n);
+    fft.forward(in.data(), out.data());
+    for (size_t k = 0; k <= n / 2; ++k) {
+        const float magnitude = hypotf(out[2 * k], out[2 * k + 1]);
+        ASSERT_NEAR(k == bin ? n / 2 : 0.f, magnitude, 0.05f) << "bin " << k;
+    }
+
+    std::vector<float> back(n);
+    fft.inverse(out.data(), back.data());
+    for (size_t i = 0; i < n; ++i) {
+        ASSERT_NEAR(in[i], back[i], 1e-5f);
+    }
+}
@@ -21,19 +21,6 @@
 #include <audio_utils/format.h>
 #include <gtest/gtest.h>
 
-/** returns true if the format is a common source or destination format.
-    memcpy_by_audio_format() allows interchange between any PCM format and the
-    "common" PCM 16 bit and PCM float formats. */
-static bool is_common_src_format(audio_format_t format) {
-    return format == AUDIO_FORMAT_PCM_16_BIT || format == AUDIO_FORMAT_PCM_FLOAT;
-}
-
-static bool is_common_dst_format(audio_format_t format) {
-    return format == AUDIO_FORMAT_PCM_8_BIT       // Allowed for HAL to AudioRecord conversion.
-            || format == AUDIO_FORMAT_PCM_16_BIT
-            || format == AUDIO_FORMAT_PCM_FLOAT;
-}
-
 // Initialize PCM 16 bit ramp for basic data validation (generated from PCM 8 bit data).
 // TODO: consider creating fillPseudoRandomValue().
 template<size_t size>
@@ -68,12 +55,6 @@ TEST_P(FormatTest, memcpy_by_audio_format)
     const audio_format_t src_encoding = std::get<0>(param);
     const audio_format_t dst_encoding = std::get<1>(param);
 
-    // either source or destination (or both) need to be a common format
-    if (!is_common_src_format(src_encoding) && !is_common_dst_format(dst_encoding)) {
-        printf("skip conversion src:%#x  dst:%#x\n", src_encoding, dst_encoding);
-        return;
-    }
-
     constexpr size_t SAMPLES = UINT8_MAX;
     constexpr audio_format_t orig_encoding = AUDIO_FORMAT_PCM_16_BIT;
     int16_t orig_data[SAMPLES];
@@ -114,6 +95,35 @@ TEST_P(FormatTest, memcpy_by_audio_format)
             memcmp(data, orig_data, SAMPLES * audio_bytes_per_sample(orig_encoding)));
 }
 
+TEST_P(FormatTest, get_memcpy_by_audio_format_fn)
+{
+    const auto param = GetParam();
+    const audio_format_t src_encoding = std::get<0>(param);
+    const audio_format_t dst_encoding = std::get<1>(param);
+
+    const memcpy_by_audio_format_fn_t fn =
+            get_memcpy_by_audio_format_fn(dst_encoding, src_encoding);
+    ASSERT_NE(nullptr, fn);
+
+    constexpr size_t SAMPLES = UINT8_MAX;
+    int16_t orig_data[SAMPLES];
+    fillRamp(orig_data);
+
+    uint32_t data[SAMPLES];
+    memcpy_by_audio_format(
+            data, src_encoding,
+            orig_data, AUDIO_FORMAT_PCM_16_BIT, SAMPLES);
+
+    // The resolved function must match memcpy_by_audio_format().
+    uint32_t expected[SAMPLES];
+    uint32_t check[SAMPLES];
+    memcpy_by_audio_format(
+            expected, dst_encoding,
+            data, src_encoding, SAMPLES);
+    fn(check, data, SAMPLES);
+    EXPECT_EQ(0, memcmp(expected, check, SAMPLES * audio_bytes_per_sample(dst_encoding)));
+}
+
 INSTANTIATE_TEST_CASE_P(FormatVariations, FormatTest, ::testing::Combine(
     ::testing::Values(
         AUDIO_FORMAT_PCM_8_BIT,
@@ -132,6 +142,75 @@ INSTANTIATE_TEST_CASE_P(FormatVariations, FormatTest, ::testing::Combine(
         AUDIO_FORMAT_PCM_8_24_BIT
     )));
 
+TEST_P(FormatTest, memcpy_by_index_array_and_format_with_gain)
+{
+    const auto param = GetParam();
+    const audio_format_t src_encoding = std::get<0>(param);
+    const audio_format_t dst_encoding = std::get<1>(param);
+    const size_t src_sample_size = audio_bytes_per_sample(src_encoding);
+    const size_t dst_sample_size = audio_bytes_per_sample(dst_encoding);
+
+    constexpr size_t FRAMES = 31;
+    constexpr uint32_t SRC_CHANNELS = 8;
+    constexpr size_t SAMPLES = FRAMES * SRC_CHANNELS;
+    int16_t orig_data[SAMPLES];
+    fillRamp(orig_data);
+    uint32_t src[SAMPLES];
+    memcpy_by_audio_format(
+            src, src_encoding,
+            orig_data, AUDIO_FORMAT_PCM_16_BIT, SAMPLES);
+
+    // reverse the channels and attenuate by channel, with and without dropping every
+    // third channel, as the remap without dropped channels is specialized by channel count.
+    int8_t idxaryDrop[SRC_CHANNELS + 1];
+    int8_t idxaryAll[SRC_CHANNELS + 1];
+    float gains[SRC_CHANNELS + 1];
+    for (size_t i = 0; i < SRC_CHANNELS + 1; ++i) {
+        idxaryAll[i] = SRC_CHANNELS - 1 - i % SRC_CHANNELS;
+        idxaryDrop[i] = i % 3 == 2 ? -1 : idxaryAll[i];
+        gains[i] = 1.f - 0.1f * i;
+    }
+
+    for (const int8_t *idxary : {idxaryDrop, idxaryAll}) {
+        for (uint32_t dst_channels : {1, 2, 3, 4, 6, 8, 9}) {
+            SCOPED_TRACE(testing::Message() << "drop " << (idxary == idxaryDrop)
+                    << " dst_channels " << dst_channels);
+            uint32_t dst[FRAMES * (SRC_CHANNELS + 1)];
+            memcpy_by_index_array_and_format_with_gain(
+                    dst, dst_encoding, dst_channels,
+                    src, src_encoding, SRC_CHANNELS,
+                    idxary, gains, FRAMES);
+
+            // compare with sample by sample conversion through float.
+            for (size_t i = 0; i < FRAMES; ++i) {
+                for (size_t c = 0; c < dst_channels; ++c) {
+                    float f = 0.f;
+                    if (idxary[c] >= 0) {
+                        memcpy_by_audio_format(&f, AUDIO_FORMAT_PCM_FLOAT,
+                                (uint8_t *)src
+                                        + (i * SRC_CHANNELS + idxary[c]) * src_sample_size,
+                                src_encoding, 1);
+                        f *= gains[c];
+                    }
+                    uint32_t expected = 0;
+                    memcpy_by_audio_format(&expected, dst_encoding,
+                            &f, AUDIO_FORMAT_PCM_FLOAT, 1);
+                    ASSERT_EQ(0, memcmp(&expected,
+                            (uint8_t *)dst + (i * dst_channels + c) * dst_sample_size,
+                            dst_sample_size)) << "frame " << i << " channel " << c;
+                }
+            }
+        }
+    }
+}
+
+TEST(FormatTest, get_memcpy_by_audio_format_fn_invalid)
+{
+    EXPECT_EQ(nullptr, get_memcpy_by_audio_format_fn(AUDIO_FORMAT_MP3, AUDIO_FORMAT_PCM_16_BIT));
+    EXPECT_EQ(nullptr, get_memcpy_by_audio_format_fn(AUDIO_FORMAT_PCM_16_BIT, AUDIO_FORMAT_AAC));
+    EXPECT_EQ(nullptr, get_memcpy_by_audio_format_fn(AUDIO_FORMAT_DEFAULT, AUDIO_FORMAT_DEFAULT));
+}
+
 class FormatTest1p : public testing::TestWithParam<audio_format_t>
 {
 };
@@ -168,6 +247,55 @@ TEST_P(FormatTest1p, accumulate_by_audio_format)
     EXPECT_EQ(0, memcmp(src, acc, SAMPLES * audio_bytes_per_sample(src_encoding)));
 }
 
+TEST_P(FormatTest1p, memcpy_by_index_array_and_format_with_unity_gain)
+{
+    const audio_format_t encoding = GetParam();
+    const size_t sample_size = audio_bytes_per_sample(encoding);
+
+    constexpr size_t FRAMES = 31;
+    constexpr uint32_t SRC_CHANNELS = 8;
+    constexpr size_t SAMPLES = FRAMES * SRC_CHANNELS;
+    // all the bits are set somewhere, which a conversion through float does not keep
+    // for the 32 bit formats.
+    uint32_t src[SAMPLES];
+    for (size_t i = 0; i < SAMPLES; ++i) {
+        src[i] = (0x01010101u * (i % 255)) ^ 0x5a3c96f0u;
+    }
+
+    int8_t idxary[SRC_CHANNELS + 1];
+    float unity_gains[SRC_CHANNELS + 1];
+    for (size_t i = 0; i < SRC_CHANNELS + 1; ++i) {
+        idxary[i] = i % 3 == 2 ? -1 : (SRC_CHANNELS - 1 - i % SRC_CHANNELS);
+        unity_gains[i] = 1.f;
+    }
+
+    for (const float *gains : {(const float *)nullptr, (const float *)unity_gains}) {
+        for (uint32_t dst_channels : {1, 2, 4, 9}) {
+            SCOPED_TRACE(testing::Message() << "gains " << (gains != nullptr)
+                    << " dst_channels " << dst_channels);
+            uint32_t dst[FRAMES * (SRC_CHANNELS + 1)];
+            memcpy_by_index_array_and_format_with_gain(
+                    dst, encoding, dst_channels,
+                    src, encoding, SRC_CHANNELS,
+                    idxary, gains, FRAMES);
+
+            for (size_t i = 0; i < FRAMES; ++i) {
+                for (size_t c = 0; c < dst_channels; ++c) {
+                    uint32_t expected = 0;
+                    if (idxary[c] >= 0) {
+                        memcpy(&expected,
+                                (uint8_t *)src + (i * SRC_CHANNELS + idxary[c]) * sample_size,
+                                sample_size);
+                    }
+                    ASSERT_EQ(0, memcmp(&expected,
+                            (uint8_t *)dst + (i * dst_channels + c) * sample_size,
+                            sample_size)) << "frame " << i << " channel " << c;
+                }
+            }
+        }
+    }
+}
+
 INSTANTIATE_TEST_CASE_P(FormatVariation, FormatTest1p, ::testing::Values(
         AUDIO_FORMAT_PCM_8_BIT,
         AUDIO_FORMAT_PCM_16_BIT,
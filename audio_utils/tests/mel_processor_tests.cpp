@@ -18,12 +18,16 @@
 #define LOG_TAG "audio_utils_mel_processor_tests"
 
 #include <audio_utils/MelProcessor.h>
+#include <audio_utils/format.h>
 
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
 
 #include <chrono>
 #include <cmath>
+#include <condition_variable>
+#include <future>
+#include <mutex>
 #include <tuple>
 #include <unordered_map>
 #include <log/log.h>
@@ -48,6 +52,12 @@ const std::unordered_map<int32_t, float> kAWeightFResponse =
     {{80, -22.5}, {100, -19.1}, {500, -3.2}, {1000, 0}, {2000, 1.2}, {4000, 1.0},
      {8000, -1.1}, {12000, -4.3}};
 
+// MEL difference in dB allowed between the conversions of the same signal to the
+// supported formats, or between different processing block sizes.
+constexpr float kFormatAccuracy = 0.01f;
+// Coarse quantization of a periodic signal adds a slight gain error.
+constexpr float kLowResolutionFormatAccuracy = 0.05f;
+
 // MEL values have a range between  0 .. 110dB(A). When comparing to the estimated
 // attenuation of 1kHz this will result to approx. kFilterAccuracy/2 percent accuracy
 constexpr float kFilterAccuracy = 2.f;
@@ -193,6 +203,292 @@ TEST_P(MelProcessorFixtureTest, AttenuationCheck) {
     }
 }
 
+TEST(MelProcessorTest, EngineProcessorsRegistration) {
+    auto engine = sp<MelEngine>::make();
+    sp<MelCallbackMock> callback = sp<MelCallbackMock>::make();
+    EXPECT_EQ(engine->getThreadCount(), MelEngine::kDefaultThreadCount);
+
+    auto processor1 = sp<MelProcessor>::make(48000, 1, AUDIO_FORMAT_PCM_FLOAT, callback, 1, 100,
+                                             engine);
+    auto processor2 = sp<MelProcessor>::make(48000, 2, AUDIO_FORMAT_PCM_16_BIT, callback, 2, 100,
+                                             engine);
+    EXPECT_EQ(engine->getProcessorCount(), size_t{2});
+
+    processor1.clear();
+    EXPECT_EQ(engine->getProcessorCount(), size_t{1});
+    processor2.clear();
+    EXPECT_EQ(engine->getProcessorCount(), size_t{0});
+}
+
+TEST(MelProcessorTest, EngineQueueFull) {
+    constexpr int32_t kSampleRate = 48000;
+    auto engine = sp<MelEngine>::make(1);
+    sp<MelCallbackMock> callback = sp<MelCallbackMock>::make();
+    auto processor = sp<MelProcessor>::make(kSampleRate, 1, AUDIO_FORMAT_PCM_FLOAT, callback,
+                                            1, 100, engine);
+    std::vector<float> buffer(kSampleRate);  // silence, more than the queue holds
+
+    const int32_t queued = processor->process(buffer.data(), buffer.size() * sizeof(float));
+    EXPECT_GT(queued, 0);
+    EXPECT_LE(queued, static_cast<int32_t>(
+            kSampleRate * MelProcessor::kEngineQueueMs / 1000 * sizeof(float)));
+    processor->drainAndWait();
+}
+
+TEST(MelProcessorTest, EngineMatchesCallerThread) {
+    constexpr int32_t kSampleRate = 48000;
+    constexpr size_t kMaxMelsCallback = 2;
+    constexpr size_t kProcessors = 4;
+    // chunks which fit in the engine queue.
+    constexpr size_t kChunkFrames = kSampleRate / 10;
+    auto engine = sp<MelEngine>::make();
+    sp<MelCallbackMock> callback = sp<MelCallbackMock>::make();
+
+    std::vector<float> buffer;
+    appendSineWaveBuffer(buffer, 1000.0f, kSampleRate * kMaxMelsCallback, kSampleRate);
+
+    std::mutex lock;
+    std::unordered_map<audio_port_handle_t, std::vector<float>> mels;
+    EXPECT_CALL(*callback.get(), onMomentaryExposure(_, _)).Times(testing::AnyNumber());
+    EXPECT_CALL(*callback.get(), onNewMelValues(_, _, _, _, Eq(true)))
+        .Times(kProcessors + 1)
+        .WillRepeatedly([&] (const std::vector<float>& mel, size_t offset, size_t length,
+                                audio_port_handle_t deviceId, bool /* attenuated */) {
+            std::lock_guard l(lock);
+            mels[deviceId].assign(mel.begin() + offset, mel.begin() + offset + length);
+        });
+
+    // reference computed on the caller thread, device id 0.
+    auto reference = sp<MelProcessor>::make(kSampleRate, 1, AUDIO_FORMAT_PCM_FLOAT, callback,
+                                            0, 100, kMaxMelsCallback);
+    EXPECT_GT(reference->process(buffer.data(), buffer.size() * sizeof(float)), 0);
+    reference->drainAndWait();
+
+    std::vector<sp<MelProcessor>> processors;
+    for (size_t i = 1; i <= kProcessors; ++i) {
+        processors.push_back(sp<MelProcessor>::make(kSampleRate, 1, AUDIO_FORMAT_PCM_FLOAT,
+                callback, i, 100, engine, kMaxMelsCallback));
+    }
+    for (size_t offset = 0; offset < buffer.size(); offset += kChunkFrames) {
+        for (const auto& processor : processors) {
+            EXPECT_EQ(processor->process(buffer.data() + offset, kChunkFrames * sizeof(float)),
+                      static_cast<int32_t>(kChunkFrames * sizeof(float)));
+            processor->drainAndWait();
+        }
+    }
+
+    std::lock_guard l(lock);
+    ASSERT_EQ(mels[0].size(), kMaxMelsCallback);
+    for (size_t i = 1; i <= kProcessors; ++i) {
+        ASSERT_EQ(mels[i].size(), kMaxMelsCallback);
+        for (size_t j = 0; j < kMaxMelsCallback; ++j) {
+            // the energy sums are rounded differently for other block sizes.
+            EXPECT_NEAR(mels[i][j], mels[0][j], kFormatAccuracy)
+                    << "device " << i << " mel " << j;
+        }
+    }
+}
+
+// The workers wait without a timeout, so the data must be processed on the wakeups
+// from process() alone, also when a worker finds the processor taken by another.
+TEST(MelProcessorTest, EngineProcessesWithoutDrain) {
+    constexpr int32_t kSampleRate = 48000;
+    constexpr size_t kProcessors = 4;
+    constexpr size_t kChunkFrames = kSampleRate / 100;
+    auto engine = sp<MelEngine>::make(4);
+    sp<MelCallbackMock> callback = sp<MelCallbackMock>::make();
+
+    std::vector<float> buffer;
+    appendSineWaveBuffer(buffer, 1000.0f, kSampleRate, kSampleRate);
+
+    std::mutex lock;
+    std::condition_variable cv;
+    size_t callbacks = 0;
+    EXPECT_CALL(*callback.get(), onMomentaryExposure(_, _)).Times(testing::AnyNumber());
+    EXPECT_CALL(*callback.get(), onNewMelValues(_, _, _, _, _))
+        .Times(kProcessors)
+        .WillRepeatedly([&] (const std::vector<float>&, size_t, size_t, audio_port_handle_t,
+                             bool) {
+            std::lock_guard l(lock);
+            ++callbacks;
+            cv.notify_one();
+        });
+
+    std::vector<sp<MelProcessor>> processors;
+    for (size_t i = 0; i < kProcessors; ++i) {
+        processors.push_back(sp<MelProcessor>::make(kSampleRate, 1, AUDIO_FORMAT_PCM_FLOAT,
+                callback, i, 100, engine, 1 /* maxMelsCallback */));
+    }
+    for (size_t offset = 0; offset < buffer.size(); offset += kChunkFrames) {
+        for (const auto& processor : processors) {
+            size_t written = 0;
+            while (written < kChunkFrames * sizeof(float)) {
+                const int32_t result = processor->process(
+                        reinterpret_cast<const uint8_t*>(buffer.data() + offset) + written,
+                        kChunkFrames * sizeof(float) - written);
+                ASSERT_GE(result, 0);
+                written += result;
+                if (result == 0) std::this_thread::yield();  // queue full
+            }
+        }
+    }
+
+    std::unique_lock l(lock);
+    EXPECT_TRUE(cv.wait_for(l, std::chrono::seconds(10), [&] {
+        return callbacks == kProcessors;
+    }));
+}
+
+TEST(MelProcessorTest, EngineUpdateAudioFormatWithQueuedData) {
+    constexpr int32_t kSampleRate = 48000;
+    constexpr size_t kMaxMelsCallback = 2;
+    constexpr size_t kChunkFrames = kSampleRate / 5;
+    auto engine = sp<MelEngine>::make(1);
+    sp<MelCallbackMock> callback = sp<MelCallbackMock>::make();
+    sp<MelCallbackMock> blockerCallback = sp<MelCallbackMock>::make();
+
+    std::vector<float> buffer;
+    appendSineWaveBuffer(buffer, 1000.0f, kSampleRate * kMaxMelsCallback, kSampleRate);
+    std::vector<int16_t> buffer16(buffer.size());
+    memcpy_by_audio_format(buffer16.data(), AUDIO_FORMAT_PCM_16_BIT, buffer.data(),
+                           AUDIO_FORMAT_PCM_FLOAT, buffer.size());
+
+    std::mutex lock;
+    std::unordered_map<audio_port_handle_t, std::vector<float>> mels;
+    EXPECT_CALL(*callback.get(), onMomentaryExposure(_, _)).Times(testing::AnyNumber());
+    EXPECT_CALL(*callback.get(), onNewMelValues(_, _, _, _, Eq(true)))
+        .Times(2)
+        .WillRepeatedly([&] (const std::vector<float>& mel, size_t offset, size_t length,
+                                audio_port_handle_t deviceId, bool /* attenuated */) {
+            std::lock_guard l(lock);
+            mels[deviceId].assign(mel.begin() + offset, mel.begin() + offset + length);
+        });
+
+    // reference computed on the caller thread in float, device id 0.
+    auto reference = sp<MelProcessor>::make(kSampleRate, 1, AUDIO_FORMAT_PCM_FLOAT, callback,
+                                            0, 100, kMaxMelsCallback);
+    EXPECT_GT(reference->process(buffer.data(), buffer.size() * sizeof(float)), 0);
+    reference->drainAndWait();
+
+    // keeps the single engine thread busy in a callback, so that the first chunk is
+    // still queued when the format changes.
+    std::promise<void> blocked, unblock;
+    EXPECT_CALL(*blockerCallback.get(), onMomentaryExposure(_, _)).Times(testing::AnyNumber());
+    EXPECT_CALL(*blockerCallback.get(), onNewMelValues(_, _, _, _, _))
+        .WillOnce([&] (const std::vector<float>&, size_t, size_t, audio_port_handle_t, bool) {
+            blocked.set_value();
+            unblock.get_future().wait();
+        })
+        .WillRepeatedly(testing::Return());
+    auto blocker = sp<MelProcessor>::make(kSampleRate, 1, AUDIO_FORMAT_PCM_FLOAT,
+                                          blockerCallback, 2, 100, engine, 1);
+    for (size_t offset = 0; offset < kSampleRate; offset += kChunkFrames) {
+        EXPECT_EQ(blocker->process(buffer.data() + offset, kChunkFrames * sizeof(float)),
+                  static_cast<int32_t>(kChunkFrames * sizeof(float)));
+        if (offset + kChunkFrames < kSampleRate) {
+            blocker->drainAndWait();
+        }
+    }
+    blocked.get_future().wait();
+
+    auto processor = sp<MelProcessor>::make(kSampleRate, 1, AUDIO_FORMAT_PCM_FLOAT, callback,
+                                            1, 100, engine, kMaxMelsCallback);
+    EXPECT_EQ(processor->process(buffer.data(), kChunkFrames * sizeof(float)),
+              static_cast<int32_t>(kChunkFrames * sizeof(float)));
+    processor->updateAudioFormat(kSampleRate, 1, AUDIO_FORMAT_PCM_16_BIT);
+    unblock.set_value();
+    for (size_t offset = kChunkFrames; offset < buffer16.size(); offset += kChunkFrames) {
+        EXPECT_EQ(processor->process(buffer16.data() + offset, kChunkFrames * sizeof(int16_t)),
+                  static_cast<int32_t>(kChunkFrames * sizeof(int16_t)));
+        processor->drainAndWait();
+    }
+
+    std::lock_guard l(lock);
+    ASSERT_EQ(mels[0].size(), kMaxMelsCallback);
+    ASSERT_EQ(mels[1].size(), kMaxMelsCallback);
+    for (size_t j = 0; j < kMaxMelsCallback; ++j) {
+        EXPECT_NEAR(mels[1][j], mels[0][j], kFormatAccuracy) << "mel " << j;
+    }
+}
+
+// Returns the MEL values of a stereo 1 kHz sine of the given amplitude on the left channel
+// and half of it on the right channel, converted to format. The MEL values are raised by
+// the amplitude level, so that they stay above RS1.
+std::vector<float> computeMels(audio_format_t format, float amplitude) {
+    constexpr int32_t kSampleRate = 48000;
+    constexpr size_t kChannelCount = 2;
+    constexpr size_t kMaxMelsCallback = 2;
+    sp<MelCallbackMock> callback = sp<MelCallbackMock>::make();
+    std::vector<float> mels;
+    EXPECT_CALL(*callback.get(), onMomentaryExposure(_, _)).Times(testing::AnyNumber());
+    EXPECT_CALL(*callback.get(), onNewMelValues(_, _, _, _, Eq(true)))
+        .Times(1)
+        .WillRepeatedly([&] (const std::vector<float>& mel, size_t offset, size_t length,
+                                audio_port_handle_t /* deviceId */, bool /* attenuated */) {
+            mels.assign(mel.begin() + offset, mel.begin() + offset + length);
+        });
+
+    std::vector<float> left, right;
+    appendSineWaveBuffer(left, 1000.0f, kSampleRate * kMaxMelsCallback, kSampleRate,
+                         amplitude);
+    appendSineWaveBuffer(right, 1000.0f, kSampleRate * kMaxMelsCallback, kSampleRate,
+                         amplitude / 2);
+    std::vector<float> interleaved;
+    for (size_t i = 0; i < left.size(); ++i) {
+        interleaved.push_back(left[i]);
+        interleaved.push_back(right[i]);
+    }
+    const size_t sampleSize = audio_bytes_per_sample(format);
+    std::vector<uint8_t> buffer(interleaved.size() * sampleSize);
+    memcpy_by_audio_format(buffer.data(), format, interleaved.data(), AUDIO_FORMAT_PCM_FLOAT,
+                           interleaved.size());
+
+    auto processor = sp<MelProcessor>::make(kSampleRate, kChannelCount, format, callback, 1,
+                                            100, kMaxMelsCallback);
+    processor->setAttenuation(20.f * log10f(amplitude));
+    EXPECT_EQ(processor->process(buffer.data(), buffer.size()),
+              static_cast<int32_t>(buffer.size()));
+    processor->drainAndWait();
+    return mels;
+}
+
+// Contains the sample format and the sine amplitude
+using FormatParam = std::tuple<audio_format_t, float>;
+
+class MelProcessorFormatTest : public TestWithParam<FormatParam> {};
+
+TEST_P(MelProcessorFormatTest, MatchesFloat) {
+    const audio_format_t format = std::get<0>(GetParam());
+    const float amplitude = std::get<1>(GetParam());
+    const size_t bits = format == AUDIO_FORMAT_PCM_8_24_BIT || format == AUDIO_FORMAT_PCM_FLOAT
+            ? 24 : audio_bytes_per_sample(format) * 8;
+    // the number of quantization steps of the left channel amplitude.
+    const float steps = ldexpf(amplitude, bits - 1);
+    if (steps < 64) {
+        GTEST_SKIP() << audio_format_to_string(format) << " cannot represent amplitude "
+                     << amplitude;
+    }
+    const std::vector<float> expected = computeMels(AUDIO_FORMAT_PCM_FLOAT, amplitude);
+    const std::vector<float> mels = computeMels(format, amplitude);
+    const float accuracy = steps < 4096 ? kLowResolutionFormatAccuracy : kFormatAccuracy;
+    ASSERT_EQ(mels.size(), expected.size());
+    for (size_t i = 0; i < mels.size(); ++i) {
+        EXPECT_NEAR(mels[i], expected[i], accuracy)
+                << audio_format_to_string(format) << " amplitude " << amplitude
+                << " mel " << i;
+    }
+}
+
+// The low amplitude is only represented by the 2 least significant bytes of 24 bit or more
+// formats.
+INSTANTIATE_TEST_SUITE_P(MelProcessorFormats,
+    MelProcessorFormatTest,
+    Combine(Values(AUDIO_FORMAT_PCM_8_BIT, AUDIO_FORMAT_PCM_16_BIT,
+                   AUDIO_FORMAT_PCM_24_BIT_PACKED, AUDIO_FORMAT_PCM_8_24_BIT,
+                   AUDIO_FORMAT_PCM_32_BIT, AUDIO_FORMAT_PCM_FLOAT),
+            Values(0.5f, 1.f / (1 << 14)))
+);
+
 // A-weight filter loses precision around Nyquist frequency
 // Splitting into multiple suites that are capable to have an accurate
 // estimation for a-weight frequency response.
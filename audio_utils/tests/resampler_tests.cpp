@@ -0,0 +1,376 @@
+/*
+ * Copyright 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "audio_utils_resampler_tests"
+
+#include <math.h>
+
+#include <algorithm>
+#include <vector>
+
+#include <audio_utils/primitives.h>
+#include <audio_utils/resampler.h>
+#include <gtest/gtest.h>
+#include <log/log.h>
+
+namespace {
+
+constexpr float kFrequency = 997.f;
+constexpr float kAmplitude = 0.5f;
+
+std::vector<float> makeSine(uint32_t sampleRate, size_t frames, size_t channelCount) {
+    std::vector<float> buffer(frames * channelCount);
+    for (size_t i = 0; i < frames; ++i) {
+        const float value = kAmplitude * sinf(2.f * M_PI * kFrequency * i / sampleRate);
+        for (size_t c = 0; c < channelCount; ++c) {
+            buffer[i * channelCount + c] = value;
+        }
+    }
+    return buffer;
+}
+
+// The first output frame is centered on the first input frame, so the output
+// should match the sine evaluated at the output sample rate once the filter is primed.
+float maxSineError(const std::vector<float>& out, size_t frames, uint32_t sampleRate,
+        size_t channelCount, size_t skipFrames) {
+    float maxError = 0.f;
+    for (size_t i = skipFrames; i < frames; ++i) {
+        const float expected = kAmplitude * sinf(2.f * M_PI * kFrequency * i / sampleRate);
+        for (size_t c = 0; c < channelCount; ++c) {
+            maxError = std::max(maxError, fabsf(out[i * channelCount + c] - expected));
+        }
+    }
+    return maxError;
+}
+
+struct VectorProvider {
+    struct resampler_buffer_provider provider;  // must be first
+    const void *data;
+    size_t frames;
+    size_t frameSize;
+    size_t offset;
+    size_t maxFramesPerBuffer;
+};
+
+int vectorGetNextBuffer(struct resampler_buffer_provider *provider,
+        struct resampler_buffer *buffer) {
+    VectorProvider *vp = reinterpret_cast<VectorProvider *>(provider);
+    const size_t frames = std::min({buffer->frame_count, vp->frames - vp->offset,
+            vp->maxFramesPerBuffer});
+    if (frames == 0) {
+        buffer->raw = nullptr;
+        buffer->frame_count = 0;
+        return -ENODATA;
+    }
+    buffer->raw = (uint8_t *)vp->data + vp->offset * vp->frameSize;
+    buffer->frame_count = frames;
+    return 0;
+}
+
+void vectorReleaseBuffer(struct resampler_buffer_provider *provider,
+        struct resampler_buffer *buffer) {
+    VectorProvider *vp = reinterpret_cast<VectorProvider *>(provider);
+    vp->offset += buffer->frame_count;
+}
+
+} // namespace
+
+TEST(audio_utils_resampler, polyphase_invalid_arguments) {
+    struct resampler_itfe *resampler = nullptr;
+    EXPECT_EQ(-EINVAL, create_polyphase_resampler(48000, 44100, 2, RESAMPLER_QUALITY_MAX,
+            AUDIO_FORMAT_PCM_FLOAT, nullptr, &resampler));
+    EXPECT_EQ(-EINVAL, create_polyphase_resampler(48000, 44100, 0, RESAMPLER_QUALITY_DEFAULT,
+            AUDIO_FORMAT_PCM_FLOAT, nullptr, &resampler));
+    EXPECT_EQ(-EINVAL, create_polyphase_resampler(48000, 0, 2, RESAMPLER_QUALITY_DEFAULT,
+            AUDIO_FORMAT_PCM_FLOAT, nullptr, &resampler));
+    EXPECT_EQ(nullptr, resampler);
+    EXPECT_EQ(-EINVAL, create_polyphase_resampler(48000, 44100, 2, RESAMPLER_QUALITY_DEFAULT,
+            AUDIO_FORMAT_PCM_FLOAT, nullptr, nullptr));
+}
+
+class PolyphaseResamplerTest
+        : public ::testing::TestWithParam<std::tuple<uint32_t, uint32_t, uint32_t>> {
+};
+
+// Resamples a sine through resample_from_input_float() in small uneven chunks.
+TEST_P(PolyphaseResamplerTest, sine_float) {
+    const auto [inRate, outRate, channelCount] = GetParam();
+    struct resampler_itfe *resampler = nullptr;
+    ASSERT_EQ(0, create_polyphase_resampler(inRate, outRate, channelCount,
+            RESAMPLER_QUALITY_DEFAULT, AUDIO_FORMAT_PCM_FLOAT, nullptr, &resampler));
+    ASSERT_NE(nullptr, resampler->resample_from_input_float);
+
+    constexpr size_t kInFrames = 8192;
+    const std::vector<float> in = makeSine(inRate, kInFrames, channelCount);
+    const size_t outCapacity = kInFrames * outRate / inRate + 1;
+    std::vector<float> out(outCapacity * channelCount);
+
+    size_t framesRd = 0;
+    size_t framesWr = 0;
+    size_t chunk = 1;
+    while (framesRd < kInFrames) {
+        size_t inFrames = std::min(chunk, kInFrames - framesRd);
+        size_t outFrames = outCapacity - framesWr;
+        ASSERT_EQ(0, resampler->resample_from_input_float(resampler,
+                &in[framesRd * channelCount], &inFrames, &out[framesWr * channelCount],
+                &outFrames));
+        framesRd += inFrames;
+        framesWr += outFrames;
+        chunk = chunk * 3 % 1021 + 1;
+    }
+    // all but the filter lookahead is output.
+    EXPECT_LE(outCapacity - 64 * outRate / inRate, framesWr);
+    EXPECT_GT(resampler->delay_ns(resampler), 0);
+
+    // the first few frames contain the filter startup transient.
+    EXPECT_GT(1e-3f, maxSineError(out, framesWr, outRate, channelCount, 64));
+    release_resampler(resampler);
+}
+
+INSTANTIATE_TEST_SUITE_P(PolyphaseResamplerAll, PolyphaseResamplerTest,
+        ::testing::Values(
+                std::make_tuple(44100, 48000, 1),
+                std::make_tuple(44100, 48000, 2),
+                std::make_tuple(48000, 44100, 2),
+                std::make_tuple(16000, 48000, 1),
+                std::make_tuple(48000, 16000, 2),
+                std::make_tuple(48000, 32000, 6),
+                std::make_tuple(44100, 47999, 1),  // interpolated phases
+                std::make_tuple(47999, 44100, 2)));
+
+// The provider path and the input path produce identical output,
+// and the int16_t, int32_t and float entry points agree.
+TEST(audio_utils_resampler, polyphase_provider_matches_input) {
+    constexpr uint32_t kInRate = 44100;
+    constexpr uint32_t kOutRate = 48000;
+    constexpr size_t kChannelCount = 2;
+    constexpr size_t kInFrames = 4096;
+    constexpr size_t kOutFrames = 3000;  // larger than the internal input block
+
+    const std::vector<float> sine = makeSine(kInRate, kInFrames, kChannelCount);
+    std::vector<int16_t> in16(sine.size());
+    memcpy_to_i16_from_float(in16.data(), sine.data(), sine.size());
+
+    VectorProvider vp{};
+    vp.provider.get_next_buffer = vectorGetNextBuffer;
+    vp.provider.release_buffer = vectorReleaseBuffer;
+    vp.data = in16.data();
+    vp.frames = kInFrames;
+    vp.frameSize = kChannelCount * sizeof(int16_t);
+    vp.maxFramesPerBuffer = 93;
+
+    struct resampler_itfe *fromProvider = nullptr;
+    ASSERT_EQ(0, create_polyphase_resampler(kInRate, kOutRate, kChannelCount,
+            RESAMPLER_QUALITY_DEFAULT, AUDIO_FORMAT_PCM_16_BIT, &vp.provider, &fromProvider));
+    struct resampler_itfe *fromInput = nullptr;
+    ASSERT_EQ(0, create_polyphase_resampler(kInRate, kOutRate, kChannelCount,
+            RESAMPLER_QUALITY_DEFAULT, AUDIO_FORMAT_DEFAULT, nullptr, &fromInput));
+
+    // the provider path is not allowed from input and vice versa.
+    size_t inFrames = kInFrames;
+    size_t outFrames = kOutFrames;
+    std::vector<float> outProvider(kOutFrames * kChannelCount);
+    std::vector<float> outInput(kOutFrames * kChannelCount);
+    EXPECT_EQ(-ENOSYS, fromProvider->resample_from_input_float(fromProvider,
+            sine.data(), &inFrames, outInput.data(), &outFrames));
+    EXPECT_EQ(-ENOSYS, fromInput->resample_from_provider_float(fromInput,
+            outProvider.data(), &outFrames));
+
+    outFrames = kOutFrames;
+    ASSERT_EQ(0, fromProvider->resample_from_provider_float(
+            fromProvider, outProvider.data(), &outFrames));
+    EXPECT_EQ(kOutFrames, outFrames);
+
+    std::vector<float> in16AsFloat(in16.size());
+    memcpy_to_float_from_i16(in16AsFloat.data(), in16.data(), in16.size());
+    inFrames = kInFrames;
+    outFrames = kOutFrames;
+    ASSERT_EQ(0, fromInput->resample_from_input_float(fromInput,
+            in16AsFloat.data(), &inFrames, outInput.data(), &outFrames));
+    EXPECT_EQ(kOutFrames, outFrames);
+    EXPECT_EQ(outProvider, outInput);
+
+    // int16_t and int32_t entry points after a reset.
+    fromInput->reset(fromInput);
+    std::vector<int16_t> out16(kOutFrames * kChannelCount);
+    inFrames = kInFrames;
+    outFrames = kOutFrames;
+    ASSERT_EQ(0, fromInput->resample_from_input(fromInput,
+            in16.data(), &inFrames, out16.data(), &outFrames));
+    EXPECT_EQ(kOutFrames, outFrames);
+
+    fromInput->reset(fromInput);
+    std::vector<int32_t> in32(sine.size());
+    memcpy_to_i32_from_i16(in32.data(), in16.data(), in16.size());
+    std::vector<int32_t> out32(kOutFrames * kChannelCount);
+    inFrames = kInFrames;
+    outFrames = kOutFrames;
+    ASSERT_EQ(0, fromInput->resample_from_input_i32(fromInput,
+            in32.data(), &inFrames, out32.data(), &outFrames));
+    EXPECT_EQ(kOutFrames, outFrames);
+
+    for (size_t i = 0; i < kOutFrames * kChannelCount; ++i) {
+        EXPECT_EQ(clamp16_from_float(outInput[i]), out16[i]);
+        EXPECT_NEAR(outInput[i], float_from_i32(out32[i]), 1e-6f);
+    }
+
+    release_resampler(fromProvider);
+    release_resampler(fromInput);
+}
+
+// A float provider is resampled in place, with the same output as the copying int16_t provider.
+TEST(audio_utils_resampler, polyphase_provider_in_place) {
+    constexpr uint32_t kInRate = 48000;
+    constexpr uint32_t kOutRate = 44100;
+    constexpr size_t kChannelCount = 2;
+    constexpr size_t kInFrames = 48000;
+    constexpr size_t kOutFrames = 40000;
+
+    const std::vector<float> sine = makeSine(kInRate, kInFrames, kChannelCount);
+    std::vector<int16_t> in16(sine.size());
+    memcpy_to_i16_from_float(in16.data(), sine.data(), sine.size());
+    std::vector<float> in16AsFloat(in16.size());
+    memcpy_to_float_from_i16(in16AsFloat.data(), in16.data(), in16.size());
+
+    VectorProvider vp16{};
+    vp16.provider.get_next_buffer = vectorGetNextBuffer;
+    vp16.provider.release_buffer = vectorReleaseBuffer;
+    vp16.data = in16.data();
+    vp16.frames = kInFrames;
+    vp16.frameSize = kChannelCount * sizeof(int16_t);
+    vp16.maxFramesPerBuffer = SIZE_MAX;
+    VectorProvider vpFloat = vp16;
+    vpFloat.data = in16AsFloat.data();
+    vpFloat.frameSize = kChannelCount * sizeof(float);
+
+    struct resampler_itfe *copying = nullptr;
+    ASSERT_EQ(0, create_polyphase_resampler(kInRate, kOutRate, kChannelCount,
+            RESAMPLER_QUALITY_DEFAULT, AUDIO_FORMAT_PCM_16_BIT, &vp16.provider, &copying));
+    struct resampler_itfe *inPlace = nullptr;
+    ASSERT_EQ(0, create_polyphase_resampler(kInRate, kOutRate, kChannelCount,
+            RESAMPLER_QUALITY_DEFAULT, AUDIO_FORMAT_PCM_FLOAT, &vpFloat.provider, &inPlace));
+
+    // request uneven output sizes so that provider buffers are partially released.
+    std::vector<float> outCopying(kOutFrames * kChannelCount);
+    std::vector<float> outInPlace(kOutFrames * kChannelCount);
+    size_t framesWr = 0;
+    size_t chunk = 1;
+    while (framesWr < kOutFrames) {
+        const size_t frames = std::min(chunk, kOutFrames - framesWr);
+        size_t copyingFrames = frames;
+        ASSERT_EQ(0, copying->resample_from_provider_float(copying,
+                &outCopying[framesWr * kChannelCount], &copyingFrames));
+        size_t inPlaceFrames = frames;
+        ASSERT_EQ(0, inPlace->resample_from_provider_float(inPlace,
+                &outInPlace[framesWr * kChannelCount], &inPlaceFrames));
+        ASSERT_EQ(frames, copyingFrames);
+        ASSERT_EQ(frames, inPlaceFrames);
+        framesWr += frames;
+        chunk = chunk * 7 % 4093 + 1;
+    }
+    EXPECT_EQ(outCopying, outInPlace);
+
+    // only the filter windows spanning two provider buffers are copied.
+    EXPECT_GT(polyphase_resampler_get_input_bytes_copied(copying),
+            polyphase_resampler_get_input_bytes_copied(inPlace) * 4);
+
+    release_resampler(copying);
+    release_resampler(inPlace);
+}
+
+// The speex resampler reading provider buffers in place produces the same output as the
+// copying provider path, with short provider buffers partially released.
+TEST(audio_utils_resampler, speex_provider_in_place) {
+    constexpr uint32_t kInRate = 48000;
+    constexpr uint32_t kOutRate = 44100;
+    constexpr size_t kChannelCount = 2;
+    constexpr size_t kInFrames = 48000;
+    constexpr size_t kOutFrames = 40000;
+
+    const std::vector<float> sine = makeSine(kInRate, kInFrames, kChannelCount);
+    std::vector<int16_t> in16(sine.size());
+    memcpy_to_i16_from_float(in16.data(), sine.data(), sine.size());
+
+    VectorProvider vpCopying{};
+    vpCopying.provider.get_next_buffer = vectorGetNextBuffer;
+    vpCopying.provider.release_buffer = vectorReleaseBuffer;
+    vpCopying.data = in16.data();
+    vpCopying.frames = kInFrames;
+    vpCopying.frameSize = kChannelCount * sizeof(int16_t);
+    vpCopying.maxFramesPerBuffer = 93;
+    VectorProvider vpInPlace = vpCopying;
+
+    struct resampler_itfe *copying = nullptr;
+    ASSERT_EQ(0, create_resampler(kInRate, kOutRate, kChannelCount,
+            RESAMPLER_QUALITY_DEFAULT, &vpCopying.provider, &copying));
+    struct resampler_itfe *inPlace = nullptr;
+    ASSERT_EQ(0, create_resampler_in_place(kInRate, kOutRate, kChannelCount,
+            RESAMPLER_QUALITY_DEFAULT, &vpInPlace.provider, &inPlace));
+
+    // request uneven output sizes so that provider buffers are partially released.
+    std::vector<int16_t> outCopying(kOutFrames * kChannelCount);
+    std::vector<int16_t> outInPlace(kOutFrames * kChannelCount);
+    size_t framesWr = 0;
+    size_t chunk = 1;
+    while (framesWr < kOutFrames) {
+        const size_t frames = std::min(chunk, kOutFrames - framesWr);
+        size_t copyingFrames = frames;
+        ASSERT_EQ(0, copying->resample_from_provider(copying,
+                &outCopying[framesWr * kChannelCount], &copyingFrames));
+        size_t inPlaceFrames = frames;
+        ASSERT_EQ(0, inPlace->resample_from_provider(inPlace,
+                &outInPlace[framesWr * kChannelCount], &inPlaceFrames));
+        ASSERT_EQ(frames, copyingFrames);
+        ASSERT_EQ(frames, inPlaceFrames);
+        framesWr += frames;
+        chunk = chunk * 7 % 4093 + 1;
+    }
+    EXPECT_EQ(outCopying, outInPlace);
+    // the copying path holds the frames it read ahead, the in place path leaves them with
+    // the provider.
+    EXPECT_LE(vpInPlace.offset, vpCopying.offset);
+
+    release_resampler(copying);
+    release_resampler(inPlace);
+}
+
+// A provider returning empty buffers ends the in place resampling instead of being polled
+// forever.
+TEST(audio_utils_resampler, speex_provider_in_place_empty_buffer) {
+    constexpr size_t kChannelCount = 2;
+    int16_t data[kChannelCount] = {};
+    VectorProvider vp{};
+    vp.provider.get_next_buffer = [](struct resampler_buffer_provider *provider,
+            struct resampler_buffer *buffer) {
+        buffer->raw = (void *)reinterpret_cast<VectorProvider *>(provider)->data;
+        buffer->frame_count = 0;
+        return 0;
+    };
+    vp.provider.release_buffer = vectorReleaseBuffer;
+    vp.data = data;
+    vp.frameSize = kChannelCount * sizeof(int16_t);
+
+    struct resampler_itfe *resampler = nullptr;
+    ASSERT_EQ(0, create_resampler_in_place(48000, 44100, kChannelCount,
+            RESAMPLER_QUALITY_DEFAULT, &vp.provider, &resampler));
+    std::vector<int16_t> out(480 * kChannelCount);
+    size_t outFrames = 480;
+    ASSERT_EQ(0, resampler->resample_from_provider(resampler, out.data(), &outFrames));
+    EXPECT_EQ(0u, outFrames);
+    EXPECT_EQ(0u, vp.offset);
+    release_resampler(resampler);
+}
@@ -0,0 +1,157 @@
+/*
+ * Copyright 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "audio_utils_stft_processor_tests"
+
+#include <math.h>
+
+#include <algorithm>
+#include <vector>
+
+#include <audio_utils/StftProcessor.h>
+#include <audio_utils/format.h>
+#include <gtest/gtest.h>
+#include <log/log.h>
+
+using namespace android::audio_utils;
+
+namespace {
+
+constexpr size_t kFftSize = 512;
+constexpr size_t kBin = 32;
+
+// A full scale stereo sine centered on bin kBin.
+std::vector<float> makeStereoSine(size_t frames) {
+    std::vector<float> buffer(frames * 2);
+    for (size_t i = 0; i < frames; ++i) {
+        buffer[i * 2] = buffer[i * 2 + 1] =
+                sin(2. * M_PI * ((kBin * i) % kFftSize) / kFftSize);
+    }
+    return buffer;
+}
+
+struct Collector {
+    std::vector<std::vector<float>> spectra;
+    std::vector<int64_t> positions;
+
+    StftProcessor::Callback callback() {
+        return [this](const float *bins, size_t binCount, int64_t position) {
+            spectra.emplace_back(bins, bins + binCount);
+            positions.push_back(position);
+        };
+    }
+};
+
+} // namespace
+
+TEST(stft_processor, sine_magnitude) {
+    Collector collector;
+    StftProcessor stft(AUDIO_FORMAT_PCM_FLOAT, 2, kFftSize, kFftSize / 4,
+            StftProcessor::Window::HANN, StftProcessor::Spectrum::MAGNITUDE,
+            collector.callback());
+    ASSERT_EQ(kFftSize / 2 + 1, stft.getBinCount());
+
+    const std::vector<float> in = makeStereoSine(kFftSize * 4);
+    stft.push(in.data(), kFftSize * 4);
+
+    // the first window completes after kFftSize frames, then one every hop.
+    ASSERT_EQ(13u, collector.spectra.size());
+    for (size_t i = 0; i < collector.spectra.size(); ++i) {
+        EXPECT_EQ((int64_t)(i * kFftSize / 4), collector.positions[i]);
+        const std::vector<float>& spectrum = collector.spectra[i];
+        ASSERT_EQ(kFftSize / 2 + 1, spectrum.size());
+        EXPECT_NEAR(0.5f, spectrum[kBin], 1e-4f);
+        // the Hann window main lobe spreads over the neighboring bins only.
+        for (size_t k = 0; k < spectrum.size(); ++k) {
+            if (k + 1 < kBin || k > kBin + 1) {
+                ASSERT_NEAR(0.f, spectrum[k], 1e-4f) << "bin " << k;
+            }
+        }
+    }
+}
+
+TEST(stft_processor, push_size_and_format_independent) {
+    const std::vector<float> in = makeStereoSine(kFftSize * 3);
+    std::vector<int16_t> in16(in.size());
+    memcpy_by_audio_format(in16.data(), AUDIO_FORMAT_PCM_16_BIT,
+            in.data(), AUDIO_FORMAT_PCM_FLOAT, in.size());
+
+    Collector reference;
+    StftProcessor stft(AUDIO_FORMAT_PCM_FLOAT, 2, kFftSize, 100,
+            StftProcessor::Window::BLACKMAN, StftProcessor::Spectrum::POWER,
+            reference.callback());
+    stft.push(in.data(), kFftSize * 3);
+
+    Collector collector;
+    StftProcessor stft16(AUDIO_FORMAT_PCM_16_BIT, 2, kFftSize, 100,
+            StftProcessor::Window::BLACKMAN, StftProcessor::Spectrum::POWER,
+            collector.callback());
+    // odd push sizes, which do not align with the conversion block or the hop.
+    for (size_t offset = 0, count = 1; offset < kFftSize * 3; count = count * 3 + 1) {
+        const size_t frames = std::min(count, kFftSize * 3 - offset);
+        stft16.push(&in16[offset * 2], frames);
+        offset += frames;
+    }
+
+    // PCM 16 quantization limits the match to about 1e-4.
+    ASSERT_EQ(reference.positions, collector.positions);
+    for (size_t i = 0; i < reference.spectra.size(); ++i) {
+        for (size_t k = 0; k < reference.spectra[i].size(); ++k) {
+            ASSERT_NEAR(reference.spectra[i][k], collector.spectra[i][k], 1e-4f);
+        }
+    }
+}
+
+TEST(stft_processor, reset) {
+    Collector collector;
+    StftProcessor stft(AUDIO_FORMAT_PCM_FLOAT, 1, 64, 64,
+            StftProcessor::Window::RECTANGULAR, StftProcessor::Spectrum::MAGNITUDE,
+            collector.callback());
+    std::vector<float> in(100, 1.f);
+    stft.push(in.data(), in.size());
+    ASSERT_EQ(1u, collector.spectra.size());
+    EXPECT_NEAR(1.f, collector.spectra[0][0], 1e-6f);
+
+    stft.reset();
+    std::fill(in.begin(), in.end(), 0.25f);
+    stft.push(in.data(), in.size());
+    ASSERT_EQ(2u, collector.spectra.size());
+    EXPECT_EQ(0, collector.positions[1]);
+    EXPECT_NEAR(0.25f, collector.spectra[1][0], 1e-6f);
+}
+
+TEST(stft_processor, invalid_arguments) {
+    // the arguments are checked before anything is computed or allocated from them.
+    Collector collector;
+    const auto make = [&](audio_format_t format, uint32_t channelCount, size_t fftSize,
+            size_t hop, StftProcessor::Callback callback) {
+        StftProcessor{format, channelCount, fftSize, hop, StftProcessor::Window::HANN,
+                StftProcessor::Spectrum::MAGNITUDE, std::move(callback)};
+    };
+    EXPECT_DEATH(make(AUDIO_FORMAT_MP3, 1, kFftSize, kFftSize, collector.callback()),
+            ".*invalid format.*");
+    EXPECT_DEATH(make(AUDIO_FORMAT_PCM_FLOAT, 0, kFftSize, kFftSize, collector.callback()),
+            ".*invalid channelCount.*");
+    EXPECT_DEATH(make(AUDIO_FORMAT_PCM_FLOAT, UINT32_MAX, kFftSize, kFftSize,
+            collector.callback()), ".*invalid channelCount.*");
+    EXPECT_DEATH(make(AUDIO_FORMAT_PCM_FLOAT, 1, SIZE_MAX / 2 + 1, 1, collector.callback()),
+            ".*invalid fftSize.*");
+    EXPECT_DEATH(make(AUDIO_FORMAT_PCM_FLOAT, 1, kFftSize, kFftSize + 1, collector.callback()),
+            ".*invalid hop.*");
+    EXPECT_DEATH(make(AUDIO_FORMAT_PCM_FLOAT, 1, kFftSize, kFftSize, nullptr),
+            ".*null callback.*");
+}
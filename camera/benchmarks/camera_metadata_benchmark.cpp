@@ -0,0 +1,729 @@
+/*
+ * Copyright 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <system/camera_metadata.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+#include <camera_metadata_hidden.h>
+#include <system/camera_vendor_tags.h>
+#include <unistd.h>
+
+/*
+BM_FindSingle measures N find_camera_metadata_ro_entry() calls.
+BM_FindBatch measures one find_camera_metadata_entries() call for the same N tags.
+
+The metadata holds one entry for every tag of the android sections, about as many
+as static characteristics. The argument is the number of queried tags N, half of
+which are missing. The _Sorted variants run on sorted metadata, and the _Ordered
+variants query the tags in increasing order.
+
+BM_UpdateSingle measures N update_camera_metadata_entry() calls changing the data size.
+BM_UpdateBatch measures one update_camera_metadata_entries() call for the same N updates.
+The argument is the number of updates N.
+
+BM_BuildRealloc measures building metadata of N entries from small capacities, by
+allocating a buffer twice larger and appending into it whenever an add fails.
+BM_BuildBuilder measures building the same metadata with a reused builder, finished
+into a caller buffer. The argument is the number of entries N. Both are dominated by
+the adds: the builder saves the reallocations, but copies the finished metadata once,
+which costs as much as the reallocations from about 256 entries.
+
+BM_CloneMalloc measures clone_camera_metadata() and free_camera_metadata() of request
+sized metadata. BM_ClonePool measures the same with a shared camera_metadata_pool_t.
+Both run on 1 to 8 threads.
+
+BM_Diff measures diff_camera_metadata() between sorted metadata holding every android
+tag and a copy with N changed entries, and BM_ApplyDelta measures rebuilding the copy
+with apply_camera_metadata_delta(). The argument is the number of changed entries N.
+
+BM_ValidateFull measures validate_camera_metadata_structure() of metadata holding every
+android tag. BM_ValidateFast measures validate_camera_metadata_structure_fast() of the
+same metadata. Both check every entry against its tag type, so the fast validation only
+saves the per-entry branches, about 10% on host.
+
+BM_Sort measures copy_camera_metadata() and sort_camera_metadata() of unsorted metadata.
+BM_SortQsort measures the same copy and the previous qsort() of the entries by tag for
+comparison. The argument is the number of entries N, cycling through the android tags.
+
+BM_TagFromName measures get_camera_metadata_tag_from_name() of every android tag name.
+BM_TagFromNameLinear measures the same lookups by comparing the name with every tag
+name in turn, as done without a name hash. BM_VendorTagFromName measures
+get_camera_metadata_tag_from_name() of every vendor tag name.
+
+BM_VendorTagType measures get_camera_metadata_tag_type() of every vendor tag, and
+BM_VendorTagType_Ops measures the vendor tag ops get_tag_type() calls it replaces.
+The vendor tag ops hold 8 sections of 64 tags, found by binary search.
+
+BM_LoadMap measures map_camera_metadata_file() and unmap_camera_metadata_file() of a
+file written by write_camera_metadata_file() with metadata holding every android tag.
+BM_LoadCopy measures reading the same file and allocate_copy_camera_metadata_checked()
+for comparison. The argument is the size in bytes of the stream configurations.
+ */
+
+// returns all the known tags of the android sections, in random order.
+static std::vector<uint32_t> getAllTags() {
+    std::vector<uint32_t> tags;
+    for (unsigned int section = 0; section < ANDROID_SECTION_COUNT; ++section) {
+        for (uint32_t tag = camera_metadata_section_bounds[section][0];
+                tag < camera_metadata_section_bounds[section][1]; ++tag) {
+            if (get_camera_metadata_tag_type(tag) >= 0) {
+                tags.push_back(tag);
+            }
+        }
+    }
+    std::shuffle(tags.begin(), tags.end(), std::minstd_rand(42));
+    return tags;
+}
+
+// returns metadata with one single value entry for every tag, to be freed by the caller.
+static camera_metadata_t* getMetadata(const std::vector<uint32_t>& tags, bool sorted) {
+    camera_metadata_t* m = allocate_camera_metadata(tags.size(), tags.size() * sizeof(double));
+    const uint8_t value[sizeof(double)] = {};  // large enough for any type
+    for (uint32_t tag : tags) {
+        add_camera_metadata_entry(m, tag, value, 1);
+    }
+    if (sorted) {
+        sort_camera_metadata(m);
+    }
+    return m;
+}
+
+// returns count of the tags, with every other one missing from metadata.
+static std::vector<uint32_t> getQueries(
+        const std::vector<uint32_t>& tags, size_t count, bool ordered) {
+    std::vector<uint32_t> queries(count);
+    std::minstd_rand gen(count);
+    std::uniform_int_distribution<size_t> dis(0, tags.size() - 1);
+    for (size_t i = 0; i < count; ++i) {
+        queries[i] = (i & 1) ? tags[dis(gen)] : VENDOR_SECTION_START + i;
+    }
+    if (ordered) {
+        std::sort(queries.begin(), queries.end());
+    }
+    return queries;
+}
+
+static void BenchmarkFindSingle(benchmark::State& state, bool sorted, bool ordered) {
+    const std::vector<uint32_t> tags = getAllTags();
+    camera_metadata_t* m = getMetadata(tags, sorted);
+    const std::vector<uint32_t> queries = getQueries(tags, state.range(0), ordered);
+    std::vector<camera_metadata_ro_entry_t> entries(queries.size());
+
+    // run the test
+    for (auto _ : state) {
+        for (size_t i = 0; i < queries.size(); ++i) {
+            benchmark::DoNotOptimize(find_camera_metadata_ro_entry(m, queries[i], &entries[i]));
+        }
+        benchmark::ClobberMemory();
+    }
+
+    free_camera_metadata(m);
+    state.SetComplexityN(queries.size());
+}
+
+static void BenchmarkFindBatch(benchmark::State& state, bool sorted, bool ordered) {
+    const std::vector<uint32_t> tags = getAllTags();
+    camera_metadata_t* m = getMetadata(tags, sorted);
+    const std::vector<uint32_t> queries = getQueries(tags, state.range(0), ordered);
+    std::vector<camera_metadata_ro_entry_t> entries(queries.size());
+
+    // run the test
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(find_camera_metadata_entries(
+                m, queries.data(), queries.size(), entries.data()));
+        benchmark::ClobberMemory();
+    }
+
+    free_camera_metadata(m);
+    state.SetComplexityN(queries.size());
+}
+
+// returns count updates of random non byte entries, alternating between 2 and 4 values.
+static std::vector<camera_metadata_update_t> getUpdates(
+        const camera_metadata_t* m, size_t count, const void* data, bool grow) {
+    std::vector<size_t> indices;
+    for (size_t i = 0; i < get_camera_metadata_entry_count(m); ++i) {
+        camera_metadata_ro_entry_t entry;
+        get_camera_metadata_ro_entry(m, i, &entry);
+        if (entry.type != TYPE_BYTE) {
+            indices.push_back(i);
+        }
+    }
+    std::shuffle(indices.begin(), indices.end(), std::minstd_rand(count));
+    std::vector<camera_metadata_update_t> updates(count);
+    for (size_t i = 0; i < count; ++i) {
+        updates[i] = {indices[i], data, (grow == (i & 1)) ? 4u : 2u};
+    }
+    return updates;
+}
+
+template <bool BATCH>
+static void BenchmarkUpdate(benchmark::State& state) {
+    const std::vector<uint32_t> tags = getAllTags();
+    camera_metadata_t* m = allocate_camera_metadata(tags.size(), tags.size() * 4 * sizeof(double));
+    const double data[4] = {};  // large enough for any type
+    for (uint32_t tag : tags) {
+        add_camera_metadata_entry(m, tag, data, 2);
+    }
+    const std::vector<camera_metadata_update_t> updates[2] = {
+        getUpdates(m, state.range(0), data, false /* grow */),
+        getUpdates(m, state.range(0), data, true /* grow */),
+    };
+
+    // run the test, every iteration changes the size of all the updated entries.
+    size_t i = 0;
+    for (auto _ : state) {
+        const std::vector<camera_metadata_update_t>& u = updates[++i & 1];
+        if constexpr (BATCH) {
+            benchmark::DoNotOptimize(update_camera_metadata_entries(m, u.data(), u.size()));
+        } else {
+            for (const camera_metadata_update_t& update : u) {
+                benchmark::DoNotOptimize(update_camera_metadata_entry(
+                        m, update.index, update.data, update.data_count, nullptr));
+            }
+        }
+        benchmark::ClobberMemory();
+    }
+
+    free_camera_metadata(m);
+    state.SetComplexityN(state.range(0));
+}
+
+static void BenchmarkBuildRealloc(benchmark::State& state) {
+    const std::vector<uint32_t> tags = getAllTags();
+    const double data = 0;  // large enough for any type
+
+    // run the test
+    for (auto _ : state) {
+        camera_metadata_t* m = allocate_camera_metadata(8, 64);
+        for (int i = 0; i < state.range(0); ++i) {
+            while (add_camera_metadata_entry(m, tags[i], &data, 1) != 0) {
+                camera_metadata_t* larger = allocate_camera_metadata(
+                        get_camera_metadata_entry_capacity(m) * 2,
+                        get_camera_metadata_data_capacity(m) * 2);
+                append_camera_metadata(larger, m);
+                free_camera_metadata(m);
+                m = larger;
+            }
+        }
+        benchmark::DoNotOptimize(m);
+        free_camera_metadata(m);
+        benchmark::ClobberMemory();
+    }
+
+    state.SetComplexityN(state.range(0));
+}
+
+static void BenchmarkBuildBuilder(benchmark::State& state) {
+    const std::vector<uint32_t> tags = getAllTags();
+    const double data = 0;  // large enough for any type
+    camera_metadata_builder_t* builder = allocate_camera_metadata_builder(8, 64, nullptr);
+    std::vector<uint64_t> buffer(
+            calculate_camera_metadata_size(tags.size(), tags.size() * sizeof(data)));
+
+    // run the test
+    for (auto _ : state) {
+        for (int i = 0; i < state.range(0); ++i) {
+            add_camera_metadata_builder_entry(builder, tags[i], &data, 1);
+        }
+        benchmark::DoNotOptimize(finish_camera_metadata_builder(
+                builder, buffer.data(), buffer.size() * sizeof(uint64_t)));
+        benchmark::ClobberMemory();
+    }
+
+    free_camera_metadata_builder(builder);
+    state.SetComplexityN(state.range(0));
+}
+
+static void BenchmarkClone(benchmark::State& state, camera_metadata_pool_t* pool) {
+    std::vector<uint32_t> tags = getAllTags();
+    tags.resize(64);  // about a capture request
+    camera_metadata_t* m = getMetadata(tags, true /* sorted */);
+
+    // run the test
+    for (auto _ : state) {
+        camera_metadata_t* clone = pool != nullptr ?
+                clone_camera_metadata_from_pool(pool, m) : clone_camera_metadata(m);
+        benchmark::DoNotOptimize(clone);
+        if (pool != nullptr) {
+            release_camera_metadata_to_pool(pool, clone);
+        } else {
+            free_camera_metadata(clone);
+        }
+        benchmark::ClobberMemory();
+    }
+
+    free_camera_metadata(m);
+}
+
+template <bool APPLY>
+static void BenchmarkDelta(benchmark::State& state) {
+    const std::vector<uint32_t> tags = getAllTags();
+    camera_metadata_t* m = getMetadata(tags, true /* sorted */);
+    camera_metadata_t* changed = allocate_camera_metadata(tags.size(),
+            tags.size() * 2 * sizeof(double));
+    append_camera_metadata(changed, m);
+    uint8_t data[2 * sizeof(double)];  // large enough for any type
+    memset(data, 0x5a, sizeof(data));
+    for (const camera_metadata_update_t& update : getUpdates(changed, state.range(0), data,
+            false /* grow */)) {
+        // 1 value of the same size, or 2 values
+        update_camera_metadata_entry(changed, update.index, data, update.data_count / 2, nullptr);
+    }
+    camera_metadata_delta_t* delta = diff_camera_metadata(m, changed);
+
+    // run the test
+    for (auto _ : state) {
+        if constexpr (APPLY) {
+            camera_metadata_t* applied = apply_camera_metadata_delta(m, delta);
+            benchmark::DoNotOptimize(applied);
+            free_camera_metadata(applied);
+        } else {
+            camera_metadata_delta_t* d = diff_camera_metadata(m, changed);
+            benchmark::DoNotOptimize(d);
+            free_camera_metadata_delta(d);
+        }
+        benchmark::ClobberMemory();
+    }
+
+    state.counters["delta_bytes"] = get_camera_metadata_delta_size(delta);
+    state.counters["packet_bytes"] = get_camera_metadata_compact_size(changed);
+    free_camera_metadata_delta(delta);
+    free_camera_metadata(changed);
+    free_camera_metadata(m);
+    state.SetComplexityN(state.range(0));
+}
+
+template<bool FAST>
+static void BenchmarkValidate(benchmark::State& state) {
+    camera_metadata_t* m = getMetadata(getAllTags(), false /* sorted */);
+    const size_t size = get_camera_metadata_size(m);
+
+    // run the test
+    for (auto _ : state) {
+        if constexpr (FAST) {
+            benchmark::DoNotOptimize(validate_camera_metadata_structure_fast(m, &size));
+        } else {
+            benchmark::DoNotOptimize(validate_camera_metadata_structure(m, &size));
+        }
+        benchmark::ClobberMemory();
+    }
+
+    free_camera_metadata(m);
+}
+
+// The layout of the metadata entries, for the qsort() comparison.
+struct BufferEntry {
+    uint32_t tag;
+    uint32_t count;
+    uint32_t data;
+    uint8_t type;
+    uint8_t reserved[3];
+};
+
+static int compareEntryTags(const void* p1, const void* p2) {
+    const uint32_t tag1 = static_cast<const BufferEntry*>(p1)->tag;
+    const uint32_t tag2 = static_cast<const BufferEntry*>(p2)->tag;
+    return tag1 < tag2 ? -1 : tag1 == tag2 ? 0 : 1;
+}
+
+template<bool QSORT>
+static void BenchmarkSort(benchmark::State& state) {
+    const std::vector<uint32_t> tags = getAllTags();
+    std::vector<uint32_t> entryTags(state.range(0));
+    for (size_t i = 0; i < entryTags.size(); ++i) {
+        entryTags[i] = tags[i % tags.size()];
+    }
+    camera_metadata_t* m = getMetadata(entryTags, false /* sorted */);
+    const size_t size = get_camera_metadata_compact_size(m);
+    std::vector<uint64_t> buffer(size / sizeof(uint64_t) + 1);
+
+    // run the test
+    for (auto _ : state) {
+        camera_metadata_t* copy = copy_camera_metadata(buffer.data(), size, m);
+        if constexpr (QSORT) {
+            // The entries start offset is the 6th header word.
+            uint8_t* entries = reinterpret_cast<uint8_t*>(copy) +
+                    reinterpret_cast<const uint32_t*>(copy)[5];
+            qsort(entries, entryTags.size(), sizeof(BufferEntry), compareEntryTags);
+        } else {
+            benchmark::DoNotOptimize(sort_camera_metadata(copy));
+        }
+        benchmark::ClobberMemory();
+    }
+
+    free_camera_metadata(m);
+    state.SetComplexityN(state.range(0));
+}
+
+// returns the full names of the android tags, in random order.
+static std::vector<std::string> getAllTagNames() {
+    std::vector<std::string> names;
+    for (uint32_t tag : getAllTags()) {
+        names.push_back(std::string(get_camera_metadata_section_name(tag)) + "." +
+                get_camera_metadata_tag_name(tag));
+    }
+    return names;
+}
+
+static void BM_TagFromName(benchmark::State& state) {
+    const std::vector<std::string> names = getAllTagNames();
+
+    // run the test
+    for (auto _ : state) {
+        for (const std::string& name : names) {
+            uint32_t tag;
+            benchmark::DoNotOptimize(get_camera_metadata_tag_from_name(name.c_str(), &tag));
+        }
+        benchmark::ClobberMemory();
+    }
+
+    state.SetItemsProcessed(state.iterations() * names.size());
+}
+
+static void BM_TagFromNameLinear(benchmark::State& state) {
+    const std::vector<std::string> names = getAllTagNames();
+
+    // run the test
+    for (auto _ : state) {
+        for (const std::string& name : names) {
+            uint32_t found = 0;
+            for (unsigned int section = 0; section < ANDROID_SECTION_COUNT && found == 0;
+                    ++section) {
+                const char* sectionName = camera_metadata_section_names[section];
+                const size_t sectionLength = strlen(sectionName);
+                if (strncmp(name.c_str(), sectionName, sectionLength) != 0 ||
+                        name[sectionLength] != '.') {
+                    continue;
+                }
+                for (uint32_t tag = camera_metadata_section_bounds[section][0];
+                        tag < camera_metadata_section_bounds[section][1]; ++tag) {
+                    const char* tagName = get_camera_metadata_tag_name(tag);
+                    if (tagName != nullptr &&
+                            strcmp(name.c_str() + sectionLength + 1, tagName) == 0) {
+                        found = tag;
+                        break;
+                    }
+                }
+            }
+            benchmark::DoNotOptimize(found);
+        }
+        benchmark::ClobberMemory();
+    }
+
+    state.SetItemsProcessed(state.iterations() * names.size());
+}
+
+// Vendor tag ops of kVendorSectionCount sections of kVendorSectionTagCount tags.
+static constexpr uint32_t kVendorSectionCount = 8;
+static constexpr uint32_t kVendorSectionTagCount = 64;
+
+struct VendorTag {
+    uint32_t tag;
+    int type;
+    std::string sectionName;
+    std::string tagName;
+};
+
+// sorted by tag
+static const std::vector<VendorTag>& getVendorTags() {
+    static const std::vector<VendorTag> vendorTags = [] {
+        std::vector<VendorTag> tags;
+        for (uint32_t section = 0; section < kVendorSectionCount; ++section) {
+            for (uint32_t index = 0; index < kVendorSectionTagCount; ++index) {
+                tags.push_back({(VENDOR_SECTION + section) << 16 | index,
+                        static_cast<int>(index % NUM_TYPES),
+                        "com.vendor.section" + std::to_string(section),
+                        "tag" + std::to_string(index)});
+            }
+        }
+        return tags;
+    }();
+    return vendorTags;
+}
+
+static const VendorTag* findVendorTag(uint32_t tag) {
+    const std::vector<VendorTag>& tags = getVendorTags();
+    auto it = std::lower_bound(tags.begin(), tags.end(), tag,
+            [](const VendorTag& vendorTag, uint32_t t) { return vendorTag.tag < t; });
+    return it != tags.end() && it->tag == tag ? &*it : nullptr;
+}
+
+static const vendor_tag_ops_t kVendorTagOps = {
+    .get_tag_count = [](const vendor_tag_ops_t*) {
+        return static_cast<int>(getVendorTags().size());
+    },
+    .get_all_tags = [](const vendor_tag_ops_t*, uint32_t* tagArray) {
+        for (const VendorTag& vendorTag : getVendorTags()) {
+            *tagArray++ = vendorTag.tag;
+        }
+    },
+    .get_section_name = [](const vendor_tag_ops_t*, uint32_t tag) {
+        const VendorTag* vendorTag = findVendorTag(tag);
+        return vendorTag != nullptr ? vendorTag->sectionName.c_str() : nullptr;
+    },
+    .get_tag_name = [](const vendor_tag_ops_t*, uint32_t tag) {
+        const VendorTag* vendorTag = findVendorTag(tag);
+        return vendorTag != nullptr ? vendorTag->tagName.c_str() : nullptr;
+    },
+    .get_tag_type = [](const vendor_tag_ops_t*, uint32_t tag) {
+        const VendorTag* vendorTag = findVendorTag(tag);
+        return vendorTag != nullptr ? vendorTag->type : -1;
+    },
+    .reserved = {},
+};
+
+// returns the vendor tags in random order.
+static std::vector<uint32_t> getVendorTagsShuffled() {
+    std::vector<uint32_t> tags;
+    for (const VendorTag& vendorTag : getVendorTags()) {
+        tags.push_back(vendorTag.tag);
+    }
+    std::shuffle(tags.begin(), tags.end(), std::minstd_rand(42));
+    return tags;
+}
+
+static void BM_VendorTagFromName(benchmark::State& state) {
+    set_camera_metadata_vendor_ops(&kVendorTagOps);
+    std::vector<std::string> names;
+    for (uint32_t tag : getVendorTagsShuffled()) {
+        names.push_back(std::string(get_camera_metadata_section_name(tag)) + "." +
+                get_camera_metadata_tag_name(tag));
+    }
+
+    // run the test
+    for (auto _ : state) {
+        for (const std::string& name : names) {
+            uint32_t tag;
+            benchmark::DoNotOptimize(get_camera_metadata_tag_from_name(name.c_str(), &tag));
+        }
+        benchmark::ClobberMemory();
+    }
+
+    set_camera_metadata_vendor_ops(nullptr);
+    state.SetItemsProcessed(state.iterations() * names.size());
+}
+
+template<bool OPS>
+static void BenchmarkVendorTagType(benchmark::State& state) {
+    set_camera_metadata_vendor_ops(&kVendorTagOps);
+    const std::vector<uint32_t> tags = getVendorTagsShuffled();
+
+    // run the test
+    for (auto _ : state) {
+        for (uint32_t tag : tags) {
+            if constexpr (OPS) {
+                benchmark::DoNotOptimize(kVendorTagOps.get_tag_type(&kVendorTagOps, tag));
+            } else {
+                benchmark::DoNotOptimize(get_camera_metadata_tag_type(tag));
+            }
+        }
+        benchmark::ClobberMemory();
+    }
+
+    set_camera_metadata_vendor_ops(nullptr);
+    state.SetItemsProcessed(state.iterations() * tags.size());
+}
+
+static void BM_VendorTagType(benchmark::State& state) {
+    BenchmarkVendorTagType<false /* OPS */>(state);
+}
+
+static void BM_VendorTagType_Ops(benchmark::State& state) {
+    BenchmarkVendorTagType<true /* OPS */>(state);
+}
+
+template<bool MAP>
+static void BenchmarkLoad(benchmark::State& state) {
+    // Static characteristics hold large arrays, such as the stream configurations.
+    camera_metadata_t* allTags = getMetadata(getAllTags(), true /* sorted */);
+    const std::vector<int32_t> configurations(state.range(0) / sizeof(int32_t));
+    camera_metadata_t* m = allocate_camera_metadata(
+            get_camera_metadata_entry_count(allTags),
+            get_camera_metadata_data_count(allTags) + state.range(0));
+    append_camera_metadata(m, allTags);
+    free_camera_metadata(allTags);
+    camera_metadata_entry_t entry;
+    find_camera_metadata_entry(m, ANDROID_SCALER_AVAILABLE_STREAM_CONFIGURATIONS, &entry);
+    update_camera_metadata_entry(m, entry.index, configurations.data(), configurations.size(),
+            nullptr);
+    FILE* file = tmpfile();
+    const int fd = fileno(file);
+    write_camera_metadata_file(fd, m);
+    const size_t size = get_camera_metadata_compact_size(m);
+    std::vector<uint64_t> buffer(size / sizeof(uint64_t) + 1);
+
+    // run the test
+    for (auto _ : state) {
+        if constexpr (MAP) {
+            const camera_metadata_t* mapped = map_camera_metadata_file(fd);
+            benchmark::DoNotOptimize(mapped);
+            unmap_camera_metadata_file(mapped);
+        } else {
+            benchmark::DoNotOptimize(pread(fd, buffer.data(), size, 0));
+            camera_metadata_t* copy = allocate_copy_camera_metadata_checked(
+                    reinterpret_cast<camera_metadata_t*>(buffer.data()), size);
+            benchmark::DoNotOptimize(copy);
+            free_camera_metadata(copy);
+        }
+        benchmark::ClobberMemory();
+    }
+
+    state.counters["file_bytes"] = size;
+    fclose(file);
+    free_camera_metadata(m);
+}
+
+static void QueryArgs(benchmark::internal::Benchmark* b) {
+    for (int count : {1, 4, 16, 64, 256}) {
+        b->Args({count});
+    }
+}
+
+static void BM_FindSingle(benchmark::State& state) {
+    BenchmarkFindSingle(state, false /* sorted */, false /* ordered */);
+}
+
+static void BM_FindSingle_Sorted(benchmark::State& state) {
+    BenchmarkFindSingle(state, true /* sorted */, false /* ordered */);
+}
+
+static void BM_FindSingle_SortedOrdered(benchmark::State& state) {
+    BenchmarkFindSingle(state, true /* sorted */, true /* ordered */);
+}
+
+static void BM_FindBatch(benchmark::State& state) {
+    BenchmarkFindBatch(state, false /* sorted */, false /* ordered */);
+}
+
+static void BM_FindBatch_Sorted(benchmark::State& state) {
+    BenchmarkFindBatch(state, true /* sorted */, false /* ordered */);
+}
+
+static void BM_FindBatch_SortedOrdered(benchmark::State& state) {
+    BenchmarkFindBatch(state, true /* sorted */, true /* ordered */);
+}
+
+static void UpdateArgs(benchmark::internal::Benchmark* b) {
+    for (int count : {1, 4, 16, 64}) {
+        b->Args({count});
+    }
+}
+
+static void BM_UpdateSingle(benchmark::State& state) {
+    BenchmarkUpdate<false /* BATCH */>(state);
+}
+
+static void BM_UpdateBatch(benchmark::State& state) {
+    BenchmarkUpdate<true /* BATCH */>(state);
+}
+
+static void BuildArgs(benchmark::internal::Benchmark* b) {
+    for (int count : {16, 64, 256}) {
+        b->Args({count});
+    }
+}
+
+static void BM_BuildRealloc(benchmark::State& state) {
+    BenchmarkBuildRealloc(state);
+}
+
+static void BM_BuildBuilder(benchmark::State& state) {
+    BenchmarkBuildBuilder(state);
+}
+
+static void BM_CloneMalloc(benchmark::State& state) {
+    BenchmarkClone(state, nullptr /* pool */);
+}
+
+static camera_metadata_pool_t* gPool = allocate_camera_metadata_pool(8);
+
+static void BM_ClonePool(benchmark::State& state) {
+    BenchmarkClone(state, gPool);
+}
+
+static void BM_Diff(benchmark::State& state) {
+    BenchmarkDelta<false /* APPLY */>(state);
+}
+
+static void BM_ApplyDelta(benchmark::State& state) {
+    BenchmarkDelta<true /* APPLY */>(state);
+}
+
+static void SortArgs(benchmark::internal::Benchmark* b) {
+    for (int count : {50, 100, 250, 500, 1000, 2000}) {
+        b->Args({count});
+    }
+}
+
+static void BM_Sort(benchmark::State& state) {
+    BenchmarkSort<false /* QSORT */>(state);
+}
+
+static void BM_SortQsort(benchmark::State& state) {
+    BenchmarkSort<true /* QSORT */>(state);
+}
+
+static void BM_LoadMap(benchmark::State& state) {
+    BenchmarkLoad<true /* MAP */>(state);
+}
+
+static void BM_LoadCopy(benchmark::State& state) {
+    BenchmarkLoad<false /* MAP */>(state);
+}
+
+static void BM_ValidateFull(benchmark::State& state) {
+    BenchmarkValidate<false /* FAST */>(state);
+}
+
+static void BM_ValidateFast(benchmark::State& state) {
+    BenchmarkValidate<true /* FAST */>(state);
+}
+
+BENCHMARK(BM_FindSingle)->Apply(QueryArgs);
+BENCHMARK(BM_FindSingle_Sorted)->Apply(QueryArgs);
+BENCHMARK(BM_FindSingle_SortedOrdered)->Apply(QueryArgs);
+BENCHMARK(BM_FindBatch)->Apply(QueryArgs);
+BENCHMARK(BM_FindBatch_Sorted)->Apply(QueryArgs);
+BENCHMARK(BM_FindBatch_SortedOrdered)->Apply(QueryArgs);
+BENCHMARK(BM_UpdateSingle)->Apply(UpdateArgs);
+BENCHMARK(BM_UpdateBatch)->Apply(UpdateArgs);
+BENCHMARK(BM_BuildRealloc)->Apply(BuildArgs);
+BENCHMARK(BM_BuildBuilder)->Apply(BuildArgs);
+BENCHMARK(BM_CloneMalloc)->ThreadRange(1, 8);
+BENCHMARK(BM_ClonePool)->ThreadRange(1, 8);
+BENCHMARK(BM_Diff)->Apply(UpdateArgs);
+BENCHMARK(BM_ApplyDelta)->Apply(UpdateArgs);
+BENCHMARK(BM_ValidateFull);
+BENCHMARK(BM_ValidateFast);
+BENCHMARK(BM_Sort)->Apply(SortArgs);
+BENCHMARK(BM_SortQsort)->Apply(SortArgs);
+BENCHMARK(BM_TagFromName);
+BENCHMARK(BM_TagFromNameLinear);
+BENCHMARK(BM_VendorTagFromName);
+BENCHMARK(BM_VendorTagType);
+BENCHMARK(BM_VendorTagType_Ops);
+BENCHMARK(BM_LoadMap)->Arg(0)->Arg(64 << 10)->Arg(256 << 10);
+BENCHMARK(BM_LoadCopy)->Arg(0)->Arg(64 << 10)->Arg(256 << 10);
+
+BENCHMARK_MAIN();
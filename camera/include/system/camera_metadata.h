@@ -202,6 +202,34 @@ camera_metadata_t *place_camera_metadata(void *dst, size_t dst_size,
         size_t entry_capacity,
         size_t data_capacity);
 
+/**
+ * Allocate a new camera_metadata structure with a tag index, which makes
+ * find_camera_metadata_entry() a hash table lookup whether or not the
+ * structure is sorted. The index is kept up to date by every function adding,
+ * deleting or moving entries, and takes 4 bytes per entry of capacity, rounded
+ * up to a power of two, at least twice the entry capacity.
+ *
+ * The index is not part of the compacted structure: copy_camera_metadata()
+ * and clone_camera_metadata() return structures without an index.
+ *
+ * Returns NULL if the entry_capacity is larger than 2^28, or on allocation
+ * failure. The resulting structure can be freed with free_camera_metadata().
+ */
+ANDROID_API
+camera_metadata_t *allocate_indexed_camera_metadata(size_t entry_capacity,
+        size_t data_capacity);
+
+/**
+ * Place a camera metadata structure with a tag index into an existing buffer,
+ * as place_camera_metadata() does. See allocate_indexed_camera_metadata() for
+ * the tag index. The buffer must be at least
+ * calculate_indexed_camera_metadata_size() bytes.
+ */
+ANDROID_API
+camera_metadata_t *place_indexed_camera_metadata(void *dst, size_t dst_size,
+        size_t entry_capacity,
+        size_t data_capacity);
+
 /**
  * Free a camera_metadata structure. Should only be used with structures
  * allocated with allocate_camera_metadata().
@@ -217,6 +245,15 @@ ANDROID_API
 size_t calculate_camera_metadata_size(size_t entry_count,
         size_t data_count);
 
+/**
+ * Calculate the buffer size needed for a metadata structure with a tag index,
+ * as placed by place_indexed_camera_metadata(). Returns 0 if the entry_count is
+ * larger than 2^28.
+ */
+ANDROID_API
+size_t calculate_indexed_camera_metadata_size(size_t entry_count,
+        size_t data_count);
+
 /**
  * Get current size of entire metadata structure in bytes, including reserved
  * but unused space.
@@ -292,7 +329,8 @@ enum {
  *
  * This is useful in particular after copying the binary metadata blob
  * from an untrusted source, since passing this check means the data is at least
- * consistent.
+ * consistent. For a structure with a tag index, this includes checking that
+ * the index finds every entry.
  *
  * The expected_size argument is optional.
  *
@@ -306,6 +344,25 @@ ANDROID_API
 int validate_camera_metadata_structure(const camera_metadata_t *metadata,
                                        const size_t *expected_size);
 
+/**
+ * Validate a metadata like validate_camera_metadata_structure(), in a single
+ * pass over the entries without early exits, checking their types against the
+ * android tag types and their data bounds. The metadata is only read, so it
+ * may be shared or mapped read-only.
+ *
+ * No validation state is kept: validating the same metadata again costs the
+ * same single pass, linear in the entry count.
+ *
+ * The expected_size argument is optional.
+ *
+ * Returns 0: on success
+ *         CAMERA_METADATA_VALIDATION_ERROR: on error
+ *         CAMERA_METADATA_VALIDATION_SHIFTED: as validate_camera_metadata_structure()
+ */
+ANDROID_API
+int validate_camera_metadata_structure_fast(const camera_metadata_t *metadata,
+                                            const size_t *expected_size);
+
 /**
  * Append camera metadata in src to an existing metadata structure in dst.  This
  * does not resize the destination structure, so if it is too small, a non-zero
@@ -392,7 +449,8 @@ int get_camera_metadata_ro_entry(const camera_metadata_t *src,
  *
  * If multiple entries with the same tag exist, does not have any guarantees on
  * which is returned. To speed up searching for tags, sort the metadata
- * structure first by calling sort_camera_metadata().
+ * structure first by calling sort_camera_metadata(), or allocate it with
+ * allocate_indexed_camera_metadata().
  */
 ANDROID_API
 int find_camera_metadata_entry(camera_metadata_t *src,
@@ -407,6 +465,28 @@ int find_camera_metadata_ro_entry(const camera_metadata_t *src,
         uint32_t tag,
         camera_metadata_ro_entry_t *entry);
 
+/**
+ * Find the entries for tag_count tag values at once. For more than 32 tags, the
+ * tags are resolved in a single pass over the entries of an unsorted structure,
+ * after sorting them, or in a single merge pass over a sorted structure, if they
+ * are given in increasing order. Otherwise, including for an indexed structure,
+ * each tag is looked up as by find_camera_metadata_ro_entry(), which is faster in
+ * these cases.
+ *
+ * entries[i] is set to the entry for tags[i], as by get_camera_metadata_entry().
+ * If tags[i] is not found, entries[i] has a NULL data pointer, a count of 0,
+ * and an index equal to the entry count. If multiple entries with the same tag
+ * exist, the first one is returned for an unsorted structure.
+ *
+ * Returns 0 if all the tags were found, -ENOENT if any tag was not found, or
+ * another non-0 value on error.
+ */
+ANDROID_API
+int find_camera_metadata_entries(const camera_metadata_t *src,
+        const uint32_t *tags,
+        size_t tag_count,
+        camera_metadata_ro_entry_t *entries);
+
 /**
  * Delete an entry at given index. This is an expensive operation, since it
  * requires repacking entries and possibly entry data. This also invalidates any
@@ -433,6 +513,269 @@ int update_camera_metadata_entry(camera_metadata_t *dst,
         size_t data_count,
         camera_metadata_entry_t *updated_entry);
 
+/**
+ * A pending update of the entry at index with data_count values from data, for
+ * update_camera_metadata_entries().
+ */
+typedef struct camera_metadata_update {
+    size_t      index;
+    const void *data;
+    size_t      data_count;
+} camera_metadata_update_t;
+
+/**
+ * Updates several metadata entries at once, as if update_camera_metadata_entry()
+ * were called for each update in order. The data of the entries changing size
+ * is removed in a single compaction pass over the data array, and the entry
+ * offsets are fixed once, making this O(N) for all the updates instead of O(N)
+ * for each. The update data must not point into dst.
+ *
+ * The updates are applied atomically: if any index is out of range or repeated,
+ * or if there is no room for the new data in the buffer, a non-zero value is
+ * returned and dst is left unchanged. Maintains sorting, but invalidates
+ * camera_metadata_entry instances that point to the updated entries, or to any
+ * entry if a data size changes.
+ */
+ANDROID_API
+int update_camera_metadata_entries(camera_metadata_t *dst,
+        const camera_metadata_update_t *updates,
+        size_t update_count);
+
+/**
+ * Memory allocation callbacks of a camera_metadata_builder_t, for example backed
+ * by an arena or by a pool of recycled buffers. allocate() returns a buffer of at
+ * least size bytes, aligned for camera_metadata_t, or NULL on failure. free()
+ * releases a buffer returned by allocate(), with the size it was allocated with.
+ */
+typedef struct camera_metadata_allocator {
+    void *(*allocate)(void *context, size_t size);
+    void  (*free)(void *context, void *buffer, size_t size);
+    void  *context;
+} camera_metadata_allocator_t;
+
+/**
+ * A camera metadata structure growing as entries are added, to build metadata
+ * of unknown size without repeatedly allocating and appending into larger
+ * buffers on failure.
+ */
+typedef struct camera_metadata_builder camera_metadata_builder_t;
+
+/**
+ * Allocate a builder with the given initial capacities. Its buffers come from
+ * allocator, or from malloc() if allocator is NULL. Returns NULL on failure.
+ */
+ANDROID_API
+camera_metadata_builder_t *allocate_camera_metadata_builder(size_t entry_capacity,
+        size_t data_capacity,
+        const camera_metadata_allocator_t *allocator);
+
+/**
+ * Free a builder and its buffer. Metadata returned by
+ * finish_camera_metadata_builder() is not affected.
+ */
+ANDROID_API
+void free_camera_metadata_builder(camera_metadata_builder_t *builder);
+
+/**
+ * Add an entry to the metadata being built, as add_camera_metadata_entry().
+ * If there is no room, the capacities are at least doubled, so that building N
+ * entries costs O(N) amortized copies. Returns a non-zero value on failure.
+ */
+ANDROID_API
+int add_camera_metadata_builder_entry(camera_metadata_builder_t *builder,
+        uint32_t tag,
+        const void *data,
+        size_t data_count);
+
+/**
+ * Append the entries of src to the metadata being built, as
+ * append_camera_metadata(), growing the capacities if there is no room.
+ */
+ANDROID_API
+int append_camera_metadata_builder(camera_metadata_builder_t *builder,
+        const camera_metadata_t *src);
+
+/**
+ * Get the metadata being built, for example to find, update, or sort entries.
+ * Adding entries to it directly is limited by its current capacities. The
+ * pointer is invalidated by the next add or append to the builder.
+ */
+ANDROID_API
+camera_metadata_t *get_camera_metadata_builder_metadata(camera_metadata_builder_t *builder);
+
+/**
+ * Finish the metadata being built, packed into get_camera_metadata_compact_size()
+ * bytes. If dst is NULL, the metadata is allocated and must be freed with
+ * free_camera_metadata(). Otherwise it is copied into dst as
+ * copy_camera_metadata(), and NULL is returned if dst_size is too small.
+ *
+ * On success the builder is emptied, keeping its grown buffer to build the next
+ * metadata without allocating.
+ */
+ANDROID_API
+camera_metadata_t *finish_camera_metadata_builder(camera_metadata_builder_t *builder,
+        void *dst,
+        size_t dst_size);
+
+/**
+ * A thread-safe pool recycling camera metadata buffers, to avoid a malloc() and
+ * free() for each per-frame metadata. Buffers are bucketed by size class, with
+ * the entry and data capacities rounded up to powers of 2. Very large
+ * capacities are not pooled.
+ */
+typedef struct camera_metadata_pool camera_metadata_pool_t;
+
+/**
+ * Counters of a camera_metadata_pool_t. The hit rate is hits / allocations.
+ * The counters are kept per size class, and the high-water marks are the sums
+ * of the high-water marks of all the size classes.
+ */
+typedef struct camera_metadata_pool_stats {
+    uint64_t allocations;             // buffers handed out
+    uint64_t hits;                    // of which reused a pooled buffer
+    size_t   in_use;                  // buffers handed out and not released
+    size_t   in_use_high_water;
+    size_t   pooled_bytes;            // bytes of the buffers kept for reuse
+    size_t   pooled_bytes_high_water;
+} camera_metadata_pool_stats_t;
+
+/**
+ * Allocate a pool keeping up to max_buffers_per_class released buffers of each
+ * size class. Returns NULL on failure.
+ */
+ANDROID_API
+camera_metadata_pool_t *allocate_camera_metadata_pool(size_t max_buffers_per_class);
+
+/**
+ * Free a pool and the buffers it keeps. The buffers in use must be released or
+ * freed with free_camera_metadata() by their owners.
+ */
+ANDROID_API
+void free_camera_metadata_pool(camera_metadata_pool_t *pool);
+
+/**
+ * Get an empty metadata structure with at least the requested capacities from
+ * the pool, as allocate_camera_metadata(). A recycled buffer is reset as by
+ * place_camera_metadata(). Returns NULL if a capacity is larger than 2^32 - 1,
+ * or on failure.
+ */
+ANDROID_API
+camera_metadata_t *allocate_camera_metadata_from_pool(camera_metadata_pool_t *pool,
+        size_t entry_capacity,
+        size_t data_capacity);
+
+/**
+ * Clone src into a buffer of the pool, as clone_camera_metadata(). The capacities
+ * may be larger than the entry and data counts of src.
+ */
+ANDROID_API
+camera_metadata_t *clone_camera_metadata_from_pool(camera_metadata_pool_t *pool,
+        const camera_metadata_t *src);
+
+/**
+ * Return a buffer obtained from the pool for reuse, or free it if the pool keeps
+ * enough buffers of its size class. A buffer from the pool may also be freed with
+ * free_camera_metadata(), but is then counted as still in use. Buffers of other
+ * sizes, like from allocate_camera_metadata(), are freed.
+ */
+ANDROID_API
+void release_camera_metadata_to_pool(camera_metadata_pool_t *pool,
+        camera_metadata_t *metadata);
+
+/**
+ * Get a snapshot of the pool counters. Returns a non-zero value on error.
+ */
+ANDROID_API
+int get_camera_metadata_pool_stats(const camera_metadata_pool_t *pool,
+        camera_metadata_pool_stats_t *stats);
+
+/**
+ * The changes from one metadata packet to another, in a self-contained wire
+ * format which can be copied across processes like a metadata packet.
+ */
+typedef struct camera_metadata_delta camera_metadata_delta_t;
+
+/**
+ * Compute the delta from old_metadata to new_metadata: the tags removed, and
+ * the entries added or changed in new_metadata. Both packets must be sorted,
+ * without duplicate tags, and are compared in a single merge pass.
+ *
+ * Returns NULL on failure. The delta must be freed with
+ * free_camera_metadata_delta().
+ */
+ANDROID_API
+camera_metadata_delta_t *diff_camera_metadata(const camera_metadata_t *old_metadata,
+        const camera_metadata_t *new_metadata);
+
+/**
+ * Free a delta returned by diff_camera_metadata().
+ */
+ANDROID_API
+void free_camera_metadata_delta(camera_metadata_delta_t *delta);
+
+/**
+ * Get the size in bytes of a delta, to copy it.
+ */
+ANDROID_API
+size_t get_camera_metadata_delta_size(const camera_metadata_delta_t *delta);
+
+/**
+ * Validate that a delta is well-formed, as validate_camera_metadata_structure():
+ * its size is at most expected_size if not NULL, its removed tags are sorted,
+ * and its added or changed entries form a valid sorted metadata packet. Returns
+ * CAMERA_METADATA_VALIDATION_ERROR if not.
+ *
+ * A delta received from another process must be validated with its buffer size
+ * before any other use.
+ */
+ANDROID_API
+int validate_camera_metadata_delta(const camera_metadata_delta_t *delta,
+        const size_t *expected_size);
+
+/**
+ * Reconstruct new_metadata from old_metadata as base and the delta returned by
+ * diff_camera_metadata(old_metadata, new_metadata), in a single merge pass. base
+ * must be sorted without duplicate tags, and the result is sorted and compact.
+ *
+ * Returns NULL if the delta is not valid, or removes tags not in base. The
+ * result must be freed with free_camera_metadata().
+ */
+ANDROID_API
+camera_metadata_t *apply_camera_metadata_delta(const camera_metadata_t *base,
+        const camera_metadata_delta_t *delta);
+
+/**
+ * Write a sorted and compacted copy of src to the file fd, in the packet layout,
+ * replacing the file contents. This is meant for immutable metadata such as
+ * static characteristics, to be shared across processes with
+ * map_camera_metadata_file().
+ *
+ * Returns 0 on success, or non-0 if src is NULL or the file cannot be written.
+ */
+ANDROID_API
+int write_camera_metadata_file(int fd, const camera_metadata_t *src);
+
+/**
+ * Map a file written by write_camera_metadata_file() read-only, without copying
+ * it. The pages are shared with the file cache, and with the other processes
+ * mapping the same file. The file is checked with
+ * validate_camera_metadata_structure(), and must hold a single packet. The fd
+ * can be closed once mapped.
+ *
+ * The result must not be modified. Clone it to get a modifiable copy.
+ *
+ * Returns NULL if the file is not a valid packet, or cannot be mapped. The
+ * result must be unmapped with unmap_camera_metadata_file().
+ */
+ANDROID_API
+const camera_metadata_t *map_camera_metadata_file(int fd);
+
+/**
+ * Unmap metadata returned by map_camera_metadata_file().
+ */
+ANDROID_API
+void unmap_camera_metadata_file(const camera_metadata_t *metadata);
+
 /**
  * Retrieve human-readable name of section the tag is in. Returns NULL if
  * no such tag is defined. Returns NULL for tags in the vendor section, unless
@@ -457,6 +800,19 @@ const char *get_camera_metadata_tag_name(uint32_t tag);
 ANDROID_API
 int get_camera_metadata_tag_type(uint32_t tag);
 
+/**
+ * Find a tag from its full name, "<section name>.<tag name>" as printed by
+ * dump_camera_metadata(), for example "android.sensor.exposureTime". Vendor
+ * tags are found once set_camera_metadata_vendor_ops() has been used.
+ *
+ * The lookup is a perfect hash of the names, built on first use.
+ *
+ * Returns 0 and sets tag if found, -ENOENT if no such tag is defined, or
+ * another non-0 value if an argument is NULL.
+ */
+ANDROID_API
+int get_camera_metadata_tag_from_name(const char *name, uint32_t *tag);
+
 /**
  * Retrieve human-readable name of section the tag is in. Returns NULL if
  * no such tag is defined.
@@ -480,6 +836,14 @@ ANDROID_API
 int get_local_camera_metadata_tag_type(uint32_t tag,
         const camera_metadata_t *meta);
 
+/**
+ * Find a tag from its full name, as get_camera_metadata_tag_from_name(), with
+ * the vendor tags of the vendor id of meta.
+ */
+ANDROID_API
+int get_local_camera_metadata_tag_from_name(const char *name,
+        const camera_metadata_t *meta, uint32_t *tag);
+
 /**
  * Retrieve all tags that need permission.
  */
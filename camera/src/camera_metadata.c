@@ -22,8 +22,13 @@
 #include <assert.h>
 #include <errno.h>
 #include <inttypes.h>
+#include <pthread.h>
+#include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include <log/log.h>
 
@@ -68,6 +73,7 @@ typedef uint32_t metadata_size_t;
  *   |                                               |
  *   |-----------------------------------------------|
  *   | reserved for future expansion                 |
+ *   | (tag index, if FLAG_INDEXED is set)           |
  *   |-----------------------------------------------|
  *   | camera_metadata_buffer_entry_t #0             |
  *   |-----------------------------------------------|
@@ -178,6 +184,18 @@ _Static_assert(sizeof(camera_metadata_t) == 48,
 
 /** Flag definitions */
 #define FLAG_SORTED 0x00000001
+#define FLAG_INDEXED 0x00000002
+
+/**
+ * Tag index of an indexed packet. This is an open addressing hash table of
+ * entry indices, with linear probing, placed between the header and the
+ * entries. Its slot count is a power of two, at least twice the entry
+ * capacity, so there is always an empty slot to end a probe sequence.
+ * If the same tag was added several times, the lowest entry index is kept.
+ */
+#define INDEX_ALIGNMENT ((size_t) 4)
+#define INDEX_EMPTY_SLOT UINT32_MAX
+#define INDEX_MAX_ENTRY_CAPACITY ((size_t) 1 << 28)
 
 /** Tag information */
 
@@ -216,6 +234,63 @@ static uint8_t *get_data(const camera_metadata_t *metadata) {
     return (uint8_t*)metadata + metadata->data_start;
 }
 
+static size_t get_index_slot_count(size_t entry_capacity) {
+    if (entry_capacity == 0) return 1;
+    return (size_t)1 << (32 - __builtin_clz((uint32_t)(2 * entry_capacity - 1)));
+}
+
+static uint32_t *get_index(const camera_metadata_t *metadata) {
+    return (uint32_t*)
+            ((uint8_t*)metadata + ALIGN_TO(sizeof(camera_metadata_t), INDEX_ALIGNMENT));
+}
+
+static size_t get_index_start_slot(uint32_t tag, size_t slot_mask) {
+    uint32_t hash = tag * 0x9E3779B1u;
+    return (hash ^ (hash >> 16)) & slot_mask;
+}
+
+// Returns the slot holding the entry with the given tag, or the empty slot
+// ending its probe sequence. Returns SIZE_MAX if neither is found.
+static size_t find_index_slot(const camera_metadata_t *metadata, uint32_t tag) {
+    const uint32_t *index = get_index(metadata);
+    const camera_metadata_buffer_entry_t *entries = get_entries(metadata);
+    const size_t slot_count = get_index_slot_count(metadata->entry_capacity);
+    size_t slot = get_index_start_slot(tag, slot_count - 1);
+    for (size_t i = 0; i < slot_count; ++i, slot = (slot + 1) & (slot_count - 1)) {
+        const uint32_t entry_index = index[slot];
+        if (entry_index == INDEX_EMPTY_SLOT ||
+                (entry_index < metadata->entry_count && entries[entry_index].tag == tag)) {
+            return slot;
+        }
+    }
+    return SIZE_MAX;
+}
+
+static void insert_index_entry(camera_metadata_t *metadata, uint32_t entry_index) {
+    const size_t slot = find_index_slot(metadata, get_entries(metadata)[entry_index].tag);
+    if (slot != SIZE_MAX && get_index(metadata)[slot] == INDEX_EMPTY_SLOT) {
+        get_index(metadata)[slot] = entry_index;
+    }
+}
+
+static void rebuild_index(camera_metadata_t *metadata) {
+    memset(get_index(metadata), 0xFF,
+            sizeof(uint32_t[get_index_slot_count(metadata->entry_capacity)]));
+    for (uint32_t i = 0; i < metadata->entry_count; ++i) {
+        insert_index_entry(metadata, i);
+    }
+}
+
+static size_t calculate_entries_start(size_t entry_capacity, bool indexed) {
+    size_t entries_start = sizeof(camera_metadata_t);
+    if (indexed) {
+        entries_start = ALIGN_TO(entries_start, INDEX_ALIGNMENT);
+        entries_start += sizeof(uint32_t[get_index_slot_count(entry_capacity)]);
+    }
+    // Start entry list at aligned boundary
+    return ALIGN_TO(entries_start, ENTRY_ALIGNMENT);
+}
+
 size_t get_camera_metadata_alignment() {
     return METADATA_PACKET_ALIGNMENT;
 }
@@ -246,14 +321,19 @@ camera_metadata_t *allocate_copy_camera_metadata_checked(
     return metadata;
 }
 
-camera_metadata_t *allocate_camera_metadata(size_t entry_capacity,
-                                            size_t data_capacity) {
+static size_t calculate_size(size_t entry_count, size_t data_count, bool indexed);
+
+static camera_metadata_t *place(void *dst, size_t dst_size,
+        size_t entry_capacity, size_t data_capacity, bool indexed);
 
-    size_t memory_needed = calculate_camera_metadata_size(entry_capacity,
-                                                          data_capacity);
+static camera_metadata_t *allocate(size_t entry_capacity,
+                                   size_t data_capacity,
+                                   bool indexed) {
+
+    size_t memory_needed = calculate_size(entry_capacity, data_capacity, indexed);
     void *buffer = calloc(1, memory_needed);
-    camera_metadata_t *metadata = place_camera_metadata(
-        buffer, memory_needed, entry_capacity, data_capacity);
+    camera_metadata_t *metadata = place(
+        buffer, memory_needed, entry_capacity, data_capacity, indexed);
     if (!metadata) {
         /* This should not happen when memory_needed is the same
          * calculated in this function and in place_camera_metadata.
@@ -263,14 +343,40 @@ camera_metadata_t *allocate_camera_metadata(size_t entry_capacity,
     return metadata;
 }
 
+camera_metadata_t *allocate_camera_metadata(size_t entry_capacity,
+                                            size_t data_capacity) {
+    return allocate(entry_capacity, data_capacity, false /* indexed */);
+}
+
+camera_metadata_t *allocate_indexed_camera_metadata(size_t entry_capacity,
+                                                    size_t data_capacity) {
+    if (entry_capacity > INDEX_MAX_ENTRY_CAPACITY) return NULL;
+    return allocate(entry_capacity, data_capacity, true /* indexed */);
+}
+
 camera_metadata_t *place_camera_metadata(void *dst,
                                          size_t dst_size,
                                          size_t entry_capacity,
                                          size_t data_capacity) {
+    return place(dst, dst_size, entry_capacity, data_capacity, false /* indexed */);
+}
+
+camera_metadata_t *place_indexed_camera_metadata(void *dst,
+                                                 size_t dst_size,
+                                                 size_t entry_capacity,
+                                                 size_t data_capacity) {
+    if (entry_capacity > INDEX_MAX_ENTRY_CAPACITY) return NULL;
+    return place(dst, dst_size, entry_capacity, data_capacity, true /* indexed */);
+}
+
+static camera_metadata_t *place(void *dst,
+                                size_t dst_size,
+                                size_t entry_capacity,
+                                size_t data_capacity,
+                                bool indexed) {
     if (dst == NULL) return NULL;
 
-    size_t memory_needed = calculate_camera_metadata_size(entry_capacity,
-                                                          data_capacity);
+    size_t memory_needed = calculate_size(entry_capacity, data_capacity, indexed);
     if (memory_needed > dst_size) {
       ALOGE("%s: Memory needed to place camera metadata (%zu) > dst size (%zu)", __FUNCTION__,
               memory_needed, dst_size);
@@ -279,11 +385,10 @@ camera_metadata_t *place_camera_metadata(void *dst,
 
     camera_metadata_t *metadata = (camera_metadata_t*)dst;
     metadata->version = CURRENT_METADATA_VERSION;
-    metadata->flags = 0;
+    metadata->flags = indexed ? FLAG_INDEXED : 0;
     metadata->entry_count = 0;
     metadata->entry_capacity = entry_capacity;
-    metadata->entries_start =
-            ALIGN_TO(sizeof(camera_metadata_t), ENTRY_ALIGNMENT);
+    metadata->entries_start = calculate_entries_start(entry_capacity, indexed);
     metadata->data_count = 0;
     metadata->data_capacity = data_capacity;
     metadata->size = memory_needed;
@@ -291,6 +396,9 @@ camera_metadata_t *place_camera_metadata(void *dst,
             metadata->entry_capacity) - (uint8_t*)metadata;
     metadata->data_start = ALIGN_TO(data_unaligned, DATA_ALIGNMENT);
     metadata->vendor_id = CAMERA_METADATA_INVALID_VENDOR_ID;
+    if (indexed) {
+        rebuild_index(metadata);
+    }
 
     assert(validate_camera_metadata_structure(metadata, NULL) == OK);
     return metadata;
@@ -301,9 +409,19 @@ void free_camera_metadata(camera_metadata_t *metadata) {
 
 size_t calculate_camera_metadata_size(size_t entry_count,
                                       size_t data_count) {
-    size_t memory_needed = sizeof(camera_metadata_t);
-    // Start entry list at aligned boundary
-    memory_needed = ALIGN_TO(memory_needed, ENTRY_ALIGNMENT);
+    return calculate_size(entry_count, data_count, false /* indexed */);
+}
+
+size_t calculate_indexed_camera_metadata_size(size_t entry_count,
+                                              size_t data_count) {
+    if (entry_count > INDEX_MAX_ENTRY_CAPACITY) return 0;
+    return calculate_size(entry_count, data_count, true /* indexed */);
+}
+
+static size_t calculate_size(size_t entry_count,
+                             size_t data_count,
+                             bool indexed) {
+    size_t memory_needed = calculate_entries_start(entry_count, indexed);
     memory_needed += sizeof(camera_metadata_buffer_entry_t[entry_count]);
     // Start buffer list at aligned boundary
     memory_needed = ALIGN_TO(memory_needed, DATA_ALIGNMENT);
@@ -356,7 +474,8 @@ camera_metadata_t* copy_camera_metadata(void *dst, size_t dst_size,
     camera_metadata_t *metadata =
         place_camera_metadata(dst, dst_size, src->entry_count, src->data_count);
 
-    metadata->flags = src->flags;
+    // the copy is compacted without a tag index.
+    metadata->flags = src->flags & ~FLAG_INDEXED;
     metadata->entry_count = src->entry_count;
     metadata->data_count = src->data_count;
     metadata->vendor_id = src->vendor_id;
@@ -402,6 +521,130 @@ size_t calculate_camera_metadata_entry_data_size(uint8_t type,
     return data_bytes <= 4 ? 0 : ALIGN_TO(data_bytes, DATA_ALIGNMENT);
 }
 
+// Checks the header invariants, and the tag index if any. The header may be
+// an aligned copy of the metadata header.
+static int validate_header(const camera_metadata_t *metadata,
+        const camera_metadata_t *header,
+        const size_t *expected_size) {
+    if (expected_size != NULL && header->size > *expected_size) {
+        ALOGE("%s: Metadata size (%" PRIu32 ") should be <= expected size (%zu)",
+              __FUNCTION__, header->size, *expected_size);
+        return CAMERA_METADATA_VALIDATION_ERROR;
+    }
+
+    if (header->entry_count > header->entry_capacity) {
+        ALOGE("%s: Entry count (%" PRIu32 ") should be <= entry capacity "
+              "(%" PRIu32 ")",
+              __FUNCTION__, header->entry_count, header->entry_capacity);
+        return CAMERA_METADATA_VALIDATION_ERROR;
+    }
+
+    if (header->data_count > header->data_capacity) {
+        ALOGE("%s: Data count (%" PRIu32 ") should be <= data capacity "
+              "(%" PRIu32 ")",
+              __FUNCTION__, header->data_count, header->data_capacity);
+        android_errorWriteLog(SN_EVENT_LOG_ID, "30591838");
+        return CAMERA_METADATA_VALIDATION_ERROR;
+    }
+
+    const metadata_uptrdiff_t entries_end =
+        header->entries_start + header->entry_capacity;
+    if (entries_end < header->entries_start || // overflow check
+        entries_end > header->data_start) {
+
+        ALOGE("%s: Entry start + capacity (%" PRIu32 ") should be <= data start "
+              "(%" PRIu32 ")",
+               __FUNCTION__,
+              (header->entries_start + header->entry_capacity),
+              header->data_start);
+        return CAMERA_METADATA_VALIDATION_ERROR;
+    }
+
+    const metadata_uptrdiff_t data_end =
+        header->data_start + header->data_capacity;
+    if (data_end < header->data_start || // overflow check
+        data_end > header->size) {
+
+        ALOGE("%s: Data start + capacity (%" PRIu32 ") should be <= total size "
+              "(%" PRIu32 ")",
+               __FUNCTION__,
+              (header->data_start + header->data_capacity),
+              header->size);
+        return CAMERA_METADATA_VALIDATION_ERROR;
+    }
+
+    if (header->flags & FLAG_INDEXED) {
+        // The index lies between the header and the entries, so it is only read once the
+        // section bounds above are known to be within the packet.
+        if (header->entry_capacity > INDEX_MAX_ENTRY_CAPACITY ||
+                header->entries_start < calculate_entries_start(header->entry_capacity, true) ||
+                header->entries_start > header->size) {
+            ALOGE("%s: Entry start (%" PRIu32 ") leaves no room for the tag index of "
+                  "entry capacity %" PRIu32,
+                  __FUNCTION__, header->entries_start, header->entry_capacity);
+            return CAMERA_METADATA_VALIDATION_ERROR;
+        }
+
+        // Entry indices must be in range, and the table not full.
+        const uint8_t *index = (const uint8_t*)get_index(metadata);
+        const size_t slot_count = get_index_slot_count(header->entry_capacity);
+        size_t empty_slots = 0;
+        for (size_t i = 0; i < slot_count; ++i) {
+            uint32_t entry_index;
+            memcpy(&entry_index, index + i * sizeof(uint32_t), sizeof(uint32_t));
+            if (entry_index == INDEX_EMPTY_SLOT) {
+                ++empty_slots;
+            } else if (entry_index >= header->entry_count) {
+                ALOGE("%s: Tag index slot %zu has entry index %" PRIu32 " beyond "
+                      "the entry count %" PRIu32,
+                      __FUNCTION__, i, entry_index, header->entry_count);
+                return CAMERA_METADATA_VALIDATION_ERROR;
+            }
+        }
+        if (empty_slots == 0) {
+            ALOGE("%s: Tag index has no empty slot", __FUNCTION__);
+            return CAMERA_METADATA_VALIDATION_ERROR;
+        }
+    }
+    return OK;
+}
+
+// Checks that the tag index finds each entry at the lowest entry index holding its tag,
+// as find_camera_metadata_entry() would, so that a stale or altered index cannot hide
+// entries. validate_header() must have passed. The packet may be unaligned.
+static int validate_index(const camera_metadata_t *metadata,
+        const camera_metadata_t *header) {
+    const uint8_t *index = (const uint8_t*)get_index(metadata);
+    const uint8_t *entries = (const uint8_t*)metadata + header->entries_start;
+    const size_t slot_mask = get_index_slot_count(header->entry_capacity) - 1;
+    for (size_t i = 0; i < header->entry_count; ++i) {
+        uint32_t tag;
+        memcpy(&tag, entries + i * sizeof(camera_metadata_buffer_entry_t) +
+                offsetof(camera_metadata_buffer_entry_t, tag), sizeof(tag));
+        // validate_header() checked that there is an empty slot to end the probe.
+        for (size_t slot = get_index_start_slot(tag, slot_mask);; slot = (slot + 1) & slot_mask) {
+            uint32_t entry_index, entry_tag;
+            memcpy(&entry_index, index + slot * sizeof(uint32_t), sizeof(uint32_t));
+            if (entry_index == INDEX_EMPTY_SLOT) {
+                ALOGE("%s: Entry index %zu (0x%x) is missing from the tag index",
+                      __FUNCTION__, i, tag);
+                return CAMERA_METADATA_VALIDATION_ERROR;
+            }
+            memcpy(&entry_tag, entries + entry_index * sizeof(camera_metadata_buffer_entry_t) +
+                    offsetof(camera_metadata_buffer_entry_t, tag), sizeof(entry_tag));
+            if (entry_tag == tag) {
+                if (entry_index > i) {
+                    ALOGE("%s: Tag index finds entry index %" PRIu32 " for 0x%x instead "
+                          "of %zu", __FUNCTION__, entry_index, tag, i);
+                    return CAMERA_METADATA_VALIDATION_ERROR;
+                }
+                break;
+            }
+        }
+    }
+    return OK;
+}
+
 int validate_camera_metadata_structure(const camera_metadata_t *metadata,
                                        const size_t *expected_size) {
 
@@ -466,50 +709,7 @@ int validate_camera_metadata_structure(const camera_metadata_t *metadata,
         header = metadata;
     }
 
-    if (expected_size != NULL && header->size > *expected_size) {
-        ALOGE("%s: Metadata size (%" PRIu32 ") should be <= expected size (%zu)",
-              __FUNCTION__, header->size, *expected_size);
-        return CAMERA_METADATA_VALIDATION_ERROR;
-    }
-
-    if (header->entry_count > header->entry_capacity) {
-        ALOGE("%s: Entry count (%" PRIu32 ") should be <= entry capacity "
-              "(%" PRIu32 ")",
-              __FUNCTION__, header->entry_count, header->entry_capacity);
-        return CAMERA_METADATA_VALIDATION_ERROR;
-    }
-
-    if (header->data_count > header->data_capacity) {
-        ALOGE("%s: Data count (%" PRIu32 ") should be <= data capacity "
-              "(%" PRIu32 ")",
-              __FUNCTION__, header->data_count, header->data_capacity);
-        android_errorWriteLog(SN_EVENT_LOG_ID, "30591838");
-        return CAMERA_METADATA_VALIDATION_ERROR;
-    }
-
-    const metadata_uptrdiff_t entries_end =
-        header->entries_start + header->entry_capacity;
-    if (entries_end < header->entries_start || // overflow check
-        entries_end > header->data_start) {
-
-        ALOGE("%s: Entry start + capacity (%" PRIu32 ") should be <= data start "
-              "(%" PRIu32 ")",
-               __FUNCTION__,
-              (header->entries_start + header->entry_capacity),
-              header->data_start);
-        return CAMERA_METADATA_VALIDATION_ERROR;
-    }
-
-    const metadata_uptrdiff_t data_end =
-        header->data_start + header->data_capacity;
-    if (data_end < header->data_start || // overflow check
-        data_end > header->size) {
-
-        ALOGE("%s: Data start + capacity (%" PRIu32 ") should be <= total size "
-              "(%" PRIu32 ")",
-               __FUNCTION__,
-              (header->data_start + header->data_capacity),
-              header->size);
+    if (validate_header(metadata, header, expected_size) != OK) {
         return CAMERA_METADATA_VALIDATION_ERROR;
     }
 
@@ -593,12 +793,75 @@ int validate_camera_metadata_structure(const camera_metadata_t *metadata,
         } // else data stored inline, so we look at value which can be anything.
     }
 
+    if ((header->flags & FLAG_INDEXED) && validate_index(metadata, header) != OK) {
+        return CAMERA_METADATA_VALIDATION_ERROR;
+    }
+
     if (alignmentOffset == 0) {
         return OK;
     }
     return CAMERA_METADATA_VALIDATION_SHIFTED;
 }
 
+// Checks the entry table, the entry data bounds and the entry types against the android
+// tag types, in a single loop without early exits. The tag type of an android tag is a
+// direct table index; vendor tags are not checked, as in validate_camera_metadata_structure().
+static bool validate_entries(const camera_metadata_t *metadata) {
+    if (metadata->entries_start % ENTRY_ALIGNMENT != 0 ||
+            metadata->data_start % DATA_ALIGNMENT != 0 ||
+            metadata->entries_start + (uint64_t)metadata->entry_capacity *
+                    sizeof(camera_metadata_buffer_entry_t) > metadata->data_start) {
+        ALOGE("%s: Entries (start %" PRIu32 ", capacity %" PRIu32 ") or data (start %"
+              PRIu32 ") are misplaced", __FUNCTION__, metadata->entries_start,
+              metadata->entry_capacity, metadata->data_start);
+        return false;
+    }
+    const camera_metadata_buffer_entry_t *entries = get_entries(metadata);
+    const size_t entry_count = metadata->entry_count;
+    const uint64_t data_capacity = metadata->data_capacity;
+    uint32_t invalid = 0;
+    for (size_t i = 0; i < entry_count; ++i) {
+        const uint32_t tag = entries[i].tag;
+        const uint8_t type = entries[i].type;
+        const uint32_t count = entries[i].count;
+        const uint32_t offset = entries[i].data.offset;
+        const uint32_t tag_section = tag >> 16;
+        const int tag_type = tag_section < ANDROID_SECTION_COUNT &&
+                tag < camera_metadata_section_bounds[tag_section][1] ?
+                tag_info[tag_section][tag & 0xFFFF].tag_type : -1;
+        const uint64_t payload_bytes =
+                (uint64_t)count * camera_metadata_type_size[type < NUM_TYPES ? type : 0];
+        const uint64_t data_end = offset + ALIGN_TO(payload_bytes, DATA_ALIGNMENT);
+        invalid |= (type >= NUM_TYPES) |
+                ((tag_section < VENDOR_SECTION) & (tag_type != (int)type)) |
+                ((payload_bytes > 4) &
+                        ((offset % DATA_ALIGNMENT != 0) | (data_end > data_capacity))) |
+                ((count == 0) & (offset != 0));
+    }
+    return invalid == 0;
+}
+
+int validate_camera_metadata_structure_fast(const camera_metadata_t *metadata,
+        const size_t *expected_size) {
+    if (metadata == NULL || (uintptr_t)metadata % METADATA_PACKET_ALIGNMENT != 0 ||
+            (expected_size != NULL && sizeof(camera_metadata_t) > *expected_size)) {
+        // The full validation reports the error, or a shifted packet.
+        return validate_camera_metadata_structure(metadata, expected_size);
+    }
+    if (validate_header(metadata, metadata, expected_size) != OK) {
+        return CAMERA_METADATA_VALIDATION_ERROR;
+    }
+    if (!validate_entries(metadata)) {
+        // The full validation reports which entry is invalid.
+        int res = validate_camera_metadata_structure(metadata, expected_size);
+        return res != OK ? res : CAMERA_METADATA_VALIDATION_ERROR;
+    }
+    if ((metadata->flags & FLAG_INDEXED) && validate_index(metadata, metadata) != OK) {
+        return CAMERA_METADATA_VALIDATION_ERROR;
+    }
+    return OK;
+}
+
 int append_camera_metadata(camera_metadata_t *dst,
         const camera_metadata_t *src) {
     if (dst == NULL || src == NULL ) return ERROR;
@@ -643,6 +906,11 @@ int append_camera_metadata(camera_metadata_t *dst,
     }
     dst->entry_count += src->entry_count;
     dst->data_count += src->data_count;
+    if (dst->flags & FLAG_INDEXED) {
+        for (uint32_t i = dst->entry_count - src->entry_count; i < dst->entry_count; ++i) {
+            insert_index_entry(dst, i);
+        }
+    }
 
     if (dst->vendor_id == CAMERA_METADATA_INVALID_VENDOR_ID) {
         dst->vendor_id = src->vendor_id;
@@ -702,6 +970,9 @@ static int add_camera_metadata_entry_raw(camera_metadata_t *dst,
     }
     dst->entry_count++;
     dst->flags &= ~FLAG_SORTED;
+    if (dst->flags & FLAG_INDEXED) {
+        insert_index_entry(dst, dst->entry_count - 1);
+    }
     assert(validate_camera_metadata_structure(dst, NULL) == OK);
     return OK;
 }
@@ -732,14 +1003,92 @@ static int compare_entry_tags(const void *p1, const void *p2) {
             1;
 }
 
+#define ENTRY_INSERTION_SORT_COUNT 32
+#define ENTRY_RADIX_BITS 8
+#define ENTRY_RADIX_SIZE (1 << ENTRY_RADIX_BITS)
+#define ENTRY_RADIX_DIGITS (32 / ENTRY_RADIX_BITS)
+
+// Stable sort of the entries by tag, by insertion from the first unsorted entry.
+static void insertion_sort_entries(camera_metadata_buffer_entry_t *entries,
+        size_t entry_count, size_t unsorted) {
+    for (size_t i = unsorted; i < entry_count; ++i) {
+        const camera_metadata_buffer_entry_t entry = entries[i];
+        size_t j = i;
+        for (; j > 0 && entry.tag < entries[j - 1].tag; --j) {
+            entries[j] = entries[j - 1];
+        }
+        entries[j] = entry;
+    }
+}
+
+/**
+ * Stable LSD radix sort of the entries by tag, one pass per byte of the tag.
+ * The passes of bytes shared by all the tags are skipped, which usually leaves
+ * the tag index byte and the section byte. Returns ERROR if the scratch buffer
+ * cannot be allocated.
+ */
+static int radix_sort_entries(camera_metadata_buffer_entry_t *entries, size_t entry_count) {
+    camera_metadata_buffer_entry_t *scratch =
+            malloc(sizeof(camera_metadata_buffer_entry_t[entry_count]));
+    if (scratch == NULL) return ERROR;
+
+    // entry_count fits a metadata_size_t
+    metadata_size_t counts[ENTRY_RADIX_DIGITS][ENTRY_RADIX_SIZE] = {{0}};
+    for (size_t i = 0; i < entry_count; ++i) {
+        const uint32_t tag = entries[i].tag;
+        for (size_t digit = 0; digit < ENTRY_RADIX_DIGITS; ++digit) {
+            ++counts[digit][(tag >> (digit * ENTRY_RADIX_BITS)) % ENTRY_RADIX_SIZE];
+        }
+    }
+
+    camera_metadata_buffer_entry_t *src = entries;
+    camera_metadata_buffer_entry_t *dst = scratch;
+    for (size_t digit = 0; digit < ENTRY_RADIX_DIGITS; ++digit) {
+        const unsigned int shift = digit * ENTRY_RADIX_BITS;
+        metadata_size_t *offsets = counts[digit];
+        if (offsets[(src[0].tag >> shift) % ENTRY_RADIX_SIZE] == entry_count) {
+            continue; // all the tags have this byte
+        }
+        metadata_size_t offset = 0;
+        for (size_t value = 0; value < ENTRY_RADIX_SIZE; ++value) {
+            const metadata_size_t count = offsets[value];
+            offsets[value] = offset;
+            offset += count;
+        }
+        for (size_t i = 0; i < entry_count; ++i) {
+            dst[offsets[(src[i].tag >> shift) % ENTRY_RADIX_SIZE]++] = src[i];
+        }
+        camera_metadata_buffer_entry_t *sorted = dst;
+        dst = src;
+        src = sorted;
+    }
+    if (src != entries) {
+        memcpy(entries, src, sizeof(camera_metadata_buffer_entry_t[entry_count]));
+    }
+    free(scratch);
+    return OK;
+}
+
 int sort_camera_metadata(camera_metadata_t *dst) {
     if (dst == NULL) return ERROR;
     if (dst->flags & FLAG_SORTED) return OK;
 
-    qsort(get_entries(dst), dst->entry_count,
-            sizeof(camera_metadata_buffer_entry_t),
-            compare_entry_tags);
+    // Both sorts are stable, entries of the same tag keep their order.
+    camera_metadata_buffer_entry_t *entries = get_entries(dst);
+    const size_t entry_count = dst->entry_count;
+    size_t unsorted = 1;
+    while (unsorted < entry_count && entries[unsorted - 1].tag <= entries[unsorted].tag) {
+        ++unsorted;
+    }
+    if (unsorted < entry_count &&
+            (entry_count <= ENTRY_INSERTION_SORT_COUNT ||
+                    radix_sort_entries(entries, entry_count) != OK)) {
+        insertion_sort_entries(entries, entry_count, unsorted);
+    }
     dst->flags |= FLAG_SORTED;
+    if (dst->flags & FLAG_INDEXED) {
+        rebuild_index(dst);
+    }
 
     assert(validate_camera_metadata_structure(dst, NULL) == OK);
     return OK;
@@ -779,7 +1128,12 @@ int find_camera_metadata_entry(camera_metadata_t *src,
     if (src == NULL) return ERROR;
 
     uint32_t index;
-    if (src->flags & FLAG_SORTED) {
+    if (src->flags & FLAG_INDEXED) {
+        // Indexed entries, sorted or not, do a hash table lookup
+        const size_t slot = find_index_slot(src, tag);
+        if (slot == SIZE_MAX || get_index(src)[slot] == INDEX_EMPTY_SLOT) return NOT_FOUND;
+        index = get_index(src)[slot];
+    } else if (src->flags & FLAG_SORTED) {
         // Sorted entries, do a binary search
         camera_metadata_buffer_entry_t *search_entry = NULL;
         camera_metadata_buffer_entry_t key;
@@ -813,6 +1167,160 @@ int find_camera_metadata_ro_entry(const camera_metadata_t *src,
             (camera_metadata_entry_t*)entry);
 }
 
+/**
+ * A query of find_camera_metadata_entries(), sorted by tag.
+ */
+typedef struct tag_query {
+    uint32_t tag;
+    uint32_t position; // in the caller's tags and entries arrays
+} tag_query_t;
+
+#define TAG_QUERY_STACK_COUNT 128
+#define TAG_QUERY_LINEAR_COUNT 32 // up to which the tags are looked up one by one
+
+static int compare_tag_queries(const void *p1, const void *p2) {
+    const tag_query_t *query1 = (const tag_query_t*)p1;
+    const tag_query_t *query2 = (const tag_query_t*)p2;
+    if (query1->tag != query2->tag) {
+        return query1->tag < query2->tag ? -1 : 1;
+    }
+    // keep the positions ordered for equal tags.
+    return query1->position < query2->position ? -1 :
+            query1->position == query2->position ? 0 :
+            1;
+}
+
+// Fills the entries of all the queries for the tag of the buffer entry at index,
+// unless they were already found.
+static void fill_tag_queries(const camera_metadata_t *src, size_t index,
+        const tag_query_t *queries, size_t query_count, size_t first_query,
+        camera_metadata_ro_entry_t *entries) {
+    const uint32_t tag = get_entries(src)[index].tag;
+    for (size_t i = first_query; i < query_count && queries[i].tag == tag; ++i) {
+        camera_metadata_ro_entry_t *entry = entries + queries[i].position;
+        if (entry->data.u8 == NULL) {
+            get_camera_metadata_ro_entry(src, index, entry);
+        }
+    }
+}
+
+static inline void set_tag_not_found(const camera_metadata_t *src, uint32_t tag,
+        camera_metadata_ro_entry_t *entry) {
+    entry->index = src->entry_count;
+    entry->tag = tag;
+    entry->type = 0;
+    entry->count = 0;
+    entry->data.u8 = NULL;
+}
+
+int find_camera_metadata_entries(const camera_metadata_t *src,
+        const uint32_t *tags,
+        size_t tag_count,
+        camera_metadata_ro_entry_t *entries) {
+    if (src == NULL || (tag_count != 0 && (tags == NULL || entries == NULL))) return ERROR;
+    if (tag_count > UINT32_MAX) return ERROR;
+
+    bool tags_sorted = true;
+    for (size_t i = 1; i < tag_count && tags_sorted; ++i) {
+        tags_sorted = tags[i - 1] <= tags[i];
+    }
+    // Single lookups are faster when:
+    // - each lookup is O(1) with the index, there is nothing to share between queries.
+    // - the binary searches of a sorted structure beat sorting the queries, or beat
+    //   the merge pass for few ordered queries.
+    // - a few linear searches of an unsorted structure beat a pass with binary searches.
+    if ((src->flags & FLAG_INDEXED) ||
+            tag_count <= TAG_QUERY_LINEAR_COUNT ||
+            ((src->flags & FLAG_SORTED) && !tags_sorted)) {
+        size_t found = 0;
+        for (size_t i = 0; i < tag_count; ++i) {
+            if (find_camera_metadata_ro_entry(src, tags[i], entries + i) == OK) {
+                ++found;
+            } else {
+                set_tag_not_found(src, tags[i], entries + i);
+            }
+        }
+        return found == tag_count ? OK : NOT_FOUND;
+    }
+
+    for (size_t i = 0; i < tag_count; ++i) {
+        set_tag_not_found(src, tags[i], entries + i);
+    }
+
+    tag_query_t stack_queries[TAG_QUERY_STACK_COUNT];
+    tag_query_t *queries = stack_queries;
+    if (tag_count > TAG_QUERY_STACK_COUNT) {
+        queries = malloc(tag_count * sizeof(tag_query_t));
+        if (queries == NULL) return ERROR;
+    }
+    for (size_t i = 0; i < tag_count; ++i) {
+        queries[i].tag = tags[i];
+        queries[i].position = i;
+    }
+    if (!tags_sorted) {
+        qsort(queries, tag_count, sizeof(tag_query_t), compare_tag_queries);
+    }
+
+    const camera_metadata_buffer_entry_t *buffer_entries = get_entries(src);
+    if (src->flags & FLAG_SORTED) {
+        // Sorted entries, a single merge pass over both sorted arrays. The entries
+        // cursor gallops to each query tag, so few queries do not scan all entries.
+        size_t index = 0;
+        size_t query = 0;
+        while (index < src->entry_count && query < tag_count) {
+            const uint32_t tag = queries[query].tag;
+            size_t step = 1;
+            size_t high = index;
+            while (high < src->entry_count && buffer_entries[high].tag < tag) {
+                index = high + 1;
+                high += step;
+                step <<= 1;
+            }
+            if (high > src->entry_count) high = src->entry_count;
+            while (index < high) { // lower bound of tag in the entries
+                const size_t mid = index + (high - index) / 2;
+                if (buffer_entries[mid].tag < tag) {
+                    index = mid + 1;
+                } else {
+                    high = mid;
+                }
+            }
+            if (index < src->entry_count && buffer_entries[index].tag == tag) {
+                fill_tag_queries(src, index, queries, tag_count, query, entries);
+            }
+            while (query < tag_count && queries[query].tag == tag) ++query;
+        }
+    } else {
+        // Not sorted, a single linear pass with a binary search in the queries
+        const uint32_t min_tag = tag_count != 0 ? queries[0].tag : 0;
+        const uint32_t max_tag = tag_count != 0 ? queries[tag_count - 1].tag : 0;
+        for (size_t index = 0; index < src->entry_count; ++index) {
+            const uint32_t tag = buffer_entries[index].tag;
+            if (tag < min_tag || tag > max_tag) continue;
+            size_t low = 0;
+            size_t high = tag_count;
+            while (low < high) { // lower bound of tag in the queries
+                const size_t mid = low + (high - low) / 2;
+                if (queries[mid].tag < tag) {
+                    low = mid + 1;
+                } else {
+                    high = mid;
+                }
+            }
+            fill_tag_queries(src, index, queries, tag_count, low, entries);
+        }
+    }
+
+    if (queries != stack_queries) {
+        free(queries);
+    }
+
+    for (size_t i = 0; i < tag_count; ++i) {
+        if (entries[i].data.u8 == NULL) return NOT_FOUND;
+    }
+    return OK;
+}
+
 
 int delete_camera_metadata_entry(camera_metadata_t *dst,
         size_t index) {
@@ -848,6 +1356,10 @@ int delete_camera_metadata_entry(camera_metadata_t *dst,
             sizeof(camera_metadata_buffer_entry_t) *
             (dst->entry_count - index - 1) );
     dst->entry_count -= 1;
+    if (dst->flags & FLAG_INDEXED) {
+        // The following entries moved down, and a duplicate tag may now be found.
+        rebuild_index(dst);
+    }
 
     assert(validate_camera_metadata_structure(dst, NULL) == OK);
     return OK;
@@ -929,13 +1441,1265 @@ int update_camera_metadata_entry(camera_metadata_t *dst,
     return OK;
 }
 
-static const vendor_tag_ops_t *vendor_tag_ops = NULL;
-static const struct vendor_tag_cache_ops *vendor_cache_ops = NULL;
+/**
+ * The data of an entry changing size in update_camera_metadata_entries().
+ */
+typedef struct data_hole {
+    size_t index;    // of the entry
+    uint32_t offset; // of the old data in the data array
+    uint32_t bytes;  // of the old data, 0 if it fits in the entry
+    uint32_t shift;  // bytes of the holes before this one
+} data_hole_t;
+
+#define DATA_HOLE_STACK_COUNT 16
+
+static int compare_data_hole_indices(const void *p1, const void *p2) {
+    const size_t index1 = ((const data_hole_t*)p1)->index;
+    const size_t index2 = ((const data_hole_t*)p2)->index;
+    return index1 < index2 ? -1 : index1 == index2 ? 0 : 1;
+}
 
-// Declared in system/media/private/camera/include/camera_metadata_hidden.h
-const char *get_local_camera_metadata_section_name_vendor_id(uint32_t tag,
-        metadata_vendor_id_t id) {
-    uint32_t tag_section = tag >> 16;
+static int compare_data_hole_offsets(const void *p1, const void *p2) {
+    const data_hole_t *hole1 = (const data_hole_t*)p1;
+    const data_hole_t *hole2 = (const data_hole_t*)p2;
+    // The holes without data go last.
+    if ((hole1->bytes == 0) != (hole2->bytes == 0)) {
+        return hole1->bytes == 0 ? 1 : -1;
+    }
+    return hole1->offset < hole2->offset ? -1 :
+            hole1->offset == hole2->offset ? 0 :
+            1;
+}
+
+// Checks that the updates have distinct valid indices, and fit in the data array.
+static int check_camera_metadata_updates(const camera_metadata_t *dst,
+        const camera_metadata_update_t *updates, size_t update_count,
+        data_hole_t *holes) {
+    const camera_metadata_buffer_entry_t *entries = get_entries(dst);
+    size_t data_count = dst->data_count;
+    for (size_t i = 0; i < update_count; ++i) {
+        if (updates[i].index >= dst->entry_count) return ERROR;
+        holes[i].index = updates[i].index;
+        const camera_metadata_buffer_entry_t *entry = entries + updates[i].index;
+        data_count += calculate_camera_metadata_entry_data_size(entry->type,
+                updates[i].data_count);
+        data_count -= calculate_camera_metadata_entry_data_size(entry->type,
+                entry->count);
+    }
+    if (data_count > dst->data_capacity) {
+        // No room
+        return ERROR;
+    }
+    qsort(holes, update_count, sizeof(data_hole_t), compare_data_hole_indices);
+    for (size_t i = 1; i < update_count; ++i) {
+        if (holes[i].index == holes[i - 1].index) return ERROR;
+    }
+    return OK;
+}
+
+int update_camera_metadata_entries(camera_metadata_t *dst,
+        const camera_metadata_update_t *updates,
+        size_t update_count) {
+    if (dst == NULL || (update_count != 0 && updates == NULL)) return ERROR;
+    if (update_count > dst->entry_count) return ERROR; // an index is repeated
+
+    data_hole_t stack_holes[DATA_HOLE_STACK_COUNT];
+    data_hole_t *holes = stack_holes;
+    if (update_count > DATA_HOLE_STACK_COUNT) {
+        holes = malloc(update_count * sizeof(data_hole_t));
+        if (holes == NULL) return ERROR;
+    }
+
+    // Check all the updates before changing anything
+    if (check_camera_metadata_updates(dst, updates, update_count, holes) != OK) {
+        if (holes != stack_holes) {
+            free(holes);
+        }
+        return ERROR;
+    }
+
+    // The holes of the entries changing size, in data offset order
+    camera_metadata_buffer_entry_t *entries = get_entries(dst);
+    size_t hole_count = 0;
+    for (size_t i = 0; i < update_count; ++i) {
+        const camera_metadata_buffer_entry_t *entry = entries + updates[i].index;
+        const size_t entry_bytes =
+                calculate_camera_metadata_entry_data_size(entry->type, entry->count);
+        if (calculate_camera_metadata_entry_data_size(entry->type,
+                updates[i].data_count) != entry_bytes) {
+            holes[hole_count].index = updates[i].index;
+            holes[hole_count].offset = entry_bytes != 0 ? entry->data.offset : 0;
+            holes[hole_count].bytes = entry_bytes;
+            ++hole_count;
+        }
+    }
+    qsort(holes, hole_count, sizeof(data_hole_t), compare_data_hole_offsets);
+    size_t data_hole_count = 0;
+    uint32_t shift = 0;
+    for (; data_hole_count < hole_count && holes[data_hole_count].bytes != 0;
+            ++data_hole_count) {
+        holes[data_hole_count].shift = shift;
+        shift += holes[data_hole_count].bytes;
+    }
+
+    if (data_hole_count != 0) {
+        // Single compaction pass, moving the data between the holes down
+        uint8_t *data = get_data(dst);
+        for (size_t i = 0; i < data_hole_count; ++i) {
+            const size_t start = holes[i].offset + holes[i].bytes;
+            const size_t end = i + 1 < data_hole_count ?
+                    holes[i + 1].offset : dst->data_count;
+            memmove(data + start - holes[i].shift - holes[i].bytes, data + start,
+                    end - start);
+        }
+        dst->data_count -= shift;
+
+        // Single pass fixing the offsets of the moved data
+        for (size_t i = 0; i < dst->entry_count; ++i) {
+            camera_metadata_buffer_entry_t *e = entries + i;
+            if (calculate_camera_metadata_entry_data_size(e->type, e->count) == 0 ||
+                    e->data.offset < holes[0].offset) {
+                continue;
+            }
+            size_t low = 0; // last hole at or before the entry data
+            size_t high = data_hole_count;
+            while (high - low > 1) {
+                const size_t mid = low + (high - low) / 2;
+                if (holes[mid].offset <= e->data.offset) {
+                    low = mid;
+                } else {
+                    high = mid;
+                }
+            }
+            // The entries changing size get their new offsets below.
+            e->data.offset -= holes[low].shift + holes[low].bytes;
+        }
+    }
+
+    // Data appended in update order, or replaced in place when the size is unchanged
+    uint8_t *data_start = get_data(dst);
+    for (size_t i = 0; i < update_count; ++i) {
+        camera_metadata_buffer_entry_t *entry = entries + updates[i].index;
+        const size_t data_bytes =
+                calculate_camera_metadata_entry_data_size(entry->type, updates[i].data_count);
+        const size_t data_payload_bytes =
+                updates[i].data_count * camera_metadata_type_size[entry->type];
+        if (data_bytes == 0) {
+            // Data fits into entry
+            memcpy(entry->data.value, updates[i].data, data_payload_bytes);
+        } else {
+            if (data_bytes != calculate_camera_metadata_entry_data_size(entry->type,
+                    entry->count)) {
+                entry->data.offset = dst->data_count;
+                dst->data_count += data_bytes;
+            }
+            memcpy(data_start + entry->data.offset, updates[i].data, data_payload_bytes);
+        }
+        entry->count = updates[i].data_count;
+    }
+
+    if (holes != stack_holes) {
+        free(holes);
+    }
+    assert(validate_camera_metadata_structure(dst, NULL) == OK);
+    return OK;
+}
+
+/**
+ * A growable camera_metadata_t, see allocate_camera_metadata_builder().
+ */
+struct camera_metadata_builder {
+    camera_metadata_t *metadata;
+    size_t size; // of the metadata buffer
+    camera_metadata_allocator_t allocator;
+};
+
+static void *allocate_builder_buffer(void *context, size_t size) {
+    (void) context;
+    return malloc(size);
+}
+
+static void free_builder_buffer(void *context, void *buffer, size_t size) {
+    (void) context;
+    (void) size;
+    free(buffer);
+}
+
+// Replaces the metadata of the builder by an empty one with the given capacities.
+static int reset_camera_metadata_builder(camera_metadata_builder_t *builder,
+        size_t entry_capacity, size_t data_capacity) {
+    const size_t size = calculate_camera_metadata_size(entry_capacity, data_capacity);
+    void *buffer = builder->allocator.allocate(builder->allocator.context, size);
+    if (buffer == NULL) return ERROR;
+    camera_metadata_t *metadata = place_camera_metadata(buffer, size,
+            entry_capacity, data_capacity);
+    if (builder->metadata != NULL) {
+        builder->allocator.free(builder->allocator.context, builder->metadata, builder->size);
+    }
+    builder->metadata = metadata;
+    builder->size = size;
+    return OK;
+}
+
+// Grows the metadata of the builder geometrically to hold at least the given counts.
+static int grow_camera_metadata_builder(camera_metadata_builder_t *builder,
+        size_t entry_count, size_t data_count) {
+    camera_metadata_t *metadata = builder->metadata;
+    if (entry_count <= metadata->entry_capacity && data_count <= metadata->data_capacity) {
+        return OK;
+    }
+    size_t entry_capacity = metadata->entry_capacity;
+    while (entry_capacity < entry_count) {
+        entry_capacity = entry_capacity != 0 ? entry_capacity * 2 : 1;
+    }
+    size_t data_capacity = metadata->data_capacity;
+    while (data_capacity < data_count) {
+        data_capacity = data_capacity != 0 ? data_capacity * 2 : DATA_ALIGNMENT;
+    }
+    if (entry_capacity > UINT32_MAX || data_capacity > UINT32_MAX) return ERROR;
+
+    const size_t size = builder->size;
+    builder->metadata = NULL; // not freed by reset_camera_metadata_builder()
+    if (reset_camera_metadata_builder(builder, entry_capacity, data_capacity) != OK) {
+        builder->metadata = metadata;
+        builder->size = size;
+        return ERROR;
+    }
+    append_camera_metadata(builder->metadata, metadata);
+    builder->allocator.free(builder->allocator.context, metadata, size);
+    return OK;
+}
+
+camera_metadata_builder_t *allocate_camera_metadata_builder(size_t entry_capacity,
+        size_t data_capacity, const camera_metadata_allocator_t *allocator) {
+    if (entry_capacity > UINT32_MAX || data_capacity > UINT32_MAX) return NULL;
+    if (allocator != NULL && (allocator->allocate == NULL || allocator->free == NULL)) {
+        return NULL;
+    }
+    camera_metadata_builder_t *builder = malloc(sizeof(camera_metadata_builder_t));
+    if (builder == NULL) return NULL;
+    builder->metadata = NULL;
+    builder->size = 0;
+    if (allocator != NULL) {
+        builder->allocator = *allocator;
+    } else {
+        builder->allocator.allocate = allocate_builder_buffer;
+        builder->allocator.free = free_builder_buffer;
+        builder->allocator.context = NULL;
+    }
+    if (reset_camera_metadata_builder(builder, entry_capacity, data_capacity) != OK) {
+        free(builder);
+        return NULL;
+    }
+    return builder;
+}
+
+void free_camera_metadata_builder(camera_metadata_builder_t *builder) {
+    if (builder == NULL) return;
+    builder->allocator.free(builder->allocator.context, builder->metadata, builder->size);
+    free(builder);
+}
+
+camera_metadata_t *get_camera_metadata_builder_metadata(camera_metadata_builder_t *builder) {
+    if (builder == NULL) return NULL;
+    return builder->metadata;
+}
+
+int add_camera_metadata_builder_entry(camera_metadata_builder_t *builder,
+        uint32_t tag,
+        const void *data,
+        size_t data_count) {
+    if (builder == NULL) return ERROR;
+    camera_metadata_t *metadata = builder->metadata;
+    int type = get_local_camera_metadata_tag_type(tag, metadata);
+    if (type == -1) {
+        ALOGE("%s: Unknown tag %04x.", __FUNCTION__, tag);
+        return ERROR;
+    }
+    const size_t data_bytes = calculate_camera_metadata_entry_data_size(type, data_count);
+    if (data_bytes + metadata->data_count < data_bytes) return ERROR;
+    if (grow_camera_metadata_builder(builder, metadata->entry_count + 1,
+            metadata->data_count + data_bytes) != OK) {
+        return ERROR;
+    }
+    return add_camera_metadata_entry_raw(builder->metadata, tag, type, data, data_count);
+}
+
+int append_camera_metadata_builder(camera_metadata_builder_t *builder,
+        const camera_metadata_t *src) {
+    if (builder == NULL || src == NULL) return ERROR;
+    camera_metadata_t *metadata = builder->metadata;
+    if (src->entry_count + metadata->entry_count < src->entry_count) return ERROR;
+    if (src->data_count + metadata->data_count < src->data_count) return ERROR;
+    if (grow_camera_metadata_builder(builder, metadata->entry_count + src->entry_count,
+            metadata->data_count + src->data_count) != OK) {
+        return ERROR;
+    }
+    return append_camera_metadata(builder->metadata, src);
+}
+
+camera_metadata_t *finish_camera_metadata_builder(camera_metadata_builder_t *builder,
+        void *dst,
+        size_t dst_size) {
+    if (builder == NULL) return NULL;
+    camera_metadata_t *metadata = builder->metadata;
+    camera_metadata_t *result = dst != NULL ?
+            copy_camera_metadata(dst, dst_size, metadata) :
+            clone_camera_metadata(metadata);
+    if (result == NULL) return NULL;
+
+    // Keep the grown buffer for the next metadata
+    const metadata_vendor_id_t vendor_id = metadata->vendor_id;
+    place_camera_metadata(metadata, builder->size, metadata->entry_capacity,
+            metadata->data_capacity);
+    metadata->vendor_id = vendor_id;
+    return result;
+}
+
+/**
+ * Size classes of a camera_metadata_pool_t, powers of 2 of the capacities.
+ * Larger capacities are not pooled.
+ */
+#define POOL_MIN_ENTRY_CLASS 4   // 16 entries
+#define POOL_MAX_ENTRY_CLASS 12  // 4096 entries
+#define POOL_MIN_DATA_CLASS  8   // 256 bytes
+#define POOL_MAX_DATA_CLASS  20  // 1 MiB
+#define POOL_ENTRY_CLASS_COUNT (POOL_MAX_ENTRY_CLASS - POOL_MIN_ENTRY_CLASS + 1)
+#define POOL_DATA_CLASS_COUNT  (POOL_MAX_DATA_CLASS - POOL_MIN_DATA_CLASS + 1)
+
+/**
+ * A free buffer of a pool, linked in place of its camera_metadata_t header.
+ */
+typedef struct pooled_buffer {
+    struct pooled_buffer *next;
+} pooled_buffer_t;
+
+/**
+ * The free buffers and counters of one size class. Each class has its own lock,
+ * so that threads using different sizes do not contend, and the counters are
+ * updated under that lock rather than with shared atomics.
+ */
+typedef struct pool_bucket {
+    pthread_mutex_t lock;
+    pooled_buffer_t *head;
+    size_t count;            // of free buffers
+    size_t count_high_water;
+    uint64_t allocations;
+    uint64_t hits;
+    size_t in_use;
+    size_t in_use_high_water;
+} pool_bucket_t;
+
+struct camera_metadata_pool {
+    size_t max_buffers_per_class;
+    pool_bucket_t buckets[POOL_ENTRY_CLASS_COUNT][POOL_DATA_CLASS_COUNT];
+    pool_bucket_t unpooled; // counters of the capacities too large to be pooled
+};
+
+// Returns the smallest class with 1 << class >= capacity, at least min_class.
+static unsigned int get_pool_class(size_t capacity, unsigned int min_class) {
+    unsigned int size_class = min_class;
+    while (((size_t)1 << size_class) < capacity) {
+        ++size_class;
+    }
+    return size_class;
+}
+
+// Returns the bucket of the size classes, or the unpooled bucket if too large.
+static pool_bucket_t *get_pool_bucket(camera_metadata_pool_t *pool,
+        unsigned int entry_class, unsigned int data_class) {
+    if (entry_class > POOL_MAX_ENTRY_CLASS || data_class > POOL_MAX_DATA_CLASS) {
+        return &pool->unpooled;
+    }
+    return &pool->buckets[entry_class - POOL_MIN_ENTRY_CLASS][data_class - POOL_MIN_DATA_CLASS];
+}
+
+static void init_pool_bucket(pool_bucket_t *bucket) {
+    pthread_mutex_init(&bucket->lock, NULL);
+}
+
+static void destroy_pool_bucket(pool_bucket_t *bucket) {
+    while (bucket->head != NULL) {
+        pooled_buffer_t *buffer = bucket->head;
+        bucket->head = buffer->next;
+        free(buffer);
+    }
+    pthread_mutex_destroy(&bucket->lock);
+}
+
+camera_metadata_pool_t *allocate_camera_metadata_pool(size_t max_buffers_per_class) {
+    camera_metadata_pool_t *pool = calloc(1, sizeof(camera_metadata_pool_t));
+    if (pool == NULL) return NULL;
+    pool->max_buffers_per_class = max_buffers_per_class;
+    for (size_t e = 0; e < POOL_ENTRY_CLASS_COUNT; ++e) {
+        for (size_t d = 0; d < POOL_DATA_CLASS_COUNT; ++d) {
+            init_pool_bucket(&pool->buckets[e][d]);
+        }
+    }
+    init_pool_bucket(&pool->unpooled);
+    return pool;
+}
+
+void free_camera_metadata_pool(camera_metadata_pool_t *pool) {
+    if (pool == NULL) return;
+    for (size_t e = 0; e < POOL_ENTRY_CLASS_COUNT; ++e) {
+        for (size_t d = 0; d < POOL_DATA_CLASS_COUNT; ++d) {
+            destroy_pool_bucket(&pool->buckets[e][d]);
+        }
+    }
+    destroy_pool_bucket(&pool->unpooled);
+    free(pool);
+}
+
+camera_metadata_t *allocate_camera_metadata_from_pool(camera_metadata_pool_t *pool,
+        size_t entry_capacity,
+        size_t data_capacity) {
+    if (pool == NULL) return NULL;
+    if (entry_capacity > UINT32_MAX || data_capacity > UINT32_MAX) return NULL;
+    const unsigned int entry_class = get_pool_class(entry_capacity, POOL_MIN_ENTRY_CLASS);
+    const unsigned int data_class = get_pool_class(data_capacity, POOL_MIN_DATA_CLASS);
+    pool_bucket_t *bucket = get_pool_bucket(pool, entry_class, data_class);
+    if (bucket != &pool->unpooled) {
+        entry_capacity = (size_t)1 << entry_class;
+        data_capacity = (size_t)1 << data_class;
+    }
+
+    pthread_mutex_lock(&bucket->lock);
+    pooled_buffer_t *buffer = bucket->head;
+    if (buffer != NULL) {
+        bucket->head = buffer->next;
+        --bucket->count;
+        ++bucket->hits;
+    }
+    ++bucket->allocations;
+    if (++bucket->in_use > bucket->in_use_high_water) {
+        bucket->in_use_high_water = bucket->in_use;
+    }
+    pthread_mutex_unlock(&bucket->lock);
+
+    if (buffer != NULL) {
+        return place_camera_metadata(buffer,
+                calculate_camera_metadata_size(entry_capacity, data_capacity),
+                entry_capacity, data_capacity);
+    }
+    camera_metadata_t *metadata = allocate_camera_metadata(entry_capacity, data_capacity);
+    if (metadata == NULL) {
+        pthread_mutex_lock(&bucket->lock);
+        --bucket->in_use;
+        pthread_mutex_unlock(&bucket->lock);
+    }
+    return metadata;
+}
+
+camera_metadata_t *clone_camera_metadata_from_pool(camera_metadata_pool_t *pool,
+        const camera_metadata_t *src) {
+    if (src == NULL) return NULL;
+    camera_metadata_t *clone = allocate_camera_metadata_from_pool(pool,
+            get_camera_metadata_entry_count(src),
+            get_camera_metadata_data_count(src));
+    if (clone != NULL && append_camera_metadata(clone, src) != OK) {
+        release_camera_metadata_to_pool(pool, clone);
+        clone = NULL;
+    }
+    return clone;
+}
+
+void release_camera_metadata_to_pool(camera_metadata_pool_t *pool,
+        camera_metadata_t *metadata) {
+    if (pool == NULL || metadata == NULL) return;
+    const size_t entry_capacity = metadata->entry_capacity;
+    const size_t data_capacity = metadata->data_capacity;
+    const unsigned int entry_class = get_pool_class(entry_capacity, POOL_MIN_ENTRY_CLASS);
+    const unsigned int data_class = get_pool_class(data_capacity, POOL_MIN_DATA_CLASS);
+    pool_bucket_t *bucket = get_pool_bucket(pool, entry_class, data_class);
+    // Only buffers allocated for a size class are pooled.
+    const bool poolable = bucket != &pool->unpooled &&
+            ((size_t)1 << entry_class) == entry_capacity &&
+            ((size_t)1 << data_class) == data_capacity &&
+            metadata->size == calculate_camera_metadata_size(entry_capacity, data_capacity);
+    if (!poolable && bucket != &pool->unpooled) {
+        // Not from this pool, the counters are unchanged.
+        free_camera_metadata(metadata);
+        return;
+    }
+
+    pooled_buffer_t *buffer = (pooled_buffer_t*)metadata;
+    pthread_mutex_lock(&bucket->lock);
+    if (bucket->in_use != 0) {
+        --bucket->in_use;
+    }
+    const bool pooled = poolable && bucket->count < pool->max_buffers_per_class;
+    if (pooled) {
+        buffer->next = bucket->head;
+        bucket->head = buffer;
+        if (++bucket->count > bucket->count_high_water) {
+            bucket->count_high_water = bucket->count;
+        }
+    }
+    pthread_mutex_unlock(&bucket->lock);
+
+    if (!pooled) {
+        free(buffer);
+    }
+}
+
+// Adds the counters of a bucket with buffers of the given size to stats.
+static void add_pool_bucket_stats(pool_bucket_t *bucket, size_t size,
+        camera_metadata_pool_stats_t *stats) {
+    pthread_mutex_lock(&bucket->lock);
+    stats->allocations += bucket->allocations;
+    stats->hits += bucket->hits;
+    stats->in_use += bucket->in_use;
+    stats->in_use_high_water += bucket->in_use_high_water;
+    stats->pooled_bytes += bucket->count * size;
+    stats->pooled_bytes_high_water += bucket->count_high_water * size;
+    pthread_mutex_unlock(&bucket->lock);
+}
+
+int get_camera_metadata_pool_stats(const camera_metadata_pool_t *pool,
+        camera_metadata_pool_stats_t *stats) {
+    if (pool == NULL || stats == NULL) return ERROR;
+    memset(stats, 0, sizeof(camera_metadata_pool_stats_t));
+    camera_metadata_pool_t *p = (camera_metadata_pool_t*)pool; // for the locks
+    for (unsigned int e = POOL_MIN_ENTRY_CLASS; e <= POOL_MAX_ENTRY_CLASS; ++e) {
+        for (unsigned int d = POOL_MIN_DATA_CLASS; d <= POOL_MAX_DATA_CLASS; ++d) {
+            add_pool_bucket_stats(get_pool_bucket(p, e, d),
+                    calculate_camera_metadata_size((size_t)1 << e, (size_t)1 << d), stats);
+        }
+    }
+    add_pool_bucket_stats(&p->unpooled, 0 /* size */, stats);
+    return OK;
+}
+
+/**
+ * The wire format of a delta between two sorted metadata packets: the header,
+ * the strictly increasing removed tags, then at metadata_start a sorted metadata
+ * packet of the added or changed entries, with strictly increasing tags.
+ */
+struct camera_metadata_delta {
+    uint32_t size;           // of the whole delta
+    uint32_t version;
+    uint32_t removed_count;
+    uint32_t metadata_start; // offset from camera_metadata_delta
+};
+
+#define CURRENT_METADATA_DELTA_VERSION 1
+
+static uint32_t *get_delta_removed_tags(const camera_metadata_delta_t *delta) {
+    return (uint32_t*)((uint8_t*)delta + sizeof(camera_metadata_delta_t));
+}
+
+static camera_metadata_t *get_delta_metadata(const camera_metadata_delta_t *delta) {
+    return (camera_metadata_t*)((uint8_t*)delta + delta->metadata_start);
+}
+
+static size_t calculate_delta_metadata_start(size_t removed_count) {
+    return ALIGN_TO(sizeof(camera_metadata_delta_t) + removed_count * sizeof(uint32_t),
+            METADATA_PACKET_ALIGNMENT);
+}
+
+static const uint8_t *get_entry_data(const camera_metadata_t *metadata,
+        const camera_metadata_buffer_entry_t *entry) {
+    if (calculate_camera_metadata_entry_data_size(entry->type, entry->count) == 0) {
+        return entry->data.value;
+    }
+    return get_data(metadata) + entry->data.offset;
+}
+
+static bool entries_equal(const camera_metadata_t *metadata1,
+        const camera_metadata_buffer_entry_t *entry1,
+        const camera_metadata_t *metadata2,
+        const camera_metadata_buffer_entry_t *entry2) {
+    return entry1->type == entry2->type && entry1->count == entry2->count &&
+            memcmp(get_entry_data(metadata1, entry1), get_entry_data(metadata2, entry2),
+                    entry1->count * camera_metadata_type_size[entry1->type]) == 0;
+}
+
+// Checks that the metadata is sorted with strictly increasing tags, for merging.
+static bool is_sorted_without_duplicates(const camera_metadata_t *metadata) {
+    if (!(metadata->flags & FLAG_SORTED)) return false;
+    const camera_metadata_buffer_entry_t *entries = get_entries(metadata);
+    for (size_t i = 1; i < metadata->entry_count; ++i) {
+        if (entries[i - 1].tag >= entries[i].tag) return false;
+    }
+    return true;
+}
+
+static int add_camera_metadata_buffer_entry(camera_metadata_t *dst,
+        const camera_metadata_t *src,
+        const camera_metadata_buffer_entry_t *entry) {
+    return add_camera_metadata_entry_raw(dst, entry->tag, entry->type,
+            get_entry_data(src, entry), entry->count);
+}
+
+camera_metadata_delta_t *diff_camera_metadata(const camera_metadata_t *old_metadata,
+        const camera_metadata_t *new_metadata) {
+    if (old_metadata == NULL || new_metadata == NULL) return NULL;
+    if (!is_sorted_without_duplicates(old_metadata) ||
+            !is_sorted_without_duplicates(new_metadata)) {
+        ALOGE("%s: Metadata must be sorted without duplicate tags", __FUNCTION__);
+        return NULL;
+    }
+    const camera_metadata_buffer_entry_t *old_entries = get_entries(old_metadata);
+    const camera_metadata_buffer_entry_t *new_entries = get_entries(new_metadata);
+
+    // First merge pass to size the delta
+    size_t removed_count = 0;
+    size_t entry_count = 0;
+    size_t data_count = 0;
+    size_t i = 0;
+    size_t j = 0;
+    while (i < old_metadata->entry_count || j < new_metadata->entry_count) {
+        if (j == new_metadata->entry_count ||
+                (i < old_metadata->entry_count && old_entries[i].tag < new_entries[j].tag)) {
+            ++removed_count;
+            ++i;
+            continue;
+        }
+        if (i == old_metadata->entry_count || new_entries[j].tag < old_entries[i].tag ||
+                !entries_equal(old_metadata, old_entries + i, new_metadata, new_entries + j)) {
+            ++entry_count;
+            data_count += calculate_camera_metadata_entry_data_size(new_entries[j].type,
+                    new_entries[j].count);
+        }
+        if (i < old_metadata->entry_count && old_entries[i].tag == new_entries[j].tag) ++i;
+        ++j;
+    }
+
+    const size_t metadata_start = calculate_delta_metadata_start(removed_count);
+    const size_t metadata_size = calculate_camera_metadata_size(entry_count, data_count);
+    const size_t size = metadata_start + metadata_size;
+    if (size > UINT32_MAX) return NULL;
+    camera_metadata_delta_t *delta = calloc(1, size);
+    if (delta == NULL) return NULL;
+    delta->size = size;
+    delta->version = CURRENT_METADATA_DELTA_VERSION;
+    delta->removed_count = removed_count;
+    delta->metadata_start = metadata_start;
+    camera_metadata_t *metadata = place_camera_metadata(get_delta_metadata(delta),
+            metadata_size, entry_count, data_count);
+    metadata->vendor_id = new_metadata->vendor_id;
+
+    // Second merge pass to fill it, in tag order
+    uint32_t *removed_tags = get_delta_removed_tags(delta);
+    i = 0;
+    j = 0;
+    while (i < old_metadata->entry_count || j < new_metadata->entry_count) {
+        if (j == new_metadata->entry_count ||
+                (i < old_metadata->entry_count && old_entries[i].tag < new_entries[j].tag)) {
+            *removed_tags++ = old_entries[i].tag;
+            ++i;
+            continue;
+        }
+        if (i == old_metadata->entry_count || new_entries[j].tag < old_entries[i].tag ||
+                !entries_equal(old_metadata, old_entries + i, new_metadata, new_entries + j)) {
+            add_camera_metadata_buffer_entry(metadata, new_metadata, new_entries + j);
+        }
+        if (i < old_metadata->entry_count && old_entries[i].tag == new_entries[j].tag) ++i;
+        ++j;
+    }
+    metadata->flags |= FLAG_SORTED;
+
+    assert(validate_camera_metadata_delta(delta, NULL) == OK);
+    return delta;
+}
+
+void free_camera_metadata_delta(camera_metadata_delta_t *delta) {
+    free(delta);
+}
+
+size_t get_camera_metadata_delta_size(const camera_metadata_delta_t *delta) {
+    if (delta == NULL) return 0;
+    return delta->size;
+}
+
+int validate_camera_metadata_delta(const camera_metadata_delta_t *delta,
+        const size_t *expected_size) {
+    if (delta == NULL) {
+        ALOGE("%s: delta is null!", __FUNCTION__);
+        return CAMERA_METADATA_VALIDATION_ERROR;
+    }
+    if ((uintptr_t)delta % METADATA_PACKET_ALIGNMENT != 0) {
+        ALOGE("%s: Delta pointer %p is not aligned to %zu", __FUNCTION__, delta,
+                (size_t)METADATA_PACKET_ALIGNMENT);
+        return CAMERA_METADATA_VALIDATION_ERROR;
+    }
+    if (expected_size != NULL && *expected_size < sizeof(camera_metadata_delta_t)) {
+        ALOGE("%s: Expected size (%zu) should be >= delta header size (%zu)", __FUNCTION__,
+                *expected_size, sizeof(camera_metadata_delta_t));
+        return CAMERA_METADATA_VALIDATION_ERROR;
+    }
+    if (expected_size != NULL && delta->size > *expected_size) {
+        ALOGE("%s: Delta size (%" PRIu32 ") should be <= expected size (%zu)",
+                __FUNCTION__, delta->size, *expected_size);
+        return CAMERA_METADATA_VALIDATION_ERROR;
+    }
+    if (delta->version != CURRENT_METADATA_DELTA_VERSION) {
+        ALOGE("%s: Delta version (%" PRIu32 ") is not supported", __FUNCTION__,
+                delta->version);
+        return CAMERA_METADATA_VALIDATION_ERROR;
+    }
+    if ((uint64_t)delta->removed_count * sizeof(uint32_t) > delta->size ||
+            delta->metadata_start != calculate_delta_metadata_start(delta->removed_count) ||
+            delta->metadata_start > delta->size) {
+        ALOGE("%s: Delta metadata start (%" PRIu32 ") is invalid for %" PRIu32
+                " removed tags and size %" PRIu32, __FUNCTION__, delta->metadata_start,
+                delta->removed_count, delta->size);
+        return CAMERA_METADATA_VALIDATION_ERROR;
+    }
+    const uint32_t *removed_tags = get_delta_removed_tags(delta);
+    for (size_t i = 1; i < delta->removed_count; ++i) {
+        if (removed_tags[i - 1] >= removed_tags[i]) {
+            ALOGE("%s: Removed tags are not strictly increasing at %zu", __FUNCTION__, i);
+            return CAMERA_METADATA_VALIDATION_ERROR;
+        }
+    }
+
+    const camera_metadata_t *metadata = get_delta_metadata(delta);
+    const size_t metadata_size = delta->size - delta->metadata_start;
+    if (metadata_size < sizeof(camera_metadata_t)) {
+        ALOGE("%s: Delta metadata size (%zu) is too small", __FUNCTION__, metadata_size);
+        return CAMERA_METADATA_VALIDATION_ERROR;
+    }
+    int res = validate_camera_metadata_structure(metadata, &metadata_size);
+    if (res != OK) return res;
+    if (!is_sorted_without_duplicates(metadata)) {
+        ALOGE("%s: Delta metadata is not sorted with strictly increasing tags", __FUNCTION__);
+        return CAMERA_METADATA_VALIDATION_ERROR;
+    }
+    // A tag is either removed or set
+    const camera_metadata_buffer_entry_t *entries = get_entries(metadata);
+    size_t i = 0;
+    size_t j = 0;
+    while (i < delta->removed_count && j < metadata->entry_count) {
+        if (removed_tags[i] == entries[j].tag) {
+            ALOGE("%s: Tag 0x%x is both removed and set", __FUNCTION__, removed_tags[i]);
+            return CAMERA_METADATA_VALIDATION_ERROR;
+        }
+        if (removed_tags[i] < entries[j].tag) {
+            ++i;
+        } else {
+            ++j;
+        }
+    }
+    return OK;
+}
+
+camera_metadata_t *apply_camera_metadata_delta(const camera_metadata_t *base,
+        const camera_metadata_delta_t *delta) {
+    if (base == NULL || delta == NULL) return NULL;
+    if (validate_camera_metadata_delta(delta, NULL) != OK) return NULL;
+    if (!is_sorted_without_duplicates(base)) {
+        ALOGE("%s: Metadata must be sorted without duplicate tags", __FUNCTION__);
+        return NULL;
+    }
+    const uint32_t *removed_tags = get_delta_removed_tags(delta);
+    const camera_metadata_t *metadata = get_delta_metadata(delta);
+    const camera_metadata_buffer_entry_t *base_entries = get_entries(base);
+    const camera_metadata_buffer_entry_t *delta_entries = get_entries(metadata);
+
+    // First merge pass to size the result, and check that the delta matches base
+    size_t entry_count = 0;
+    size_t data_count = 0;
+    size_t removed = 0;
+    size_t i = 0;
+    size_t j = 0;
+    while (i < base->entry_count || j < metadata->entry_count) {
+        const camera_metadata_buffer_entry_t *entry;
+        if (j == metadata->entry_count ||
+                (i < base->entry_count && base_entries[i].tag < delta_entries[j].tag)) {
+            entry = base_entries + i++;
+            if (removed < delta->removed_count && removed_tags[removed] <= entry->tag) {
+                if (removed_tags[removed] != entry->tag) break; // not in base
+                ++removed;
+                continue;
+            }
+        } else {
+            if (i < base->entry_count && base_entries[i].tag == delta_entries[j].tag) ++i;
+            entry = delta_entries + j++;
+        }
+        ++entry_count;
+        data_count += calculate_camera_metadata_entry_data_size(entry->type, entry->count);
+    }
+    if (removed != delta->removed_count) {
+        ALOGE("%s: Delta removes tags not in base", __FUNCTION__);
+        return NULL;
+    }
+
+    camera_metadata_t *result = allocate_camera_metadata(entry_count, data_count);
+    if (result == NULL) return NULL;
+    result->vendor_id = metadata->vendor_id != CAMERA_METADATA_INVALID_VENDOR_ID ?
+            metadata->vendor_id : base->vendor_id;
+
+    // Second merge pass to fill it, in tag order
+    removed = 0;
+    i = 0;
+    j = 0;
+    while (i < base->entry_count || j < metadata->entry_count) {
+        if (j == metadata->entry_count ||
+                (i < base->entry_count && base_entries[i].tag < delta_entries[j].tag)) {
+            const camera_metadata_buffer_entry_t *entry = base_entries + i++;
+            if (removed < delta->removed_count && removed_tags[removed] == entry->tag) {
+                ++removed;
+                continue;
+            }
+            add_camera_metadata_buffer_entry(result, base, entry);
+        } else {
+            if (i < base->entry_count && base_entries[i].tag == delta_entries[j].tag) ++i;
+            add_camera_metadata_buffer_entry(result, metadata, delta_entries + j++);
+        }
+    }
+    result->flags |= FLAG_SORTED;
+
+    assert(validate_camera_metadata_structure(result, NULL) == OK);
+    return result;
+}
+
+int write_camera_metadata_file(int fd, const camera_metadata_t *src) {
+    if (src == NULL) return ERROR;
+
+    // The clone is compacted, without a tag index.
+    camera_metadata_t *metadata = clone_camera_metadata(src);
+    if (metadata == NULL || sort_camera_metadata(metadata) != OK) {
+        free_camera_metadata(metadata);
+        return ERROR;
+    }
+
+    int res = OK;
+    if (ftruncate(fd, 0) != 0) {
+        ALOGE("%s: Cannot truncate the file: %s", __FUNCTION__, strerror(errno));
+        res = ERROR;
+    }
+    const uint8_t *bytes = (const uint8_t*)metadata;
+    size_t written = 0;
+    while (res == OK && written < metadata->size) {
+        ssize_t count = pwrite(fd, bytes + written, metadata->size - written, written);
+        if (count < 0 && errno == EINTR) continue;
+        if (count <= 0) {
+            ALOGE("%s: Cannot write the file: %s", __FUNCTION__,
+                    count < 0 ? strerror(errno) : "no space");
+            res = ERROR;
+        } else {
+            written += count;
+        }
+    }
+    free_camera_metadata(metadata);
+    return res;
+}
+
+const camera_metadata_t *map_camera_metadata_file(int fd) {
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) != 0) {
+        ALOGE("%s: Cannot stat the file: %s", __FUNCTION__, strerror(errno));
+        return NULL;
+    }
+    if (file_stat.st_size < (off_t)sizeof(camera_metadata_t) ||
+            (uint64_t)file_stat.st_size > UINT32_MAX) {
+        ALOGE("%s: File size %" PRId64 " is not a metadata size", __FUNCTION__,
+                (int64_t)file_stat.st_size);
+        return NULL;
+    }
+    const size_t size = file_stat.st_size;
+    void *mapped = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    if (mapped == MAP_FAILED) {
+        ALOGE("%s: Cannot map the file: %s", __FUNCTION__, strerror(errno));
+        return NULL;
+    }
+
+    const camera_metadata_t *metadata = (const camera_metadata_t*)mapped;
+    // The mapping is page aligned, the packet cannot be shifted.
+    if (validate_camera_metadata_structure(metadata, &size) != OK) {
+        munmap(mapped, size);
+        return NULL;
+    }
+    if (metadata->size != size) {
+        // unmap_camera_metadata_file() unmaps the packet size
+        ALOGE("%s: File size %zu is not the metadata size %" PRIu32, __FUNCTION__, size,
+                metadata->size);
+        munmap(mapped, size);
+        return NULL;
+    }
+    return metadata;
+}
+
+void unmap_camera_metadata_file(const camera_metadata_t *metadata) {
+    if (metadata == NULL) return;
+    munmap((void*)metadata, metadata->size);
+}
+
+static const vendor_tag_ops_t *vendor_tag_ops = NULL;
+static const struct vendor_tag_cache_ops *vendor_cache_ops = NULL;
+
+/**
+ * Perfect hash of 64-bit key hashes, by hash and displace: the keys are split
+ * in buckets, and the keys of each bucket are placed with the first seed
+ * mapping them all to free slots. A lookup is a bucket and a slot calculation,
+ * and the key found at the slot must still be compared with the looked up one.
+ */
+typedef struct perfect_hash {
+    uint32_t bucket_mask;
+    uint32_t slot_mask;
+    uint32_t *seeds; // per bucket
+    uint32_t *slots; // key index, or PERFECT_HASH_EMPTY_SLOT
+} perfect_hash_t;
+
+#define PERFECT_HASH_EMPTY_SLOT UINT32_MAX
+#define PERFECT_HASH_MAX_SEED 0x10000
+#define TAG_NAME_HASH_START 0xCBF29CE484222325ULL
+
+static uint64_t mix_hash(uint64_t hash) {
+    hash = (hash ^ (hash >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    hash = (hash ^ (hash >> 27)) * 0x94D049BB133111EBULL;
+    return hash ^ (hash >> 31);
+}
+
+static uint64_t hash_tag(uint32_t tag) {
+    return mix_hash(tag);
+}
+
+// FNV-1a of the bytes of the string.
+static uint64_t hash_string(uint64_t hash, const char *string) {
+    for (; *string != '\0'; ++string) {
+        hash = (hash ^ (uint8_t)*string) * 0x100000001B3ULL;
+    }
+    return hash;
+}
+
+// Hash of the full tag name "<section name>.<tag name>".
+static uint64_t hash_tag_name(const char *section_name, const char *tag_name) {
+    uint64_t hash = hash_string(TAG_NAME_HASH_START, section_name);
+    hash = hash_string(hash, ".");
+    return mix_hash(hash_string(hash, tag_name));
+}
+
+static uint32_t get_perfect_hash_slot(const perfect_hash_t *hash, uint64_t key) {
+    const uint64_t seed = hash->seeds[(key >> 32) & hash->bucket_mask];
+    return (uint32_t)mix_hash(key + seed * 0x9E3779B97F4A7C15ULL) & hash->slot_mask;
+}
+
+// Returns the index of the only key which can be key, or PERFECT_HASH_EMPTY_SLOT.
+static uint32_t find_perfect_hash(const perfect_hash_t *hash, uint64_t key) {
+    return hash->slots[get_perfect_hash_slot(hash, key)];
+}
+
+static void free_perfect_hash(perfect_hash_t *hash) {
+    free(hash->seeds);
+    free(hash->slots);
+    hash->seeds = NULL;
+    hash->slots = NULL;
+}
+
+static uint32_t round_up_to_power_of_2(size_t value) {
+    uint32_t power = 1;
+    while (power < value) power <<= 1;
+    return power;
+}
+
+/**
+ * Builds the perfect hash of the keys, with 4 keys per bucket and 80% of the
+ * slots used on average. The largest buckets are placed first. Fails if two
+ * keys are equal, or on allocation failure.
+ */
+static bool build_perfect_hash(perfect_hash_t *hash, const uint64_t *keys, size_t key_count) {
+    if (key_count >= PERFECT_HASH_EMPTY_SLOT / 2) return false;
+    const uint32_t bucket_count = round_up_to_power_of_2(key_count / 4 + 1);
+    const uint32_t slot_count = round_up_to_power_of_2(key_count + key_count / 4 + 1);
+    hash->bucket_mask = bucket_count - 1;
+    hash->slot_mask = slot_count - 1;
+    hash->seeds = calloc(bucket_count, sizeof(uint32_t));
+    hash->slots = malloc(sizeof(uint32_t[slot_count]));
+    // The key indices grouped by bucket, from bucket_starts[bucket] to
+    // bucket_starts[bucket + 1], and the buckets by decreasing key count.
+    uint32_t *bucket_starts = calloc(bucket_count + 1, sizeof(uint32_t));
+    uint32_t *bucket_keys = malloc(sizeof(uint32_t[key_count + 1]));
+    uint32_t *buckets = malloc(sizeof(uint32_t[bucket_count]));
+    bool built = hash->seeds != NULL && hash->slots != NULL && bucket_starts != NULL &&
+            bucket_keys != NULL && buckets != NULL;
+    if (built) {
+        for (size_t i = 0; i < slot_count; ++i) {
+            hash->slots[i] = PERFECT_HASH_EMPTY_SLOT;
+        }
+        for (size_t i = 0; i < key_count; ++i) {
+            ++bucket_starts[((keys[i] >> 32) & hash->bucket_mask) + 1];
+        }
+        for (size_t i = 0; i < bucket_count; ++i) {
+            bucket_starts[i + 1] += bucket_starts[i];
+        }
+        uint32_t *bucket_ends = buckets; // until sorting the buckets
+        memcpy(bucket_ends, bucket_starts, sizeof(uint32_t[bucket_count]));
+        for (size_t i = 0; i < key_count; ++i) {
+            bucket_keys[bucket_ends[(keys[i] >> 32) & hash->bucket_mask]++] = i;
+        }
+        for (uint32_t i = 0; i < bucket_count; ++i) {
+            const uint32_t size = bucket_starts[i + 1] - bucket_starts[i];
+            size_t j = i;
+            for (; j > 0 &&
+                    bucket_starts[buckets[j - 1] + 1] - bucket_starts[buckets[j - 1]] < size;
+                    --j) {
+                buckets[j] = buckets[j - 1];
+            }
+            buckets[j] = i;
+        }
+    }
+    for (uint32_t i = 0; built && i < bucket_count; ++i) {
+        const uint32_t bucket = buckets[i];
+        const uint32_t *first = bucket_keys + bucket_starts[bucket];
+        const uint32_t *last = bucket_keys + bucket_starts[bucket + 1];
+        if (first == last) break; // the remaining buckets are empty too
+        built = false;
+        for (uint32_t seed = 0; seed < PERFECT_HASH_MAX_SEED && !built; ++seed) {
+            hash->seeds[bucket] = seed;
+            const uint32_t *key = first;
+            for (; key != last; ++key) {
+                uint32_t *slot = hash->slots + get_perfect_hash_slot(hash, keys[*key]);
+                if (*slot != PERFECT_HASH_EMPTY_SLOT) break;
+                *slot = *key;
+            }
+            built = key == last;
+            while (!built && key != first) {
+                // A slot was taken by another bucket, or this one: undo
+                --key;
+                hash->slots[get_perfect_hash_slot(hash, keys[*key])] = PERFECT_HASH_EMPTY_SLOT;
+            }
+        }
+    }
+    free(bucket_starts);
+    free(bucket_keys);
+    free(buckets);
+    if (!built) {
+        free_perfect_hash(hash);
+    }
+    return built;
+}
+
+/**
+ * Flat table of tags, found by tag or by full name with perfect hashes. All
+ * the android tags are in one table, built on the first lookup by name. The
+ * vendor tags have a table per vendor tag source, built on their first lookup
+ * from the vendor tag ops, or from the vendor tag cache ops for a vendor id.
+ */
+typedef struct tag_table_entry {
+    uint32_t tag;
+    int tag_type;
+    const char *section_name;
+    const char *tag_name;
+} tag_table_entry_t;
+
+typedef struct tag_table {
+    // The source of vendor tags
+    uint32_t vendor_generation;
+    metadata_vendor_id_t vendor_id;
+    bool built; // or failed, lookups go to the vendor tag ops
+    size_t tag_count;
+    tag_table_entry_t *tags;
+    perfect_hash_t tag_hash;
+    perfect_hash_t name_hash;
+    struct tag_table *next;
+} tag_table_t;
+
+static pthread_once_t android_tag_table_once = PTHREAD_ONCE_INIT;
+static tag_table_t android_tag_table;
+
+// The vendor tag tables, published with atomic stores of the list head, and
+// built under the lock. The tables of previous vendor tag ops are never freed,
+// since concurrent lookups may still use them.
+static tag_table_t *vendor_tag_tables = NULL;
+static uint32_t vendor_tag_generation = 0;
+static pthread_mutex_t vendor_tag_tables_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Builds the hashes of a table holding its tags, which must have names.
+static bool build_tag_table_hashes(tag_table_t *table) {
+    if (table->tag_count == 0) return false;
+    uint64_t *keys = malloc(sizeof(uint64_t[table->tag_count]));
+    if (keys == NULL) return false;
+    bool built;
+    for (size_t i = 0; i < table->tag_count; ++i) {
+        keys[i] = hash_tag(table->tags[i].tag);
+    }
+    built = build_perfect_hash(&table->tag_hash, keys, table->tag_count);
+    for (size_t i = 0; i < table->tag_count; ++i) {
+        keys[i] = hash_tag_name(table->tags[i].section_name, table->tags[i].tag_name);
+    }
+    // Failing for a duplicate name, or a 64-bit hash collision
+    built = built && build_perfect_hash(&table->name_hash, keys, table->tag_count);
+    free(keys);
+    if (!built) {
+        free_perfect_hash(&table->tag_hash);
+    }
+    return built;
+}
+
+static void build_android_tag_table(void) {
+    size_t tag_count = 0;
+    for (uint32_t section = 0; section < ANDROID_SECTION_COUNT; ++section) {
+        tag_count += camera_metadata_section_bounds[section][1] -
+                camera_metadata_section_bounds[section][0];
+    }
+    tag_table_t *table = &android_tag_table;
+    table->tags = malloc(sizeof(tag_table_entry_t[tag_count + 1]));
+    if (table->tags == NULL) return;
+    for (uint32_t section = 0; section < ANDROID_SECTION_COUNT; ++section) {
+        for (uint32_t tag = camera_metadata_section_bounds[section][0];
+                tag < camera_metadata_section_bounds[section][1]; ++tag) {
+            const tag_info_t *info = &tag_info[section][tag & 0xFFFF];
+            if (info->tag_name == NULL) continue;
+            table->tags[table->tag_count++] = (tag_table_entry_t) {
+                .tag = tag,
+                .tag_type = info->tag_type,
+                .section_name = camera_metadata_section_names[section],
+                .tag_name = info->tag_name
+            };
+        }
+    }
+    table->built = build_tag_table_hashes(table);
+}
+
+static tag_table_t *build_vendor_tag_table(metadata_vendor_id_t id) {
+    tag_table_t *table = calloc(1, sizeof(tag_table_t));
+    if (table == NULL) return NULL;
+    table->vendor_generation = vendor_tag_generation;
+    table->vendor_id = id;
+    const bool cached = id != CAMERA_METADATA_INVALID_VENDOR_ID;
+    const int tag_count = cached ? vendor_cache_ops->get_tag_count(id) :
+            vendor_tag_ops->get_tag_count(vendor_tag_ops);
+    uint32_t *tags = tag_count > 0 ? malloc(sizeof(uint32_t[tag_count])) : NULL;
+    table->tags = tag_count > 0 ? malloc(sizeof(tag_table_entry_t[tag_count])) : NULL;
+    if (tags != NULL && table->tags != NULL) {
+        if (cached) {
+            vendor_cache_ops->get_all_tags(tags, id);
+        } else {
+            vendor_tag_ops->get_all_tags(vendor_tag_ops, tags);
+        }
+        for (int i = 0; i < tag_count; ++i) {
+            tag_table_entry_t *entry = table->tags + table->tag_count;
+            entry->tag = tags[i];
+            if (cached) {
+                entry->tag_type = vendor_cache_ops->get_tag_type(tags[i], id);
+                entry->section_name = vendor_cache_ops->get_section_name(tags[i], id);
+                entry->tag_name = vendor_cache_ops->get_tag_name(tags[i], id);
+            } else {
+                entry->tag_type = vendor_tag_ops->get_tag_type(vendor_tag_ops, tags[i]);
+                entry->section_name = vendor_tag_ops->get_section_name(vendor_tag_ops, tags[i]);
+                entry->tag_name = vendor_tag_ops->get_tag_name(vendor_tag_ops, tags[i]);
+            }
+            // The tags missing a name are left to the vendor tag ops
+            if (entry->section_name != NULL && entry->tag_name != NULL) {
+                ++table->tag_count;
+            }
+        }
+        table->built = build_tag_table_hashes(table);
+    }
+    free(tags);
+    if (!table->built) {
+        ALOGW("%s: Vendor tags of vendor id %" PRIu64 " are not cached, tag count %d",
+              __FUNCTION__, id, tag_count);
+        free(table->tags);
+        table->tags = NULL;
+        table->tag_count = 0;
+    }
+    return table;
+}
+
+/**
+ * Returns the table of the vendor tags of the vendor id, or of the vendor tag
+ * ops for CAMERA_METADATA_INVALID_VENDOR_ID. Returns NULL if there are no such
+ * vendor tags, or if they could not be cached.
+ */
+static const tag_table_t *get_vendor_tag_table(metadata_vendor_id_t id) {
+    if (vendor_cache_ops == NULL || id == CAMERA_METADATA_INVALID_VENDOR_ID) {
+        if (vendor_tag_ops == NULL) return NULL;
+        id = CAMERA_METADATA_INVALID_VENDOR_ID;
+    }
+    const uint32_t generation = __atomic_load_n(&vendor_tag_generation, __ATOMIC_ACQUIRE);
+    for (const tag_table_t *table = __atomic_load_n(&vendor_tag_tables, __ATOMIC_ACQUIRE);
+            table != NULL; table = table->next) {
+        if (table->vendor_id == id && table->vendor_generation == generation) {
+            return table->built ? table : NULL;
+        }
+    }
+
+    pthread_mutex_lock(&vendor_tag_tables_lock);
+    tag_table_t *table = vendor_tag_tables;
+    for (; table != NULL; table = table->next) {
+        if (table->vendor_id == id && table->vendor_generation == vendor_tag_generation) break;
+    }
+    if (table == NULL && (id == CAMERA_METADATA_INVALID_VENDOR_ID ? vendor_tag_ops != NULL :
+            vendor_cache_ops != NULL)) {
+        table = build_vendor_tag_table(id);
+        if (table != NULL) {
+            table->next = vendor_tag_tables;
+            __atomic_store_n(&vendor_tag_tables, table, __ATOMIC_RELEASE);
+        }
+    }
+    pthread_mutex_unlock(&vendor_tag_tables_lock);
+    return table != NULL && table->built ? table : NULL;
+}
+
+static const tag_table_entry_t *find_tag_table_entry(const tag_table_t *table, uint32_t tag) {
+    const uint32_t index = find_perfect_hash(&table->tag_hash, hash_tag(tag));
+    if (index == PERFECT_HASH_EMPTY_SLOT || table->tags[index].tag != tag) return NULL;
+    return table->tags + index;
+}
+
+// Returns the vendor tag entry, or NULL if the vendor tag ops must be used.
+static const tag_table_entry_t *find_vendor_tag_entry(uint32_t tag, metadata_vendor_id_t id) {
+    const tag_table_t *table = get_vendor_tag_table(id);
+    return table != NULL ? find_tag_table_entry(table, tag) : NULL;
+}
+
+static bool is_full_tag_name(const char *name, const tag_table_entry_t *entry) {
+    const size_t section_length = strlen(entry->section_name);
+    return strncmp(name, entry->section_name, section_length) == 0 &&
+            name[section_length] == '.' &&
+            strcmp(name + section_length + 1, entry->tag_name) == 0;
+}
+
+static const tag_table_entry_t *find_tag_table_entry_by_name(const tag_table_t *table,
+        const char *name, uint64_t key) {
+    const uint32_t index = find_perfect_hash(&table->name_hash, key);
+    if (index == PERFECT_HASH_EMPTY_SLOT || !is_full_tag_name(name, table->tags + index)) {
+        return NULL;
+    }
+    return table->tags + index;
+}
+
+// Declared in system/media/private/camera/include/camera_metadata_hidden.h
+int get_local_camera_metadata_tag_from_name_vendor_id(const char *name,
+        metadata_vendor_id_t id, uint32_t *tag) {
+    if (name == NULL || tag == NULL) return ERROR;
+
+    pthread_once(&android_tag_table_once, build_android_tag_table);
+    const uint64_t key = mix_hash(hash_string(TAG_NAME_HASH_START, name));
+    const tag_table_entry_t *entry = NULL;
+    if (android_tag_table.built) {
+        entry = find_tag_table_entry_by_name(&android_tag_table, name, key);
+    } else {
+        for (size_t i = 0; i < android_tag_table.tag_count && entry == NULL; ++i) {
+            if (is_full_tag_name(name, android_tag_table.tags + i)) {
+                entry = android_tag_table.tags + i;
+            }
+        }
+    }
+    if (entry == NULL) {
+        const tag_table_t *table = get_vendor_tag_table(id);
+        if (table != NULL) {
+            entry = find_tag_table_entry_by_name(table, name, key);
+        }
+    }
+    if (entry == NULL) return NOT_FOUND;
+    *tag = entry->tag;
+    return OK;
+}
+
+// Declared in system/media/private/camera/include/camera_metadata_hidden.h
+const char *get_local_camera_metadata_section_name_vendor_id(uint32_t tag,
+        metadata_vendor_id_t id) {
+    uint32_t tag_section = tag >> 16;
+    const tag_table_entry_t *entry =
+            tag_section >= VENDOR_SECTION ? find_vendor_tag_entry(tag, id) : NULL;
+    if (entry != NULL) {
+        return entry->section_name;
+    }
     if (tag_section >= VENDOR_SECTION && vendor_cache_ops != NULL &&
                id != CAMERA_METADATA_INVALID_VENDOR_ID) {
            return vendor_cache_ops->get_section_name(tag, id);
@@ -954,6 +2718,11 @@ const char *get_local_camera_metadata_section_name_vendor_id(uint32_t tag,
 const char *get_local_camera_metadata_tag_name_vendor_id(uint32_t tag,
         metadata_vendor_id_t id) {
     uint32_t tag_section = tag >> 16;
+    const tag_table_entry_t *entry =
+            tag_section >= VENDOR_SECTION ? find_vendor_tag_entry(tag, id) : NULL;
+    if (entry != NULL) {
+        return entry->tag_name;
+    }
     if (tag_section >= VENDOR_SECTION && vendor_cache_ops != NULL &&
                 id != CAMERA_METADATA_INVALID_VENDOR_ID) {
             return vendor_cache_ops->get_tag_name(tag, id);
@@ -974,6 +2743,11 @@ const char *get_local_camera_metadata_tag_name_vendor_id(uint32_t tag,
 int get_local_camera_metadata_tag_type_vendor_id(uint32_t tag,
         metadata_vendor_id_t id) {
     uint32_t tag_section = tag >> 16;
+    const tag_table_entry_t *entry =
+            tag_section >= VENDOR_SECTION ? find_vendor_tag_entry(tag, id) : NULL;
+    if (entry != NULL) {
+        return entry->tag_type;
+    }
     if (tag_section >= VENDOR_SECTION && vendor_cache_ops != NULL &&
                 id != CAMERA_METADATA_INVALID_VENDOR_ID) {
             return vendor_cache_ops->get_tag_type(tag, id);
@@ -1026,6 +2800,18 @@ int get_local_camera_metadata_tag_type(uint32_t tag,
     return get_local_camera_metadata_tag_type_vendor_id(tag, id);
 }
 
+int get_camera_metadata_tag_from_name(const char *name, uint32_t *tag) {
+    return get_local_camera_metadata_tag_from_name(name, NULL, tag);
+}
+
+int get_local_camera_metadata_tag_from_name(const char *name,
+        const camera_metadata_t *meta, uint32_t *tag) {
+    metadata_vendor_id_t id = (NULL == meta) ? CAMERA_METADATA_INVALID_VENDOR_ID :
+            meta->vendor_id;
+
+    return get_local_camera_metadata_tag_from_name_vendor_id(name, id, tag);
+}
+
 const int32_t *get_camera_metadata_permission_needed(uint32_t *tag_count) {
     if (NULL == tag_count) {
         return NULL;
@@ -1044,14 +2830,20 @@ int set_camera_metadata_vendor_tag_ops(const vendor_tag_query_ops_t* ops) {
 
 // Declared in system/media/private/camera/include/camera_metadata_hidden.h
 int set_camera_metadata_vendor_ops(const vendor_tag_ops_t* ops) {
+    pthread_mutex_lock(&vendor_tag_tables_lock);
     vendor_tag_ops = ops;
+    __atomic_add_fetch(&vendor_tag_generation, 1, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&vendor_tag_tables_lock);
     return OK;
 }
 
 // Declared in system/media/private/camera/include/camera_metadata_hidden.h
 int set_camera_metadata_vendor_cache_ops(
         const struct vendor_tag_cache_ops *query_cache_ops) {
+    pthread_mutex_lock(&vendor_tag_tables_lock);
     vendor_cache_ops = query_cache_ops;
+    __atomic_add_fetch(&vendor_tag_generation, 1, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&vendor_tag_tables_lock);
     return OK;
 }
 
@@ -18,9 +18,12 @@
 #define LOG_TAG "camera_metadata_tests"
 
 #include <errno.h>
+#include <unistd.h>
 
 #include <vector>
 #include <algorithm>
+#include <string>
+#include <thread>
 
 #include <gtest/gtest.h>
 #include <log/log.h>
@@ -873,6 +876,63 @@ TEST(camera_metadata, vendor_tags) {
     FINISH_USING_CAMERA_METADATA(m);
 }
 
+TEST(camera_metadata, tag_from_name) {
+    for (unsigned int section = 0; section < ANDROID_SECTION_COUNT; ++section) {
+        for (uint32_t tag = camera_metadata_section_bounds[section][0];
+                tag < camera_metadata_section_bounds[section][1]; ++tag) {
+            const char *tag_name = get_camera_metadata_tag_name(tag);
+            if (tag_name == NULL) continue;
+            std::string name = std::string(camera_metadata_section_names[section]) + "." +
+                    tag_name;
+            uint32_t found_tag = 0;
+            EXPECT_EQ(OK, get_camera_metadata_tag_from_name(name.c_str(), &found_tag)) << name;
+            EXPECT_EQ(tag, found_tag) << name;
+        }
+    }
+
+    uint32_t tag = 0;
+    EXPECT_EQ(NOT_FOUND, get_camera_metadata_tag_from_name("", &tag));
+    EXPECT_EQ(NOT_FOUND, get_camera_metadata_tag_from_name("android.sensor", &tag));
+    EXPECT_EQ(NOT_FOUND, get_camera_metadata_tag_from_name("android.sensor.", &tag));
+    EXPECT_EQ(NOT_FOUND, get_camera_metadata_tag_from_name("exposureTime", &tag));
+    EXPECT_EQ(NOT_FOUND, get_camera_metadata_tag_from_name("android.sensor.exposureTim", &tag));
+    EXPECT_EQ(NOT_FOUND, get_camera_metadata_tag_from_name("android.sensor.exposureTimes", &tag));
+    EXPECT_EQ(NOT_FOUND, get_camera_metadata_tag_from_name("android.lens.exposureTime", &tag));
+    EXPECT_EQ(ERROR, get_camera_metadata_tag_from_name(NULL, &tag));
+    EXPECT_EQ(ERROR, get_camera_metadata_tag_from_name("android.sensor.exposureTime", NULL));
+
+    // Vendor tags, cached from the vendor tag ops
+    const char *vendor_name = "com.fakevendor.sensor.info.availableSuperModes";
+    EXPECT_EQ(NOT_FOUND, get_camera_metadata_tag_from_name(vendor_name, &tag));
+
+    set_camera_metadata_vendor_ops(&fakevendor_ops);
+    EXPECT_EQ(OK, get_camera_metadata_tag_from_name(vendor_name, &tag));
+    EXPECT_EQ((uint32_t)FAKEVENDOR_SENSOR_AVAILABLE_SUPERMODES, tag);
+    EXPECT_EQ(OK, get_camera_metadata_tag_from_name("com.fakevendor.scaler.downscaleMode", &tag));
+    EXPECT_EQ((uint32_t)FAKEVENDOR_SCALER_DOWNSCALE_MODE, tag);
+    EXPECT_EQ(NOT_FOUND, get_camera_metadata_tag_from_name("com.fakevendor.sensor.info", &tag));
+    EXPECT_EQ(OK, get_camera_metadata_tag_from_name("android.sensor.exposureTime", &tag));
+    EXPECT_EQ((uint32_t)ANDROID_SENSOR_EXPOSURE_TIME, tag);
+
+    for (int section = 0; section < FAKEVENDOR_SECTION_COUNT; ++section) {
+        for (uint32_t vendor_tag = fakevendor_section_bounds[section][0];
+                vendor_tag < fakevendor_section_bounds[section][1]; ++vendor_tag) {
+            EXPECT_EQ(get_fakevendor_tag_type(&fakevendor_ops, vendor_tag),
+                    get_camera_metadata_tag_type(vendor_tag));
+            EXPECT_STREQ(get_fakevendor_tag_name(&fakevendor_ops, vendor_tag),
+                    get_camera_metadata_tag_name(vendor_tag));
+            EXPECT_STREQ(get_fakevendor_section_name(&fakevendor_ops, vendor_tag),
+                    get_camera_metadata_section_name(vendor_tag));
+        }
+    }
+
+    // The cache follows the vendor tag ops
+    set_camera_metadata_vendor_ops(NULL);
+    EXPECT_EQ(NOT_FOUND, get_camera_metadata_tag_from_name(vendor_name, &tag));
+    EXPECT_EQ(-1, get_camera_metadata_tag_type(FAKEVENDOR_SENSOR_AVAILABLE_SUPERMODES));
+    EXPECT_NULL(get_camera_metadata_tag_name(FAKEVENDOR_SENSOR_AVAILABLE_SUPERMODES));
+}
+
 TEST(camera_metadata, add_all_tags) {
     int total_tag_count = 0;
     for (int i = 0; i < ANDROID_SECTION_COUNT; i++) {
@@ -1072,6 +1132,404 @@ TEST(camera_metadata, sort_metadata) {
     FINISH_USING_CAMERA_METADATA(m);
 }
 
+TEST(camera_metadata, sort_metadata_stable) {
+    const uint32_t tags[] = {
+        ANDROID_SENSOR_SENSITIVITY,
+        ANDROID_CONTROL_AE_EXPOSURE_COMPENSATION,
+        ANDROID_JPEG_ORIENTATION,
+        ANDROID_REQUEST_ID,
+        ANDROID_SENSOR_TEST_PATTERN_MODE,
+        ANDROID_CONTROL_AE_TARGET_FPS_RANGE,
+    };
+    // Below and above the count sorted by insertion
+    for (size_t entry_count : {20, 300}) {
+        camera_metadata_t *m = allocate_camera_metadata(entry_count, 0);
+
+        // The value of each entry is its position, to check the sort is stable.
+        uint32_t tag_choice = 1;
+        for (int32_t i = 0; i < (int32_t)entry_count; ++i) {
+            tag_choice = tag_choice * 1103515245 + 12345;
+            EXPECT_EQ(OK, add_camera_metadata_entry(m,
+                    tags[(tag_choice >> 16) % ARRAY_SIZE(tags)], &i, 1));
+        }
+        EXPECT_EQ(OK, sort_camera_metadata(m));
+        ASSERT_EQ(entry_count, get_camera_metadata_entry_count(m));
+
+        camera_metadata_ro_entry_t previous;
+        EXPECT_EQ(OK, get_camera_metadata_ro_entry(m, 0, &previous));
+        for (size_t i = 1; i < entry_count; ++i) {
+            camera_metadata_ro_entry_t entry;
+            EXPECT_EQ(OK, get_camera_metadata_ro_entry(m, i, &entry));
+            EXPECT_LE(previous.tag, entry.tag) << "at index " << i;
+            if (previous.tag == entry.tag) {
+                EXPECT_LT(previous.data.i32[0], entry.data.i32[0]) << "at index " << i;
+            }
+            previous = entry;
+        }
+
+        FINISH_USING_CAMERA_METADATA(m);
+    }
+}
+
+// Checks that every tag is found at the same index in the indexed and plain structures.
+static void expect_same_find(camera_metadata_t *indexed, camera_metadata_t *plain,
+        const std::vector<uint32_t> &tags) {
+    for (uint32_t tag : tags) {
+        camera_metadata_entry_t indexed_entry, plain_entry;
+        int indexed_result = find_camera_metadata_entry(indexed, tag, &indexed_entry);
+        int plain_result = find_camera_metadata_entry(plain, tag, &plain_entry);
+        EXPECT_EQ(plain_result, indexed_result) << "tag " << tag;
+        if (plain_result == OK && indexed_result == OK) {
+            EXPECT_EQ(plain_entry.index, indexed_entry.index) << "tag " << tag;
+            EXPECT_EQ(tag, indexed_entry.tag);
+            EXPECT_EQ(plain_entry.count, indexed_entry.count);
+            EXPECT_EQ(0, memcmp(plain_entry.data.u8, indexed_entry.data.u8,
+                    plain_entry.count * camera_metadata_type_size[plain_entry.type]));
+        }
+    }
+}
+
+TEST(camera_metadata, indexed_find) {
+    const size_t entry_capacity = 20;
+    const size_t data_capacity = 200;
+
+    camera_metadata_t *m = allocate_indexed_camera_metadata(entry_capacity, data_capacity);
+    camera_metadata_t *p = allocate_camera_metadata(entry_capacity, data_capacity);
+    EXPECT_NOT_NULL(m);
+    EXPECT_EQ(calculate_indexed_camera_metadata_size(entry_capacity, data_capacity),
+            get_camera_metadata_size(m));
+    EXPECT_GT(get_camera_metadata_size(m), get_camera_metadata_size(p));
+    EXPECT_EQ(OK, validate_camera_metadata_structure(m, NULL));
+
+    const std::vector<uint32_t> tags = {
+        ANDROID_SENSOR_EXPOSURE_TIME,
+        ANDROID_SENSOR_SENSITIVITY,
+        ANDROID_LENS_FOCUS_DISTANCE,
+        ANDROID_REQUEST_FRAME_COUNT,
+        ANDROID_COLOR_CORRECTION_MODE,
+        ANDROID_CONTROL_AE_MODE,
+        ANDROID_JPEG_QUALITY,
+        ANDROID_FLASH_MODE,
+        ANDROID_SENSOR_FRAME_DURATION,
+    };
+    std::vector<uint32_t> queries = tags;
+    queries.push_back(ANDROID_NOISE_REDUCTION_STRENGTH);  // never added
+
+    // Add in non-sorted order
+    for (size_t i = 0; i < tags.size(); i++) {
+        const int64_t value = i + 1;  // large enough for any type
+        EXPECT_EQ(OK, add_camera_metadata_entry(m, tags[i], &value, 1));
+        EXPECT_EQ(OK, add_camera_metadata_entry(p, tags[i], &value, 1));
+    }
+    expect_same_find(m, p, queries);
+
+    // A duplicate tag does not hide the first entry
+    const int64_t exposure_times[] = {300, 400};
+    for (camera_metadata_t *meta : {m, p}) {
+        EXPECT_EQ(OK, add_camera_metadata_entry(meta, ANDROID_SENSOR_EXPOSURE_TIME,
+                exposure_times, 2));
+    }
+    expect_same_find(m, p, queries);
+
+    // Deleting the first entry makes the duplicate visible
+    for (camera_metadata_t *meta : {m, p}) {
+        EXPECT_EQ(OK, delete_camera_metadata_entry(meta, 0));
+    }
+    expect_same_find(m, p, queries);
+    camera_metadata_entry_t entry;
+    EXPECT_EQ(OK, find_camera_metadata_entry(m, ANDROID_SENSOR_EXPOSURE_TIME, &entry));
+    EXPECT_EQ((size_t)2, entry.count);
+
+    // Updates moving data around
+    const int32_t sensitivities[] = {100, 200, 300};
+    for (camera_metadata_t *meta : {m, p}) {
+        camera_metadata_entry_t e;
+        ASSERT_EQ(OK, find_camera_metadata_entry(meta, ANDROID_SENSOR_SENSITIVITY, &e));
+        EXPECT_EQ(OK, update_camera_metadata_entry(meta, e.index, sensitivities,
+                ARRAY_SIZE(sensitivities), NULL));
+    }
+    expect_same_find(m, p, queries);
+
+    // Sorting
+    for (camera_metadata_t *meta : {m, p}) {
+        EXPECT_EQ(OK, sort_camera_metadata(meta));
+    }
+    expect_same_find(m, p, queries);
+
+    // Appending
+    camera_metadata_t *src = allocate_camera_metadata(2, 0);
+    const uint8_t mode = ANDROID_NOISE_REDUCTION_MODE_FAST;
+    EXPECT_EQ(OK, add_camera_metadata_entry(src, ANDROID_NOISE_REDUCTION_MODE, &mode, 1));
+    const uint8_t strength = 5;
+    EXPECT_EQ(OK, add_camera_metadata_entry(src, ANDROID_NOISE_REDUCTION_STRENGTH, &strength, 1));
+    EXPECT_EQ(OK, append_camera_metadata(m, src));
+    EXPECT_EQ(OK, append_camera_metadata(p, src));
+    queries.push_back(ANDROID_NOISE_REDUCTION_MODE);
+    expect_same_find(m, p, queries);
+    FINISH_USING_CAMERA_METADATA(src);
+
+    // Copies are compacted without an index
+    std::vector<uint8_t> buffer(get_camera_metadata_compact_size(m));
+    camera_metadata_t *copy = copy_camera_metadata(buffer.data(), buffer.size(), m);
+    EXPECT_NOT_NULL(copy);
+    EXPECT_EQ(OK, validate_camera_metadata_structure(copy, NULL));
+    expect_same_find(copy, p, queries);
+
+    FINISH_USING_CAMERA_METADATA(p);
+    FINISH_USING_CAMERA_METADATA(m);
+}
+
+TEST(camera_metadata, indexed_place) {
+    const size_t entry_capacity = 5;
+    const size_t data_capacity = 50;
+    const size_t size = calculate_indexed_camera_metadata_size(entry_capacity, data_capacity);
+    EXPECT_GT(size, calculate_camera_metadata_size(entry_capacity, data_capacity));
+    EXPECT_EQ((size_t)0, calculate_indexed_camera_metadata_size((size_t)1 << 29, 0));
+
+    std::vector<uint64_t> buffer(size / sizeof(uint64_t), ~0ULL);  // not cleared
+    EXPECT_NULL(place_indexed_camera_metadata(buffer.data(), size - 1,
+            entry_capacity, data_capacity));
+    camera_metadata_t *m = place_indexed_camera_metadata(buffer.data(), size,
+            entry_capacity, data_capacity);
+    EXPECT_NOT_NULL(m);
+
+    add_test_metadata(m, entry_capacity);
+    camera_metadata_entry_t entry;
+    EXPECT_EQ(OK, find_camera_metadata_entry(m, ANDROID_SENSOR_EXPOSURE_TIME, &entry));
+    EXPECT_EQ((size_t)0, entry.index);
+    EXPECT_EQ(NOT_FOUND, find_camera_metadata_entry(m, ANDROID_SENSOR_SENSITIVITY, &entry));
+    EXPECT_EQ(OK, validate_camera_metadata_structure(m, &size));
+}
+
+TEST(camera_metadata, indexed_truncated) {
+    const size_t entry_capacity = 100;
+    const size_t data_capacity = 50;
+    camera_metadata_t *m = allocate_indexed_camera_metadata(entry_capacity, data_capacity);
+    ASSERT_NE((void*)NULL, (void*)m);
+    add_test_metadata(m, 5);
+
+    // Only the header is received, with a size claiming it is the whole packet:
+    // the tag index that would follow the header must not be read.
+    const size_t size = calculate_camera_metadata_size(0, 0);
+    std::vector<uint64_t> buffer(size / sizeof(uint64_t));
+    memcpy(buffer.data(), m, size);
+    reinterpret_cast<uint32_t*>(buffer.data())[0] = size;
+    const camera_metadata_t *truncated =
+            reinterpret_cast<const camera_metadata_t*>(buffer.data());
+    EXPECT_EQ(CAMERA_METADATA_VALIDATION_ERROR,
+            validate_camera_metadata_structure(truncated, &size));
+    EXPECT_EQ(CAMERA_METADATA_VALIDATION_ERROR,
+            validate_camera_metadata_structure(truncated, NULL));
+
+    FINISH_USING_CAMERA_METADATA(m);
+}
+
+TEST(camera_metadata, indexed_stale_index) {
+    const size_t entry_capacity = 10;
+    const size_t data_capacity = 50;
+    const size_t size = calculate_indexed_camera_metadata_size(entry_capacity, data_capacity);
+    camera_metadata_t *m = allocate_indexed_camera_metadata(entry_capacity, data_capacity);
+    ASSERT_NE((void*)NULL, (void*)m);
+    add_test_metadata(m, 5);
+    int32_t sensitivity = 800;
+    EXPECT_EQ(OK, add_camera_metadata_entry(m, ANDROID_SENSOR_SENSITIVITY, &sensitivity, 1));
+    EXPECT_EQ(OK, add_camera_metadata_entry(m, ANDROID_SENSOR_SENSITIVITY, &sensitivity, 1));
+    EXPECT_EQ(OK, validate_camera_metadata_structure(m, &size));
+    EXPECT_EQ(OK, validate_camera_metadata_structure_fast(m, &size));
+
+    // The index follows the header; find the slots holding entries.
+    const size_t slot_count = 32;
+    uint32_t *index = reinterpret_cast<uint32_t*>(reinterpret_cast<uint8_t*>(m) +
+            ((calculate_camera_metadata_size(0, 0) + 3) & ~size_t(3)));
+    camera_metadata_entry_t entry;
+    ASSERT_EQ(OK, find_camera_metadata_entry(m, ANDROID_SENSOR_SENSITIVITY, &entry));
+    const uint32_t first = entry.index;
+    const uint32_t last = get_camera_metadata_entry_count(m) - 1;
+    size_t slot = 0;
+    while (slot < slot_count && index[slot] != first) ++slot;
+    ASSERT_LT(slot, slot_count);
+
+    // A cleared slot hides an entry from the lookup.
+    index[slot] = UINT32_MAX;
+    EXPECT_EQ(NOT_FOUND, find_camera_metadata_entry(m, ANDROID_SENSOR_SENSITIVITY, &entry));
+    EXPECT_EQ(CAMERA_METADATA_VALIDATION_ERROR, validate_camera_metadata_structure(m, &size));
+    EXPECT_EQ(CAMERA_METADATA_VALIDATION_ERROR,
+            validate_camera_metadata_structure_fast(m, &size));
+
+    // A slot holding a later entry with the same tag returns the wrong entry.
+    index[slot] = last;
+    EXPECT_EQ(CAMERA_METADATA_VALIDATION_ERROR, validate_camera_metadata_structure(m, &size));
+    EXPECT_EQ(CAMERA_METADATA_VALIDATION_ERROR,
+            validate_camera_metadata_structure_fast(m, &size));
+
+    // A slot holding an entry with another tag is skipped by the lookup.
+    index[slot] = 0;
+    EXPECT_EQ(CAMERA_METADATA_VALIDATION_ERROR, validate_camera_metadata_structure(m, &size));
+    EXPECT_EQ(CAMERA_METADATA_VALIDATION_ERROR,
+            validate_camera_metadata_structure_fast(m, &size));
+
+    index[slot] = first;
+    EXPECT_EQ(OK, validate_camera_metadata_structure(m, &size));
+    EXPECT_EQ(OK, validate_camera_metadata_structure_fast(m, &size));
+
+    FINISH_USING_CAMERA_METADATA(m);
+}
+
+// Checks that a batch lookup returns the same entries as single lookups.
+static void expect_batch_find(const camera_metadata_t *m, const std::vector<uint32_t> &tags) {
+    std::vector<camera_metadata_ro_entry_t> entries(tags.size());
+    int expected_result = OK;
+    for (size_t i = 0; i < tags.size(); i++) {
+        if (find_camera_metadata_ro_entry(m, tags[i], &entries[i]) != OK) {
+            expected_result = NOT_FOUND;
+        }
+    }
+    std::vector<camera_metadata_ro_entry_t> batch(tags.size());
+    EXPECT_EQ(expected_result,
+            find_camera_metadata_entries(m, tags.data(), tags.size(), batch.data()));
+    for (size_t i = 0; i < tags.size(); i++) {
+        EXPECT_EQ(tags[i], batch[i].tag) << "query " << i;
+        camera_metadata_ro_entry_t entry;
+        if (find_camera_metadata_ro_entry(m, tags[i], &entry) != OK) {
+            EXPECT_NULL(batch[i].data.u8) << "query " << i;
+            EXPECT_EQ((size_t)0, batch[i].count);
+            continue;
+        }
+        EXPECT_EQ(entry.index, batch[i].index) << "query " << i;
+        EXPECT_EQ(entry.type, batch[i].type);
+        EXPECT_EQ(entry.count, batch[i].count);
+        EXPECT_EQ(entry.data.u8, batch[i].data.u8);
+    }
+}
+
+TEST(camera_metadata, find_entries) {
+    const size_t entry_capacity = 20;
+    const size_t data_capacity = 200;
+
+    camera_metadata_t *m = allocate_camera_metadata(entry_capacity, data_capacity);
+    camera_metadata_t *indexed = allocate_indexed_camera_metadata(entry_capacity, data_capacity);
+    EXPECT_NOT_NULL(m);
+    EXPECT_NOT_NULL(indexed);
+
+    const std::vector<uint32_t> tags = {
+        ANDROID_SENSOR_EXPOSURE_TIME,
+        ANDROID_SENSOR_SENSITIVITY,
+        ANDROID_LENS_FOCUS_DISTANCE,
+        ANDROID_REQUEST_FRAME_COUNT,
+        ANDROID_COLOR_CORRECTION_MODE,
+        ANDROID_CONTROL_AE_MODE,
+        ANDROID_JPEG_QUALITY,
+    };
+    for (size_t i = 0; i < tags.size(); i++) {
+        const int64_t value = i + 1;  // large enough for any type
+        EXPECT_EQ(OK, add_camera_metadata_entry(m, tags[i], &value, 1));
+        EXPECT_EQ(OK, add_camera_metadata_entry(indexed, tags[i], &value, 1));
+    }
+    // A duplicate tag, only the first entry is returned
+    const int64_t exposure_times[] = {300, 400};
+    EXPECT_EQ(OK, add_camera_metadata_entry(m, ANDROID_SENSOR_EXPOSURE_TIME,
+            exposure_times, 2));
+
+    std::vector<uint32_t> queries = {
+        ANDROID_JPEG_QUALITY,
+        ANDROID_SENSOR_EXPOSURE_TIME,
+        ANDROID_SENSOR_EXPOSURE_TIME,  // duplicate query
+        ANDROID_COLOR_CORRECTION_MODE,
+        ANDROID_LENS_FOCUS_DISTANCE,
+    };
+
+    // Unsorted
+    expect_batch_find(m, queries);
+    expect_batch_find(indexed, queries);
+    expect_batch_find(m, {});
+
+    // Missing tags
+    queries.push_back(ANDROID_NOISE_REDUCTION_STRENGTH);
+    queries.insert(queries.begin(), ANDROID_FLASH_MODE);
+    expect_batch_find(m, queries);
+    expect_batch_find(indexed, queries);
+
+    // Sorted, without the duplicate which single lookups may find in any order
+    EXPECT_EQ(OK, delete_camera_metadata_entry(m, tags.size()));
+    EXPECT_EQ(OK, sort_camera_metadata(m));
+    EXPECT_EQ(OK, sort_camera_metadata(indexed));
+    expect_batch_find(m, queries);
+    expect_batch_find(indexed, queries);
+    expect_batch_find(m, tags);
+
+    // Many queries, not fitting in the stack buffer
+    std::vector<uint32_t> many_queries;
+    for (size_t i = 0; i < 300; i++) {
+        many_queries.push_back(queries[i % queries.size()]);
+    }
+    expect_batch_find(m, many_queries);
+    std::sort(many_queries.begin(), many_queries.end());
+    expect_batch_find(m, many_queries);
+
+    camera_metadata_ro_entry_t entry;
+    EXPECT_EQ(ERROR, find_camera_metadata_entries(NULL, tags.data(), 1, &entry));
+    EXPECT_EQ(ERROR, find_camera_metadata_entries(m, NULL, 1, &entry));
+    EXPECT_EQ(ERROR, find_camera_metadata_entries(m, tags.data(), 1, NULL));
+
+    FINISH_USING_CAMERA_METADATA(indexed);
+    FINISH_USING_CAMERA_METADATA(m);
+}
+
+TEST(camera_metadata, find_entries_many) {
+    // More queries than are looked up one by one, so that the entries are scanned
+    // in a single pass, after sorting the queries when needed.
+    const size_t tag_count = 64;
+    std::vector<uint32_t> tags;
+    std::vector<uint32_t> missing_tags;
+    for (unsigned int section = 0; section < ANDROID_SECTION_COUNT; ++section) {
+        for (uint32_t tag = camera_metadata_section_bounds[section][0];
+                tag < camera_metadata_section_bounds[section][1]; ++tag) {
+            if (get_camera_metadata_tag_type(tag) < 0) continue;
+            if (tags.size() < tag_count) {
+                tags.push_back(tag);
+            } else if (missing_tags.size() < tag_count) {
+                missing_tags.push_back(tag);
+            }
+        }
+    }
+    ASSERT_EQ(tag_count, tags.size());
+    ASSERT_EQ(tag_count, missing_tags.size());
+
+    camera_metadata_t *m = allocate_camera_metadata(tag_count + 1, tag_count * 8 * 2);
+    EXPECT_NOT_NULL(m);
+    // added in decreasing tag order, so the structure is not sorted.
+    const int64_t value = 1;  // large enough for any type
+    for (auto it = tags.rbegin(); it != tags.rend(); ++it) {
+        EXPECT_EQ(OK, add_camera_metadata_entry(m, *it, &value, 1));
+    }
+    // A duplicate tag, only the first entry is returned
+    EXPECT_EQ(OK, add_camera_metadata_entry(m, tags[5], &value, 1));
+
+    // tags in a shuffled order, with duplicates and missing tags.
+    std::vector<uint32_t> queries;
+    for (size_t i = 0; i < tag_count; i++) {
+        queries.push_back(tags[i * 17 % tag_count]);
+        if (i % 4 == 0) queries.push_back(missing_tags[i]);
+        if (i % 8 == 0) queries.push_back(tags[i]);
+    }
+    ASSERT_GT(queries.size(), (size_t)32);
+    std::vector<uint32_t> sorted_queries = queries;
+    std::sort(sorted_queries.begin(), sorted_queries.end());
+
+    expect_batch_find(m, queries);
+    expect_batch_find(m, sorted_queries);
+    expect_batch_find(m, tags);
+
+    // Sorted, without the duplicate which single lookups may find in any order
+    EXPECT_EQ(OK, delete_camera_metadata_entry(m, tag_count));
+    EXPECT_EQ(OK, sort_camera_metadata(m));
+    expect_batch_find(m, queries);
+    expect_batch_find(m, sorted_queries);
+    expect_batch_find(m, tags);
+
+    FINISH_USING_CAMERA_METADATA(m);
+}
+
 TEST(camera_metadata, delete_metadata) {
     camera_metadata_t *m = NULL;
     const size_t entry_capacity = 50;
@@ -1681,6 +2139,423 @@ TEST(camera_metadata, update_metadata) {
 
 }
 
+// Checks that the entries have the same contents, wherever their data is.
+static void expect_same_entries(const camera_metadata_t *m1, const camera_metadata_t *m2) {
+    ASSERT_EQ(get_camera_metadata_entry_count(m1), get_camera_metadata_entry_count(m2));
+    EXPECT_EQ(get_camera_metadata_data_count(m1), get_camera_metadata_data_count(m2));
+    for (size_t i = 0; i < get_camera_metadata_entry_count(m1); i++) {
+        camera_metadata_ro_entry_t e1, e2;
+        ASSERT_EQ(OK, get_camera_metadata_ro_entry(m1, i, &e1));
+        ASSERT_EQ(OK, get_camera_metadata_ro_entry(m2, i, &e2));
+        EXPECT_EQ(e1.tag, e2.tag) << "entry " << i;
+        EXPECT_EQ(e1.type, e2.type);
+        ASSERT_EQ(e1.count, e2.count) << "entry " << i;
+        EXPECT_EQ(0, memcmp(e1.data.u8, e2.data.u8,
+                e1.count * camera_metadata_type_size[e1.type])) << "entry " << i;
+    }
+}
+
+TEST(camera_metadata, update_entries) {
+    const size_t entry_capacity = 10;
+    const size_t data_capacity = 200;
+    camera_metadata_t *m = allocate_camera_metadata(entry_capacity, data_capacity);
+    camera_metadata_t *p = allocate_camera_metadata(entry_capacity, data_capacity);
+
+    const int64_t exposure_times[] = {100, 200, 300};
+    const int32_t regions[] = {0, 0, 100, 100, 1, 50, 50, 150, 150, 1};
+    const uint8_t quality[] = {90};
+    const float focus_distances[] = {0.5f, 1.5f};
+    const float gains[] = {1.0f, 1.5f, 2.0f, 2.5f};
+    const int32_t thumbnail_size[] = {320, 240};
+    const int32_t new_thumbnail_size[] = {160, 120};
+
+    EXPECT_EQ(OK, add_camera_metadata_entry(m, ANDROID_SENSOR_EXPOSURE_TIME, exposure_times, 1));
+    EXPECT_EQ(OK, add_camera_metadata_entry(m, ANDROID_CONTROL_AE_REGIONS, regions, 5));
+    EXPECT_EQ(OK, add_camera_metadata_entry(m, ANDROID_JPEG_QUALITY, quality, 1));
+    EXPECT_EQ(OK, add_camera_metadata_entry(m, ANDROID_LENS_FOCUS_DISTANCE, focus_distances, 1));
+    EXPECT_EQ(OK, add_camera_metadata_entry(m, ANDROID_COLOR_CORRECTION_GAINS, gains, 4));
+    EXPECT_EQ(OK, add_camera_metadata_entry(m, ANDROID_JPEG_THUMBNAIL_SIZE, thumbnail_size, 2));
+    EXPECT_EQ(OK, append_camera_metadata(p, m));
+
+    // Growing, shrinking to fit in the entry, leaving the entry, and keeping sizes
+    const std::vector<camera_metadata_update_t> updates = {
+        {4, gains + 1, 1},
+        {1, regions, 10},
+        {0, exposure_times, 3},
+        {5, new_thumbnail_size, 2},
+        {3, focus_distances, 2},
+        {2, quality, 1},
+    };
+    EXPECT_EQ(OK, update_camera_metadata_entries(m, updates.data(), updates.size()));
+    for (const camera_metadata_update_t &update : updates) {
+        EXPECT_EQ(OK, update_camera_metadata_entry(p, update.index, update.data,
+                update.data_count, NULL));
+    }
+    EXPECT_EQ(OK, validate_camera_metadata_structure(m, NULL));
+    expect_same_entries(m, p);
+
+    // Shrinking back, with the data of some entries moving down
+    const std::vector<camera_metadata_update_t> shrink_updates = {
+        {1, regions + 5, 5},
+        {0, exposure_times + 2, 1},
+        {3, focus_distances + 1, 1},
+    };
+    EXPECT_EQ(OK, update_camera_metadata_entries(m, shrink_updates.data(),
+            shrink_updates.size()));
+    for (const camera_metadata_update_t &update : shrink_updates) {
+        EXPECT_EQ(OK, update_camera_metadata_entry(p, update.index, update.data,
+                update.data_count, NULL));
+    }
+    EXPECT_EQ(OK, validate_camera_metadata_structure(m, NULL));
+    expect_same_entries(m, p);
+    EXPECT_EQ(OK, update_camera_metadata_entries(m, NULL, 0));
+
+    // Failed updates leave the buffer unchanged
+    const size_t size = get_camera_metadata_size(m);
+    std::vector<uint8_t> before(size);
+    memcpy(before.data(), m, size);
+    const std::vector<int32_t> too_large(data_capacity, 0);
+    const std::vector<std::vector<camera_metadata_update_t>> failed_updates = {
+        {{0, exposure_times, 2}, {6, thumbnail_size, 2}},  // out of range
+        {{1, regions, 10}, {0, exposure_times, 2}, {1, regions, 5}},  // repeated
+        {{0, exposure_times, 2}, {1, too_large.data(), too_large.size() / 4}},  // no room
+    };
+    for (const auto &failed : failed_updates) {
+        EXPECT_EQ(ERROR, update_camera_metadata_entries(m, failed.data(), failed.size()));
+        EXPECT_EQ(0, memcmp(before.data(), m, size));
+    }
+    EXPECT_EQ(ERROR, update_camera_metadata_entries(NULL, updates.data(), 1));
+    EXPECT_EQ(ERROR, update_camera_metadata_entries(m, NULL, 1));
+
+    FINISH_USING_CAMERA_METADATA(p);
+    FINISH_USING_CAMERA_METADATA(m);
+}
+
+TEST(camera_metadata, builder) {
+    camera_metadata_builder_t *builder = allocate_camera_metadata_builder(1, 0, NULL);
+    EXPECT_NOT_NULL(builder);
+    camera_metadata_t *expected = allocate_camera_metadata(100, 1000);
+
+    // Grows past the initial capacities
+    for (int i = 0; i < 100; i++) {
+        const int64_t exposure_time = 100 + i * 100;
+        EXPECT_EQ(OK, add_camera_metadata_builder_entry(builder,
+                ANDROID_SENSOR_EXPOSURE_TIME, &exposure_time, 1));
+        EXPECT_EQ(OK, add_camera_metadata_entry(expected,
+                ANDROID_SENSOR_EXPOSURE_TIME, &exposure_time, 1));
+        const uint8_t mode = i;
+        EXPECT_EQ(OK, add_camera_metadata_builder_entry(builder, ANDROID_CONTROL_MODE, &mode, 1));
+    }
+    EXPECT_EQ(ERROR, add_camera_metadata_builder_entry(builder, (uint32_t)-1, NULL, 0));
+    camera_metadata_t *m = get_camera_metadata_builder_metadata(builder);
+    EXPECT_EQ((size_t)200, get_camera_metadata_entry_count(m));
+    EXPECT_GE(get_camera_metadata_entry_capacity(m), (size_t)200);
+    EXPECT_LT(get_camera_metadata_entry_capacity(m), (size_t)400);
+
+    camera_metadata_t *finished = finish_camera_metadata_builder(builder, NULL, 0);
+    EXPECT_NOT_NULL(finished);
+    EXPECT_EQ(get_camera_metadata_compact_size(finished), get_camera_metadata_size(finished));
+    EXPECT_EQ((size_t)200, get_camera_metadata_entry_count(finished));
+    EXPECT_EQ(OK, validate_camera_metadata_structure(finished, NULL));
+
+    // The builder is empty and keeps its buffer
+    EXPECT_EQ(m, get_camera_metadata_builder_metadata(builder));
+    EXPECT_EQ((size_t)0, get_camera_metadata_entry_count(m));
+    EXPECT_EQ((size_t)0, get_camera_metadata_data_count(m));
+
+    // Appending
+    EXPECT_EQ(OK, append_camera_metadata_builder(builder, expected));
+    EXPECT_EQ(OK, append_camera_metadata_builder(builder, expected));
+    m = get_camera_metadata_builder_metadata(builder);
+    EXPECT_EQ((size_t)200, get_camera_metadata_entry_count(m));
+    const size_t size = get_camera_metadata_compact_size(m);
+    std::vector<uint64_t> buffer(size / sizeof(uint64_t) + 1);
+    EXPECT_NULL(finish_camera_metadata_builder(builder, buffer.data(), size - 1));
+    EXPECT_EQ((size_t)200, get_camera_metadata_entry_count(m));  // not emptied
+    camera_metadata_t *copy = finish_camera_metadata_builder(builder, buffer.data(), size);
+    EXPECT_EQ((void*)buffer.data(), (void*)copy);
+    EXPECT_EQ(OK, validate_camera_metadata_structure(copy, &size));
+    camera_metadata_ro_entry_t entry;
+    EXPECT_EQ(OK, get_camera_metadata_ro_entry(copy, 199, &entry));
+    EXPECT_EQ(ANDROID_SENSOR_EXPOSURE_TIME, entry.tag);
+    EXPECT_EQ(10000, *entry.data.i64);
+
+    free_camera_metadata(finished);
+    FINISH_USING_CAMERA_METADATA(expected);
+    free_camera_metadata_builder(builder);
+}
+
+// A bump allocator over a fixed buffer, freeing only the last allocation.
+struct TestArena {
+    std::vector<uint64_t> buffer;
+    size_t used = 0;  // in uint64_t
+    int allocations = 0;
+    int frees = 0;
+
+    static void *allocate(void *context, size_t size) {
+        TestArena *arena = static_cast<TestArena*>(context);
+        const size_t count = (size + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+        if (arena->used + count > arena->buffer.size()) return NULL;
+        void *result = arena->buffer.data() + arena->used;
+        arena->used += count;
+        arena->allocations++;
+        return result;
+    }
+
+    static void free(void *context, void *buffer, size_t size) {
+        TestArena *arena = static_cast<TestArena*>(context);
+        const size_t count = (size + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+        if (static_cast<uint64_t*>(buffer) + count == arena->buffer.data() + arena->used) {
+            arena->used -= count;
+        }
+        arena->frees++;
+    }
+};
+
+TEST(camera_metadata, builder_allocator) {
+    TestArena arena;
+    arena.buffer.resize(1024);
+    const camera_metadata_allocator_t allocator = {
+        TestArena::allocate, TestArena::free, &arena};
+
+    camera_metadata_builder_t *builder = allocate_camera_metadata_builder(2, 16, &allocator);
+    EXPECT_NOT_NULL(builder);
+    EXPECT_EQ(1, arena.allocations);
+
+    int64_t exposure_time = 100;
+    int i = 0;
+    for (; i < 8; i++) {
+        EXPECT_EQ(OK, add_camera_metadata_builder_entry(builder,
+                ANDROID_SENSOR_EXPOSURE_TIME, &exposure_time, 1));
+    }
+    EXPECT_EQ(3, arena.allocations);  // grown twice
+    EXPECT_EQ(2, arena.frees);
+
+    // Out of arena memory, the metadata is unchanged
+    for (; add_camera_metadata_builder_entry(builder,
+            ANDROID_SENSOR_EXPOSURE_TIME, &exposure_time, 1) == OK; i++) {
+    }
+    camera_metadata_t *m = get_camera_metadata_builder_metadata(builder);
+    EXPECT_EQ((size_t)i, get_camera_metadata_entry_count(m));
+    EXPECT_EQ(OK, validate_camera_metadata_structure(m, NULL));
+
+    const camera_metadata_allocator_t no_free = {TestArena::allocate, NULL, &arena};
+    EXPECT_NULL(allocate_camera_metadata_builder(1, 1, &no_free));
+
+    const int allocations = arena.allocations;
+    free_camera_metadata_builder(builder);
+    EXPECT_EQ(allocations, arena.frees);
+}
+
+TEST(camera_metadata, pool) {
+    camera_metadata_pool_t *pool = allocate_camera_metadata_pool(2);
+    EXPECT_NOT_NULL(pool);
+
+    camera_metadata_t *m = allocate_camera_metadata_from_pool(pool, 20, 300);
+    EXPECT_NOT_NULL(m);
+    EXPECT_EQ((size_t)32, get_camera_metadata_entry_capacity(m));
+    EXPECT_EQ((size_t)512, get_camera_metadata_data_capacity(m));
+    EXPECT_EQ(OK, validate_camera_metadata_structure(m, NULL));
+    add_test_metadata(m, 20);
+    set_camera_metadata_vendor_id(m, 1);
+    release_camera_metadata_to_pool(pool, m);
+
+    // Recycled from the same size class, and reset
+    camera_metadata_t *m2 = allocate_camera_metadata_from_pool(pool, 32, 400);
+    EXPECT_EQ(m, m2);
+    EXPECT_EQ((size_t)0, get_camera_metadata_entry_count(m2));
+    EXPECT_EQ((size_t)0, get_camera_metadata_data_count(m2));
+    EXPECT_EQ(CAMERA_METADATA_INVALID_VENDOR_ID, get_camera_metadata_vendor_id(m2));
+    EXPECT_EQ(OK, validate_camera_metadata_structure(m2, NULL));
+
+    // Another size class
+    camera_metadata_t *m3 = allocate_camera_metadata_from_pool(pool, 33, 400);
+    EXPECT_NE(m2, m3);
+    EXPECT_EQ((size_t)64, get_camera_metadata_entry_capacity(m3));
+
+    add_test_metadata(m2, 10);
+    camera_metadata_t *clone = clone_camera_metadata_from_pool(pool, m2);
+    EXPECT_NOT_NULL(clone);
+    EXPECT_EQ((size_t)10, get_camera_metadata_entry_count(clone));
+    EXPECT_EQ(OK, validate_camera_metadata_structure(clone, NULL));
+
+    camera_metadata_pool_stats_t stats;
+    EXPECT_EQ(OK, get_camera_metadata_pool_stats(pool, &stats));
+    EXPECT_EQ(4u, stats.allocations);
+    EXPECT_EQ(1u, stats.hits);
+    EXPECT_EQ((size_t)3, stats.in_use);
+    EXPECT_EQ((size_t)3, stats.in_use_high_water);
+    EXPECT_EQ((size_t)0, stats.pooled_bytes);
+    EXPECT_EQ(calculate_camera_metadata_size(32, 512), stats.pooled_bytes_high_water);
+
+    // At most 2 buffers per size class are kept
+    camera_metadata_t *m4 = allocate_camera_metadata_from_pool(pool, 32, 512);
+    release_camera_metadata_to_pool(pool, m2);
+    release_camera_metadata_to_pool(pool, m4);
+    release_camera_metadata_to_pool(pool, clone);
+    release_camera_metadata_to_pool(pool, m3);
+    const size_t pooled_bytes = calculate_camera_metadata_size(32, 512) * 2 +
+            calculate_camera_metadata_size(16, 256) + calculate_camera_metadata_size(64, 512);
+    EXPECT_EQ(OK, get_camera_metadata_pool_stats(pool, &stats));
+    EXPECT_EQ((size_t)0, stats.in_use);
+    EXPECT_EQ((size_t)4, stats.in_use_high_water);
+    EXPECT_EQ(pooled_bytes, stats.pooled_bytes);
+
+    // Capacities too large to be pooled
+    camera_metadata_t *large = allocate_camera_metadata_from_pool(pool, 5000, 100);
+    EXPECT_NOT_NULL(large);
+    EXPECT_EQ((size_t)5000, get_camera_metadata_entry_capacity(large));
+    release_camera_metadata_to_pool(pool, large);
+
+    // Buffers not of a size class are freed
+    release_camera_metadata_to_pool(pool, allocate_camera_metadata(10, 100));
+    release_camera_metadata_to_pool(pool, allocate_indexed_camera_metadata(32, 512));
+    EXPECT_EQ(OK, get_camera_metadata_pool_stats(pool, &stats));
+    EXPECT_EQ(pooled_bytes, stats.pooled_bytes);
+
+    EXPECT_EQ(ERROR, get_camera_metadata_pool_stats(pool, NULL));
+    EXPECT_NULL(allocate_camera_metadata_from_pool(NULL, 1, 1));
+    // Capacities beyond the size classes are rejected, not searched for a class
+    EXPECT_NULL(allocate_camera_metadata_from_pool(pool, SIZE_MAX, 1));
+    EXPECT_NULL(allocate_camera_metadata_from_pool(pool, 1, SIZE_MAX));
+    EXPECT_EQ(OK, get_camera_metadata_pool_stats(pool, &stats));
+    EXPECT_EQ((size_t)0, stats.in_use);
+    free_camera_metadata_pool(pool);
+}
+
+TEST(camera_metadata, pool_threads) {
+    constexpr int kThreads = 4;
+    constexpr int kIterations = 1000;
+    camera_metadata_pool_t *pool = allocate_camera_metadata_pool(kThreads);
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < kThreads; t++) {
+        threads.emplace_back([pool, t] {
+            for (int i = 0; i < kIterations; i++) {
+                camera_metadata_t *m =
+                        allocate_camera_metadata_from_pool(pool, 16 << (i % 2), 256 << t);
+                ASSERT_NE(nullptr, m);
+                add_test_metadata(m, 16);
+                release_camera_metadata_to_pool(pool, m);
+            }
+        });
+    }
+    for (std::thread &thread : threads) {
+        thread.join();
+    }
+
+    camera_metadata_pool_stats_t stats;
+    EXPECT_EQ(OK, get_camera_metadata_pool_stats(pool, &stats));
+    EXPECT_EQ((uint64_t)kThreads * kIterations, stats.allocations);
+    EXPECT_GE(stats.hits, (uint64_t)kThreads * (kIterations - 2));
+    EXPECT_EQ((size_t)0, stats.in_use);
+    EXPECT_LE(stats.in_use_high_water, (size_t)kThreads * 2);  // 2 size classes per thread
+    free_camera_metadata_pool(pool);
+}
+
+TEST(camera_metadata, delta) {
+    const size_t entry_capacity = 20;
+    const size_t data_capacity = 200;
+    camera_metadata_t *old_metadata = allocate_camera_metadata(entry_capacity, data_capacity);
+    camera_metadata_t *new_metadata = allocate_camera_metadata(entry_capacity, data_capacity);
+
+    const int64_t exposure_times[] = {100, 200};
+    const int32_t sensitivities[] = {400, 800};
+    const float focus_distance = 0.5f;
+    const int64_t frame_duration = 33333333;
+    const uint8_t modes[] = {ANDROID_CONTROL_AE_MODE_ON, ANDROID_CONTROL_AE_MODE_OFF};
+    const int32_t regions[] = {0, 0, 100, 100, 1};
+    const int32_t frame_count = 10;
+
+    EXPECT_EQ(OK, add_camera_metadata_entry(old_metadata, ANDROID_SENSOR_EXPOSURE_TIME,
+            exposure_times, 1));
+    EXPECT_EQ(OK, add_camera_metadata_entry(old_metadata, ANDROID_SENSOR_SENSITIVITY,
+            sensitivities, 1));
+    EXPECT_EQ(OK, add_camera_metadata_entry(old_metadata, ANDROID_LENS_FOCUS_DISTANCE,
+            &focus_distance, 1));
+    EXPECT_EQ(OK, add_camera_metadata_entry(old_metadata, ANDROID_SENSOR_FRAME_DURATION,
+            &frame_duration, 1));
+    EXPECT_EQ(OK, add_camera_metadata_entry(old_metadata, ANDROID_CONTROL_AE_MODE, modes, 1));
+    EXPECT_EQ(OK, add_camera_metadata_entry(old_metadata, ANDROID_CONTROL_AE_REGIONS,
+            regions, 5));
+
+    // Changed, unchanged, removed, and added entries
+    EXPECT_EQ(OK, add_camera_metadata_entry(new_metadata, ANDROID_SENSOR_EXPOSURE_TIME,
+            exposure_times + 1, 1));
+    EXPECT_EQ(OK, add_camera_metadata_entry(new_metadata, ANDROID_SENSOR_SENSITIVITY,
+            sensitivities, 2));
+    EXPECT_EQ(OK, add_camera_metadata_entry(new_metadata, ANDROID_LENS_FOCUS_DISTANCE,
+            &focus_distance, 1));
+    EXPECT_EQ(OK, add_camera_metadata_entry(new_metadata, ANDROID_SENSOR_FRAME_DURATION,
+            &frame_duration, 1));
+    EXPECT_EQ(OK, add_camera_metadata_entry(new_metadata, ANDROID_CONTROL_AE_MODE, modes + 1, 1));
+    EXPECT_EQ(OK, add_camera_metadata_entry(new_metadata, ANDROID_REQUEST_FRAME_COUNT,
+            &frame_count, 1));
+
+    // Only sorted metadata
+    EXPECT_NULL(diff_camera_metadata(old_metadata, new_metadata));
+    EXPECT_EQ(OK, sort_camera_metadata(old_metadata));
+    EXPECT_NULL(diff_camera_metadata(old_metadata, new_metadata));
+    EXPECT_EQ(OK, sort_camera_metadata(new_metadata));
+
+    camera_metadata_delta_t *delta = diff_camera_metadata(old_metadata, new_metadata);
+    EXPECT_NOT_NULL(delta);
+    const size_t size = get_camera_metadata_delta_size(delta);
+    EXPECT_EQ(OK, validate_camera_metadata_delta(delta, &size));
+    EXPECT_LT(size, get_camera_metadata_compact_size(new_metadata));
+
+    // As received by another process
+    std::vector<uint64_t> buffer(size / sizeof(uint64_t));
+    memcpy(buffer.data(), delta, size);
+    camera_metadata_delta_t *received = reinterpret_cast<camera_metadata_delta_t*>(buffer.data());
+    EXPECT_EQ(OK, validate_camera_metadata_delta(received, &size));
+    camera_metadata_t *applied = apply_camera_metadata_delta(old_metadata, received);
+    EXPECT_NOT_NULL(applied);
+    EXPECT_EQ(OK, validate_camera_metadata_structure(applied, NULL));
+    EXPECT_EQ(get_camera_metadata_compact_size(applied), get_camera_metadata_size(applied));
+    expect_same_entries(new_metadata, applied);
+
+    // Not the base of the delta
+    EXPECT_NULL(apply_camera_metadata_delta(new_metadata, delta));
+
+    // No changes
+    camera_metadata_delta_t *empty = diff_camera_metadata(new_metadata, new_metadata);
+    EXPECT_NOT_NULL(empty);
+    camera_metadata_t *same = apply_camera_metadata_delta(applied, empty);
+    EXPECT_NOT_NULL(same);
+    expect_same_entries(new_metadata, same);
+
+    // Corrupted deltas
+    const size_t small_size = size - 1;
+    EXPECT_EQ(CAMERA_METADATA_VALIDATION_ERROR, validate_camera_metadata_delta(received,
+            &small_size));
+    for (size_t offset : {(size_t)4 /* version */, (size_t)8 /* removed count */,
+            (size_t)12 /* metadata start */}) {
+        std::vector<uint64_t> corrupted(buffer);
+        reinterpret_cast<uint8_t*>(corrupted.data())[offset + 1] ^= 0xFF;
+        EXPECT_EQ(CAMERA_METADATA_VALIDATION_ERROR, validate_camera_metadata_delta(
+                reinterpret_cast<camera_metadata_delta_t*>(corrupted.data()), &size))
+                << "offset " << offset;
+        EXPECT_NULL(apply_camera_metadata_delta(old_metadata,
+                reinterpret_cast<camera_metadata_delta_t*>(corrupted.data())));
+    }
+    EXPECT_EQ(CAMERA_METADATA_VALIDATION_ERROR, validate_camera_metadata_delta(NULL, &size));
+    // A well-formed delta removing a tag which is not in base
+    std::vector<uint64_t> corrupted(buffer);
+    reinterpret_cast<uint32_t*>(corrupted.data())[4] = ANDROID_JPEG_QUALITY;
+    EXPECT_EQ(OK, validate_camera_metadata_delta(
+            reinterpret_cast<camera_metadata_delta_t*>(corrupted.data()), &size));
+    EXPECT_NULL(apply_camera_metadata_delta(old_metadata,
+            reinterpret_cast<camera_metadata_delta_t*>(corrupted.data())));
+
+    free_camera_metadata(same);
+    free_camera_metadata_delta(empty);
+    free_camera_metadata(applied);
+    free_camera_metadata_delta(delta);
+    FINISH_USING_CAMERA_METADATA(new_metadata);
+    FINISH_USING_CAMERA_METADATA(old_metadata);
+}
+
 TEST(camera_metadata, memcpy) {
     camera_metadata_t *m = NULL;
     const size_t entry_capacity = 50;
@@ -1904,3 +2779,147 @@ TEST(camera_metadata, buffer_alignment) {
     delete[] dst;
     FINISH_USING_CAMERA_METADATA(m);
 }
+
+TEST(camera_metadata, validate_fast) {
+    const size_t entry_capacity = 15;
+    const size_t data_capacity = 450;
+    camera_metadata_t *m = allocate_camera_metadata(entry_capacity, data_capacity);
+    add_test_metadata(m, 10);
+
+    size_t m_size = get_camera_metadata_size(m);
+    EXPECT_EQ(OK, validate_camera_metadata_structure_fast(m, &m_size));
+    EXPECT_EQ(OK, validate_camera_metadata_structure_fast(m, &m_size));
+    EXPECT_EQ(OK, validate_camera_metadata_structure_fast(m, NULL));
+    size_t small_size = m_size - 1;
+    EXPECT_EQ(CAMERA_METADATA_VALIDATION_ERROR,
+            validate_camera_metadata_structure_fast(m, &small_size));
+    EXPECT_EQ(CAMERA_METADATA_VALIDATION_ERROR,
+            validate_camera_metadata_structure_fast(NULL, NULL));
+
+    // Entry i is at entries_start + 16 * i, with its data offset at byte 8
+    // and its type at byte 12.
+    const uint32_t entries_start = reinterpret_cast<uint32_t*>(m)[5];
+    auto entry_bytes = [entries_start](camera_metadata_t *metadata, size_t index) {
+        return reinterpret_cast<uint8_t*>(metadata) + entries_start + 16 * index;
+    };
+
+    // The packet is only read
+    const uint8_t *m_bytes = reinterpret_cast<const uint8_t*>(m);
+    std::vector<uint8_t> before(m_bytes, m_bytes + m_size);
+    EXPECT_EQ(OK, validate_camera_metadata_structure_fast(m, &m_size));
+    EXPECT_EQ(0, memcmp(before.data(), m, m_size));
+
+    // A validated packet is validated again once changed
+    entry_bytes(m, 3)[12] = NUM_TYPES;
+    EXPECT_EQ(CAMERA_METADATA_VALIDATION_ERROR,
+            validate_camera_metadata_structure_fast(m, &m_size));
+    entry_bytes(m, 3)[12] = TYPE_INT64;
+    EXPECT_EQ(OK, validate_camera_metadata_structure_fast(m, &m_size));
+    uint32_t *entry_count = reinterpret_cast<uint32_t*>(m) + 3;
+    *entry_count += entry_capacity;
+    EXPECT_EQ(CAMERA_METADATA_VALIDATION_ERROR,
+            validate_camera_metadata_structure_fast(m, &m_size));
+    *entry_count -= entry_capacity;
+    EXPECT_EQ(OK, validate_camera_metadata_structure_fast(m, &m_size));
+    int64_t exposure_time = 1000;
+    EXPECT_EQ(OK, add_camera_metadata_entry(m, ANDROID_SENSOR_EXPOSURE_TIME, &exposure_time, 1));
+    EXPECT_EQ(OK, validate_camera_metadata_structure_fast(m, &m_size));
+
+    // An entry with data beyond the data section
+    size_t copy_size = get_camera_metadata_compact_size(m);
+    std::vector<uint64_t> buffer(copy_size / sizeof(uint64_t) + 1);
+    camera_metadata_t *copy = copy_camera_metadata(buffer.data(), copy_size, m);
+    ASSERT_NE((void*)NULL, (void*)copy);
+    const uint32_t copy_entries_start = reinterpret_cast<uint32_t*>(copy)[5];
+    uint8_t *copy_entry = reinterpret_cast<uint8_t*>(copy) + copy_entries_start + 16 * 2;
+    uint32_t offset = data_capacity;
+    memcpy(copy_entry + 8, &offset, sizeof(offset));
+    EXPECT_EQ(CAMERA_METADATA_VALIDATION_ERROR,
+            validate_camera_metadata_structure_fast(copy, &copy_size));
+    EXPECT_EQ(CAMERA_METADATA_VALIDATION_ERROR,
+            validate_camera_metadata_structure(copy, &copy_size));
+
+    // An entry type mismatching its tag type
+    copy = copy_camera_metadata(buffer.data(), copy_size, m);
+    ASSERT_NE((void*)NULL, (void*)copy);
+    copy_entry[12] = TYPE_DOUBLE;
+    EXPECT_EQ(CAMERA_METADATA_VALIDATION_ERROR,
+            validate_camera_metadata_structure(copy, &copy_size));
+    EXPECT_EQ(CAMERA_METADATA_VALIDATION_ERROR,
+            validate_camera_metadata_structure_fast(copy, &copy_size));
+    copy_entry[12] = TYPE_INT64;
+    EXPECT_EQ(OK, validate_camera_metadata_structure_fast(copy, &copy_size));
+
+    // An android section tag beyond its section
+    uint32_t tag = ANDROID_SENSOR_END;
+    memcpy(copy_entry, &tag, sizeof(tag));
+    EXPECT_EQ(CAMERA_METADATA_VALIDATION_ERROR,
+            validate_camera_metadata_structure(copy, &copy_size));
+    EXPECT_EQ(CAMERA_METADATA_VALIDATION_ERROR,
+            validate_camera_metadata_structure_fast(copy, &copy_size));
+
+    FINISH_USING_CAMERA_METADATA(m);
+}
+
+TEST(camera_metadata, map_file) {
+    const size_t entry_capacity = 50;
+    const size_t data_capacity = 1000;
+    camera_metadata_t *m = allocate_camera_metadata(entry_capacity, data_capacity);
+    add_test_metadata(m, 10);
+    int32_t sensitivity = 400;
+    EXPECT_EQ(OK, add_camera_metadata_entry(m, ANDROID_SENSOR_SENSITIVITY, &sensitivity, 1));
+    uint8_t mode = ANDROID_CONTROL_MODE_AUTO;
+    EXPECT_EQ(OK, add_camera_metadata_entry(m, ANDROID_CONTROL_MODE, &mode, 1));
+    set_camera_metadata_vendor_id(m, 7);
+
+    FILE *file = tmpfile();
+    ASSERT_NE((void*)NULL, (void*)file);
+    const int fd = fileno(file);
+    EXPECT_EQ(OK, write_camera_metadata_file(fd, m));
+    EXPECT_EQ(ERROR, write_camera_metadata_file(fd, NULL));
+
+    const camera_metadata_t *mapped = map_camera_metadata_file(fd);
+    ASSERT_NE((void*)NULL, (void*)mapped);
+    // Sorted and compacted
+    EXPECT_EQ(get_camera_metadata_compact_size(m), get_camera_metadata_size(mapped));
+    EXPECT_EQ(get_camera_metadata_entry_count(m), get_camera_metadata_entry_count(mapped));
+    EXPECT_EQ((uint64_t)7, get_camera_metadata_vendor_id(mapped));
+    camera_metadata_ro_entry_t entry;
+    ASSERT_EQ(OK, find_camera_metadata_ro_entry(mapped, ANDROID_SENSOR_SENSITIVITY, &entry));
+    EXPECT_EQ(sensitivity, entry.data.i32[0]);
+    ASSERT_EQ(OK, find_camera_metadata_ro_entry(mapped, ANDROID_CONTROL_MODE, &entry));
+    EXPECT_EQ(mode, entry.data.u8[0]);
+    uint32_t previous_tag = 0;
+    for (size_t i = 0; i < get_camera_metadata_entry_count(mapped); ++i) {
+        ASSERT_EQ(OK, get_camera_metadata_ro_entry(mapped, i, &entry));
+        EXPECT_LE(previous_tag, entry.tag);
+        previous_tag = entry.tag;
+    }
+
+    // The mapping is a usable source, and outlives the fd.
+    camera_metadata_t *clone = clone_camera_metadata(mapped);
+    ASSERT_NE((void*)NULL, (void*)clone);
+    fclose(file);
+    EXPECT_EQ(get_camera_metadata_entry_count(m), get_camera_metadata_entry_count(clone));
+    ASSERT_EQ(OK, find_camera_metadata_ro_entry(mapped, ANDROID_SENSOR_SENSITIVITY, &entry));
+    EXPECT_EQ(sensitivity, entry.data.i32[0]);
+    unmap_camera_metadata_file(mapped);
+    unmap_camera_metadata_file(NULL);
+    free_camera_metadata(clone);
+
+    // Truncated, or followed by other data
+    const size_t size = get_camera_metadata_compact_size(m);
+    file = tmpfile();
+    ASSERT_NE((void*)NULL, (void*)file);
+    EXPECT_EQ(OK, write_camera_metadata_file(fileno(file), m));
+    EXPECT_EQ(0, ftruncate(fileno(file), size - 1));
+    EXPECT_NULL(map_camera_metadata_file(fileno(file)));
+    EXPECT_EQ(0, ftruncate(fileno(file), size + 8));
+    EXPECT_NULL(map_camera_metadata_file(fileno(file)));
+    EXPECT_EQ(0, ftruncate(fileno(file), 0));
+    EXPECT_NULL(map_camera_metadata_file(fileno(file)));
+    fclose(file);
+    EXPECT_NULL(map_camera_metadata_file(-1));
+
+    FINISH_USING_CAMERA_METADATA(m);
+}
@@ -89,6 +89,14 @@ ANDROID_API
 const char *get_local_camera_metadata_section_name_vendor_id(uint32_t tag,
         metadata_vendor_id_t id);
 
+/**
+ * Find a tag from its full name, "<section name>.<tag name>". Returns 0 and
+ * sets tag if found, -ENOENT if no such tag is defined.
+ */
+ANDROID_API
+int get_local_camera_metadata_tag_from_name_vendor_id(const char *name,
+        metadata_vendor_id_t id, uint32_t *tag);
+
 /**
  * Retrieve the type of a tag. Returns -1 if no such tag is defined.
  */